@@ -35,6 +35,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -60,6 +61,8 @@
 
 #include "mpack/mpack.h"
 
+#include <zlib.h>
+
 #include "version.h"
 
 int unshare(int);
@@ -432,6 +435,28 @@ kis_capture_handler_t *cf_handler_init(const char *in_type) {
     ch->in_ringbuf = NULL;
     ch->out_ringbuf = NULL;
 
+    pthread_mutex_init(&(ch->prefilter_lock), NULL);
+    ch->prefilter = NULL;
+
+    ch->compress = 0;
+    ch->compress_reset = 0;
+    ch->compress_stream = NULL;
+    ch->compress_buf = NULL;
+
+    pthread_mutex_init(&(ch->beacon_lock), NULL);
+    ch->beacon_capable = 0;
+    ch->beacon_refresh = 0;
+    ch->beacon_table = NULL;
+    ch->beacon_table_used = 0;
+    ch->beacon_last_summary.tv_sec = 0;
+    ch->beacon_last_summary.tv_usec = 0;
+
+    ch->shm_ring = NULL;
+    ch->shm_map_sz = 0;
+    ch->shm_data_fd = -1;
+    ch->shm_space_fd = -1;
+    ch->shm_registered = 0;
+
     ch->ipc_list = NULL;
 
     pthread_mutexattr_init(&mutexattr);
@@ -477,6 +502,21 @@ kis_capture_handler_t *cf_handler_init(const char *in_type) {
 
     ch->verbose = 0;
 
+    pthread_mutex_init(&(ch->flow_lock), NULL);
+    ch->flow_control = 0;
+    ch->flow_credit = 0;
+    ch->flow_dropped = 0;
+    ch->flow_dropped_bytes = 0;
+    ch->flow_reported_dropped = 0;
+
+    pthread_mutex_init(&(ch->batch_lock), NULL);
+    ch->batch_max = 0;
+    ch->batch_delay_us = 0;
+    ch->batch_buf = NULL;
+    ch->batch_len = 0;
+    ch->batch_count = 0;
+    ch->batch_signal_len = 0;
+
     return ch;
 }
 
@@ -524,6 +564,15 @@ void cf_handler_free(kis_capture_handler_t *caph) {
     if (caph->out_ringbuf != NULL)
         kis_simple_ringbuf_free(caph->out_ringbuf);
 
+    if (caph->shm_ring != NULL)
+        munmap(caph->shm_ring, caph->shm_map_sz);
+
+    if (caph->shm_data_fd >= 0)
+        close(caph->shm_data_fd);
+
+    if (caph->shm_space_fd >= 0)
+        close(caph->shm_space_fd);
+
     for (szi = 0; szi < caph->channel_hop_list_sz; szi++) {
         if (caph->channel_hop_list[szi] != NULL)
             free(caph->channel_hop_list[szi]);
@@ -558,6 +607,27 @@ void cf_handler_free(kis_capture_handler_t *caph) {
 
     pthread_mutex_destroy(&(caph->out_ringbuf_lock));
     pthread_mutex_destroy(&(caph->handler_lock));
+    pthread_mutex_destroy(&(caph->flow_lock));
+
+    if (caph->batch_buf != NULL)
+        free(caph->batch_buf);
+
+    pthread_mutex_destroy(&(caph->batch_lock));
+
+    cf_prefilter_free(caph->prefilter);
+    pthread_mutex_destroy(&(caph->prefilter_lock));
+
+    if (caph->compress_stream != NULL) {
+        deflateEnd(caph->compress_stream);
+        free(caph->compress_stream);
+    }
+
+    if (caph->compress_buf != NULL)
+        free(caph->compress_buf);
+
+    if (caph->beacon_table != NULL)
+        free(caph->beacon_table);
+    pthread_mutex_destroy(&(caph->beacon_lock));
 }
 
 cf_params_interface_t *cf_params_interface_new() {
@@ -790,6 +860,70 @@ void cf_handler_list_devices(kis_capture_handler_t *caph) {
     }
 }
 
+/* Map the shared memory ring the server offered in the environment, if any; a
+ * helper which can't use it keeps sending everything through the pipe */
+static void cf_handler_attach_shm(kis_capture_handler_t *caph) {
+#ifdef __linux__
+    const char *env = getenv(KIS_EXTERNAL_SHM_ENV);
+    int mem_fd, data_fd, space_fd;
+    struct stat sb;
+    void *map;
+    kismet_external_shm_ring_t *ring;
+
+    if (env == NULL)
+        return;
+
+    if (sscanf(env, "%d,%d,%d", &mem_fd, &data_fd, &space_fd) != 3) {
+        fprintf(stderr, "WARNING: Ignoring invalid shared memory ring '%s'\n", env);
+        unsetenv(KIS_EXTERNAL_SHM_ENV);
+        return;
+    }
+
+    /* Don't pass the ring on to anything we exec */
+    unsetenv(KIS_EXTERNAL_SHM_ENV);
+
+    fcntl(data_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(space_fd, F_SETFD, FD_CLOEXEC);
+
+    if (fstat(mem_fd, &sb) < 0 || (size_t) sb.st_size < sizeof(kismet_external_shm_ring_t)) {
+        close(mem_fd);
+        goto fail;
+    }
+
+    map = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+
+    /* The mapping keeps the memory around */
+    close(mem_fd);
+
+    if (map == MAP_FAILED)
+        goto fail;
+
+    ring = (kismet_external_shm_ring_t *) map;
+
+    if (ring->signature != KIS_EXTERNAL_SHM_SIG ||
+            ring->version != KIS_EXTERNAL_SHM_VERSION ||
+            ring->data_sz + sizeof(kismet_external_shm_ring_t) > (size_t) sb.st_size ||
+            ring->data_sz % KIS_EXTERNAL_SHM_ALIGN != 0) {
+        munmap(map, sb.st_size);
+        goto fail;
+    }
+
+    caph->shm_ring = ring;
+    caph->shm_map_sz = sb.st_size;
+    caph->shm_data_fd = data_fd;
+    caph->shm_space_fd = space_fd;
+
+    fcntl(space_fd, F_SETFL, fcntl(space_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    return;
+
+fail:
+    fprintf(stderr, "WARNING: Could not map shared memory ring, using the IPC pipe\n");
+    close(data_fd);
+    close(space_fd);
+#endif
+}
+
 int cf_handler_parse_opts(kis_capture_handler_t *caph, int argc, char *argv[]) {
     int option_idx;
 
@@ -1084,6 +1218,8 @@ int cf_handler_parse_opts(kis_capture_handler_t *caph, int argc, char *argv[]) {
         goto cleanup;
     }
 
+    cf_handler_attach_shm(caph);
+
 cleanup:
     if (gps_arg != NULL)
         free(gps_arg);
@@ -1190,6 +1326,12 @@ void cf_handler_set_userdata(kis_capture_handler_t *capf, void *userdata) {
     pthread_mutex_unlock(&(capf->handler_lock));
 }
 
+void cf_handler_set_beacon_summary(kis_capture_handler_t *capf, int enable) {
+    pthread_mutex_lock(&(capf->beacon_lock));
+    capf->beacon_capable = enable;
+    pthread_mutex_unlock(&(capf->beacon_lock));
+}
+
 void cf_handler_set_capture_cb(kis_capture_handler_t *capf, cf_callback_capture cb) {
     pthread_mutex_lock(&(capf->handler_lock));
     capf->capture_cb = cb;
@@ -1649,220 +1791,887 @@ int cf_handler_launch_hopping_thread(kis_capture_handler_t *caph) {
     return 1;
 }
 
-/* Common dispatch layer */
-int cf_dispatch_rx_content(kis_capture_handler_t *caph, unsigned int cmd,
-        uint32_t seqno, const uint8_t *data, size_t packet_sz) {
-    int cbret = -1;
-    char msgstr[STATUS_MAX];
-    size_t i;
-
-    pthread_mutex_lock(&(caph->handler_lock));
+/* Link types we can find an 802.11 header in for prefiltering */
+#define CF_PREFILTER_DLT_IEEE802_11     105
+#define CF_PREFILTER_DLT_RADIOTAP       127
+#define CF_PREFILTER_DLT_PPI            192
 
-    if (cmd == KIS_EXTERNAL_V3_CMD_PING) {
-        caph->last_ping = time(0);
-        cf_send_pong(caph, seqno);
-        cbret = 1;
-        goto finish;
-    } else if (cmd == KIS_EXTERNAL_V3_CMD_PONG) {
-        cbret = 1;
-        goto finish;
-    } else if (cmd == KIS_EXTERNAL_V3_KDS_LISTREQ) {
-        if (caph->listdevices_cb == NULL) {
-            if (caph->verbose) {
-                fprintf(stderr, "ERROR:  Capture source (%s) does not support "
-                        "listing datasources\n", caph->capsource_type);
-            }
+void cf_prefilter_free(cf_prefilter_t *pf) {
+    if (pf == NULL)
+        return;
 
-            cf_send_listresp(caph, seqno, true, "", NULL, 0);
-            cbret = -1;
-            goto finish;
-        } else {
-            cf_params_list_interface_t **interfaces = NULL;
-            msgstr[0] = 0;
-            cbret = (*(caph->listdevices_cb))(caph, seqno, msgstr, &interfaces);
+    if (pf->exact != NULL)
+        free(pf->exact);
 
-            if (caph->verbose && strlen(msgstr) > 0) {
-                if (cbret >= 0)
-                    fprintf(stderr, "INFO: %s\n", msgstr);
-                else
-                    fprintf(stderr, "ERROR: %s\n", msgstr);
-            }
+    if (pf->masked != NULL)
+        free(pf->masked);
 
-            cf_send_listresp(caph, seqno, cbret >= 0, msgstr, interfaces, cbret < 0 ? 0 : cbret);
+    free(pf);
+}
 
-            if (cbret > 0) {
-                for (i = 0; i < (size_t) cbret; i++) {
-                    if (interfaces[i] != NULL) {
-                        if (interfaces[i]->interface != NULL)
-                            free(interfaces[i]->interface);
-                        if (interfaces[i]->flags != NULL)
-                            free(interfaces[i]->flags);
-                        if (interfaces[i]->hardware != NULL)
-                            free(interfaces[i]->hardware);
+static int cf_prefilter_mac_cmp(const void *a, const void *b) {
+    const cf_prefilter_mac_t *ma = (const cf_prefilter_mac_t *) a;
+    const cf_prefilter_mac_t *mb = (const cf_prefilter_mac_t *) b;
 
-                        free(interfaces[i]);
-                    }
-                }
+    if (ma->mac < mb->mac)
+        return -1;
+    if (ma->mac > mb->mac)
+        return 1;
+    return 0;
+}
 
-                free(interfaces);
-            }
+/* Compile a prefilter sub-block; returns NULL if it has no usable rules */
+static cf_prefilter_t *cf_prefilter_compile(mpack_node_t node) {
+    cf_prefilter_t *pf;
+    mpack_node_t types_n, macs_n, rule_n;
+    size_t n, i, sz;
+    cf_prefilter_mac_t rule;
 
-            /* Always spin down after listing */
-            cf_handler_spindown(caph);
-            goto finish;
-        }
-    } else if (cmd == KIS_EXTERNAL_V3_KDS_PROBEREQ) {
-        if (caph->probe_cb == NULL) {
-            if (caph->verbose) {
-                fprintf(stderr, "ERROR:  Capture source (%s) does not support automatic "
-                        "probing.\n", caph->capsource_type);
-            }
+    pf = (cf_prefilter_t *) malloc(sizeof(cf_prefilter_t));
 
-            pthread_mutex_unlock(&(caph->handler_lock));
-            cf_send_proberesp(caph, seqno, false, "Source does not support probing", NULL, NULL);
-            pthread_mutex_lock(&(caph->handler_lock));
+    if (pf == NULL)
+        return NULL;
 
-            cbret = -1;
-            goto finish;
-        } else {
-            cf_params_interface_t *interfaceparams = NULL;
-            cf_params_spectrum_t *spectrumparams = NULL;
+    memset(pf, 0, sizeof(cf_prefilter_t));
 
-            char *uuid = NULL;
+    types_n = mpack_node_map_uint_optional(node, KIS_EXTERNAL_V3_KDS_SUB_PREFILTER_FIELD_DOT11_TYPES);
+    if (!mpack_node_is_missing(types_n)) {
+        sz = mpack_node_array_length(types_n);
 
-            mpack_tree_t tree;
-            mpack_node_t root;
+        for (i = 0; i < sz && i < 4; i++)
+            pf->drop_subtypes[i] = mpack_node_u16(mpack_node_array_at(types_n, i));
+    }
 
-            char *definition;
+    macs_n = mpack_node_map_uint_optional(node, KIS_EXTERNAL_V3_KDS_SUB_PREFILTER_FIELD_MACS);
+    if (!mpack_node_is_missing(macs_n)) {
+        sz = mpack_node_array_length(macs_n);
 
-            mpack_tree_init_data(&tree, (const char *) data, packet_sz);
+        if (sz > 0) {
+            pf->exact = (cf_prefilter_mac_t *) malloc(sizeof(cf_prefilter_mac_t) * sz);
+            pf->masked = (cf_prefilter_mac_t *) malloc(sizeof(cf_prefilter_mac_t) * sz);
 
-            if (!mpack_tree_try_parse(&tree)) {
-                fprintf(stderr, "FATAL: Invalid probe request received, unable to unpack command.\n");
-                cbret = -1;
-                mpack_tree_destroy(&tree);
-                goto finish;
+            if (pf->exact == NULL || pf->masked == NULL) {
+                cf_prefilter_free(pf);
+                return NULL;
             }
+        }
 
-            root = mpack_tree_root(&tree);
+        for (i = 0; i < sz; i++) {
+            rule_n = mpack_node_array_at(macs_n, i);
 
-            if (!mpack_node_map_contains_uint(root, KIS_EXTERNAL_V3_KDS_PROBEREQ_FIELD_DEFINITION)) {
-                fprintf(stderr, "FATAL: Invalid probe request received, unable to unpack source definition.\n");
-                cbret = -1;
-                mpack_tree_destroy(&tree);
-                goto finish;
-            }
+            if (mpack_node_array_length(rule_n) != 3)
+                continue;
 
-            definition = mpack_node_cstr_alloc(mpack_node_map_uint(root,
-                        KIS_EXTERNAL_V3_KDS_PROBEREQ_FIELD_DEFINITION), 4096);
+            rule.roles = mpack_node_u8(mpack_node_array_at(rule_n, 0));
+            rule.mask = mpack_node_u64(mpack_node_array_at(rule_n, 2)) & 0xFFFFFFFFFFFF0000ULL;
+            rule.mac = mpack_node_u64(mpack_node_array_at(rule_n, 1)) & rule.mask;
 
-            if (mpack_tree_error(&tree) != mpack_ok) {
-                fprintf(stderr, "FATAL: Invalid probe request received, unable to unpack source definition.\n");
-                cbret = -1;
-                mpack_tree_destroy(&tree);
-                if (definition != NULL) {
-                    free(definition);
-                }
-                goto finish;
-            }
+            if (rule.roles == 0)
+                continue;
 
-            msgstr[0] = 0;
-            cbret = (*(caph->probe_cb))(caph, seqno, definition, msgstr, &uuid,
-                    &interfaceparams, &spectrumparams);
+            if (rule.mask == 0xFFFFFFFFFFFF0000ULL)
+                pf->exact[pf->exact_sz++] = rule;
+            else
+                pf->masked[pf->masked_sz++] = rule;
+        }
 
-            if (definition != NULL) {
-                free(definition);
-            }
+        qsort(pf->exact, pf->exact_sz, sizeof(cf_prefilter_mac_t), cf_prefilter_mac_cmp);
 
-            cf_send_proberesp(caph, seqno, cbret < 0 ? 0 : cbret, msgstr, interfaceparams, spectrumparams);
+        /* Fold repeated addresses into one entry so the search finds every role */
+        for (i = 0, n = 0; i < pf->exact_sz; i++) {
+            if (n > 0 && pf->exact[n - 1].mac == pf->exact[i].mac)
+                pf->exact[n - 1].roles |= pf->exact[i].roles;
+            else
+                pf->exact[n++] = pf->exact[i];
+        }
 
-            mpack_tree_destroy(&tree);
+        pf->exact_sz = n;
+    }
 
-            if (uuid != NULL)
-                free(uuid);
+    if (pf->exact_sz == 0 && pf->masked_sz == 0 &&
+            (pf->drop_subtypes[0] | pf->drop_subtypes[1] |
+             pf->drop_subtypes[2] | pf->drop_subtypes[3]) == 0) {
+        cf_prefilter_free(pf);
+        return NULL;
+    }
 
-            if (interfaceparams != NULL)
-                cf_params_interface_free(interfaceparams);
+    return pf;
+}
 
-            if (spectrumparams != NULL)
-                cf_params_spectrum_free(spectrumparams);
+static int cf_prefilter_match(const cf_prefilter_t *pf, const uint8_t *addr, uint8_t role) {
+    uint64_t mac;
+    size_t lo, hi, mid, i;
 
-            /* Always spin down after probing */
-            cf_handler_spindown(caph);
+    if (addr == NULL)
+        return 0;
 
-            goto finish;
-        }
-    } else if (cmd == KIS_EXTERNAL_V3_KDS_OPENREQ) {
-        if (caph->open_cb == NULL) {
-            if (caph->verbose) {
-                fprintf(stderr, "ERROR:  Capture source (%s) does not support opening\n",
-                        caph->capsource_type);
-            }
+    mac = ((uint64_t) addr[0] << 56) | ((uint64_t) addr[1] << 48) |
+        ((uint64_t) addr[2] << 40) | ((uint64_t) addr[3] << 32) |
+        ((uint64_t) addr[4] << 24) | ((uint64_t) addr[5] << 16);
 
-            pthread_mutex_unlock(&(caph->handler_lock));
-            cf_send_openresp(caph, seqno, false, "source cannot be opened", 0,
-                    NULL, NULL, NULL);
-            pthread_mutex_lock(&(caph->handler_lock));
+    lo = 0;
+    hi = pf->exact_sz;
 
-            cbret = -1;
-            goto finish;
-        } else {
-            cf_params_interface_t *interfaceparams = NULL;
-            cf_params_spectrum_t *spectrumparams = NULL;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
 
-            char *uuid = NULL;
+        if (pf->exact[mid].mac == mac)
+            return (pf->exact[mid].roles & role) != 0;
 
-            mpack_tree_t tree;
-            mpack_node_t root;
+        if (pf->exact[mid].mac < mac)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
 
-            char *definition;
+    for (i = 0; i < pf->masked_sz; i++) {
+        if ((pf->masked[i].roles & role) && (mac & pf->masked[i].mask) == pf->masked[i].mac)
+            return 1;
+    }
 
-            mpack_tree_init_data(&tree, (const char *) data, packet_sz);
+    return 0;
+}
 
-            if (!mpack_tree_try_parse(&tree)) {
-                fprintf(stderr, "FATAL: Invalid open request received, unable to unpack command.\n");
-                cbret = -1;
-                goto finish;
-            }
+/* Should a packet be dropped by the prefilter instead of being sent */
+static int cf_prefilter_drop(kis_capture_handler_t *caph, uint32_t dlt,
+        uint32_t packet_sz, const uint8_t *pack) {
+    const cf_prefilter_t *pf;
+    const uint8_t *hdr;
+    const uint8_t *src = NULL, *dst = NULL, *bss = NULL;
+    size_t offt, hdr_sz;
+    unsigned int type, subtype;
+    int drop = 0;
+
+    switch (dlt) {
+        case CF_PREFILTER_DLT_IEEE802_11:
+            offt = 0;
+            break;
+        case CF_PREFILTER_DLT_RADIOTAP:
+            if (packet_sz < 4)
+                return 0;
+            offt = pack[2] | (pack[3] << 8);
+            break;
+        case CF_PREFILTER_DLT_PPI:
+            if (packet_sz < 8)
+                return 0;
+            if ((pack[4] | (pack[5] << 8) | (pack[6] << 16) | ((uint32_t) pack[7] << 24)) !=
+                    CF_PREFILTER_DLT_IEEE802_11)
+                return 0;
+            offt = pack[2] | (pack[3] << 8);
+            break;
+        default:
+            return 0;
+    }
 
-            root = mpack_tree_root(&tree);
+    if (offt + 2 > packet_sz)
+        return 0;
 
-            if (!mpack_node_map_contains_uint(root, KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_DEFINITION)) {
-                fprintf(stderr, "FATAL: Invalid open request received, unable to unpack source definition.\n");
-                cbret = -1;
-                mpack_tree_destroy(&tree);
-                goto finish;
-            }
+    hdr = pack + offt;
+    hdr_sz = packet_sz - offt;
 
-            definition = mpack_node_cstr_alloc(mpack_node_map_uint(root,
-                        KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_DEFINITION), 8192);
+    type = (hdr[0] >> 2) & 0x03;
+    subtype = (hdr[0] >> 4) & 0x0F;
 
-            if (mpack_tree_error(&tree) != mpack_ok) {
-                fprintf(stderr, "FATAL: Invalid open request received, unable to unpack source definition.\n");
-                cbret = -1;
-                mpack_tree_destroy(&tree);
-                if (definition != NULL) {
-                    free(definition);
-                }
-                goto finish;
-            }
+    pthread_mutex_lock(&(caph->prefilter_lock));
 
-            uint32_t dlt;
+    pf = caph->prefilter;
 
-            msgstr[0] = 0;
-            cbret = (*(caph->open_cb))(caph, seqno, definition,
-                    msgstr, &dlt, &uuid, &interfaceparams, &spectrumparams);
+    if (pf == NULL) {
+        pthread_mutex_unlock(&(caph->prefilter_lock));
+        return 0;
+    }
 
-            cf_send_openresp(caph, seqno, cbret < 0 ? 0 : 1, msgstr, dlt, uuid,
-                    interfaceparams, spectrumparams);
+    if (pf->drop_subtypes[type] & (1 << subtype)) {
+        pthread_mutex_unlock(&(caph->prefilter_lock));
+        return 1;
+    }
 
-            if (uuid != NULL)
-                free(uuid);
+    if (pf->exact_sz == 0 && pf->masked_sz == 0) {
+        pthread_mutex_unlock(&(caph->prefilter_lock));
+        return 0;
+    }
 
-            if (definition != NULL)
-                free(definition);
+    if (hdr_sz >= 10)
+        dst = hdr + 4;
+
+    if (type == 0 && hdr_sz >= 22) {
+        /* Management */
+        src = hdr + 10;
+        bss = hdr + 16;
+    } else if (type == 1 && hdr_sz >= 16) {
+        /* Control frames with a transmitter */
+        src = hdr + 10;
+    } else if (type == 2 && hdr_sz >= 22) {
+        /* Data, addressed by the to/from DS bits */
+        switch (hdr[1] & 0x03) {
+            case 0:
+                src = hdr + 10;
+                bss = hdr + 16;
+                break;
+            case 1:
+                bss = hdr + 4;
+                src = hdr + 10;
+                dst = hdr + 16;
+                break;
+            case 2:
+                bss = hdr + 10;
+                src = hdr + 16;
+                break;
+            case 3:
+                dst = hdr + 16;
+                if (hdr_sz >= 30)
+                    src = hdr + 24;
+                break;
+        }
+    }
 
-            mpack_tree_destroy(&tree);
+    drop = cf_prefilter_match(pf, src, KIS_EXTERNAL_V3_PREFILTER_ROLE_SOURCE) ||
+        cf_prefilter_match(pf, dst, KIS_EXTERNAL_V3_PREFILTER_ROLE_DEST) ||
+        cf_prefilter_match(pf, bss, KIS_EXTERNAL_V3_PREFILTER_ROLE_NETWORK);
+
+    pthread_mutex_unlock(&(caph->prefilter_lock));
+
+    return drop;
+}
+
+/* Radiotap fields we need for beacon summaries; everything we read is in the
+ * first presence word, so extended words are only skipped */
+#define CF_RADIOTAP_FLAGS           1
+#define CF_RADIOTAP_CHANNEL         3
+#define CF_RADIOTAP_DBM_ANTSIGNAL   5
+#define CF_RADIOTAP_DBM_ANTNOISE    6
+#define CF_RADIOTAP_F_FCS           0x10
+
+/* Find the signal, noise, and frequency of a radiotap frame, and if it ends in
+ * an FCS.  Returns the header length, or 0 if it can't be parsed */
+static size_t cf_radiotap_signal(const uint8_t *pack, uint32_t packet_sz,
+        int32_t *signal_dbm, int32_t *noise_dbm, uint64_t *freq_khz, int *fcs) {
+    /* Alignment and size of the fields up to the antenna noise */
+    static const uint8_t align[] = { 8, 1, 1, 2, 2, 1, 1 };
+    static const uint8_t size[] = { 8, 1, 1, 4, 2, 1, 1 };
+    size_t it_len, offt;
+    uint32_t present, p;
+    unsigned int f;
+
+    if (packet_sz < 8)
+        return 0;
+
+    it_len = pack[2] | (pack[3] << 8);
+
+    if (it_len < 8 || it_len > packet_sz)
+        return 0;
+
+    present = pack[4] | (pack[5] << 8) | (pack[6] << 16) | ((uint32_t) pack[7] << 24);
+
+    offt = 8;
+    p = present;
+    while ((p & 0x80000000) && offt + 4 <= it_len) {
+        p = pack[offt] | (pack[offt + 1] << 8) | (pack[offt + 2] << 16) |
+            ((uint32_t) pack[offt + 3] << 24);
+        offt += 4;
+    }
+
+    for (f = 0; f <= CF_RADIOTAP_DBM_ANTNOISE; f++) {
+        if (!(present & (1 << f)))
+            continue;
+
+        offt = (offt + align[f] - 1) & ~((size_t) align[f] - 1);
+
+        if (offt + size[f] > it_len)
+            break;
+
+        switch (f) {
+            case CF_RADIOTAP_FLAGS:
+                if (pack[offt] & CF_RADIOTAP_F_FCS)
+                    *fcs = 1;
+                break;
+            case CF_RADIOTAP_CHANNEL:
+                *freq_khz = (pack[offt] | (pack[offt + 1] << 8)) * 1000;
+                break;
+            case CF_RADIOTAP_DBM_ANTSIGNAL:
+                *signal_dbm = (int8_t) pack[offt];
+                break;
+            case CF_RADIOTAP_DBM_ANTNOISE:
+                *noise_dbm = (int8_t) pack[offt];
+                break;
+        }
+
+        offt += size[f];
+    }
+
+    return it_len;
+}
+
+/* Count a beacon in the summary instead of sending it, if its content matches
+ * the last full beacon from the BSSID and the refresh interval hasn't passed.
+ *
+ * The hash covers the beacon interval, capabilities, and tags, skipping the
+ * timestamp and sequence number as well as the TIM and BSS load tags, which
+ * change from beacon to beacon.
+ *
+ * Returns 1 if the beacon was summarized and should not be sent */
+static int cf_beacon_summarize(kis_capture_handler_t *caph,
+        struct cf_params_signal *signal, struct timeval ts,
+        uint32_t dlt, uint32_t packet_sz, const uint8_t *pack) {
+    const uint8_t *hdr, *body;
+    size_t offt = 0, hdr_sz, body_sz, i;
+    int32_t signal_dbm = 0, noise_dbm = 0;
+    uint64_t freq_khz = 0;
+    int fcs = 0;
+    uint64_t bssid;
+    uint32_t hash;
+    unsigned int slot;
+    cf_beacon_summary_t *e;
+
+    /* Unlocked check; a summary racing with a new open only means one extra
+     * beacon is sent */
+    if (caph->beacon_refresh == 0)
+        return 0;
+
+    if (dlt == CF_PREFILTER_DLT_RADIOTAP) {
+        if ((offt = cf_radiotap_signal(pack, packet_sz, &signal_dbm, &noise_dbm,
+                        &freq_khz, &fcs)) == 0)
+            return 0;
+    } else if (dlt != CF_PREFILTER_DLT_IEEE802_11) {
+        return 0;
+    }
+
+    if (signal != NULL) {
+        signal_dbm = (int32_t) signal->signal_dbm;
+        noise_dbm = (int32_t) signal->noise_dbm;
+        freq_khz = signal->freq_khz;
+    }
+
+    hdr = pack + offt;
+    hdr_sz = packet_sz - offt;
+
+    if (fcs) {
+        if (hdr_sz < 4)
+            return 0;
+        hdr_sz -= 4;
+    }
+
+    /* Management header, timestamp, interval, and capabilities */
+    if (hdr_sz < 24 + 12 || hdr[0] != 0x80)
+        return 0;
+
+    bssid = ((uint64_t) hdr[16] << 40) | ((uint64_t) hdr[17] << 32) |
+        ((uint64_t) hdr[18] << 24) | ((uint64_t) hdr[19] << 16) |
+        ((uint64_t) hdr[20] << 8) | hdr[21];
+
+    if (bssid == 0)
+        return 0;
+
+    body = hdr + 24 + 8;
+    body_sz = hdr_sz - 24 - 8;
+
+    /* FNV-1a over the fixed fields and every tag we care about; a malformed tag
+     * list always goes to the server */
+    hash = 2166136261U;
+
+    for (i = 0; i < 4; i++)
+        hash = (hash ^ body[i]) * 16777619U;
+
+    i = 4;
+    while (i < body_sz) {
+        size_t tag_end;
+
+        if (i + 2 > body_sz)
+            return 0;
+
+        tag_end = i + 2 + body[i + 1];
+
+        if (tag_end > body_sz)
+            return 0;
+
+        /* TIM and BSS load */
+        if (body[i] != 5 && body[i] != 11) {
+            for (; i < tag_end; i++)
+                hash = (hash ^ body[i]) * 16777619U;
+        }
+
+        i = tag_end;
+    }
+
+    pthread_mutex_lock(&(caph->beacon_lock));
+
+    if (caph->beacon_table == NULL || caph->beacon_refresh == 0) {
+        pthread_mutex_unlock(&(caph->beacon_lock));
+        return 0;
+    }
+
+    /* Open addressing with linear probing; the table is emptied when it gets too
+     * full, which costs one full beacon per access point */
+    slot = (uint32_t) ((bssid * 0x9E3779B97F4A7C15ULL) >> 32) & (CAP_FRAMEWORK_BEACON_TABLE_SZ - 1);
+
+    while (1) {
+        e = &(caph->beacon_table[slot]);
+
+        if (e->bssid == bssid || e->bssid == 0)
+            break;
+
+        slot = (slot + 1) & (CAP_FRAMEWORK_BEACON_TABLE_SZ - 1);
+    }
+
+    if (e->bssid == 0) {
+        if (caph->beacon_table_used >= (CAP_FRAMEWORK_BEACON_TABLE_SZ / 4) * 3) {
+            pthread_mutex_unlock(&(caph->beacon_lock));
+
+            /* Anything pending is sent first so the counts aren't lost */
+            if (cf_flush_beacon_summary(caph, 1) <= 0)
+                return 0;
+
+            pthread_mutex_lock(&(caph->beacon_lock));
+            memset(caph->beacon_table, 0,
+                    sizeof(cf_beacon_summary_t) * CAP_FRAMEWORK_BEACON_TABLE_SZ);
+            caph->beacon_table_used = 0;
+            pthread_mutex_unlock(&(caph->beacon_lock));
+
+            return 0;
+        }
+
+        e->bssid = bssid;
+        caph->beacon_table_used++;
+    } else if (e->hash == hash && ts.tv_sec >= e->last_full &&
+            ts.tv_sec - e->last_full < (time_t) caph->beacon_refresh) {
+        if (e->count == 0 || signal_dbm > e->peak_dbm)
+            e->peak_dbm = signal_dbm;
+
+        e->count++;
+        e->last_dbm = signal_dbm;
+        e->noise_dbm = noise_dbm;
+        e->freq_khz = freq_khz;
+        e->last_ts = ts;
+
+        pthread_mutex_unlock(&(caph->beacon_lock));
+        return 1;
+    }
+
+    /* New content or refresh; send this one and count against it from now on */
+    e->hash = hash;
+    e->last_full = ts.tv_sec;
+
+    pthread_mutex_unlock(&(caph->beacon_lock));
+
+    return 0;
+}
+
+/* Start a new compression stream at the level the server offered, or turn
+ * compression off with a level of 0 */
+static void cf_setup_compression(kis_capture_handler_t *caph, int level) {
+    pthread_mutex_lock(&(caph->out_ringbuf_lock));
+
+    if (caph->compress_stream != NULL) {
+        deflateEnd(caph->compress_stream);
+        free(caph->compress_stream);
+        caph->compress_stream = NULL;
+    }
+
+    caph->compress = 0;
+
+    if (level > 0 && level <= Z_BEST_COMPRESSION) {
+        if (caph->compress_buf == NULL)
+            caph->compress_buf = (uint8_t *) malloc(CAP_FRAMEWORK_COMPRESS_BUF_SZ);
+
+        caph->compress_stream = (z_stream *) calloc(1, sizeof(z_stream));
+
+        if (caph->compress_buf == NULL || caph->compress_stream == NULL ||
+                deflateInit(caph->compress_stream, level) != Z_OK) {
+            fprintf(stderr, "ERROR: Could not initialize compression, sending uncompressed\n");
+
+            if (caph->compress_stream != NULL) {
+                free(caph->compress_stream);
+                caph->compress_stream = NULL;
+            }
+        } else {
+            caph->compress = 1;
+            caph->compress_reset = 1;
+        }
+    }
+
+    pthread_mutex_unlock(&(caph->out_ringbuf_lock));
+}
+
+/* Start beacon summaries with the refresh interval the server asked for, or turn
+ * them off with an interval of 0; anything pending from a previous open is
+ * discarded */
+static void cf_setup_beacon_summary(kis_capture_handler_t *caph, unsigned int refresh) {
+    pthread_mutex_lock(&(caph->beacon_lock));
+
+    if (!caph->beacon_capable)
+        refresh = 0;
+
+    if (refresh != 0 && caph->beacon_table == NULL) {
+        caph->beacon_table = (cf_beacon_summary_t *)
+            calloc(CAP_FRAMEWORK_BEACON_TABLE_SZ, sizeof(cf_beacon_summary_t));
+
+        if (caph->beacon_table == NULL) {
+            fprintf(stderr, "ERROR: Could not allocate beacon summaries, sending every beacon\n");
+            refresh = 0;
+        }
+    } else if (caph->beacon_table != NULL) {
+        memset(caph->beacon_table, 0, sizeof(cf_beacon_summary_t) * CAP_FRAMEWORK_BEACON_TABLE_SZ);
+    }
+
+    caph->beacon_refresh = refresh;
+    caph->beacon_table_used = 0;
+    gettimeofday(&(caph->beacon_last_summary), NULL);
+
+    pthread_mutex_unlock(&(caph->beacon_lock));
+}
+
+/* Common dispatch layer */
+int cf_dispatch_rx_content(kis_capture_handler_t *caph, unsigned int cmd,
+        uint32_t seqno, const uint8_t *data, size_t packet_sz) {
+    int cbret = -1;
+    char msgstr[STATUS_MAX];
+    size_t i;
+
+    pthread_mutex_lock(&(caph->handler_lock));
+
+    if (cmd == KIS_EXTERNAL_V3_CMD_PING) {
+        caph->last_ping = time(0);
+        cf_send_pong(caph, seqno);
+        cbret = 1;
+        goto finish;
+    } else if (cmd == KIS_EXTERNAL_V3_CMD_PONG) {
+        cbret = 1;
+        goto finish;
+    } else if (cmd == KIS_EXTERNAL_V3_KDS_CREDIT) {
+        mpack_tree_t tree;
+        mpack_node_t root;
+        uint32_t grant;
+        uint64_t dropped, dropped_bytes;
+        int report = 0;
+
+        mpack_tree_init_data(&tree, (const char *) data, packet_sz);
+
+        if (!mpack_tree_try_parse(&tree)) {
+            fprintf(stderr, "FATAL: Invalid credit grant received, unable to unpack command.\n");
+            cbret = -1;
+            mpack_tree_destroy(&tree);
+            goto finish;
+        }
+
+        root = mpack_tree_root(&tree);
+        grant = mpack_node_u32(mpack_node_map_uint(root, KIS_EXTERNAL_V3_KDS_CREDIT_FIELD_GRANT));
+
+        if (mpack_tree_destroy(&tree) != mpack_ok) {
+            fprintf(stderr, "FATAL: Invalid credit grant received, unable to unpack grant.\n");
+            cbret = -1;
+            goto finish;
+        }
+
+        pthread_mutex_lock(&(caph->flow_lock));
+        caph->flow_control = 1;
+        caph->flow_credit += grant;
+
+        if (caph->flow_dropped != caph->flow_reported_dropped) {
+            caph->flow_reported_dropped = caph->flow_dropped;
+            dropped = caph->flow_dropped;
+            dropped_bytes = caph->flow_dropped_bytes;
+            report = 1;
+        }
+        pthread_mutex_unlock(&(caph->flow_lock));
+
+        if (report) {
+            cf_send_creditreport(caph, dropped, dropped_bytes);
+        }
+
+        cbret = 1;
+        goto finish;
+    } else if (cmd == KIS_EXTERNAL_V3_KDS_LISTREQ) {
+        if (caph->listdevices_cb == NULL) {
+            if (caph->verbose) {
+                fprintf(stderr, "ERROR:  Capture source (%s) does not support "
+                        "listing datasources\n", caph->capsource_type);
+            }
+
+            cf_send_listresp(caph, seqno, true, "", NULL, 0);
+            cbret = -1;
+            goto finish;
+        } else {
+            cf_params_list_interface_t **interfaces = NULL;
+            msgstr[0] = 0;
+            cbret = (*(caph->listdevices_cb))(caph, seqno, msgstr, &interfaces);
+
+            if (caph->verbose && strlen(msgstr) > 0) {
+                if (cbret >= 0)
+                    fprintf(stderr, "INFO: %s\n", msgstr);
+                else
+                    fprintf(stderr, "ERROR: %s\n", msgstr);
+            }
+
+            cf_send_listresp(caph, seqno, cbret >= 0, msgstr, interfaces, cbret < 0 ? 0 : cbret);
+
+            if (cbret > 0) {
+                for (i = 0; i < (size_t) cbret; i++) {
+                    if (interfaces[i] != NULL) {
+                        if (interfaces[i]->interface != NULL)
+                            free(interfaces[i]->interface);
+                        if (interfaces[i]->flags != NULL)
+                            free(interfaces[i]->flags);
+                        if (interfaces[i]->hardware != NULL)
+                            free(interfaces[i]->hardware);
+
+                        free(interfaces[i]);
+                    }
+                }
+
+                free(interfaces);
+            }
+
+            /* Always spin down after listing */
+            cf_handler_spindown(caph);
+            goto finish;
+        }
+    } else if (cmd == KIS_EXTERNAL_V3_KDS_PROBEREQ) {
+        if (caph->probe_cb == NULL) {
+            if (caph->verbose) {
+                fprintf(stderr, "ERROR:  Capture source (%s) does not support automatic "
+                        "probing.\n", caph->capsource_type);
+            }
+
+            pthread_mutex_unlock(&(caph->handler_lock));
+            cf_send_proberesp(caph, seqno, false, "Source does not support probing", NULL, NULL);
+            pthread_mutex_lock(&(caph->handler_lock));
+
+            cbret = -1;
+            goto finish;
+        } else {
+            cf_params_interface_t *interfaceparams = NULL;
+            cf_params_spectrum_t *spectrumparams = NULL;
+
+            char *uuid = NULL;
+
+            mpack_tree_t tree;
+            mpack_node_t root;
+
+            char *definition;
+
+            mpack_tree_init_data(&tree, (const char *) data, packet_sz);
+
+            if (!mpack_tree_try_parse(&tree)) {
+                fprintf(stderr, "FATAL: Invalid probe request received, unable to unpack command.\n");
+                cbret = -1;
+                mpack_tree_destroy(&tree);
+                goto finish;
+            }
+
+            root = mpack_tree_root(&tree);
+
+            if (!mpack_node_map_contains_uint(root, KIS_EXTERNAL_V3_KDS_PROBEREQ_FIELD_DEFINITION)) {
+                fprintf(stderr, "FATAL: Invalid probe request received, unable to unpack source definition.\n");
+                cbret = -1;
+                mpack_tree_destroy(&tree);
+                goto finish;
+            }
+
+            definition = mpack_node_cstr_alloc(mpack_node_map_uint(root,
+                        KIS_EXTERNAL_V3_KDS_PROBEREQ_FIELD_DEFINITION), 4096);
+
+            if (mpack_tree_error(&tree) != mpack_ok) {
+                fprintf(stderr, "FATAL: Invalid probe request received, unable to unpack source definition.\n");
+                cbret = -1;
+                mpack_tree_destroy(&tree);
+                if (definition != NULL) {
+                    free(definition);
+                }
+                goto finish;
+            }
+
+            msgstr[0] = 0;
+            cbret = (*(caph->probe_cb))(caph, seqno, definition, msgstr, &uuid,
+                    &interfaceparams, &spectrumparams);
+
+            if (definition != NULL) {
+                free(definition);
+            }
+
+            cf_send_proberesp(caph, seqno, cbret < 0 ? 0 : cbret, msgstr, interfaceparams, spectrumparams);
+
+            mpack_tree_destroy(&tree);
+
+            if (uuid != NULL)
+                free(uuid);
+
+            if (interfaceparams != NULL)
+                cf_params_interface_free(interfaceparams);
+
+            if (spectrumparams != NULL)
+                cf_params_spectrum_free(spectrumparams);
+
+            /* Always spin down after probing */
+            cf_handler_spindown(caph);
+
+            goto finish;
+        }
+    } else if (cmd == KIS_EXTERNAL_V3_KDS_OPENREQ) {
+        if (caph->open_cb == NULL) {
+            if (caph->verbose) {
+                fprintf(stderr, "ERROR:  Capture source (%s) does not support opening\n",
+                        caph->capsource_type);
+            }
+
+            pthread_mutex_unlock(&(caph->handler_lock));
+            cf_send_openresp(caph, seqno, false, "source cannot be opened", 0,
+                    NULL, NULL, NULL);
+            pthread_mutex_lock(&(caph->handler_lock));
+
+            cbret = -1;
+            goto finish;
+        } else {
+            cf_params_interface_t *interfaceparams = NULL;
+            cf_params_spectrum_t *spectrumparams = NULL;
+
+            char *uuid = NULL;
+
+            mpack_tree_t tree;
+            mpack_node_t root;
+
+            char *definition;
+            mpack_node_t batch_n;
+            unsigned int batch_max, batch_delay_us;
+            cf_prefilter_t *prefilter = NULL;
+            int compress_level;
+            unsigned int beacon_refresh;
+
+            mpack_tree_init_data(&tree, (const char *) data, packet_sz);
+
+            if (!mpack_tree_try_parse(&tree)) {
+                fprintf(stderr, "FATAL: Invalid open request received, unable to unpack command.\n");
+                cbret = -1;
+                goto finish;
+            }
+
+            root = mpack_tree_root(&tree);
+
+            if (!mpack_node_map_contains_uint(root, KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_DEFINITION)) {
+                fprintf(stderr, "FATAL: Invalid open request received, unable to unpack source definition.\n");
+                cbret = -1;
+                mpack_tree_destroy(&tree);
+                goto finish;
+            }
+
+            definition = mpack_node_cstr_alloc(mpack_node_map_uint(root,
+                        KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_DEFINITION), 8192);
+
+            if (mpack_tree_error(&tree) != mpack_ok) {
+                fprintf(stderr, "FATAL: Invalid open request received, unable to unpack source definition.\n");
+                cbret = -1;
+                mpack_tree_destroy(&tree);
+                if (definition != NULL) {
+                    free(definition);
+                }
+                goto finish;
+            }
+
+            uint32_t dlt;
+
+            /* A new open starts without flow control until the server grants credit */
+            pthread_mutex_lock(&(caph->flow_lock));
+            caph->flow_control = 0;
+            caph->flow_credit = 0;
+            pthread_mutex_unlock(&(caph->flow_lock));
+
+            /* Batch only if the server offers it */
+            batch_max = 0;
+            batch_delay_us = 0;
+
+            batch_n = mpack_node_map_uint_optional(root, KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_BATCH_MAX);
+            if (!mpack_node_is_missing(batch_n))
+                batch_max = mpack_node_u32(batch_n);
+
+            batch_n = mpack_node_map_uint_optional(root, KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_BATCH_DELAY_US);
+            if (!mpack_node_is_missing(batch_n))
+                batch_delay_us = mpack_node_u32(batch_n);
+
+            if (mpack_tree_error(&tree) != mpack_ok || batch_max < 2)
+                batch_max = 0;
+
+            if (batch_max > CAP_FRAMEWORK_BATCH_MAX)
+                batch_max = CAP_FRAMEWORK_BATCH_MAX;
+
+            /* Replace any prefilter from a previous open */
+            batch_n = mpack_node_map_uint_optional(root, KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_PREFILTER);
+            if (!mpack_node_is_missing(batch_n)) {
+                prefilter = cf_prefilter_compile(batch_n);
+
+                if (mpack_tree_error(&tree) != mpack_ok) {
+                    fprintf(stderr, "ERROR: Invalid prefilter in open request, ignoring it\n");
+                    cf_prefilter_free(prefilter);
+                    prefilter = NULL;
+                }
+            }
+
+            pthread_mutex_lock(&(caph->prefilter_lock));
+            cf_prefilter_free(caph->prefilter);
+            caph->prefilter = prefilter;
+            pthread_mutex_unlock(&(caph->prefilter_lock));
+
+            /* Compression is only worth it over the network */
+            compress_level = 0;
+
+            batch_n = mpack_node_map_uint_optional(root, KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_COMPRESSION);
+            if (!mpack_node_is_missing(batch_n) && (caph->use_tcp || caph->use_ws))
+                compress_level = mpack_node_u8(batch_n);
+
+            if (mpack_tree_error(&tree) != mpack_ok)
+                compress_level = 0;
+
+            cf_setup_compression(caph, compress_level);
+
+            beacon_refresh = 0;
+
+            batch_n = mpack_node_map_uint_optional(root, KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_BEACON_REFRESH);
+            if (!mpack_node_is_missing(batch_n))
+                beacon_refresh = mpack_node_u32(batch_n);
+
+            if (mpack_tree_error(&tree) != mpack_ok)
+                beacon_refresh = 0;
+
+            /* The batch lock is taken before the handler lock when sending, so
+             * drop the handler lock while resetting the batch state; anything
+             * left from a previous open is discarded */
+            pthread_mutex_unlock(&(caph->handler_lock));
+            pthread_mutex_lock(&(caph->batch_lock));
+
+            caph->batch_count = 0;
+            caph->batch_len = 0;
+            caph->batch_signal_len = 0;
+
+            if (batch_max != 0 && caph->batch_buf == NULL) {
+                caph->batch_buf = (char *) malloc(CAP_FRAMEWORK_BATCH_BUF_SZ);
+
+                if (caph->batch_buf == NULL)
+                    batch_max = 0;
+            }
+
+            caph->batch_max = batch_max;
+            caph->batch_delay_us = batch_delay_us;
+
+            pthread_mutex_unlock(&(caph->batch_lock));
+
+            /* Beacon summaries are sent under the beacon lock, so it's also taken
+             * without the handler lock */
+            cf_setup_beacon_summary(caph, beacon_refresh);
+
+            pthread_mutex_lock(&(caph->handler_lock));
+
+            msgstr[0] = 0;
+            cbret = (*(caph->open_cb))(caph, seqno, definition,
+                    msgstr, &dlt, &uuid, &interfaceparams, &spectrumparams);
+
+            cf_send_openresp(caph, seqno, cbret < 0 ? 0 : 1, msgstr, dlt, uuid,
+                    interfaceparams, spectrumparams);
+
+            if (uuid != NULL)
+                free(uuid);
+
+            if (definition != NULL)
+                free(definition);
+
+            mpack_tree_destroy(&tree);
 
             if (interfaceparams != NULL)
                 cf_params_interface_free(interfaceparams);
@@ -2572,12 +3381,59 @@ static void ws_destroy_msg(void *in_msg) {
 }
 #endif
 
+/* Tell the server we're sending data through the shared memory ring */
+static int cf_send_register_shm(kis_capture_handler_t *caph) {
+    size_t est_len = 24;
+    size_t final_len = 0;
+
+    mpack_writer_t writer;
+    cf_frame_metadata *meta = NULL;
+
+    uint32_t seqno;
+
+    seqno = cf_get_next_seqno(caph);
+
+    meta =
+        cf_prepare_packet(caph, KIS_EXTERNAL_V3_CMD_REGISTER, seqno, 0, est_len);
+
+    if (meta == NULL) {
+        return 0;
+    }
+
+    mpack_writer_init(&writer, (char *) meta->frame->data, est_len);
+
+    mpack_build_map(&writer);
+
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_REGISTER_FIELD_SHMRING);
+    mpack_write_u8(&writer, 1);
+
+    mpack_complete_map(&writer);
+
+    final_len = mpack_writer_buffer_used(&writer);
+
+    if (mpack_writer_destroy(&writer) != mpack_ok) {
+        cf_cancel_packet(caph, meta);
+        return -1;
+    }
+
+    return cf_commit_packet(caph, meta, final_len);
+}
+
+/* Has the server consumed everything in the shared memory ring */
+static int cf_shm_empty(kis_capture_handler_t *caph) {
+    if (caph->shm_ring == NULL || !caph->shm_registered)
+        return 1;
+
+    return caph->shm_ring->head == __atomic_load_n(&caph->shm_ring->tail, __ATOMIC_ACQUIRE);
+}
+
 int cf_handler_loop(kis_capture_handler_t *caph) {
     fd_set rset, wset;
     int max_fd;
     int read_fd, write_fd;
     struct timeval tm;
     int spindown;
+    time_t shm_spindown = 0;
     int ret;
     int rv = 0;
     cf_ipc_t *ipc_iter = NULL;
@@ -2613,6 +3469,14 @@ int cf_handler_loop(kis_capture_handler_t *caph) {
             write_fd = caph->out_fd;
         }
 
+        if (caph->shm_ring != NULL && !caph->shm_registered) {
+            if (cf_send_register_shm(caph) > 0) {
+                caph->shm_registered = 1;
+            } else {
+                fprintf(stderr, "WARNING: Could not register shared memory ring, using the IPC pipe\n");
+            }
+        }
+
         /* Basic select loop using ring buffers; we fill in from the read descriptor
          * and try to make frames; similarly we populate the outbound descriptor from
          * anything that comes in from our IO thread */
@@ -2677,6 +3541,19 @@ int cf_handler_loop(kis_capture_handler_t *caph) {
 
             pthread_mutex_unlock(&(caph->handler_lock));
 
+            /* Send a partial batch once it has waited long enough, or everything
+             * batched when spinning down */
+            if (cf_flush_batch(caph, spindown) < 0) {
+                rv = -1;
+                break;
+            }
+
+            /* Beacon summaries go out about once a second */
+            if (cf_flush_beacon_summary(caph, spindown) < 0) {
+                rv = -1;
+                break;
+            }
+
             /* Only set read sets if we're not spinning down */
             if (spindown == 0) {
                 /* Only set rset if we're not spinning down */
@@ -2685,6 +3562,13 @@ int cf_handler_loop(kis_capture_handler_t *caph) {
                     max_fd = read_fd;
             }
 
+            /* The server signals when it has made space in the shared memory ring */
+            if (caph->shm_registered) {
+                FD_SET(caph->shm_space_fd, &rset);
+                if (max_fd < caph->shm_space_fd)
+                    max_fd = caph->shm_space_fd;
+            }
+
             /* Inspect the write buffer - do we have data? */
             pthread_mutex_lock(&(caph->out_ringbuf_lock));
 
@@ -2693,9 +3577,16 @@ int cf_handler_loop(kis_capture_handler_t *caph) {
                 if (max_fd < write_fd)
                     max_fd = write_fd;
             } else if (spindown != 0) {
-                pthread_mutex_unlock(&(caph->out_ringbuf_lock));
-                rv = 0;
-                break;
+                /* Give the server a moment to take anything left in the shared
+                 * memory ring, but don't wait forever if it has gone away */
+                if (shm_spindown == 0)
+                    shm_spindown = time(NULL) + 2;
+
+                if (cf_shm_empty(caph) || time(NULL) > shm_spindown) {
+                    pthread_mutex_unlock(&(caph->out_ringbuf_lock));
+                    rv = 0;
+                    break;
+                }
             }
 
             pthread_mutex_unlock(&(caph->out_ringbuf_lock));
@@ -2703,6 +3594,12 @@ int cf_handler_loop(kis_capture_handler_t *caph) {
             tm.tv_sec = 0;
             tm.tv_usec = 500000;
 
+            /* Wake up in time to send a pending batch */
+            pthread_mutex_lock(&(caph->batch_lock));
+            if (caph->batch_count != 0 && caph->batch_delay_us < tm.tv_usec)
+                tm.tv_usec = caph->batch_delay_us;
+            pthread_mutex_unlock(&(caph->batch_lock));
+
             if ((ret = select(max_fd + 1, &rset, &wset, NULL, &tm)) < 0) {
                 if (errno != EINTR && errno != EAGAIN) {
                     fprintf(stderr, "FATAL:  Error during select(): %s\n", strerror(errno));
@@ -2711,8 +3608,26 @@ int cf_handler_loop(kis_capture_handler_t *caph) {
                 }
             }
 
-            if (ret == 0)
+            if (ret == 0) {
+                /* Catch any wakeup for ring space we raced with */
+                if (caph->shm_registered)
+                    pthread_cond_broadcast(&(caph->out_ringbuf_flush_cond));
                 continue;
+            }
+
+            if (caph->shm_registered && FD_ISSET(caph->shm_space_fd, &rset)) {
+                uint64_t evt;
+
+                if (read(caph->shm_space_fd, &evt, sizeof(evt)) < 0 &&
+                        errno != EINTR && errno != EAGAIN) {
+                    fprintf(stderr, "FATAL:  Error reading shared memory ring event: %s\n",
+                            strerror(errno));
+                    rv = -1;
+                    break;
+                }
+
+                pthread_cond_broadcast(&(caph->out_ringbuf_flush_cond));
+            }
 
             pthread_mutex_lock(&caph->handler_lock);
 
@@ -2983,8 +3898,12 @@ int cf_handler_loop(kis_capture_handler_t *caph) {
 
         ret = 0;
 
-        while (ret >= 0 && !caph->shutdown)
+        while (ret >= 0 && !caph->shutdown) {
+            /* Partial batches are sent as the service loop wakes up */
+            cf_flush_batch(caph, 0);
+            cf_flush_beacon_summary(caph, 0);
             lws_service(caph->lwscontext, 0);
+        }
 
         fprintf(stderr, "FATAL:  Datasource exiting libwebsocket loop\n");
 #endif
@@ -3278,35 +4197,224 @@ int cf_commit_ws_packet(kis_capture_handler_t *caph, struct cf_ws_msg *wsmsg, si
 int cf_send_ws_packet(kis_capture_handler_t *caph, unsigned int command, uint32_t seqno,
         uint16_t code, uint8_t *data, size_t len) {
 
-    struct cf_ws_msg *wsmsg;
-    kismet_external_frame_v3_t *frame;
-    int n;
+    struct cf_ws_msg *wsmsg;
+    kismet_external_frame_v3_t *frame;
+    int n;
+
+    wsmsg = cf_prep_ws_packet(caph, command, seqno, code, len);
+    if (wsmsg == NULL) {
+        free(data);
+        return 0;
+    }
+
+    frame = (kismet_external_frame_v3_t *) (wsmsg->payload + LWS_PRE);
+
+    memcpy(frame->data, data, len);
+
+    free(data);
+
+    n = cf_commit_ws_packet(caph, wsmsg, len);
+    if (n != 0) {
+        return n;
+    }
+
+    return 1;
+}
+
+#endif
+
+static void cf_free_rb_meta(kis_capture_handler_t *caph,
+        struct _cf_frame_metadata *meta) {
+    kis_simple_ringbuf_commit(caph->out_ringbuf, meta->frame, 0);
+}
+
+/* Fill in the v3 header of a frame being assembled */
+static void cf_init_frame(kismet_external_frame_v3_t *frame, unsigned int command,
+        uint32_t seqno, uint16_t code) {
+    frame->signature = htonl(KIS_EXTERNAL_PROTO_SIG);
+    frame->v3_sentinel = htons(KIS_EXTERNAL_V3_SIG);
+    frame->v3_version = htons(3);
+
+    frame->seqno = htonl(seqno);
+
+    frame->pkt_type = htons(command);
+
+    frame->code = htons(code);
+}
+
+/* Frames in the shared memory ring aren't published until they're committed, so
+ * there's nothing to release */
+static void cf_free_shm_meta(kis_capture_handler_t *caph,
+        struct _cf_frame_metadata *meta) {
+
+}
+
+#define CF_SHM_ALIGN(x) \
+    (((x) + (KIS_EXTERNAL_SHM_ALIGN - 1)) & ~((uint64_t) KIS_EXTERNAL_SHM_ALIGN - 1))
+
+/* Reserve a frame in the shared memory ring; like cf_prep_rb_packet the output
+ * lock is held until the frame is committed or cancelled.  Returns NULL if the
+ * ring is full, after asking the server to signal when it frees space. */
+static kismet_external_frame_v3_t *cf_prep_shm_packet(kis_capture_handler_t *caph,
+        unsigned int command, uint32_t seqno, uint16_t code,
+        size_t estimated_len) {
+    kismet_external_shm_ring_t *ring = caph->shm_ring;
+    kismet_external_frame_v3_t *frame;
+    uint64_t frame_sz = CF_SHM_ALIGN(estimated_len + sizeof(kismet_external_frame_v3_t));
+    uint64_t head, tail, offt, contig;
+
+    pthread_mutex_lock(&(caph->out_ringbuf_lock));
+
+    /* We're the only writer of the head */
+    head = ring->head;
+
+    while (1) {
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+        offt = head % ring->data_sz;
+        contig = ring->data_sz - offt;
+
+        if (ring->data_sz - (head - tail) >= frame_sz + (contig < frame_sz ? contig : 0))
+            break;
+
+        /* Flag that we're waiting before checking one last time, so the server either
+         * sees the flag or we see the space it freed */
+        __atomic_store_n(&ring->producer_waiting, 1, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == tail) {
+            pthread_mutex_unlock(&(caph->out_ringbuf_lock));
+            return NULL;
+        }
+
+        __atomic_store_n(&ring->producer_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    /* Frames never wrap; mark the rest of the ring as skipped and start over
+     * at the beginning */
+    if (contig < frame_sz) {
+        if (contig >= sizeof(kismet_external_frame_v3_t))
+            ((kismet_external_frame_v3_t *) (ring->data + offt))->signature = 0;
+
+        head += contig;
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+        offt = 0;
+    }
+
+    frame = (kismet_external_frame_v3_t *) (ring->data + offt);
+
+    cf_init_frame(frame, command, seqno, code);
+
+    return frame;
+}
+
+static int cf_commit_shm_packet(kis_capture_handler_t *caph, kismet_external_frame_v3_t *frame,
+        size_t final_length) {
+    kismet_external_shm_ring_t *ring = caph->shm_ring;
+    uint64_t one = 1;
+
+    frame->length = htonl(final_length);
+
+    __atomic_store_n(&ring->head,
+            ring->head + CF_SHM_ALIGN(final_length + sizeof(kismet_external_frame_v3_t)),
+            __ATOMIC_SEQ_CST);
+
+    /* Wake the server if it ran out of data */
+    if (__atomic_exchange_n(&ring->consumer_waiting, 0, __ATOMIC_SEQ_CST)) {
+        if (write(caph->shm_data_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            pthread_mutex_unlock(&(caph->out_ringbuf_lock));
+            return -1;
+        }
+    }
+
+    pthread_mutex_unlock(&(caph->out_ringbuf_lock));
+
+    return 1;
+}
+
+/* Frames built for compression live in the compression buffer until they're
+ * committed, so there's nothing to release */
+static void cf_free_compress_meta(kis_capture_handler_t *caph,
+        struct _cf_frame_metadata *meta) {
+
+}
+
+/* Worst case growth of a frame compressed with a sync flush */
+#define CF_COMPRESS_SLOP    64
+
+/* Deflate a frame from the compression buffer into a CMD_COMPRESSED frame in the
+ * output buffer, and release the output lock held since it was prepared.  Returns
+ * 0 if the output buffer is full; nothing has been compressed yet, so the caller
+ * can retry the frame. */
+static int cf_commit_compressed_packet(kis_capture_handler_t *caph,
+        kismet_external_frame_v3_t *frame, size_t final_len) {
+    z_stream *zs = caph->compress_stream;
+    size_t in_len = final_len + sizeof(kismet_external_frame_v3_t);
+    size_t est_len = in_len + CF_COMPRESS_SLOP;
+    uint16_t code = caph->compress_reset ? KIS_EXTERNAL_V3_COMPRESSED_RESET : 0;
+    kismet_external_frame_v3_t *zframe = NULL;
+#ifdef HAVE_LIBWEBSOCKETS
+    struct cf_ws_msg *ws_msg = NULL;
+#endif
+    int r;
+
+    frame->length = htonl(final_len);
+
+    if (caph->use_tcp) {
+        zframe = cf_prep_rb_packet(caph, KIS_EXTERNAL_V3_CMD_COMPRESSED, 0, code, est_len);
+#ifdef HAVE_LIBWEBSOCKETS
+    } else if (caph->use_ws) {
+        ws_msg = cf_prep_ws_packet(caph, KIS_EXTERNAL_V3_CMD_COMPRESSED, 0, code, est_len);
 
-    wsmsg = cf_prep_ws_packet(caph, command, seqno, code, len);
-    if (wsmsg == NULL) {
-        free(data);
+        if (ws_msg != NULL)
+            zframe = (kismet_external_frame_v3_t *) (ws_msg->payload + LWS_PRE);
+#endif
+    }
+
+    if (zframe == NULL) {
+        pthread_mutex_unlock(&(caph->out_ringbuf_lock));
         return 0;
     }
 
-    frame = (kismet_external_frame_v3_t *) (wsmsg->payload + LWS_PRE);
+    zs->next_in = (Bytef *) frame;
+    zs->avail_in = in_len;
+    zs->next_out = (Bytef *) zframe->data;
+    zs->avail_out = est_len;
 
-    memcpy(frame->data, data, len);
+    r = deflate(zs, Z_SYNC_FLUSH);
 
-    free(data);
+    /* A frame which didn't compress completely leaves the stream unusable */
+    if (r != Z_OK || zs->avail_in != 0 || zs->avail_out == 0) {
+        fprintf(stderr, "FATAL: Failed to compress data frame\n");
 
-    n = cf_commit_ws_packet(caph, wsmsg, len);
-    if (n != 0) {
-        return n;
+        if (caph->use_tcp) {
+            kis_simple_ringbuf_commit(caph->out_ringbuf, zframe, 0);
+#ifdef HAVE_LIBWEBSOCKETS
+        } else {
+            free(ws_msg->payload);
+            free(ws_msg);
+#endif
+        }
+
+        /* Release both the output frame and the compression frame */
+        pthread_mutex_unlock(&(caph->out_ringbuf_lock));
+        pthread_mutex_unlock(&(caph->out_ringbuf_lock));
+
+        return -1;
     }
 
-    return 1;
-}
+    caph->compress_reset = 0;
 
+    if (caph->use_tcp) {
+        r = cf_commit_rb_packet(caph, zframe, est_len - zs->avail_out);
+#ifdef HAVE_LIBWEBSOCKETS
+    } else {
+        r = cf_commit_ws_packet(caph, ws_msg, est_len - zs->avail_out);
 #endif
+    }
 
-static void cf_free_rb_meta(kis_capture_handler_t *caph,
-        struct _cf_frame_metadata *meta) {
-    kis_simple_ringbuf_commit(caph->out_ringbuf, meta->frame, 0);
+    pthread_mutex_unlock(&(caph->out_ringbuf_lock));
+
+    return r;
 }
 
 #ifdef HAVE_LIBWEBSOCKETS
@@ -3324,6 +4432,55 @@ cf_frame_metadata *cf_prepare_packet(kis_capture_handler_t *caph,
 
     cf_frame_metadata *meta = NULL;
 
+    /* Data goes through the shared memory ring when we have one, as long as the
+     * frame is small enough to be sure of fitting */
+    if (caph->shm_registered &&
+            (command == KIS_EXTERNAL_V3_KDS_PACKET || command == KIS_EXTERNAL_V3_KDS_PACKETBATCH) &&
+            estimated_len + sizeof(kismet_external_frame_v3_t) <= caph->shm_ring->data_sz / 2) {
+        kismet_external_frame_v3_t *frame =
+            cf_prep_shm_packet(caph, command, seqno, code, estimated_len);
+
+        if (frame == NULL) {
+            return NULL;
+        }
+
+        meta = (cf_frame_metadata *) malloc(sizeof(cf_frame_metadata));
+        memset(meta, 0, sizeof(cf_frame_metadata));
+
+        meta->free_record = cf_free_shm_meta;
+
+        meta->frame = frame;
+
+        return meta;
+    }
+
+    /* Data over the network is built in the compression buffer and compressed when
+     * it's committed */
+    if (caph->compress &&
+            (command == KIS_EXTERNAL_V3_KDS_PACKET || command == KIS_EXTERNAL_V3_KDS_PACKETBATCH) &&
+            estimated_len + sizeof(kismet_external_frame_v3_t) <= CAP_FRAMEWORK_COMPRESS_BUF_SZ) {
+        pthread_mutex_lock(&(caph->out_ringbuf_lock));
+
+        /* Compression may have been turned off by a new open */
+        if (caph->compress) {
+            kismet_external_frame_v3_t *frame =
+                (kismet_external_frame_v3_t *) caph->compress_buf;
+
+            cf_init_frame(frame, command, seqno, code);
+
+            meta = (cf_frame_metadata *) malloc(sizeof(cf_frame_metadata));
+            memset(meta, 0, sizeof(cf_frame_metadata));
+
+            meta->free_record = cf_free_compress_meta;
+
+            meta->frame = frame;
+
+            return meta;
+        }
+
+        pthread_mutex_unlock(&(caph->out_ringbuf_lock));
+    }
+
     if (caph->use_tcp || caph->use_ipc) {
         kismet_external_frame_v3_t *frame =
             cf_prep_rb_packet(caph, command, seqno, code, estimated_len);
@@ -3384,7 +4541,11 @@ void cf_cancel_packet(kis_capture_handler_t *caph, cf_frame_metadata *meta) {
 
 int cf_commit_packet(kis_capture_handler_t *caph, cf_frame_metadata *meta, size_t final_len) {
 
-    if (caph->use_tcp || caph->use_ipc) {
+    if (meta->free_record == cf_free_shm_meta) {
+        return cf_commit_shm_packet(caph, meta->frame, final_len);
+    } else if (meta->free_record == cf_free_compress_meta) {
+        return cf_commit_compressed_packet(caph, meta->frame, final_len);
+    } else if (caph->use_tcp || caph->use_ipc) {
         return cf_commit_rb_packet(caph, meta->frame, final_len);
 #ifdef HAVE_LIBWEBSOCKETS
     } else if (caph->use_ws) {
@@ -3797,6 +4958,9 @@ int cf_send_openresp(kis_capture_handler_t *caph, uint32_t seq, unsigned int suc
 
     /* we don't handle spectrum yet in v3 until we figure out how to define it */
 
+    /* flow control flag */
+    est_len += 4;
+
     est_len = est_len * 1.15;
 
     seqno = cf_get_next_seqno(caph);
@@ -3812,6 +4976,11 @@ int cf_send_openresp(kis_capture_handler_t *caph, uint32_t seq, unsigned int suc
 
     mpack_build_map(&writer);
 
+    /* Advertise credit flow control; the server enables it by sending the first
+     * credit grant */
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_OPENREPORT_FIELD_FLOWCONTROL);
+    mpack_write_bool(&writer, true);
+
     if (msg != NULL) {
         mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_OPENREPORT_FIELD_MSG);
         mpack_write_cstr(&writer, msg);
@@ -3879,16 +5048,402 @@ int cf_send_openresp(kis_capture_handler_t *caph, uint32_t seq, unsigned int suc
         mpack_complete_map(&writer);
     }
 
-    mpack_complete_map(&writer);
+    mpack_complete_map(&writer);
+
+    final_len = mpack_writer_buffer_used(&writer);
+
+    if (mpack_writer_destroy(&writer) != mpack_ok) {
+        cf_cancel_packet(caph, meta);
+        return -1;
+    }
+
+    return cf_commit_packet(caph, meta, final_len);
+}
+
+/* Check for flow control credit before building a data frame; returns 0 and
+ * counts the frame as a local drop if the server has enabled flow control and
+ * we have no credit left */
+static int cf_flow_check_credit(kis_capture_handler_t *caph, size_t len) {
+    int ret = 1;
+
+    pthread_mutex_lock(&(caph->flow_lock));
+    if (caph->flow_control && caph->flow_credit == 0) {
+        caph->flow_dropped++;
+        caph->flow_dropped_bytes += len;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&(caph->flow_lock));
+
+    return ret;
+}
+
+/* Consume a credit once a data frame has been committed to the buffer; frames which
+ * are retried because the buffer was full don't consume credit until they're sent */
+static void cf_flow_consume_credit(kis_capture_handler_t *caph) {
+    pthread_mutex_lock(&(caph->flow_lock));
+    if (caph->flow_control && caph->flow_credit > 0)
+        caph->flow_credit--;
+    pthread_mutex_unlock(&(caph->flow_lock));
+}
+
+/* Write a gps sub-block; with no gps record, the fixed location from the command
+ * line is written instead */
+static void cf_write_gps_block(kis_capture_handler_t *caph, mpack_writer_t *writer,
+        struct cf_params_gps *gps) {
+    mpack_build_map(writer);
+
+    if (gps != NULL) {
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_LAT);
+        mpack_write_double(writer, gps->lat);
+
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_LON);
+        mpack_write_double(writer, gps->lon);
+
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_ALT);
+        mpack_write_float(writer, gps->alt);
+
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_FIX);
+        mpack_write_u8(writer, gps->fix);
+
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_SPEED);
+        mpack_write_float(writer, gps->speed);
+
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_HEADING);
+        mpack_write_float(writer, gps->heading);
+
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_PRECISION);
+        mpack_write_float(writer, gps->precision);
+
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TS_S);
+        mpack_write_float(writer, gps->ts_sec);
+
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TS_US);
+        mpack_write_float(writer, gps->ts_usec);
+
+        if (gps->gps_type != NULL) {
+            mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TYPE);
+            mpack_write_cstr(writer, gps->gps_type);
+        }
+
+        if (gps->gps_name != NULL) {
+            mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_NAME);
+            mpack_write_cstr(writer, gps->gps_name);
+        }
+
+        if (gps->gps_uuid != NULL) {
+            mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_UUID);
+            mpack_write_cstr(writer, gps->gps_uuid);
+        }
+    } else {
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_LAT);
+        mpack_write_double(writer, caph->gps_fixed_lat);
+
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_LON);
+        mpack_write_double(writer, caph->gps_fixed_lon);
+
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_ALT);
+        mpack_write_float(writer, caph->gps_fixed_alt);
+
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_FIX);
+        mpack_write_u8(writer, 3);
+
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TYPE);
+        mpack_write_cstr(writer, "remote-fixed");
+
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_NAME);
+        if (caph->gps_name != NULL) {
+            mpack_write_cstr(writer, caph->gps_name);
+        } else {
+            mpack_write_cstr(writer, "remote-fixed");
+        }
+    }
+
+    mpack_complete_map(writer);
+}
+
+static void cf_write_signal_block(mpack_writer_t *writer, struct cf_params_signal *signal) {
+    mpack_build_map(writer);
+
+    if (signal->channel != NULL) {
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_CHANNEL);
+        mpack_write_cstr(writer, signal->channel);
+    }
+
+    if (signal->signal_dbm != 0) {
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_SIGNAL_DBM);
+        mpack_write_u32(writer, signal->signal_dbm);
+    }
+
+    if (signal->noise_dbm != 0) {
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_NOISE_DBM);
+        mpack_write_u32(writer, signal->noise_dbm);
+    }
+
+    if (signal->signal_rssi != 0) {
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_SIGNAL_RSSI);
+        mpack_write_u32(writer, signal->signal_rssi);
+    }
+
+    if (signal->noise_rssi != 0) {
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_NOISE_RSSI);
+        mpack_write_u32(writer, signal->noise_rssi);
+    }
+
+    if (signal->freq_khz != 0) {
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_FREQ_KHZ);
+        mpack_write_u64(writer, signal->freq_khz);
+    }
+
+    if (signal->datarate != 0) {
+        mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_DATARATE);
+        mpack_write_u64(writer, signal->datarate);
+    }
+
+    mpack_complete_map(writer);
+}
+
+static void cf_write_packet_block(mpack_writer_t *writer, struct timeval ts,
+        uint32_t dlt, uint32_t original_sz, uint32_t packet_sz, uint8_t *pack) {
+    mpack_build_map(writer);
+
+    mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_DLT);
+    mpack_write_u32(writer, dlt);
+
+    mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_S);
+    mpack_write_u64(writer, ts.tv_sec);
+
+    mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_US);
+    mpack_write_u32(writer, ts.tv_usec);
+
+    mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_LENGTH);
+    mpack_write_u32(writer, original_sz);
+
+    mpack_write_uint(writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_CONTENT);
+    mpack_write_bin(writer, (const char *) pack, packet_sz);
+
+    mpack_complete_map(writer);
+}
+
+/* Send the current batch as a single KDS_PACKETBATCH frame; must be called with the
+ * batch lock held.  The batch is kept if the output buffer is full. */
+static int cf_flush_batch_locked(kis_capture_handler_t *caph) {
+    size_t est_len = 32;
+    size_t final_len = 0;
+    size_t offt = 0;
+    unsigned int i;
+
+    mpack_writer_t writer;
+    cf_frame_metadata *meta = NULL;
+
+    uint32_t seqno;
+    int r;
+
+    if (caph->batch_count == 0) {
+        return 1;
+    }
+
+    if (caph->gps_fixed_lat != 0) {
+        KIS_EXTERNAL_V3_KDS_SUB_GPS_EST_LEN2(est_len, "remote-fixed", caph->gps_name);
+    }
+
+    est_len += caph->batch_signal_len + caph->batch_len;
+
+    est_len = est_len * 1.15;
+
+    seqno = cf_get_next_seqno(caph);
+
+    meta =
+        cf_prepare_packet(caph, KIS_EXTERNAL_V3_KDS_PACKETBATCH, seqno, 0, est_len);
+
+    if (meta == NULL) {
+        return 0;
+    }
+
+    mpack_writer_init(&writer, (char *) meta->frame->data, est_len);
+
+    mpack_build_map(&writer);
+
+    if (caph->gps_fixed_lat != 0) {
+        mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_PACKETBATCH_FIELD_GPSBLOCK);
+        cf_write_gps_block(caph, &writer, NULL);
+    }
+
+    if (caph->batch_signal_len != 0) {
+        mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_PACKETBATCH_FIELD_SIGNALBLOCK);
+        mpack_write_object_bytes(&writer, caph->batch_signal, caph->batch_signal_len);
+    }
+
+    /* Reports are already encoded, copy them in as-is */
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_PACKETBATCH_FIELD_REPORTS);
+    mpack_start_array(&writer, caph->batch_count);
+
+    for (i = 0; i < caph->batch_count; i++) {
+        mpack_write_object_bytes(&writer, caph->batch_buf + offt, caph->batch_report_len[i]);
+        offt += caph->batch_report_len[i];
+    }
+
+    mpack_finish_array(&writer);
+
+    mpack_complete_map(&writer);
+
+    final_len = mpack_writer_buffer_used(&writer);
+
+    if (mpack_writer_destroy(&writer) != mpack_ok) {
+        cf_cancel_packet(caph, meta);
+        return -1;
+    }
+
+    r = cf_commit_packet(caph, meta, final_len);
+
+    if (r > 0) {
+        caph->batch_count = 0;
+        caph->batch_len = 0;
+        caph->batch_signal_len = 0;
+    }
+
+    return r;
+}
+
+int cf_flush_batch(kis_capture_handler_t *caph, int force) {
+    struct timeval now;
+    long elapsed;
+    int r = 1;
+
+    pthread_mutex_lock(&(caph->batch_lock));
+
+    if (caph->batch_count != 0) {
+        gettimeofday(&now, NULL);
+
+        elapsed = (now.tv_sec - caph->batch_first.tv_sec) * 1000000L +
+            (now.tv_usec - caph->batch_first.tv_usec);
+
+        if (force || elapsed >= (long) caph->batch_delay_us)
+            r = cf_flush_batch_locked(caph);
+    }
+
+    pthread_mutex_unlock(&(caph->batch_lock));
+
+    return r;
+}
+
+/* Add a data report to the current batch.  Sets handled if the report was queued
+ * or the result is final; reports which can't be batched are left to the caller
+ * to send on their own. */
+static int cf_batch_data(kis_capture_handler_t *caph,
+        struct cf_params_signal *signal, struct cf_params_gps *gps,
+        struct timeval ts, uint32_t dlt, uint32_t original_sz,
+        uint32_t packet_sz, uint8_t *pack, int *handled) {
+
+    char sigbuf[CAP_FRAMEWORK_BATCH_SIGNAL_SZ];
+    size_t sig_len = 0;
+    size_t est_len = 8;
+    size_t used;
+
+    mpack_writer_t writer;
+    int r = 1;
+
+    *handled = 0;
+
+    if (signal != NULL) {
+        mpack_writer_init(&writer, sigbuf, sizeof(sigbuf));
+        cf_write_signal_block(&writer, signal);
+        sig_len = mpack_writer_buffer_used(&writer);
+
+        if (mpack_writer_destroy(&writer) != mpack_ok) {
+            return 1;
+        }
+    }
+
+    if (gps != NULL) {
+        KIS_EXTERNAL_V3_KDS_SUB_GPS_EST_LEN(est_len, gps);
+    }
+
+    KIS_EXTERNAL_V3_KDS_SUB_PACKET_EST_LEN(est_len, packet_sz);
+
+    est_len += sig_len;
+
+    est_len = est_len * 1.15;
+
+    pthread_mutex_lock(&(caph->batch_lock));
+
+    if (caph->batch_max == 0 || est_len > CAP_FRAMEWORK_BATCH_BUF_SZ) {
+        pthread_mutex_unlock(&(caph->batch_lock));
+        return 1;
+    }
+
+    /* Send the current batch first if it's full, if this report might not fit, or if
+     * this report has no signal block and would inherit the batch default */
+    if (caph->batch_count != 0 &&
+            (caph->batch_count >= caph->batch_max ||
+             caph->batch_len + est_len > CAP_FRAMEWORK_BATCH_BUF_SZ ||
+             (sig_len == 0 && caph->batch_signal_len != 0))) {
+        r = cf_flush_batch_locked(caph);
+
+        if (r <= 0) {
+            pthread_mutex_unlock(&(caph->batch_lock));
+            *handled = 1;
+            return r;
+        }
+    }
+
+    if (caph->batch_count == 0) {
+        gettimeofday(&(caph->batch_first), NULL);
+        memcpy(caph->batch_signal, sigbuf, sig_len);
+        caph->batch_signal_len = sig_len;
+        caph->batch_len = 0;
+    }
+
+    mpack_writer_init(&writer, caph->batch_buf + caph->batch_len,
+            CAP_FRAMEWORK_BATCH_BUF_SZ - caph->batch_len);
+
+    mpack_build_map(&writer);
+
+    if (gps != NULL) {
+        mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_GPSBLOCK);
+        cf_write_gps_block(caph, &writer, gps);
+    }
+
+    if (sig_len != 0 && (sig_len != caph->batch_signal_len ||
+                memcmp(sigbuf, caph->batch_signal, sig_len) != 0)) {
+        mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_SIGNALBLOCK);
+        mpack_write_object_bytes(&writer, sigbuf, sig_len);
+    }
+
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_PACKETBLOCK);
+    cf_write_packet_block(&writer, ts, dlt, original_sz, packet_sz, pack);
+
+    mpack_complete_map(&writer);
+
+    used = mpack_writer_buffer_used(&writer);
+
+    if (mpack_writer_destroy(&writer) != mpack_ok) {
+        if (caph->batch_count == 0)
+            caph->batch_signal_len = 0;
+
+        pthread_mutex_unlock(&(caph->batch_lock));
+        return 1;
+    }
+
+    caph->batch_report_len[caph->batch_count] = used;
+    caph->batch_len += used;
+    caph->batch_count++;
+
+    *handled = 1;
+
+    /* The report is queued even if a full batch can't be sent yet; it goes out with
+     * the next report or from the handler loop */
+    if (caph->batch_count >= caph->batch_max) {
+        if (cf_flush_batch_locked(caph) < 0)
+            r = -1;
+    }
 
-    final_len = mpack_writer_buffer_used(&writer);
+    pthread_mutex_unlock(&(caph->batch_lock));
 
-    if (mpack_writer_destroy(&writer) != mpack_ok) {
-        cf_cancel_packet(caph, meta);
-        return -1;
+    if (r > 0) {
+        cf_flow_consume_credit(caph);
     }
 
-    return cf_commit_packet(caph, meta, final_len);
+    return r;
 }
 
 int cf_send_data(kis_capture_handler_t *caph,
@@ -3904,6 +5459,8 @@ int cf_send_data(kis_capture_handler_t *caph,
     cf_frame_metadata *meta = NULL;
 
     uint32_t seqno;
+    int r;
+    int handled;
 
     if (msg != NULL) {
         if (caph->verbose) {
@@ -3929,6 +5486,32 @@ int cf_send_data(kis_capture_handler_t *caph,
         est_len += strlen(msg);
     }
 
+    /* Packets matching the server prefilter are never sent */
+    if (pack != NULL && cf_prefilter_drop(caph, dlt, packet_sz, pack)) {
+        return 1;
+    }
+
+    /* Repeated beacons go out in the next beacon summary */
+    if (pack != NULL && msg == NULL &&
+            cf_beacon_summarize(caph, signal, ts, dlt, packet_sz, pack)) {
+        return 1;
+    }
+
+    if (!cf_flow_check_credit(caph, packet_sz)) {
+        return 1;
+    }
+
+    r = cf_batch_data(caph, signal, gps, ts, dlt, original_sz, packet_sz, pack, &handled);
+
+    if (handled) {
+        return r;
+    }
+
+    /* Keep reports in order by sending anything batched ahead of this one */
+    if ((r = cf_flush_batch(caph, 1)) <= 0) {
+        return r;
+    }
+
     if (signal != NULL) {
         KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_EST_LEN(est_len, signal);
     }
@@ -3965,143 +5548,17 @@ int cf_send_data(kis_capture_handler_t *caph,
 
     if (gps != NULL || caph->gps_fixed_lat != 0) {
         mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_GPSBLOCK);
-        mpack_build_map(&writer);
-
-        if (gps != NULL) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_LAT);
-            mpack_write_double(&writer, gps->lat);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_LON);
-            mpack_write_double(&writer, gps->lon);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_ALT);
-            mpack_write_float(&writer, gps->alt);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_FIX);
-            mpack_write_u8(&writer, gps->fix);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_SPEED);
-            mpack_write_float(&writer, gps->speed);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_HEADING);
-            mpack_write_float(&writer, gps->heading);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_PRECISION);
-            mpack_write_float(&writer, gps->precision);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TS_S);
-            mpack_write_float(&writer, gps->ts_sec);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TS_US);
-            mpack_write_float(&writer, gps->ts_usec);
-
-            if (gps->gps_type != NULL) {
-                mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TYPE);
-                mpack_write_cstr(&writer, gps->gps_type);
-            }
-
-            if (gps->gps_name != NULL) {
-                mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TYPE);
-                mpack_write_cstr(&writer, gps->gps_name);
-            }
-
-            if (gps->gps_uuid != NULL) {
-                mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_UUID);
-                mpack_write_cstr(&writer, gps->gps_uuid);
-            }
-        } else if (caph->gps_fixed_lat != 0) {
-            struct timeval tv;
-            gettimeofday(&tv, NULL);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_LAT);
-            mpack_write_double(&writer, caph->gps_fixed_lat);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_LON);
-            mpack_write_double(&writer, caph->gps_fixed_lon);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_ALT);
-            mpack_write_float(&writer, caph->gps_fixed_alt);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_FIX);
-            mpack_write_u8(&writer, 3);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TYPE);
-            mpack_write_cstr(&writer, "remote-fixed");
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TYPE);
-            if (caph->gps_name != NULL) {
-                mpack_write_cstr(&writer, caph->gps_name);
-            }
-            if (caph->gps_name != NULL) {
-                mpack_write_cstr(&writer, "remote-fixed");
-            }
-        }
-
-        mpack_complete_map(&writer);
+        cf_write_gps_block(caph, &writer, gps);
     }
 
     if (signal != NULL) {
         mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_SIGNALBLOCK);
-        mpack_build_map(&writer);
-
-        if (signal->channel != NULL) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_CHANNEL);
-            mpack_write_cstr(&writer, signal->channel);
-        }
-
-        if (signal->signal_dbm != 0) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_SIGNAL_DBM);
-            mpack_write_u32(&writer, signal->signal_dbm);
-        }
-
-        if (signal->noise_dbm != 0) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_NOISE_DBM);
-            mpack_write_u32(&writer, signal->noise_dbm);
-        }
-
-        if (signal->signal_rssi != 0) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_SIGNAL_RSSI);
-            mpack_write_u32(&writer, signal->signal_rssi);
-        }
-
-        if (signal->noise_rssi != 0) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_NOISE_RSSI);
-            mpack_write_u32(&writer, signal->noise_rssi);
-        }
-
-        if (signal->freq_khz != 0) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_FREQ_KHZ);
-            mpack_write_u64(&writer, signal->freq_khz);
-        }
-
-        if (signal->datarate != 0) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_DATARATE);
-            mpack_write_u64(&writer, signal->datarate);
-        }
-
-        mpack_complete_map(&writer);
+        cf_write_signal_block(&writer, signal);
     }
 
     /* write the packet itself */
     mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_PACKETBLOCK);
-    mpack_build_map(&writer);
-
-    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_DLT);
-    mpack_write_u32(&writer, dlt);
-
-    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_S);
-    mpack_write_u64(&writer, ts.tv_sec);
-
-    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_US);
-    mpack_write_u32(&writer, ts.tv_usec);
-
-    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_LENGTH);
-    mpack_write_u32(&writer, original_sz);
-
-    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_CONTENT);
-    mpack_write_bin(&writer, (const char *) pack, packet_sz);
-
-    mpack_complete_map(&writer);
+    cf_write_packet_block(&writer, ts, dlt, original_sz, packet_sz, pack);
 
     /* complete the map */
     mpack_complete_map(&writer);
@@ -4113,7 +5570,13 @@ int cf_send_data(kis_capture_handler_t *caph,
         return -1;
     }
 
-    return cf_commit_packet(caph, meta, final_len);
+    r = cf_commit_packet(caph, meta, final_len);
+
+    if (r > 0) {
+        cf_flow_consume_credit(caph);
+    }
+
+    return r;
 }
 
 
@@ -4129,6 +5592,7 @@ int cf_send_json(kis_capture_handler_t *caph,
     mpack_writer_t writer;
     cf_frame_metadata *meta = NULL;
     uint32_t seqno;
+    int r;
 
     if (msg != NULL) {
         if (caph->verbose) {
@@ -4154,6 +5618,15 @@ int cf_send_json(kis_capture_handler_t *caph,
         est_len += strlen(msg);
     }
 
+    if (!cf_flow_check_credit(caph, strlen(json))) {
+        return 1;
+    }
+
+    /* Keep reports in order by sending anything batched ahead of this one */
+    if ((r = cf_flush_batch(caph, 1)) <= 0) {
+        return r;
+    }
+
     if (signal != NULL) {
         KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_EST_LEN(est_len, signal);
     }
@@ -4192,117 +5665,12 @@ int cf_send_json(kis_capture_handler_t *caph,
 
     if (gps != NULL || caph->gps_fixed_lat != 0) {
         mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_GPSBLOCK);
-        mpack_build_map(&writer);
-
-        if (gps != NULL) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_LAT);
-            mpack_write_double(&writer, gps->lat);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_LON);
-            mpack_write_double(&writer, gps->lon);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_ALT);
-            mpack_write_float(&writer, gps->alt);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_FIX);
-            mpack_write_u8(&writer, gps->fix);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_SPEED);
-            mpack_write_float(&writer, gps->speed);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_HEADING);
-            mpack_write_float(&writer, gps->heading);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_PRECISION);
-            mpack_write_float(&writer, gps->precision);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TS_S);
-            mpack_write_float(&writer, gps->ts_sec);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TS_US);
-            mpack_write_float(&writer, gps->ts_usec);
-
-            if (gps->gps_type != NULL) {
-                mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TYPE);
-                mpack_write_cstr(&writer, gps->gps_type);
-            }
-
-            if (gps->gps_name != NULL) {
-                mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TYPE);
-                mpack_write_cstr(&writer, gps->gps_name);
-            }
-
-        } else if (caph->gps_fixed_lat != 0) {
-            struct timeval tv;
-            gettimeofday(&tv, NULL);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_LAT);
-            mpack_write_double(&writer, caph->gps_fixed_lat);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_LON);
-            mpack_write_double(&writer, caph->gps_fixed_lon);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_ALT);
-            mpack_write_float(&writer, caph->gps_fixed_alt);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_FIX);
-            mpack_write_u8(&writer, 3);
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TYPE);
-            mpack_write_cstr(&writer, "remote-fixed");
-
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_GPS_FIELD_TYPE);
-            if (caph->gps_name != NULL) {
-                mpack_write_cstr(&writer, caph->gps_name);
-            }
-            if (caph->gps_name != NULL) {
-                mpack_write_cstr(&writer, "remote-fixed");
-            }
-        }
-
-        mpack_complete_map(&writer);
+        cf_write_gps_block(caph, &writer, gps);
     }
 
     if (signal != NULL) {
         mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_SIGNALBLOCK);
-        mpack_build_map(&writer);
-
-        if (signal->channel != NULL) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_CHANNEL);
-            mpack_write_cstr(&writer, signal->channel);
-        }
-
-        if (signal->signal_dbm != 0) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_SIGNAL_DBM);
-            mpack_write_u32(&writer, signal->signal_dbm);
-        }
-
-        if (signal->noise_dbm != 0) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_NOISE_DBM);
-            mpack_write_u32(&writer, signal->noise_dbm);
-        }
-
-        if (signal->signal_rssi != 0) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_SIGNAL_RSSI);
-            mpack_write_u32(&writer, signal->signal_rssi);
-        }
-
-        if (signal->noise_rssi != 0) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_NOISE_RSSI);
-            mpack_write_u32(&writer, signal->noise_rssi);
-        }
-
-        if (signal->freq_khz != 0) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_FREQ_KHZ);
-            mpack_write_u64(&writer, signal->freq_khz);
-        }
-
-        if (signal->datarate != 0) {
-            mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_DATARATE);
-            mpack_write_u64(&writer, signal->datarate);
-        }
-
-        mpack_complete_map(&writer);
+        cf_write_signal_block(&writer, signal);
     }
 
     /* write the json itself */
@@ -4333,7 +5701,13 @@ int cf_send_json(kis_capture_handler_t *caph,
         return -1;
     }
 
-    return cf_commit_packet(caph, meta, final_len);
+    r = cf_commit_packet(caph, meta, final_len);
+
+    if (r > 0) {
+        cf_flow_consume_credit(caph);
+    }
+
+    return r;
 }
 
 
@@ -4496,6 +5870,214 @@ int cf_send_newsource(kis_capture_handler_t *caph, const char *uuid) {
     return cf_commit_packet(caph, meta, final_len);
 }
 
+int cf_send_creditreport(kis_capture_handler_t *caph, uint64_t dropped,
+        uint64_t dropped_bytes) {
+    size_t est_len = 24;
+    size_t final_len = 0;
+
+    mpack_writer_t writer;
+    cf_frame_metadata *meta = NULL;
+
+    uint32_t seqno;
+
+    est_len += 9 + 9;
+
+    est_len = est_len * 1.15;
+
+    seqno = cf_get_next_seqno(caph);
+
+    meta =
+        cf_prepare_packet(caph, KIS_EXTERNAL_V3_KDS_CREDITREPORT, seqno, 0, est_len);
+
+    if (meta == NULL) {
+        return 0;
+    }
+
+    mpack_writer_init(&writer, (char *) meta->frame->data, est_len);
+
+    mpack_build_map(&writer);
+
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_CREDITREPORT_FIELD_DROPPED);
+    mpack_write_u64(&writer, dropped);
+
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_CREDITREPORT_FIELD_DROPPED_BYTES);
+    mpack_write_u64(&writer, dropped_bytes);
+
+    mpack_complete_map(&writer);
+
+    final_len = mpack_writer_buffer_used(&writer);
+
+    if (mpack_writer_destroy(&writer) != mpack_ok) {
+        cf_cancel_packet(caph, meta);
+        return -1;
+    }
+
+    return cf_commit_packet(caph, meta, final_len);
+}
+
+int cf_send_capturestats(kis_capture_handler_t *caph, uint64_t packets,
+        uint64_t dropped, uint64_t freezes) {
+    size_t est_len = 24;
+    size_t final_len = 0;
+
+    mpack_writer_t writer;
+    cf_frame_metadata *meta = NULL;
+
+    uint32_t seqno;
+
+    est_len += 9 + 9 + 9;
+
+    est_len = est_len * 1.15;
+
+    seqno = cf_get_next_seqno(caph);
+
+    meta =
+        cf_prepare_packet(caph, KIS_EXTERNAL_V3_KDS_CAPTURESTATS, seqno, 0, est_len);
+
+    if (meta == NULL) {
+        return 0;
+    }
+
+    mpack_writer_init(&writer, (char *) meta->frame->data, est_len);
+
+    mpack_build_map(&writer);
+
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_CAPTURESTATS_FIELD_PACKETS);
+    mpack_write_u64(&writer, packets);
+
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_CAPTURESTATS_FIELD_DROPPED);
+    mpack_write_u64(&writer, dropped);
+
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_CAPTURESTATS_FIELD_FREEZES);
+    mpack_write_u64(&writer, freezes);
+
+    mpack_complete_map(&writer);
+
+    final_len = mpack_writer_buffer_used(&writer);
+
+    if (mpack_writer_destroy(&writer) != mpack_ok) {
+        cf_cancel_packet(caph, meta);
+        return -1;
+    }
+
+    return cf_commit_packet(caph, meta, final_len);
+}
+
+int cf_flush_beacon_summary(kis_capture_handler_t *caph, int force) {
+    struct timeval now;
+    long elapsed;
+    unsigned int i, start, n, pending;
+    size_t est_len;
+    size_t final_len;
+    uint8_t mac[6];
+
+    mpack_writer_t writer;
+    cf_frame_metadata *meta = NULL;
+
+    int r = 1;
+
+    pthread_mutex_lock(&(caph->beacon_lock));
+
+    if (caph->beacon_table == NULL || caph->beacon_table_used == 0) {
+        pthread_mutex_unlock(&(caph->beacon_lock));
+        return 1;
+    }
+
+    gettimeofday(&now, NULL);
+
+    elapsed = (now.tv_sec - caph->beacon_last_summary.tv_sec) * 1000000L +
+        (now.tv_usec - caph->beacon_last_summary.tv_usec);
+
+    if (!force && elapsed < CAP_FRAMEWORK_BEACON_SUMMARY_US) {
+        pthread_mutex_unlock(&(caph->beacon_lock));
+        return 1;
+    }
+
+    caph->beacon_last_summary = now;
+
+    /* Send the pending counts in frames of up to SUMMARY_MAX access points; counts
+     * are only cleared once their frame is queued, so a full buffer keeps them for
+     * the next summary */
+    i = 0;
+    while (i < CAP_FRAMEWORK_BEACON_TABLE_SZ) {
+        start = i;
+        pending = 0;
+
+        for (; i < CAP_FRAMEWORK_BEACON_TABLE_SZ &&
+                pending < CAP_FRAMEWORK_BEACON_SUMMARY_MAX; i++) {
+            if (caph->beacon_table[i].bssid != 0 && caph->beacon_table[i].count != 0)
+                pending++;
+        }
+
+        if (pending == 0)
+            continue;
+
+        est_len = 24 + pending * 64;
+
+        meta = cf_prepare_packet(caph, KIS_EXTERNAL_V3_KDS_BEACONSUMMARY,
+                cf_get_next_seqno(caph), 0, est_len);
+
+        if (meta == NULL) {
+            r = 0;
+            break;
+        }
+
+        mpack_writer_init(&writer, (char *) meta->frame->data, est_len);
+
+        mpack_build_map(&writer);
+
+        mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_BEACONSUMMARY_FIELD_SUMMARIES);
+        mpack_start_array(&writer, pending);
+
+        for (n = start; n < i; n++) {
+            cf_beacon_summary_t *e = &(caph->beacon_table[n]);
+
+            if (e->bssid == 0 || e->count == 0)
+                continue;
+
+            mac[0] = (e->bssid >> 40) & 0xFF;
+            mac[1] = (e->bssid >> 32) & 0xFF;
+            mac[2] = (e->bssid >> 24) & 0xFF;
+            mac[3] = (e->bssid >> 16) & 0xFF;
+            mac[4] = (e->bssid >> 8) & 0xFF;
+            mac[5] = e->bssid & 0xFF;
+
+            mpack_start_array(&writer, 8);
+            mpack_write_bin(&writer, (const char *) mac, 6);
+            mpack_write_u32(&writer, e->count);
+            mpack_write_u64(&writer, e->freq_khz);
+            mpack_write_i32(&writer, e->last_dbm);
+            mpack_write_i32(&writer, e->peak_dbm);
+            mpack_write_i32(&writer, e->noise_dbm);
+            mpack_write_u64(&writer, e->last_ts.tv_sec);
+            mpack_write_u64(&writer, e->last_ts.tv_usec);
+            mpack_finish_array(&writer);
+        }
+
+        mpack_finish_array(&writer);
+
+        mpack_complete_map(&writer);
+
+        final_len = mpack_writer_buffer_used(&writer);
+
+        if (mpack_writer_destroy(&writer) != mpack_ok) {
+            cf_cancel_packet(caph, meta);
+            r = -1;
+            break;
+        }
+
+        if ((r = cf_commit_packet(caph, meta, final_len)) <= 0)
+            break;
+
+        for (n = start; n < i; n++)
+            caph->beacon_table[n].count = 0;
+    }
+
+    pthread_mutex_unlock(&(caph->beacon_lock));
+
+    return r;
+}
+
 int cf_send_pong(kis_capture_handler_t *caph, uint32_t in_seqno) {
     size_t est_len = 24;
     size_t final_len = 0;
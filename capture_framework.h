@@ -64,6 +64,45 @@
 struct kis_capture_handler;
 typedef struct kis_capture_handler kis_capture_handler_t;
 
+struct z_stream_s;
+
+/* Capture-side prefilter pushed by the server in the open request, compiled into
+ * a subtype mask per 802.11 frame type and address tables.  Exact addresses are
+ * sorted for a binary search, masked addresses are scanned in order. */
+typedef struct {
+    uint8_t roles;
+    uint64_t mac;
+    uint64_t mask;
+} cf_prefilter_mac_t;
+
+typedef struct {
+    uint16_t drop_subtypes[4];
+
+    cf_prefilter_mac_t *exact;
+    size_t exact_sz;
+
+    cf_prefilter_mac_t *masked;
+    size_t masked_sz;
+} cf_prefilter_t;
+
+void cf_prefilter_free(cf_prefilter_t *pf);
+
+/* Beacon summary state per BSSID; beacons matching the hash of the last full
+ * beacon are counted here until the next summary is sent */
+typedef struct {
+    /* BSSID, or 0 for an empty slot */
+    uint64_t bssid;
+    uint32_t hash;
+    time_t last_full;
+
+    uint32_t count;
+    uint64_t freq_khz;
+    int32_t last_dbm;
+    int32_t peak_dbm;
+    int32_t noise_dbm;
+    struct timeval last_ts;
+} cf_beacon_summary_t;
+
 struct cf_params_interface;
 typedef struct cf_params_interface cf_params_interface_t;
 
@@ -86,6 +125,21 @@ struct cf_ws_msg {
 #define CAP_FRAMEWORK_RINGBUF_IN_SZ     (1024 * 64)
 #define CAP_FRAMEWORK_RINGBUF_OUT_SZ    (1024 * 1024 * 4)
 #define CAP_FRAMEWORK_WS_BUF_SZ         (1024 * 4)
+/* Largest batch of data reports; kept under the server frame limit */
+#define CAP_FRAMEWORK_BATCH_BUF_SZ      (1024 * 12)
+/* Largest data frame which is compressed; the compressed frame has to fit under
+ * the server frame limit */
+#define CAP_FRAMEWORK_COMPRESS_BUF_SZ   (1024 * 14)
+/* Largest encoded signal block which can be shared across a batch */
+#define CAP_FRAMEWORK_BATCH_SIGNAL_SZ   128
+/* Most reports in a batch, regardless of what the server allows */
+#define CAP_FRAMEWORK_BATCH_MAX         256
+/* Slots in the beacon summary table; must be a power of 2 */
+#define CAP_FRAMEWORK_BEACON_TABLE_SZ   1024
+/* How often beacon summaries are sent */
+#define CAP_FRAMEWORK_BEACON_SUMMARY_US 1000000
+/* Most BSSIDs in a single beacon summary frame */
+#define CAP_FRAMEWORK_BEACON_SUMMARY_MAX 256
 
 /* List devices callback
  * Called to list devices available
@@ -422,6 +476,64 @@ struct kis_capture_handler {
     /* Are we in remote/verbose mode */
     int verbose;
 
+    /* Credit based flow control; enabled by the first KDS_CREDIT from the server,
+     * after which data frames are only sent while credit remains and are dropped
+     * and counted locally otherwise */
+    pthread_mutex_t flow_lock;
+    int flow_control;
+    uint64_t flow_credit;
+    uint64_t flow_dropped;
+    uint64_t flow_dropped_bytes;
+    uint64_t flow_reported_dropped;
+
+    /* Packet batching; enabled by the batch limits in the open request.  Data
+     * reports are encoded into the batch buffer and sent as one KDS_PACKETBATCH
+     * frame when the batch is full or the first report has waited for the batch
+     * delay.  The signal block of the first report is sent once as the batch
+     * default, and later reports with the same signal omit it. */
+    pthread_mutex_t batch_lock;
+    unsigned int batch_max;
+    unsigned int batch_delay_us;
+    char *batch_buf;
+    size_t batch_len;
+    unsigned int batch_count;
+    struct timeval batch_first;
+    uint16_t batch_report_len[CAP_FRAMEWORK_BATCH_MAX];
+    char batch_signal[CAP_FRAMEWORK_BATCH_SIGNAL_SZ];
+    size_t batch_signal_len;
+
+    /* Compression over network connections, enabled by the compression level in
+     * the open request.  Data frames are built in the compression buffer and sent
+     * deflated as CMD_COMPRESSED frames, all from one deflate stream; the first
+     * frame of a new stream is flagged so the server resets its side.  Protected
+     * by the output buffer lock. */
+    int compress;
+    int compress_reset;
+    struct z_stream_s *compress_stream;
+    uint8_t *compress_buf;
+
+    /* Prefilter from the server, if any; replaced on every open */
+    pthread_mutex_t prefilter_lock;
+    cf_prefilter_t *prefilter;
+
+    /* Beacon summaries; captures opt in, and the server enables them with the
+     * beacon refresh interval in the open request.  Repeated beacons are counted
+     * in the table and sent as a KDS_BEACONSUMMARY every summary interval. */
+    pthread_mutex_t beacon_lock;
+    int beacon_capable;
+    unsigned int beacon_refresh;
+    cf_beacon_summary_t *beacon_table;
+    unsigned int beacon_table_used;
+    struct timeval beacon_last_summary;
+
+    /* Shared memory ring offered by the server in IPC mode, with the eventfds used
+     * to signal new data and to wait for space.  Data frames go through the ring
+     * once we've registered it with the server; everything else stays on the pipe */
+    kismet_external_shm_ring_t *shm_ring;
+    size_t shm_map_sz;
+    int shm_data_fd;
+    int shm_space_fd;
+    int shm_registered;
 
     /* Any exec'd child processes we monitor */
     cf_ipc_t *ipc_list;
@@ -689,6 +801,10 @@ void cf_handler_set_capture_cb(kis_capture_handler_t *capf, cf_callback_capture
 /* Set random data blob */
 void cf_handler_set_userdata(kis_capture_handler_t *capf, void *userdata);
 
+/* Allow 802.11 beacons to be summarized when the server asks for it; only
+ * captures which report every beacon they see should enable this */
+void cf_handler_set_beacon_summary(kis_capture_handler_t *capf, int enable);
+
 
 /* Initiate the capture thread, which will call the capture callback function in
  * its own thread */
@@ -939,6 +1055,12 @@ int cf_send_openresp(kis_capture_handler_t *caph, uint32_t seq, unsigned int suc
  * packet_sz is the actual captured size, if trimmed (such as caplen reported
  * by libpcap, or other trimmed data not sending the entire content)
  *
+ * If the server has enabled flow control and no credit remains, the packet is
+ * counted as a local drop and not sent; this is reported as success.
+ *
+ * If the server has enabled batching the packet may be queued in the current
+ * batch and sent later; this is reported as success.
+ *
  * Returns:
  * -1   An error occurred
  *  0   Insufficient space in buffer
@@ -950,11 +1072,35 @@ int cf_send_data(kis_capture_handler_t *caph,
         struct timeval ts, uint32_t dlt, uint32_t original_sz,
         uint32_t packet_sz, uint8_t *pack);
 
+/* Send any batched data reports if the first report in the batch has waited
+ * longer than the batch delay, or unconditionally if force is set
+ * Can be called from any thread
+ *
+ * Returns:
+ * -1   An error occurred
+ *  0   Insufficient space in buffer, batch is kept
+ *  1   Success, or nothing to send
+ */
+int cf_flush_batch(kis_capture_handler_t *caph, int force);
+
+/* Send the pending beacon summaries if the summary interval has passed, or
+ * unconditionally if force is set
+ * Can be called from any thread
+ *
+ * Returns:
+ * -1   An error occurred
+ *  0   Insufficient space in buffer, summaries are kept
+ *  1   Success, or nothing to send
+ */
+int cf_flush_beacon_summary(kis_capture_handler_t *caph, int force);
+
 /* Send a DATA frame with JSON non-packet data
  * Can be called from any thread
  *
  * If present, include message_kv, signal_kv, or gps_kv along with the json data.
  *
+ * JSON data is subject to the same flow control credit as packet data.
+ *
  * Returns:
  * -1   An error occurred
  *  0   Insufficient space in buffer, try again
@@ -1004,6 +1150,27 @@ int cf_send_pong(kis_capture_handler_t *caph, uint32_t in_seqno);
  */
 int cf_send_newsource(kis_capture_handler_t *caph, const char *uuid);
 
+/* Send a CREDITREPORT with the packets dropped locally for lack of flow control
+ * credit
+ *
+ * Returns:
+ * -1   An error occurred
+ *  0   Insufficient space in buffer
+ *  1   Success
+ */
+int cf_send_creditreport(kis_capture_handler_t *caph, uint64_t dropped,
+        uint64_t dropped_bytes);
+
+/* Send the totals from a kernel capture ring
+ *
+ * Returns:
+ * -1   An error occurred
+ *  0   Insufficient space in buffer
+ *  1   Success
+ */
+int cf_send_capturestats(kis_capture_handler_t *caph, uint64_t packets,
+        uint64_t dropped, uint64_t freezes);
+
 /* Simple frequency parser, returns the frequency in khz from multiple input
  * formats, such as:
  * 123KHz
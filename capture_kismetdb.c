@@ -19,6 +19,12 @@
 /* capture_kismetdb
  *
  * Basic capture binary for reading kismetdb logfiles.
+ *
+ * For load generation, 'ingest=max' replays as fast as the server accepts the
+ * data; the packets and data tables are read in batches of rows in the order
+ * they were logged, which keeps each read short and avoids sorting the whole
+ * table.  'replay_time=now' rewrites every timestamp to the time it is sent, so
+ * devices age and expire as if they were seen live.
  */
 
 #include <pcap.h>
@@ -39,6 +45,7 @@
 
 #include <arpa/inet.h>
 
+#include <stdint.h>
 #include <string.h>
 
 #include "config.h"
@@ -61,8 +68,66 @@ typedef struct {
     struct timeval last_ts;
 
     unsigned int pps_throttle;
+
+    /* Replay as fast as possible in batches of rows */
+    int ingest_max;
+
+    /* Rewrite timestamps to the time they're sent */
+    int replay_now;
 } local_pcap_t;
 
+/* Rows read per query in max speed replay */
+#define KISMETDB_BATCH_ROWS     4096
+
+/* A query which is either stepped once over the whole table, or re-run in batches
+ * of rows after the last rowid it returned; batched queries end with the rowid
+ * column */
+typedef struct {
+    sqlite3_stmt *stmt;
+    int batched;
+    int rowid_col;
+    sqlite3_int64 last_rowid;
+    unsigned int rows;
+} kismetdb_query_t;
+
+static int kismetdb_query_bind(kismetdb_query_t *q) {
+    int r;
+
+    if ((r = sqlite3_bind_int64(q->stmt, 1, q->last_rowid)) != SQLITE_OK)
+        return r;
+
+    q->rows = 0;
+
+    return sqlite3_bind_int(q->stmt, 2, KISMETDB_BATCH_ROWS);
+}
+
+/* Step to the next row, starting the next batch when the current one is used up */
+static int kismetdb_query_step(kismetdb_query_t *q) {
+    int r;
+
+    r = sqlite3_step(q->stmt);
+
+    if (!q->batched)
+        return r;
+
+    /* A full batch means there may be more rows */
+    if (r == SQLITE_DONE && q->rows == KISMETDB_BATCH_ROWS) {
+        sqlite3_reset(q->stmt);
+
+        if ((r = kismetdb_query_bind(q)) != SQLITE_OK)
+            return r;
+
+        r = sqlite3_step(q->stmt);
+    }
+
+    if (r == SQLITE_ROW) {
+        q->last_rowid = sqlite3_column_int64(q->stmt, q->rowid_col);
+        q->rows++;
+    }
+
+    return r;
+}
+
 /* Version callback */
 int sqlite_version_cb(void *ver, int argc, char **data, char **colnames) {
     if (argc != 1) {
@@ -245,7 +310,22 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno, char *definition,
     /* Successful open with no channel, hop, or chanset data */
     snprintf(msg, STATUS_MAX, "Opened kismetdb '%s' for playback", dbname);
 
-    if ((placeholder_len = cf_find_flag(&placeholder, "realtime", definition)) > 0) {
+    local_pcap->ingest_max = 0;
+    local_pcap->replay_now = 0;
+
+    if ((placeholder_len = cf_find_flag(&placeholder, "replay_time", definition)) > 0) {
+        if (strncasecmp(placeholder, "now", placeholder_len) == 0)
+            local_pcap->replay_now = 1;
+    }
+
+    if ((placeholder_len = cf_find_flag(&placeholder, "ingest", definition)) > 0) {
+        if (strncasecmp(placeholder, "max", placeholder_len) == 0) {
+            snprintf(errstr, 4096,
+                    "kismetdb '%s' will replay at maximum speed in logged order", dbname);
+            cf_send_message(caph, errstr, MSGFLAG_INFO);
+            local_pcap->ingest_max = 1;
+        }
+    } else if ((placeholder_len = cf_find_flag(&placeholder, "realtime", definition)) > 0) {
         if (strncasecmp(placeholder, "true", placeholder_len) == 0) {
             snprintf(errstr, 4096,
                     "kismetdb '%s' will replay in realtime", dbname);
@@ -265,6 +345,9 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno, char *definition,
     return 1;
 }
 
+/* GPS type and name of every replayed record */
+static char kismetdb_gps_name[] = "kismetdb";
+
 void kismetdb_dispatch_packet_cb(u_char *user, long ts_sec, long ts_usec,
         unsigned int dlt, uint32_t original_len, uint32_t len, const u_char *data,
         double lat, double lon, double alt, double speed, double heading) {
@@ -328,15 +411,20 @@ void kismetdb_dispatch_packet_cb(u_char *user, long ts_sec, long ts_usec,
     else
         subgps.fix = 2;
 
-    subgps.ts_sec = ts_sec;
-    subgps.ts_usec = ts_usec;
+    struct timeval ts;
 
-    subgps.gps_type = strdup("kismetdb");
-    subgps.gps_name = strdup("kismetdb");
+    if (local_pcap->replay_now) {
+        gettimeofday(&ts, NULL);
+    } else {
+        ts.tv_sec = ts_sec;
+        ts.tv_usec = ts_usec;
+    }
 
-    struct timeval ts;
-    ts.tv_sec = ts_sec;
-    ts.tv_usec = ts_usec;
+    subgps.ts_sec = ts.tv_sec;
+    subgps.ts_usec = ts.tv_usec;
+
+    subgps.gps_type = kismetdb_gps_name;
+    subgps.gps_name = kismetdb_gps_name;
 
     /* Try repeatedly to send the packet; go into a thread wait state if
      * the write buffer is full & we'll be woken up as soon as it flushes
@@ -348,6 +436,7 @@ void kismetdb_dispatch_packet_cb(u_char *user, long ts_sec, long ts_usec,
                         original_len, len, (uint8_t *) data)) < 0) {
             cf_send_error(caph, 0, "unable to send DATA frame");
             cf_handler_spindown(caph);
+            break;
         } else if (ret == 0) {
             /* Go into a wait for the write buffer to get flushed */
             // fprintf(stderr, "debug - pcapfile - dispatch_cb - no room in write buffer - waiting for it to have more space\n");
@@ -357,11 +446,6 @@ void kismetdb_dispatch_packet_cb(u_char *user, long ts_sec, long ts_usec,
             break;
         }
     }
-
-    if (subgps.gps_name != NULL)
-        free(subgps.gps_name);
-    if (subgps.gps_type != NULL)
-        free(subgps.gps_type);
 }
 
 void kismetdb_dispatch_data_cb(u_char *user, long ts_sec, long ts_usec,
@@ -427,15 +511,20 @@ void kismetdb_dispatch_data_cb(u_char *user, long ts_sec, long ts_usec,
     else
         subgps.fix = 2;
 
-    subgps.ts_sec = ts_sec;
-    subgps.ts_usec = ts_usec;
+    struct timeval ts;
 
-    subgps.gps_type = strdup("kismetdb");
-    subgps.gps_name = strdup("kismetdb");
+    if (local_pcap->replay_now) {
+        gettimeofday(&ts, NULL);
+    } else {
+        ts.tv_sec = ts_sec;
+        ts.tv_usec = ts_usec;
+    }
 
-    struct timeval ts;
-    ts.tv_sec = ts_sec;
-    ts.tv_usec = ts_usec;
+    subgps.ts_sec = ts.tv_sec;
+    subgps.ts_usec = ts.tv_usec;
+
+    subgps.gps_type = kismetdb_gps_name;
+    subgps.gps_name = kismetdb_gps_name;
 
     /* Try repeatedly to send the packet; go into a thread wait state if
      * the write buffer is full & we'll be woken up as soon as it flushes
@@ -447,6 +536,7 @@ void kismetdb_dispatch_data_cb(u_char *user, long ts_sec, long ts_usec,
                         type, json)) < 0) {
             cf_send_error(caph, 0, "unable to send DATA frame");
             cf_handler_spindown(caph);
+            break;
         } else if (ret == 0) {
             /* Go into a wait for the write buffer to get flushed */
             // fprintf(stderr, "debug - pcapfile - dispatch_cb - no room in write buffer - waiting for it to have more space\n");
@@ -456,11 +546,6 @@ void kismetdb_dispatch_data_cb(u_char *user, long ts_sec, long ts_usec,
             break;
         }
     }
-
-    if (subgps.gps_name != NULL)
-        free(subgps.gps_name);
-    if (subgps.gps_type != NULL)
-        free(subgps.gps_type);
 }
 
 void capture_thread(kis_capture_handler_t *caph) {
@@ -470,12 +555,16 @@ void capture_thread(kis_capture_handler_t *caph) {
 
     int sql_r;
 
-    sqlite3_stmt *packet_stmt = NULL;
+    kismetdb_query_t packet_q = { .stmt = NULL, .batched = 0, .rowid_col = 0,
+        .last_rowid = INT64_MIN, .rows = 0 };
     const char *packet_pz = NULL;
 
-    sqlite3_stmt *data_stmt = NULL;
+    kismetdb_query_t data_q = { .stmt = NULL, .batched = 0, .rowid_col = 0,
+        .last_rowid = INT64_MIN, .rows = 0 };
     const char *data_pz = NULL;
 
+    const char *packet_sql, *data_sql;
+
     int packet_r, data_r;
 
     /* Common between both packets and data */
@@ -519,18 +608,44 @@ void capture_thread(kis_capture_handler_t *caph) {
     const char *basic_data_sql_v9 =
         "SELECT ts_sec, ts_usec, lat, lon, alt, speed, heading, type, json FROM data ORDER BY ts_sec, ts_usec";
 
+    /* Max speed replay reads in rowid order, which is the order the records were
+     * logged in; the tables have no timestamp index, so reading batches in
+     * timestamp order would sort the table for every batch */
+    const char *batch_packet_sql_v4 =
+        "SELECT ts_sec, ts_usec, frequency, (lat / 100000.0), (lon / 100000.0), dlt, packet, rowid FROM packets "
+        "WHERE rowid > ? ORDER BY rowid LIMIT ?";
+
+    const char *batch_data_sql_v4 =
+        "SELECT ts_sec, ts_usec, (lat / 100000.0), (lon / 100000.0), type, json, rowid FROM data "
+        "WHERE rowid > ? ORDER BY rowid LIMIT ?";
+
+    const char *batch_packet_sql_v5 =
+        "SELECT ts_sec, ts_usec, frequency, lat, lon, alt, speed, heading, dlt, packet, rowid FROM packets "
+        "WHERE rowid > ? ORDER BY rowid LIMIT ?";
+
+    const char *batch_data_sql_v5 =
+        "SELECT ts_sec, ts_usec, lat, lon, alt, speed, heading, type, json, rowid FROM data "
+        "WHERE rowid > ? ORDER BY rowid LIMIT ?";
+
+    const char *batch_packet_sql_v9 =
+        "SELECT ts_sec, ts_usec, frequency, lat, lon, alt, speed, heading, dlt, packet, packet_full_len, rowid FROM packets "
+        "WHERE rowid > ? ORDER BY rowid LIMIT ?";
+
     int colno;
 
     if (local_pcap->db_version <= 4) {
-        sql_r = sqlite3_prepare(local_pcap->db, basic_packet_sql_v4, strlen(basic_packet_sql_v4), &packet_stmt, &packet_pz);
+        packet_sql = local_pcap->ingest_max ? batch_packet_sql_v4 : basic_packet_sql_v4;
+        data_sql = local_pcap->ingest_max ? batch_data_sql_v4 : basic_data_sql_v4;
     } else if (local_pcap->db_version >= 9) {
-        sql_r = sqlite3_prepare(local_pcap->db, basic_packet_sql_v9, strlen(basic_packet_sql_v9), &packet_stmt, &packet_pz);
-    } else if (local_pcap->db_version >= 5) {
-        sql_r = sqlite3_prepare(local_pcap->db, basic_packet_sql_v5, strlen(basic_packet_sql_v5), &packet_stmt, &packet_pz);
-    }  else {
-        sql_r = SQLITE_ERROR;
+        packet_sql = local_pcap->ingest_max ? batch_packet_sql_v9 : basic_packet_sql_v9;
+        data_sql = local_pcap->ingest_max ? batch_data_sql_v5 : basic_data_sql_v9;
+    } else {
+        packet_sql = local_pcap->ingest_max ? batch_packet_sql_v5 : basic_packet_sql_v5;
+        data_sql = local_pcap->ingest_max ? batch_data_sql_v5 : basic_data_sql_v5;
     }
 
+    sql_r = sqlite3_prepare_v2(local_pcap->db, packet_sql, strlen(packet_sql), &packet_q.stmt, &packet_pz);
+
     if (sql_r != SQLITE_OK) {
         snprintf(errstr, 4096, "KismetDB '%s' could not prepare packet query: %s",
                 local_pcap->dbname, sqlite3_errmsg(local_pcap->db));
@@ -538,41 +653,36 @@ void capture_thread(kis_capture_handler_t *caph) {
         return;
     }
 
-    if (local_pcap->db_version <= 4) {
-        sql_r = sqlite3_prepare(local_pcap->db, basic_data_sql_v4, strlen(basic_data_sql_v4), &data_stmt, &data_pz);
-    } else if (local_pcap->db_version >= 9) {
-        sql_r = sqlite3_prepare(local_pcap->db, basic_data_sql_v5, strlen(basic_data_sql_v9), &data_stmt, &data_pz);
-    } else if (local_pcap->db_version >= 5) {
-        sql_r = sqlite3_prepare(local_pcap->db, basic_data_sql_v5, strlen(basic_data_sql_v5), &data_stmt, &data_pz);
-    }  else {
-        sql_r = SQLITE_ERROR;
-    }
+    sql_r = sqlite3_prepare_v2(local_pcap->db, data_sql, strlen(data_sql), &data_q.stmt, &data_pz);
 
     if (sql_r != SQLITE_OK) {
         snprintf(errstr, 4096, "KismetDB '%s' could not prepare data query: %s",
                 local_pcap->dbname, sqlite3_errmsg(local_pcap->db));
         cf_send_error(caph, 0, errstr);
+        sqlite3_finalize(packet_q.stmt);
         return;
     }
 
-    sql_r = sqlite3_reset(packet_stmt);
-    if (sql_r != SQLITE_OK) {
-        snprintf(errstr, 4096, "KismetDB '%s' could not prepare packet query: %s",
-                local_pcap->dbname, sqlite3_errmsg(local_pcap->db));
-        cf_send_error(caph, 0, errstr);
-        return;
-    }
+    if (local_pcap->ingest_max) {
+        packet_q.batched = 1;
+        packet_q.rowid_col = sqlite3_column_count(packet_q.stmt) - 1;
 
-    sql_r = sqlite3_reset(data_stmt);
-    if (sql_r != SQLITE_OK) {
-        snprintf(errstr, 4096, "KismetDB '%s' could not prepare data query: %s",
-                local_pcap->dbname, sqlite3_errmsg(local_pcap->db));
-        cf_send_error(caph, 0, errstr);
-        return;
+        data_q.batched = 1;
+        data_q.rowid_col = sqlite3_column_count(data_q.stmt) - 1;
+
+        if (kismetdb_query_bind(&packet_q) != SQLITE_OK ||
+                kismetdb_query_bind(&data_q) != SQLITE_OK) {
+            snprintf(errstr, 4096, "KismetDB '%s' could not prepare batched queries: %s",
+                    local_pcap->dbname, sqlite3_errmsg(local_pcap->db));
+            cf_send_error(caph, 0, errstr);
+            sqlite3_finalize(packet_q.stmt);
+            sqlite3_finalize(data_q.stmt);
+            return;
+        }
     }
 
-    packet_r = sqlite3_step(packet_stmt);
-    data_r = sqlite3_step(data_stmt);
+    packet_r = kismetdb_query_step(&packet_q);
+    data_r = kismetdb_query_step(&data_q);
 
     while (packet_r == SQLITE_ROW || data_r == SQLITE_ROW) {
         lat = 0;
@@ -582,16 +692,16 @@ void capture_thread(kis_capture_handler_t *caph) {
         heading = 0;
 
         if (packet_r == SQLITE_ROW) {
-            packet_ts_sec = sqlite3_column_int64(packet_stmt, 0);
-            packet_ts_usec = sqlite3_column_int64(packet_stmt, 1);
+            packet_ts_sec = sqlite3_column_int64(packet_q.stmt, 0);
+            packet_ts_usec = sqlite3_column_int64(packet_q.stmt, 1);
         } else {
             packet_ts_sec = 0;
             packet_ts_usec = 0;
         }
 
         if (data_r == SQLITE_ROW) {
-            data_ts_sec = sqlite3_column_int64(data_stmt, 0);
-            data_ts_usec = sqlite3_column_int64(data_stmt, 1);
+            data_ts_sec = sqlite3_column_int64(data_q.stmt, 0);
+            data_ts_usec = sqlite3_column_int64(data_q.stmt, 1);
         } else {
             data_ts_sec = 0;
             data_ts_usec = 0;
@@ -599,61 +709,80 @@ void capture_thread(kis_capture_handler_t *caph) {
 
         /* Merge the timelines of the two tables; if the packet comes first process it,
          * otherwise process the data, and repeat */
-        if (data_ts_sec == 0 || packet_ts_sec < data_ts_sec ||
-                (packet_ts_sec == data_ts_sec && packet_ts_usec < data_ts_usec)) {
+        if (packet_r == SQLITE_ROW && (data_ts_sec == 0 || packet_ts_sec < data_ts_sec ||
+                (packet_ts_sec == data_ts_sec && packet_ts_usec < data_ts_usec))) {
             colno = 2;
 
-            // packet_frequency = sqlite3_column_double(packet_stmt, colno++);
+            // packet_frequency = sqlite3_column_double(packet_q.stmt, colno++);
+            colno++;
 
-            lat = sqlite3_column_double(packet_stmt, colno++);
-            lon = sqlite3_column_double(packet_stmt, colno++);
+            lat = sqlite3_column_double(packet_q.stmt, colno++);
+            lon = sqlite3_column_double(packet_q.stmt, colno++);
 
             if (local_pcap->db_version >= 5) {
-                alt = sqlite3_column_double(packet_stmt, colno++);
-                speed = sqlite3_column_double(packet_stmt, colno++);
-                heading = sqlite3_column_double(packet_stmt, colno++);
+                alt = sqlite3_column_double(packet_q.stmt, colno++);
+                speed = sqlite3_column_double(packet_q.stmt, colno++);
+                heading = sqlite3_column_double(packet_q.stmt, colno++);
             }
 
-            dlt = sqlite3_column_int(packet_stmt, colno++);
+            dlt = sqlite3_column_int(packet_q.stmt, colno++);
 
-            packet_len = sqlite3_column_bytes(packet_stmt, colno);
-            packet_data = sqlite3_column_blob(packet_stmt, colno++);
-            packet_fulllen = sqlite3_column_int64(packet_stmt, colno++);
+            packet_len = sqlite3_column_bytes(packet_q.stmt, colno);
+            packet_data = sqlite3_column_blob(packet_q.stmt, colno++);
+
+            if (local_pcap->db_version >= 9)
+                packet_fulllen = sqlite3_column_int64(packet_q.stmt, colno++);
+            else
+                packet_fulllen = packet_len;
 
             kismetdb_dispatch_packet_cb((u_char *) caph, packet_ts_sec, packet_ts_usec, dlt,
                     packet_fulllen, packet_len, (const u_char *) packet_data,
                     lat, lon, alt, speed, heading);
 
-            packet_r = sqlite3_step(packet_stmt);
+            packet_r = kismetdb_query_step(&packet_q);
         } else {
             colno = 2;
 
-            lat = sqlite3_column_double(data_stmt, colno++);
-            lon = sqlite3_column_double(data_stmt, colno++);
+            lat = sqlite3_column_double(data_q.stmt, colno++);
+            lon = sqlite3_column_double(data_q.stmt, colno++);
 
             if (local_pcap->db_version >= 5) {
-                alt = sqlite3_column_double(data_stmt, colno++);
-                speed = sqlite3_column_double(data_stmt, colno++);
-                heading = sqlite3_column_double(data_stmt, colno++);
+                alt = sqlite3_column_double(data_q.stmt, colno++);
+                speed = sqlite3_column_double(data_q.stmt, colno++);
+                heading = sqlite3_column_double(data_q.stmt, colno++);
             }
 
-            data_type = strdup((const char *) sqlite3_column_text(data_stmt, colno++));
-            data_json = strdup((const char *) sqlite3_column_text(data_stmt, colno++));
+            data_type = strdup((const char *) sqlite3_column_text(data_q.stmt, colno++));
+            data_json = strdup((const char *) sqlite3_column_text(data_q.stmt, colno++));
 
-            kismetdb_dispatch_data_cb((u_char *) caph, packet_ts_sec, packet_ts_usec,
+            kismetdb_dispatch_data_cb((u_char *) caph, data_ts_sec, data_ts_usec,
                     data_type, data_json,
                     lat, lon, alt, speed, heading);
 
             free(data_type);
             free(data_json);
 
-            data_r = sqlite3_step(data_stmt);
+            data_r = kismetdb_query_step(&data_q);
         }
     }
 
-    snprintf(errstr, 4096, "KismetDB '%s' closed, all packets and data processed.",
-            local_pcap->dbname);
-    cf_send_message(caph, errstr, MSGFLAG_INFO);
+    sqlite3_finalize(packet_q.stmt);
+    sqlite3_finalize(data_q.stmt);
+
+    /* Send anything left in a partial batch now instead of waiting for the batch
+     * timer */
+    cf_flush_batch(caph, 1);
+
+    if ((packet_r != SQLITE_DONE && packet_r != SQLITE_ROW) ||
+            (data_r != SQLITE_DONE && data_r != SQLITE_ROW)) {
+        snprintf(errstr, 4096, "KismetDB '%s' stopped early, could not read records: %s",
+                local_pcap->dbname, sqlite3_errmsg(local_pcap->db));
+        cf_send_message(caph, errstr, MSGFLAG_ERROR);
+    } else {
+        snprintf(errstr, 4096, "KismetDB '%s' closed, all packets and data processed.",
+                local_pcap->dbname);
+        cf_send_message(caph, errstr, MSGFLAG_INFO);
+    }
 
     /* Instead of dying, spin forever in a sleep loop */
     while (1) {
@@ -673,6 +802,8 @@ int main(int argc, char *argv[]) {
         .last_ts.tv_sec = 0,
         .last_ts.tv_usec = 0,
         .pps_throttle = 0,
+        .ingest_max = 0,
+        .replay_now = 0,
     };
 
 #if 0
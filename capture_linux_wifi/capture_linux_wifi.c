@@ -23,6 +23,10 @@
  * Linux, using either the old iwconfig IOCTL interface (deprecated) or the
  * modern nl80211 netlink interface.
  *
+ * Packets are read with libpcap, or optionally (ring=true) straight from an
+ * AF_PACKET TPACKET_V3 memory-mapped ring, which hands over whole blocks of
+ * packets at a time instead of one packet per callback.
+ *
  * The communications channel is a file descriptor pair, passed via command
  * line arguments, --in-fd= and --out-fd=
  *
@@ -40,6 +44,8 @@
 
 #define _GNU_SOURCE
 
+/* Before pcap.h, which replaces the kernel BPF initializer macros with its own */
+#include <linux/filter.h>
 #include <pcap.h>
 #include <getopt.h>
 #include <pthread.h>
@@ -74,6 +80,14 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/if_arp.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
 #include "../config.h"
 
 #include "nl80211.h"
@@ -95,6 +109,12 @@
 
 #define MAX_PACKET_LEN  8192
 
+/* TPACKET_V3 ring defaults; blocks are handed to the capture thread when they fill
+ * or when the timeout expires, whichever comes first */
+#define RING_BLOCK_SIZE     (1 << 20)
+#define RING_BLOCK_NR       8
+#define RING_TIMEOUT_MS     50
+
 // BPF program to parse radiotap and 802.11, and pass management and eapol ONLY
 struct bpf_insn rt_pgm[] = {
     // 00 LDB [3]      a = pkt[3] second half of length
@@ -411,6 +431,21 @@ typedef struct {
     unsigned long channel_set_ns_avg;
     unsigned int channel_set_ns_count;
 
+    /* Do we capture from a TPACKET_V3 ring instead of pcap?  When the ring is open,
+     * pd is a dead pcap handle used only to compile filters */
+    bool use_ring;
+    int ring_fd;
+    uint8_t *ring_map;
+    unsigned int ring_block_size;
+    unsigned int ring_block_nr;
+    unsigned int ring_timeout_ms;
+    char ring_errstr[STATUS_MAX];
+
+    /* Ring totals; the kernel resets its counters every time they're read */
+    uint64_t ring_packets;
+    uint64_t ring_dropped;
+    uint64_t ring_freezes;
+
 } local_wifi_t;
 
 /* Linux Wi-Fi Channels:
@@ -1730,6 +1765,167 @@ int build_explicit_filters(char **stringmacs, int num_macs, char **filter) {
 }
 
 
+void ring_close(local_wifi_t *local_wifi) {
+    if (local_wifi->ring_map != NULL) {
+        munmap(local_wifi->ring_map,
+                (size_t) local_wifi->ring_block_size * local_wifi->ring_block_nr);
+        local_wifi->ring_map = NULL;
+    }
+
+    if (local_wifi->ring_fd >= 0) {
+        close(local_wifi->ring_fd);
+        local_wifi->ring_fd = -1;
+    }
+}
+
+/* Open an AF_PACKET socket with a TPACKET_V3 ring on the capture interface and
+ * work out the DLT from the interface hardware type.  The socket isn't bound to
+ * the interface until ring_bind, so that filters can be attached first; like pcap,
+ * it's opened with no protocol so it receives nothing until then, instead of
+ * queuing frames from every interface into the ring. */
+int ring_open(local_wifi_t *local_wifi, int *ret_dlt, char *errstr) {
+    struct tpacket_req3 req;
+    struct ifreq ifr;
+    int version = TPACKET_V3;
+    unsigned int frame_size = TPACKET_ALIGN(TPACKET3_HDRLEN + MAX_PACKET_LEN);
+
+    if (local_wifi->ring_block_size % getpagesize() != 0 ||
+            local_wifi->ring_block_size < frame_size) {
+        snprintf(errstr, STATUS_MAX, "ring block size %u must be a multiple of the "
+                "page size (%d) and at least %u", local_wifi->ring_block_size,
+                getpagesize(), frame_size);
+        return -1;
+    }
+
+    if ((local_wifi->ring_fd = socket(AF_PACKET, SOCK_RAW, 0)) < 0) {
+        snprintf(errstr, STATUS_MAX, "could not create packet socket: %s", strerror(errno));
+        return -1;
+    }
+
+    memset(&ifr, 0, sizeof(struct ifreq));
+    snprintf(ifr.ifr_name, IFNAMSIZ, "%s", local_wifi->cap_interface);
+
+    if (ioctl(local_wifi->ring_fd, SIOCGIFHWADDR, &ifr) < 0) {
+        snprintf(errstr, STATUS_MAX, "could not get interface hardware type: %s",
+                strerror(errno));
+        ring_close(local_wifi);
+        return -1;
+    }
+
+    switch (ifr.ifr_hwaddr.sa_family) {
+        case ARPHRD_IEEE80211_RADIOTAP:
+            *ret_dlt = DLT_IEEE802_11_RADIO;
+            break;
+        case ARPHRD_IEEE80211:
+            *ret_dlt = DLT_IEEE802_11;
+            break;
+        case ARPHRD_IEEE80211_PRISM:
+            *ret_dlt = DLT_PRISM_HEADER;
+            break;
+        default:
+            snprintf(errstr, STATUS_MAX, "unsupported interface hardware type %u",
+                    ifr.ifr_hwaddr.sa_family);
+            ring_close(local_wifi);
+            return -1;
+    }
+
+    if (setsockopt(local_wifi->ring_fd, SOL_PACKET, PACKET_VERSION,
+                &version, sizeof(version)) < 0) {
+        snprintf(errstr, STATUS_MAX, "kernel does not support TPACKET_V3: %s",
+                strerror(errno));
+        ring_close(local_wifi);
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(struct tpacket_req3));
+    req.tp_block_size = local_wifi->ring_block_size;
+    req.tp_block_nr = local_wifi->ring_block_nr;
+    req.tp_frame_size = frame_size;
+    req.tp_frame_nr = (req.tp_block_size / req.tp_frame_size) * req.tp_block_nr;
+    req.tp_retire_blk_tov = local_wifi->ring_timeout_ms;
+
+    if (setsockopt(local_wifi->ring_fd, SOL_PACKET, PACKET_RX_RING,
+                &req, sizeof(req)) < 0) {
+        snprintf(errstr, STATUS_MAX, "could not create a ring of %u blocks of %u bytes: %s",
+                req.tp_block_nr, req.tp_block_size, strerror(errno));
+        ring_close(local_wifi);
+        return -1;
+    }
+
+    local_wifi->ring_map = (uint8_t *) mmap(NULL, (size_t) req.tp_block_size * req.tp_block_nr,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, local_wifi->ring_fd, 0);
+
+    if (local_wifi->ring_map == MAP_FAILED) {
+        local_wifi->ring_map = NULL;
+        snprintf(errstr, STATUS_MAX, "could not map ring: %s", strerror(errno));
+        ring_close(local_wifi);
+        return -1;
+    }
+
+    local_wifi->ring_packets = 0;
+    local_wifi->ring_dropped = 0;
+    local_wifi->ring_freezes = 0;
+
+    return 1;
+}
+
+int ring_bind(local_wifi_t *local_wifi, char *errstr) {
+    struct sockaddr_ll sll;
+    struct packet_mreq mreq;
+    int ifindex;
+
+    if ((ifindex = if_nametoindex(local_wifi->cap_interface)) == 0) {
+        snprintf(errstr, STATUS_MAX, "could not find interface index: %s", strerror(errno));
+        return -1;
+    }
+
+    memset(&sll, 0, sizeof(struct sockaddr_ll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = ifindex;
+
+    if (bind(local_wifi->ring_fd, (struct sockaddr *) &sll, sizeof(sll)) < 0) {
+        snprintf(errstr, STATUS_MAX, "could not bind packet socket: %s", strerror(errno));
+        return -1;
+    }
+
+    /* Same as pcap, which always opens promisc */
+    memset(&mreq, 0, sizeof(struct packet_mreq));
+    mreq.mr_ifindex = ifindex;
+    mreq.mr_type = PACKET_MR_PROMISC;
+
+    setsockopt(local_wifi->ring_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+
+    return 1;
+}
+
+/* Install a filter on whichever capture is open; BPF programs from libpcap are
+ * the same layout as the kernel socket filters */
+int capture_setfilter(local_wifi_t *local_wifi, struct bpf_program *bpf) {
+    struct sock_fprog fprog;
+
+    if (local_wifi->ring_fd < 0)
+        return pcap_setfilter(local_wifi->pd, bpf);
+
+    fprog.len = bpf->bf_len;
+    fprog.filter = (struct sock_filter *) bpf->bf_insns;
+
+    if (setsockopt(local_wifi->ring_fd, SOL_SOCKET, SO_ATTACH_FILTER,
+                &fprog, sizeof(fprog)) < 0) {
+        snprintf(local_wifi->ring_errstr, STATUS_MAX, "%s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+const char *capture_geterr(local_wifi_t *local_wifi) {
+    if (local_wifi->ring_fd < 0)
+        return pcap_geterr(local_wifi->pd);
+
+    return local_wifi->ring_errstr;
+}
+
 int open_callback(kis_capture_handler_t *caph, uint32_t seqno, char *definition,
         char *msg, uint32_t *dlt, char **uuid,
         cf_params_interface_t **ret_interface,
@@ -1835,6 +2031,8 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno, char *definition,
         local_wifi->pd = NULL;
     }
 
+    ring_close(local_wifi);
+
     /* Start processing the open */
 
     if ((placeholder_len = cf_parse_interface(&placeholder, definition)) <= 0) {
@@ -1881,6 +2079,45 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno, char *definition,
         }
     }
 
+    /* Do we capture from a TPACKET_V3 ring? */
+    if ((placeholder_len = 
+                cf_find_flag(&placeholder, "ring", definition)) > 0) {
+        if (strncasecmp(placeholder, "false", placeholder_len) == 0) {
+            local_wifi->use_ring = false;
+        } else if (strncasecmp(placeholder, "true", placeholder_len) == 0) {
+            local_wifi->use_ring = true;
+        }
+    }
+
+    if ((placeholder_len = 
+                cf_find_flag(&placeholder, "ring_block_size", definition)) > 0) {
+        if (sscanf(placeholder, "%u", &local_wifi->ring_block_size) != 1 ||
+                local_wifi->ring_block_size == 0) {
+            snprintf(msg, STATUS_MAX, "%s could not parse ring_block_size= option, "
+                    "expected a size in bytes", local_wifi->name);
+            return -1;
+        }
+    }
+
+    if ((placeholder_len = 
+                cf_find_flag(&placeholder, "ring_blocks", definition)) > 0) {
+        if (sscanf(placeholder, "%u", &local_wifi->ring_block_nr) != 1 ||
+                local_wifi->ring_block_nr == 0) {
+            snprintf(msg, STATUS_MAX, "%s could not parse ring_blocks= option, "
+                    "expected a number of blocks", local_wifi->name);
+            return -1;
+        }
+    }
+
+    if ((placeholder_len = 
+                cf_find_flag(&placeholder, "ring_timeout", definition)) > 0) {
+        if (sscanf(placeholder, "%u", &local_wifi->ring_timeout_ms) != 1) {
+            snprintf(msg, STATUS_MAX, "%s could not parse ring_timeout= option, "
+                    "expected a timeout in milliseconds", local_wifi->name);
+            return -1;
+        }
+    }
+
     /* Do we truncate all data? */
     if ((placeholder_len = 
                 cf_find_flag(&placeholder, "truncate_data", definition)) > 0) {
@@ -2971,32 +3208,48 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno, char *definition,
 
     (*ret_interface)->hardware = strdup(driver);
 
-    /* Open the pcap */
-    local_wifi->pd = pcap_open_live(local_wifi->cap_interface, 
-            MAX_PACKET_LEN, 1, 1000, pcap_errstr);
+    /* Open the ring if we were asked to, and fall back to pcap if we can't */
+    if (local_wifi->use_ring) {
+        int ring_dlt;
 
-    if (local_wifi->pd == NULL || strlen(pcap_errstr) != 0) {
-        snprintf(msg, STATUS_MAX, "%s could not open capture interface '%s' on '%s' "
-                "as a pcap capture: %s", local_wifi->name, local_wifi->cap_interface, 
-                local_wifi->interface, pcap_errstr);
-        return -1;
+        if (ring_open(local_wifi, &ring_dlt, errstr) < 0) {
+            snprintf(errstr2, STATUS_MAX, "%s could not open a TPACKET_V3 ring on '%s', "
+                    "falling back to pcap: %s", local_wifi->name, local_wifi->cap_interface,
+                    errstr);
+            cf_send_message(caph, errstr2, MSGFLAG_INFO);
+        } else if ((local_wifi->pd = pcap_open_dead(ring_dlt, MAX_PACKET_LEN)) == NULL) {
+            ring_close(local_wifi);
+        }
+    }
+
+    /* Open the pcap */
+    if (local_wifi->pd == NULL) {
+        local_wifi->pd = pcap_open_live(local_wifi->cap_interface, 
+                MAX_PACKET_LEN, 1, 1000, pcap_errstr);
+
+        if (local_wifi->pd == NULL || strlen(pcap_errstr) != 0) {
+            snprintf(msg, STATUS_MAX, "%s could not open capture interface '%s' on '%s' "
+                    "as a pcap capture: %s", local_wifi->name, local_wifi->cap_interface, 
+                    local_wifi->interface, pcap_errstr);
+            return -1;
+        }
     }
 
     if (local_wifi->wardrive_filter) {
         if (pcap_datalink(local_wifi->pd) == DLT_IEEE802_11_RADIO) {
             bpf.bf_len = rt_pgm_len;
             bpf.bf_insns = rt_pgm;
-            if (pcap_setfilter(local_wifi->pd, &bpf) < 0) {
+            if (capture_setfilter(local_wifi, &bpf) < 0) {
                 snprintf(errstr, STATUS_MAX, "%s unable to install management packet filter: %s",
-                         local_wifi->name, pcap_geterr(local_wifi->pd));
+                         local_wifi->name, capture_geterr(local_wifi));
                 cf_send_message(caph, errstr, MSGFLAG_ERROR);
             }
         } else if (pcap_datalink(local_wifi->pd) == DLT_IEEE802_11) {
             bpf.bf_len = dot11_pgm_len;
             bpf.bf_insns = dot11_pgm;
-            if (pcap_setfilter(local_wifi->pd, &bpf) < 0) {
+            if (capture_setfilter(local_wifi, &bpf) < 0) {
                 snprintf(errstr, STATUS_MAX, "%s unable to install management packet filter: %s",
-                         local_wifi->name, pcap_geterr(local_wifi->pd));
+                         local_wifi->name, capture_geterr(local_wifi));
                 cf_send_message(caph, errstr, MSGFLAG_ERROR);
             }
         } else {
@@ -3009,9 +3262,9 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno, char *definition,
         if (pcap_datalink(local_wifi->pd) == DLT_IEEE802_11_RADIO) {
             bpf.bf_len = rt_pgm_crop_data_len;
             bpf.bf_insns = rt_pgm_crop_data;
-            if (pcap_setfilter(local_wifi->pd, &bpf) < 0) {
+            if (capture_setfilter(local_wifi, &bpf) < 0) {
                 snprintf(errstr, STATUS_MAX, "%s unable to install data packet filter: %s",
-                         local_wifi->name, pcap_geterr(local_wifi->pd));
+                         local_wifi->name, capture_geterr(local_wifi));
                 cf_send_message(caph, errstr, MSGFLAG_ERROR);
             }
         } else {
@@ -3035,10 +3288,10 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno, char *definition,
                         local_wifi->name, pcap_geterr(local_wifi->pd));
                 cf_send_message(caph, errstr, MSGFLAG_INFO);
             } else {
-                if (pcap_setfilter(local_wifi->pd, &bpf) < 0) {
+                if (capture_setfilter(local_wifi, &bpf) < 0) {
                     snprintf(errstr, STATUS_MAX, "%s unable to assign filter to exclude other "
                             "local interfaces: %s",
-                            local_wifi->name, pcap_geterr(local_wifi->pd));
+                            local_wifi->name, capture_geterr(local_wifi));
                     cf_send_message(caph, errstr, MSGFLAG_INFO);
                 }
             }
@@ -3053,10 +3306,10 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno, char *definition,
                         local_wifi->name, pcap_geterr(local_wifi->pd));
                 cf_send_message(caph, errstr, MSGFLAG_INFO);
             } else {
-                if (pcap_setfilter(local_wifi->pd, &bpf) < 0) {
+                if (capture_setfilter(local_wifi, &bpf) < 0) {
                     snprintf(errstr, STATUS_MAX, "%s unable to assign filter to exclude "
                             "local interfaces: %s",
-                            local_wifi->name, pcap_geterr(local_wifi->pd));
+                            local_wifi->name, capture_geterr(local_wifi));
                     cf_send_message(caph, errstr, MSGFLAG_INFO);
                 }
             }
@@ -3078,10 +3331,10 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno, char *definition,
                         local_wifi->name, pcap_geterr(local_wifi->pd));
                 cf_send_message(caph, errstr, MSGFLAG_INFO);
             } else {
-                if (pcap_setfilter(local_wifi->pd, &bpf) < 0) {
+                if (capture_setfilter(local_wifi, &bpf) < 0) {
                     snprintf(errstr, STATUS_MAX, "%s unable to assign filter to exclude "
                             "specific addresses: %s",
-                            local_wifi->name, pcap_geterr(local_wifi->pd));
+                            local_wifi->name, capture_geterr(local_wifi));
                     cf_send_message(caph, errstr, MSGFLAG_INFO);
                 }
             }
@@ -3100,6 +3353,20 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno, char *definition,
     local_wifi->datalink_type = pcap_datalink(local_wifi->pd);
     *dlt = local_wifi->datalink_type;
 
+    if (local_wifi->ring_fd >= 0) {
+        if (ring_bind(local_wifi, errstr) < 0) {
+            snprintf(msg, STATUS_MAX, "%s could not open capture interface '%s' on '%s' "
+                    "as a TPACKET_V3 ring: %s", local_wifi->name, local_wifi->cap_interface,
+                    local_wifi->interface, errstr);
+            return -1;
+        }
+
+        snprintf(errstr, STATUS_MAX, "%s capturing from a TPACKET_V3 ring of %u blocks "
+                "of %u bytes", local_wifi->name, local_wifi->ring_block_nr,
+                local_wifi->ring_block_size);
+        cf_send_message(caph, errstr, MSGFLAG_INFO);
+    }
+
     if (strcmp(local_wifi->interface, local_wifi->cap_interface) != 0) {
         snprintf(msg, STATUS_MAX, "%s Linux Wi-Fi capturing from monitor vif '%s' on "
                 "interface '%s'", local_wifi->name, local_wifi->cap_interface, local_wifi->interface);
@@ -3302,20 +3569,142 @@ void pcap_dispatch_cb(u_char *user, const struct pcap_pkthdr *header,
     }
 }
 
+/* Send the ring totals to the server when they've changed */
+void ring_send_stats(kis_capture_handler_t *caph, local_wifi_t *local_wifi) {
+    struct tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+
+    if (getsockopt(local_wifi->ring_fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) < 0)
+        return;
+
+    if (stats.tp_packets == 0 && stats.tp_drops == 0 && stats.tp_freeze_q_cnt == 0)
+        return;
+
+    local_wifi->ring_packets += stats.tp_packets;
+    local_wifi->ring_dropped += stats.tp_drops;
+    local_wifi->ring_freezes += stats.tp_freeze_q_cnt;
+
+    cf_send_capturestats(caph, local_wifi->ring_packets, local_wifi->ring_dropped,
+            local_wifi->ring_freezes);
+}
+
+/* Send every packet in a ring block, then whatever the block left batched, so a
+ * block goes out as a handful of batch frames instead of waiting on the batch delay */
+int ring_send_block(kis_capture_handler_t *caph, local_wifi_t *local_wifi,
+        struct tpacket_block_desc *bd) {
+    struct tpacket3_hdr *ppd;
+    struct timeval ts;
+    unsigned int i;
+    int ret;
+
+    ppd = (struct tpacket3_hdr *) ((uint8_t *) bd + bd->hdr.bh1.offset_to_first_pkt);
+
+    for (i = 0; i < bd->hdr.bh1.num_pkts; i++) {
+        ts.tv_sec = ppd->tp_sec;
+        ts.tv_usec = ppd->tp_nsec / 1000;
+
+        while (1) {
+            if ((ret = cf_send_data(caph, NULL, 0,
+                            NULL, NULL, ts, local_wifi->datalink_type,
+                            ppd->tp_len, ppd->tp_snaplen, (uint8_t *) ppd + ppd->tp_mac)) < 0) {
+                return -1;
+            } else if (ret == 0) {
+                /* Go into a wait for the write buffer to get flushed */
+                cf_handler_wait_ringbuffer(caph);
+                continue;
+            } else {
+                break;
+            }
+        }
+
+        ppd = (struct tpacket3_hdr *) ((uint8_t *) ppd + ppd->tp_next_offset);
+    }
+
+    while ((ret = cf_flush_batch(caph, 1)) == 0)
+        cf_handler_wait_ringbuffer(caph);
+
+    return ret < 0 ? -1 : 1;
+}
+
+/* Walk the ring blocks in order, handing each one back to the kernel once it has
+ * been sent, until the interface goes away or we're shutting down */
+void ring_loop(kis_capture_handler_t *caph, local_wifi_t *local_wifi) {
+    struct tpacket_block_desc *bd;
+    struct pollfd pfd;
+    unsigned int block = 0;
+    time_t last_stats = time(NULL);
+    int sockerr;
+    socklen_t sockerr_len;
+
+    pfd.fd = local_wifi->ring_fd;
+    pfd.events = POLLIN | POLLERR;
+
+    local_wifi->ring_errstr[0] = 0;
+
+    while (!caph->spindown) {
+        bd = (struct tpacket_block_desc *)
+            (local_wifi->ring_map + ((size_t) block * local_wifi->ring_block_size));
+
+        if ((__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+            pfd.revents = 0;
+
+            if (poll(&pfd, 1, 1000) < 0) {
+                if (errno == EINTR)
+                    continue;
+
+                snprintf(local_wifi->ring_errstr, STATUS_MAX, "%s", strerror(errno));
+                break;
+            }
+
+            if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                sockerr = 0;
+                sockerr_len = sizeof(sockerr);
+                getsockopt(local_wifi->ring_fd, SOL_SOCKET, SO_ERROR, &sockerr, &sockerr_len);
+
+                if (sockerr != 0)
+                    snprintf(local_wifi->ring_errstr, STATUS_MAX, "%s", strerror(sockerr));
+                break;
+            }
+        } else {
+            if (ring_send_block(caph, local_wifi, bd) < 0) {
+                fprintf(stderr, "%s %s/%s could not send packet to Kismet server, terminating.", 
+                        local_wifi->name, local_wifi->interface, local_wifi->cap_interface);
+                cf_handler_spindown(caph);
+                break;
+            }
+
+            __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+
+            block = (block + 1) % local_wifi->ring_block_nr;
+        }
+
+        if (time(NULL) != last_stats) {
+            last_stats = time(NULL);
+            ring_send_stats(caph, local_wifi);
+        }
+    }
+
+    ring_send_stats(caph, local_wifi);
+}
+
 void capture_thread(kis_capture_handler_t *caph) {
     local_wifi_t *local_wifi = (local_wifi_t *) caph->userdata;
     char errstr[PCAP_ERRBUF_SIZE];
-    char *pcap_errstr;
+    const char *pcap_errstr;
     char iferrstr[STATUS_MAX];
     int ifflags = 0, ifret;
 
     /* Simple capture thread: since we don't care about blocking and 
      * channel control is managed by the channel hopping thread, all we have
-     * to do is enter a blocking pcap loop */
+     * to do is enter a blocking pcap loop, or walk the ring */
 
-    pcap_loop(local_wifi->pd, -1, pcap_dispatch_cb, (u_char *) caph);
+    if (local_wifi->ring_fd >= 0) {
+        ring_loop(caph, local_wifi);
+    } else {
+        pcap_loop(local_wifi->pd, -1, pcap_dispatch_cb, (u_char *) caph);
+    }
 
-    pcap_errstr = pcap_geterr(local_wifi->pd);
+    pcap_errstr = capture_geterr(local_wifi);
 
     snprintf(errstr, PCAP_ERRBUF_SIZE, "%s interface '%s' closed: %s", 
             local_wifi->name, local_wifi->cap_interface, 
@@ -3366,6 +3755,15 @@ int main(int argc, char *argv[]) {
         .verbose_statistics = 0,
         .channel_set_ns_avg = 0,
         .channel_set_ns_count = 0,
+        .use_ring = false,
+        .ring_fd = -1,
+        .ring_map = NULL,
+        .ring_block_size = RING_BLOCK_SIZE,
+        .ring_block_nr = RING_BLOCK_NR,
+        .ring_timeout_ms = RING_TIMEOUT_MS,
+        .ring_packets = 0,
+        .ring_dropped = 0,
+        .ring_freezes = 0,
     };
 
 #ifdef HAVE_LIBNM
@@ -3410,6 +3808,9 @@ int main(int argc, char *argv[]) {
      * it does nothing and hurts nothing on 5ghz */
     cf_handler_set_hop_shuffle_spacing(caph, 4);
 
+    /* Repeated beacons can be summarized if the server asks for it */
+    cf_handler_set_beacon_summary(caph, 1);
+
     int r = cf_handler_parse_opts(caph, argc, argv);
     if (r == 0) {
         return 0;
@@ -45,6 +45,12 @@
  * We parse additional options from the source definition itself, such as a DLT
  * override, once we open the protocol
  *
+ * For bulk ingest of large captures, 'ingest=max' maps the file and parses the
+ * pcap and pcapng records directly instead of going through libpcap.  A
+ * directory of capture files is merged into a single source in timestamp order,
+ * with ties going to the file which sorts first by name, so the packet order is
+ * the same on every run.
+ *
  */
 
 #include <pcap.h>
@@ -60,14 +66,53 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <sys/mman.h>
+
 #include <unistd.h>
 #include <errno.h>
+#include <dirent.h>
 
 #include <arpa/inet.h>
 
 #include "config.h"
 #include "capture_framework.h"
 
+/* Largest packet we accept from a mapped file, which also catches corrupt records */
+#define PCAP_MMAP_MAX_PACKET    (256 * 1024)
+
+/* Most interfaces we track in a pcapng section */
+#define PCAP_MMAP_MAX_IF        64
+
+/* A capture file mapped for direct parsing */
+typedef struct {
+    char *fname;
+
+    uint8_t *map;
+    size_t map_sz;
+    size_t offt;
+
+    int pcapng;
+    int swapped;
+
+    /* Classic pcap */
+    int nsec;
+    int dlt;
+
+    /* pcapng interfaces in the current section; timestamps are in units of
+     * 1/if_tsdiv seconds */
+    unsigned int num_if;
+    int if_dlt[PCAP_MMAP_MAX_IF];
+    uint64_t if_tsdiv[PCAP_MMAP_MAX_IF];
+
+    /* Next packet, read ahead so files can be merged in order */
+    int have_packet;
+    struct timeval ts;
+    int packet_dlt;
+    uint32_t len;
+    uint32_t caplen;
+    const uint8_t *data;
+} pcap_mmap_t;
+
 typedef struct {
     pcap_t *pd;
     char *pcapfname;
@@ -78,8 +123,392 @@ typedef struct {
     struct timeval last_ts;
 
     unsigned int pps_throttle;
+
+    /* Mapped files, used for max speed ingest and for directories */
+    int ingest_max;
+    pcap_mmap_t **mmap_files;
+    unsigned int num_mmap_files;
 } local_pcap_t;
 
+static uint16_t pcap_mmap_16(pcap_mmap_t *pm, const uint8_t *d) {
+    uint16_t v;
+    memcpy(&v, d, sizeof(uint16_t));
+    return pm->swapped ? __builtin_bswap16(v) : v;
+}
+
+static uint32_t pcap_mmap_32(pcap_mmap_t *pm, const uint8_t *d) {
+    uint32_t v;
+    memcpy(&v, d, sizeof(uint32_t));
+    return pm->swapped ? __builtin_bswap32(v) : v;
+}
+
+void pcap_mmap_close(pcap_mmap_t *pm) {
+    if (pm == NULL)
+        return;
+
+    if (pm->map != NULL)
+        munmap(pm->map, pm->map_sz);
+
+    free(pm->fname);
+    free(pm);
+}
+
+/* Map a pcap or pcapng file and read the file header; returns NULL with an error
+ * in errstr if the file can't be mapped or isn't a capture file we can parse */
+pcap_mmap_t *pcap_mmap_open(const char *fname, char *errstr) {
+    pcap_mmap_t *pm;
+    struct stat sbuf;
+    uint32_t magic;
+    int fd;
+
+    if ((fd = open(fname, O_RDONLY)) < 0) {
+        snprintf(errstr, PCAP_ERRBUF_SIZE, "Unable to open '%s': %s", fname, strerror(errno));
+        return NULL;
+    }
+
+    if (fstat(fd, &sbuf) < 0 || !S_ISREG(sbuf.st_mode) || sbuf.st_size < 24) {
+        snprintf(errstr, PCAP_ERRBUF_SIZE, "'%s' is not a pcap or pcapng file", fname);
+        close(fd);
+        return NULL;
+    }
+
+    pm = (pcap_mmap_t *) calloc(1, sizeof(pcap_mmap_t));
+
+    if (pm == NULL) {
+        snprintf(errstr, PCAP_ERRBUF_SIZE, "Unable to allocate memory for '%s'", fname);
+        close(fd);
+        return NULL;
+    }
+
+    pm->fname = strdup(fname);
+    pm->map_sz = sbuf.st_size;
+    pm->map = (uint8_t *) mmap(NULL, pm->map_sz, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (pm->map == MAP_FAILED) {
+        snprintf(errstr, PCAP_ERRBUF_SIZE, "Unable to map '%s': %s", fname, strerror(errno));
+        pm->map = NULL;
+        pcap_mmap_close(pm);
+        return NULL;
+    }
+
+#ifdef MADV_SEQUENTIAL
+    madvise(pm->map, pm->map_sz, MADV_SEQUENTIAL);
+#endif
+
+    memcpy(&magic, pm->map, sizeof(uint32_t));
+
+    if (magic == 0x0A0D0D0A) {
+        /* pcapng; the byte order comes from each section header */
+        pm->pcapng = 1;
+        return pm;
+    }
+
+    if (magic == 0xa1b2c3d4 || magic == 0xa1b23c4d) {
+        pm->swapped = 0;
+    } else if (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1) {
+        pm->swapped = 1;
+    } else {
+        snprintf(errstr, PCAP_ERRBUF_SIZE, "'%s' is not a pcap or pcapng file", fname);
+        pcap_mmap_close(pm);
+        return NULL;
+    }
+
+    pm->nsec = (magic == 0xa1b23c4d || magic == 0x4d3cb2a1);
+
+    /* The upper bits of the link type hold the FCS length */
+    pm->dlt = pcap_mmap_32(pm, pm->map + 20) & 0xFFFF;
+    pm->offt = 24;
+
+    return pm;
+}
+
+/* Convert a pcapng timestamp to a timeval */
+static void pcap_mmap_ng_ts(uint64_t ts, uint64_t tsdiv, struct timeval *tv) {
+    tv->tv_sec = ts / tsdiv;
+    tv->tv_usec = ((ts % tsdiv) * 1000000ULL) / tsdiv;
+}
+
+/* Parse the next packet in the file into the read ahead fields.
+ *
+ * Returns:
+ *  1   packet available
+ *  0   end of file
+ *  -1  error, with the reason in errstr
+ */
+int pcap_mmap_next(pcap_mmap_t *pm, char *errstr) {
+    const uint8_t *b;
+    uint32_t btype, blen;
+    unsigned int ifnum;
+    size_t o;
+
+    pm->have_packet = 0;
+
+    if (!pm->pcapng) {
+        if (pm->offt == pm->map_sz)
+            return 0;
+
+        if (pm->map_sz - pm->offt < 16) {
+            snprintf(errstr, PCAP_ERRBUF_SIZE, "truncated packet header in '%s'", pm->fname);
+            return -1;
+        }
+
+        b = pm->map + pm->offt;
+
+        pm->ts.tv_sec = pcap_mmap_32(pm, b);
+        pm->ts.tv_usec = pcap_mmap_32(pm, b + 4);
+        if (pm->nsec)
+            pm->ts.tv_usec /= 1000;
+
+        pm->caplen = pcap_mmap_32(pm, b + 8);
+        pm->len = pcap_mmap_32(pm, b + 12);
+
+        if (pm->caplen > PCAP_MMAP_MAX_PACKET || pm->map_sz - pm->offt - 16 < pm->caplen) {
+            snprintf(errstr, PCAP_ERRBUF_SIZE, "truncated or corrupt packet in '%s'", pm->fname);
+            return -1;
+        }
+
+        pm->data = b + 16;
+        pm->packet_dlt = pm->dlt;
+        pm->offt += 16 + pm->caplen;
+        pm->have_packet = 1;
+
+        return 1;
+    }
+
+    while (1) {
+        if (pm->offt == pm->map_sz)
+            return 0;
+
+        if (pm->map_sz - pm->offt < 12) {
+            snprintf(errstr, PCAP_ERRBUF_SIZE, "truncated block in '%s'", pm->fname);
+            return -1;
+        }
+
+        b = pm->map + pm->offt;
+        memcpy(&btype, b, sizeof(uint32_t));
+
+        /* Section headers set the byte order for everything up to the next section */
+        if (btype == 0x0A0D0D0A) {
+            uint32_t bom;
+            memcpy(&bom, b + 8, sizeof(uint32_t));
+
+            if (bom == 0x1A2B3C4D) {
+                pm->swapped = 0;
+            } else if (bom == 0x4D3C2B1A) {
+                pm->swapped = 1;
+            } else {
+                snprintf(errstr, PCAP_ERRBUF_SIZE, "corrupt section header in '%s'", pm->fname);
+                return -1;
+            }
+
+            pm->num_if = 0;
+        } else {
+            btype = pcap_mmap_32(pm, b);
+        }
+
+        blen = pcap_mmap_32(pm, b + 4);
+
+        if (blen < 12 || (blen % 4) != 0 || blen > pm->map_sz - pm->offt) {
+            snprintf(errstr, PCAP_ERRBUF_SIZE, "truncated or corrupt block in '%s'", pm->fname);
+            return -1;
+        }
+
+        pm->offt += blen;
+
+        switch (btype) {
+            case 0x00000001:
+                /* Interface description */
+                if (blen < 20)
+                    break;
+
+                if (pm->num_if >= PCAP_MMAP_MAX_IF) {
+                    snprintf(errstr, PCAP_ERRBUF_SIZE, "too many interfaces in '%s'", pm->fname);
+                    return -1;
+                }
+
+                pm->if_dlt[pm->num_if] = pcap_mmap_16(pm, b + 8);
+                pm->if_tsdiv[pm->num_if] = 1000000ULL;
+
+                /* Only the timestamp resolution matters to us */
+                o = 16;
+                while (o + 4 <= blen - 4) {
+                    uint16_t ocode = pcap_mmap_16(pm, b + o);
+                    uint16_t olen = pcap_mmap_16(pm, b + o + 2);
+
+                    if (ocode == 0 || o + 4 + olen > blen - 4)
+                        break;
+
+                    if (ocode == 9 && olen >= 1) {
+                        uint8_t res = b[o + 4];
+
+                        if (res & 0x80) {
+                            if ((res & 0x7F) < 64)
+                                pm->if_tsdiv[pm->num_if] = 1ULL << (res & 0x7F);
+                        } else if (res <= 19) {
+                            uint64_t d = 1;
+                            while (res-- > 0)
+                                d *= 10;
+                            pm->if_tsdiv[pm->num_if] = d;
+                        }
+                    }
+
+                    o += 4 + ((olen + 3) & ~3);
+                }
+
+                pm->num_if++;
+                break;
+
+            case 0x00000006:
+            case 0x00000002:
+                /* Enhanced packet and the obsolete packet block share a layout, except
+                 * the obsolete block has a 16 bit interface and a drop count */
+                if (blen < 32)
+                    break;
+
+                if (btype == 0x00000006)
+                    ifnum = pcap_mmap_32(pm, b + 8);
+                else
+                    ifnum = pcap_mmap_16(pm, b + 8);
+
+                if (ifnum >= pm->num_if) {
+                    snprintf(errstr, PCAP_ERRBUF_SIZE, "packet for unknown interface in '%s'",
+                            pm->fname);
+                    return -1;
+                }
+
+                pcap_mmap_ng_ts(((uint64_t) pcap_mmap_32(pm, b + 12) << 32) |
+                        pcap_mmap_32(pm, b + 16), pm->if_tsdiv[ifnum], &pm->ts);
+
+                pm->caplen = pcap_mmap_32(pm, b + 20);
+                pm->len = pcap_mmap_32(pm, b + 24);
+
+                if (pm->caplen > PCAP_MMAP_MAX_PACKET || pm->caplen > blen - 32) {
+                    snprintf(errstr, PCAP_ERRBUF_SIZE, "corrupt packet block in '%s'", pm->fname);
+                    return -1;
+                }
+
+                pm->data = b + 28;
+                pm->packet_dlt = pm->if_dlt[ifnum];
+                pm->have_packet = 1;
+
+                return 1;
+
+            case 0x00000003:
+                /* Simple packets have no timestamp and always come from the first
+                 * interface */
+                if (blen < 16 || pm->num_if == 0)
+                    break;
+
+                pm->len = pcap_mmap_32(pm, b + 8);
+                pm->caplen = pm->len;
+
+                if (pm->caplen > blen - 16)
+                    pm->caplen = blen - 16;
+
+                if (pm->caplen > PCAP_MMAP_MAX_PACKET) {
+                    snprintf(errstr, PCAP_ERRBUF_SIZE, "corrupt packet block in '%s'", pm->fname);
+                    return -1;
+                }
+
+                pm->ts.tv_sec = 0;
+                pm->ts.tv_usec = 0;
+                pm->data = b + 12;
+                pm->packet_dlt = pm->if_dlt[0];
+                pm->have_packet = 1;
+
+                return 1;
+
+            default:
+                break;
+        }
+    }
+}
+
+/* Capture files in a directory, in name order */
+static int pcap_dir_filter(const struct dirent *de) {
+    const char *ext;
+
+    if (de->d_name[0] == '.')
+        return 0;
+
+    if ((ext = strrchr(de->d_name, '.')) == NULL)
+        return 0;
+
+    ext++;
+
+    return strcasecmp(ext, "pcap") == 0 || strcasecmp(ext, "pcapng") == 0 ||
+        strcasecmp(ext, "cap") == 0;
+}
+
+void local_pcap_close_mmap(local_pcap_t *local_pcap) {
+    unsigned int i;
+
+    for (i = 0; i < local_pcap->num_mmap_files; i++)
+        pcap_mmap_close(local_pcap->mmap_files[i]);
+
+    free(local_pcap->mmap_files);
+    local_pcap->mmap_files = NULL;
+    local_pcap->num_mmap_files = 0;
+}
+
+/* Map a capture file, or every capture file in a directory, and read the first
+ * packet of each.  Returns the number of files, or -1 with an error in errstr */
+int local_pcap_open_mmap(local_pcap_t *local_pcap, const char *path, int is_dir, char *errstr) {
+    struct dirent **namelist = NULL;
+    char fpath[PATH_MAX];
+    pcap_mmap_t *pm;
+    int num_names = 0;
+    int n = 1, i;
+
+    local_pcap_close_mmap(local_pcap);
+
+    if (is_dir) {
+        if ((num_names = n = scandir(path, &namelist, pcap_dir_filter, alphasort)) < 0) {
+            snprintf(errstr, PCAP_ERRBUF_SIZE, "Unable to read directory '%s': %s",
+                    path, strerror(errno));
+            return -1;
+        }
+
+        if (n == 0) {
+            snprintf(errstr, PCAP_ERRBUF_SIZE, "No pcap or pcapng files in '%s'", path);
+            free(namelist);
+            return -1;
+        }
+    }
+
+    local_pcap->mmap_files = (pcap_mmap_t **) calloc(n, sizeof(pcap_mmap_t *));
+
+    for (i = 0; i < n; i++) {
+        if (is_dir) {
+            snprintf(fpath, PATH_MAX, "%s/%s", path, namelist[i]->d_name);
+            pm = pcap_mmap_open(fpath, errstr);
+        } else {
+            pm = pcap_mmap_open(path, errstr);
+        }
+
+        if (pm == NULL || pcap_mmap_next(pm, errstr) < 0) {
+            pcap_mmap_close(pm);
+            n = -1;
+            break;
+        }
+
+        local_pcap->mmap_files[local_pcap->num_mmap_files++] = pm;
+    }
+
+    if (namelist != NULL) {
+        for (i = 0; i < num_names; i++)
+            free(namelist[i]);
+        free(namelist);
+    }
+
+    if (n < 0)
+        local_pcap_close_mmap(local_pcap);
+
+    return n;
+}
+
 int probe_callback(kis_capture_handler_t *caph, uint32_t seqno,
         char *definition,
         char *msg, char **uuid,
@@ -119,19 +548,32 @@ int probe_callback(kis_capture_handler_t *caph, uint32_t seqno,
         return 0;
     }
 
-    if (!S_ISREG(sbuf.st_mode)) {
+    if (S_ISDIR(sbuf.st_mode)) {
+        /* A directory is played back as a merge of the capture files in it */
+        struct dirent **namelist;
+        int n, i;
+
+        if ((n = scandir(pcapfname, &namelist, pcap_dir_filter, alphasort)) <= 0) {
+            snprintf(msg, STATUS_MAX, "Directory '%s' has no pcap or pcapng files", pcapfname);
+            return 0;
+        }
+
+        for (i = 0; i < n; i++)
+            free(namelist[i]);
+        free(namelist);
+    } else if (!S_ISREG(sbuf.st_mode)) {
         snprintf(msg, STATUS_MAX, "File '%s' is not a regular file", pcapfname);
         return 0;
-    }
+    } else {
+        pd = pcap_open_offline(pcapfname, errstr);
+        if (strlen(errstr) > 0) {
+            snprintf(msg, STATUS_MAX, "%s", errstr);
+            return -1;
+        }
 
-    pd = pcap_open_offline(pcapfname, errstr);
-    if (strlen(errstr) > 0) {
-        snprintf(msg, STATUS_MAX, "%s", errstr);
-        return -1;
+        pcap_close(pd);
     }
 
-    pcap_close(pd);
-
     if ((placeholder_len = cf_find_flag(&placeholder, "uuid", definition)) > 0) {
         *uuid = strdup(placeholder);
     } else {
@@ -181,6 +623,8 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno,
         local_pcap->pd = NULL;
     }
 
+    local_pcap_close_mmap(local_pcap);
+
     if ((placeholder_len = cf_parse_interface(&placeholder, definition)) <= 0) {
         /* What was not an error during probe definitely is an error during open */
         snprintf(msg, STATUS_MAX, "Unable to find PCAP file name in definition");
@@ -196,17 +640,45 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno,
         return -1;
     }
 
+    local_pcap->ingest_max = 0;
+
+    if ((placeholder_len = cf_find_flag(&placeholder, "ingest", definition)) > 0) {
+        if (strncasecmp(placeholder, "max", placeholder_len) == 0)
+            local_pcap->ingest_max = 1;
+    }
+
     /* We don't check for regular file during open, only probe; we don't want to
      * open a fifo during probe and then cause a glitch, but we could open it during
-     * normal operation */
+     * normal operation.  Only regular files and directories can be mapped, anything
+     * else goes through libpcap even at max speed. */
 
-    local_pcap->pd = pcap_open_offline(pcapfname, errstr);
-    if (strlen(errstr) > 0) {
-        snprintf(msg, STATUS_MAX, "%s", errstr);
-        return -1;
+    if (S_ISDIR(sbuf.st_mode) || (local_pcap->ingest_max && S_ISREG(sbuf.st_mode))) {
+        pcap_mmap_t *pm;
+
+        if (local_pcap_open_mmap(local_pcap, pcapfname, S_ISDIR(sbuf.st_mode), errstr) < 0) {
+            snprintf(msg, STATUS_MAX, "%s", errstr);
+            return -1;
+        }
+
+        /* Report the link type of the first file; every packet carries its own */
+        pm = local_pcap->mmap_files[0];
+
+        if (pm->have_packet)
+            local_pcap->datalink_type = pm->packet_dlt;
+        else if (pm->pcapng)
+            local_pcap->datalink_type = pm->num_if > 0 ? pm->if_dlt[0] : 0;
+        else
+            local_pcap->datalink_type = pm->dlt;
+    } else {
+        local_pcap->pd = pcap_open_offline(pcapfname, errstr);
+        if (strlen(errstr) > 0) {
+            snprintf(msg, STATUS_MAX, "%s", errstr);
+            return -1;
+        }
+
+        local_pcap->datalink_type = pcap_datalink(local_pcap->pd);
     }
 
-    local_pcap->datalink_type = pcap_datalink(local_pcap->pd);
     *dlt = local_pcap->datalink_type;
 
     /* Kluge a UUID out of the name */
@@ -218,7 +690,12 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno,
     *uuid = strdup(errstr);
 
     /* Successful open with no channel, hop, or chanset data */
-    snprintf(msg, STATUS_MAX, "Opened pcapfile '%s' for playback", pcapfname);
+    if (S_ISDIR(sbuf.st_mode))
+        snprintf(msg, STATUS_MAX, "Opened %u pcapfiles in '%s' for playback in timestamp order",
+                local_pcap->num_mmap_files, pcapfname);
+    else
+        snprintf(msg, STATUS_MAX, "Opened pcapfile '%s' for playback%s", pcapfname,
+                local_pcap->ingest_max ? " at maximum speed" : "");
 
     if ((placeholder_len = cf_find_flag(&placeholder, "realtime", definition)) > 0) {
         if (strncasecmp(placeholder, "true", placeholder_len) == 0) {
@@ -240,9 +717,10 @@ int open_callback(kis_capture_handler_t *caph, uint32_t seqno,
     return 1;
 }
 
-void pcap_dispatch_cb(u_char *user, const struct pcap_pkthdr *header,
-        const u_char *data)  {
-    kis_capture_handler_t *caph = (kis_capture_handler_t *) user;
+/* Send a packet, delaying it first for realtime or throttled playback.  Returns -1
+ * if the packet could not be sent and the capture is shutting down. */
+int pcap_send_packet(kis_capture_handler_t *caph, struct timeval ts, int dlt,
+        uint32_t len, uint32_t caplen, const u_char *data) {
     local_pcap_t *local_pcap = (local_pcap_t *) caph->userdata;
     int ret;
     unsigned long delay_usec = 0;
@@ -258,23 +736,23 @@ void pcap_dispatch_cb(u_char *user, const struct pcap_pkthdr *header,
             delay_usec = 0;
         } else {
             /* Catch corrupt pcaps w/ inconsistent times */
-            if (header->ts.tv_sec < local_pcap->last_ts.tv_sec) {
+            if (ts.tv_sec < local_pcap->last_ts.tv_sec) {
                 delay_usec = 0;
             } else {
-                delay_usec = (header->ts.tv_sec - local_pcap->last_ts.tv_sec) * 1000000L;
+                delay_usec = (ts.tv_sec - local_pcap->last_ts.tv_sec) * 1000000L;
             }
 
-            if (header->ts.tv_usec < local_pcap->last_ts.tv_usec) {
+            if (ts.tv_usec < local_pcap->last_ts.tv_usec) {
                 delay_usec += (1000000L - local_pcap->last_ts.tv_usec) +
-                    header->ts.tv_usec;
+                    ts.tv_usec;
             } else {
-                delay_usec += header->ts.tv_usec - local_pcap->last_ts.tv_usec;
+                delay_usec += ts.tv_usec - local_pcap->last_ts.tv_usec;
             }
 
         }
 
-        local_pcap->last_ts.tv_sec = header->ts.tv_sec;
-        local_pcap->last_ts.tv_usec = header->ts.tv_usec;
+        local_pcap->last_ts.tv_sec = ts.tv_sec;
+        local_pcap->last_ts.tv_usec = ts.tv_usec;
 
         if (delay_usec != 0) {
             usleep(delay_usec);
@@ -292,29 +770,15 @@ void pcap_dispatch_cb(u_char *user, const struct pcap_pkthdr *header,
     /* Try repeatedly to send the packet; go into a thread wait state if
      * the write buffer is full & we'll be woken up as soon as it flushes
      * data out in the main select() loop */
-#if defined(__OpenBSD__)
-    /* OpenBSD has bpf_timeval in pcap_pkthdr */
-    struct timeval ts;
-#endif
     while (1) {
-#if defined(__OpenBSD__)
-        ts.tv_sec = header->ts.tv_sec;
-        ts.tv_usec = header->ts.tv_usec;
-#endif
         if ((ret = cf_send_data(caph,
                         NULL, MSGFLAG_INFO, /* no msg */
                         NULL, /* no signal */
                         NULL, /* no gps */
-#if defined(__OpenBSD__)
-                        ts,
-#else
-                        header->ts,
-#endif
-                        local_pcap->datalink_type,
-                        header->len, header->caplen, (uint8_t *) data)) < 0) {
-            pcap_breakloop(local_pcap->pd);
+                        ts, dlt, len, caplen, (uint8_t *) data)) < 0) {
             cf_send_error(caph, 0, "unable to send DATA frame");
             cf_handler_spindown(caph);
+            return -1;
         } else if (ret == 0) {
             /* Go into a wait for the write buffer to get flushed */
             // fprintf(stderr, "debug - pcapfile - dispatch_cb - no room in write buffer - waiting for it to have more space\n");
@@ -324,16 +788,74 @@ void pcap_dispatch_cb(u_char *user, const struct pcap_pkthdr *header,
             break;
         }
     }
+
+    return 1;
+}
+
+void pcap_dispatch_cb(u_char *user, const struct pcap_pkthdr *header,
+        const u_char *data)  {
+    kis_capture_handler_t *caph = (kis_capture_handler_t *) user;
+    local_pcap_t *local_pcap = (local_pcap_t *) caph->userdata;
+
+    /* OpenBSD has bpf_timeval in pcap_pkthdr */
+    struct timeval ts;
+
+    ts.tv_sec = header->ts.tv_sec;
+    ts.tv_usec = header->ts.tv_usec;
+
+    if (pcap_send_packet(caph, ts, local_pcap->datalink_type,
+                header->len, header->caplen, data) < 0)
+        pcap_breakloop(local_pcap->pd);
+}
+
+/* Replay the mapped files, always sending the earliest packet next; returns 0 at
+ * the end of the files, or -1 with an error in errstr */
+int mmap_loop(kis_capture_handler_t *caph, char *errstr) {
+    local_pcap_t *local_pcap = (local_pcap_t *) caph->userdata;
+    pcap_mmap_t *pm, *next;
+    unsigned int i;
+
+    while (1) {
+        next = NULL;
+
+        for (i = 0; i < local_pcap->num_mmap_files; i++) {
+            pm = local_pcap->mmap_files[i];
+
+            if (!pm->have_packet)
+                continue;
+
+            if (next == NULL || timercmp(&pm->ts, &next->ts, <))
+                next = pm;
+        }
+
+        if (next == NULL)
+            return 0;
+
+        if (pcap_send_packet(caph, next->ts, next->packet_dlt,
+                    next->len, next->caplen, next->data) < 0) {
+            snprintf(errstr, PCAP_ERRBUF_SIZE, "unable to send packet");
+            return -1;
+        }
+
+        if (pcap_mmap_next(next, errstr) < 0)
+            return -1;
+    }
 }
 
 void capture_thread(kis_capture_handler_t *caph) {
     local_pcap_t *local_pcap = (local_pcap_t *) caph->userdata;
     char errstr[PCAP_ERRBUF_SIZE];
-    char *pcap_errstr;
+    char pcap_errstr[PCAP_ERRBUF_SIZE] = "";
 
-    pcap_loop(local_pcap->pd, -1, pcap_dispatch_cb, (u_char *) caph);
+    if (local_pcap->num_mmap_files > 0) {
+        mmap_loop(caph, pcap_errstr);
+    } else {
+        pcap_loop(local_pcap->pd, -1, pcap_dispatch_cb, (u_char *) caph);
+        snprintf(pcap_errstr, PCAP_ERRBUF_SIZE, "%s", pcap_geterr(local_pcap->pd));
+    }
 
-    pcap_errstr = pcap_geterr(local_pcap->pd);
+    /* Push out anything still waiting in a batch */
+    cf_flush_batch(caph, 1);
 
     snprintf(errstr, PCAP_ERRBUF_SIZE, "Pcapfile '%s' closed: %s",
             local_pcap->pcapfname,
@@ -359,6 +881,9 @@ int main(int argc, char *argv[]) {
         .last_ts.tv_sec = 0,
         .last_ts.tv_usec = 0,
         .pps_throttle = 0,
+        .ingest_max = 0,
+        .mmap_files = NULL,
+        .num_mmap_files = 0,
     };
 
 #if 0
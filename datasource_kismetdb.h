@@ -48,6 +48,10 @@ public:
         if (in_opt == "retry")
             return "false";
 
+        // Max speed replay sends larger batches
+        if (in_opt == "batch_max" && str_lower(get_definition_opt("ingest")) == "max")
+            return "256";
+
         return "";
     }
     
@@ -46,7 +46,7 @@ int kis_datasource_nrf51822::handle_rx_data_content(kis_packet *packet,
     if (content_sz < 16) {
         packet->error = 1;
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
@@ -64,7 +64,7 @@ int kis_datasource_nrf52840::handle_rx_data_content(kis_packet *packet, kis_data
         if (chunk_start > content_sz || chunk_str_len >= content_sz) {
             packet->error = 1;
             // error, but preserve the packet for logging
-            packet->set_data((const char *) content, content_sz);
+            packet->set_data(nonstd::string_view((const char *) content, content_sz));
             datachunk->set_data(packet->data);
             return 1;
         }
@@ -76,7 +76,7 @@ int kis_datasource_nrf52840::handle_rx_data_content(kis_packet *packet, kis_data
         if (chunk_start > content_sz || chunk_str_len >= content_sz) {
             packet->error = 1;
             // error, but preserve the packet for logging
-            packet->set_data((const char *) content, content_sz);
+            packet->set_data(nonstd::string_view((const char *) content, content_sz));
             datachunk->set_data(packet->data);
             return 1;
         }
@@ -43,7 +43,7 @@ int kis_datasource_nxpkw41z::handle_rx_data_content(kis_packet *packet,
     if (content_sz < 10) {
         packet->error = 1;
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
@@ -71,7 +71,7 @@ int kis_datasource_nxpkw41z::handle_rx_data_content(kis_packet *packet,
         if (content_sz <= 11 || (content_sz - 11 < nxp_payload_len)) {
             packet->error = 1;
             // error, but preserve the packet for logging
-            packet->set_data((const char *) content, content_sz);
+            packet->set_data(nonstd::string_view((const char *) content, content_sz));
             datachunk->set_data(packet->data);
             return 1;
         }
@@ -135,7 +135,7 @@ int kis_datasource_nxpkw41z::handle_rx_data_content(kis_packet *packet,
         if (content_sz <= 13) {
             packet->error = 1;
             // error, but preserve the packet for logging
-            packet->set_data((const char *) content, content_sz);
+            packet->set_data(nonstd::string_view((const char *) content, content_sz));
             datachunk->set_data(packet->data);
             return 1;
         }
@@ -199,7 +199,7 @@ int kis_datasource_nxpkw41z::handle_rx_data_content(kis_packet *packet,
     } else {
         packet->error = 1;
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
@@ -0,0 +1,125 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <algorithm>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "datasource_pcapfile.h"
+#include "util.h"
+
+std::vector<std::string> datasource_pcapfile_builder::expand_definition(const std::string& in_definition) {
+    std::vector<std::string> ret;
+
+    std::string interface;
+    std::vector<opt_pair> opt_vec;
+
+    auto cpos = in_definition.find(":");
+
+    if (cpos == std::string::npos) {
+        interface = in_definition;
+    } else {
+        interface = in_definition.substr(0, cpos);
+        string_to_opts(in_definition.substr(cpos + 1, in_definition.size() - cpos), ",", &opt_vec);
+    }
+
+    // Ordered ingest is merged by the capture binary as a single source
+    if (fetch_opt_bool("ordered", &opt_vec, 0))
+        return ret;
+
+    struct stat sbuf;
+
+    if (stat(interface.c_str(), &sbuf) < 0 || !S_ISDIR(sbuf.st_mode))
+        return ret;
+
+    auto dir = opendir(interface.c_str());
+
+    if (dir == nullptr)
+        return ret;
+
+    std::vector<std::string> files;
+    struct dirent *de;
+
+    while ((de = readdir(dir)) != nullptr) {
+        std::string fname{de->d_name};
+
+        if (fname.length() == 0 || fname[0] == '.')
+            continue;
+
+        auto dpos = fname.rfind(".");
+        if (dpos == std::string::npos)
+            continue;
+
+        auto ext = str_lower(fname.substr(dpos + 1));
+        if (ext != "pcap" && ext != "pcapng" && ext != "cap")
+            continue;
+
+        auto path = fmt::format("{}/{}", interface, fname);
+
+        if (stat(path.c_str(), &sbuf) < 0 || !S_ISREG(sbuf.st_mode))
+            continue;
+
+        files.push_back(fname);
+    }
+
+    closedir(dir);
+
+    // Sources are created in name order so they get the same source numbers on
+    // every run
+    std::sort(files.begin(), files.end());
+
+    auto name = fetch_opt("name", &opt_vec);
+
+    for (const auto& f : files) {
+        std::stringstream opts;
+        bool first = true;
+
+        // Every file gets its own UUID from the file name, and a name derived
+        // from the directory source name if there is one
+        for (const auto& o : opt_vec) {
+            auto key = str_lower(o.opt);
+
+            if (key == "uuid" || key == "name")
+                continue;
+
+            if (!first)
+                opts << ",";
+            first = false;
+
+            if (o.quoted)
+                opts << o.opt << "=\"" << o.val << "\"";
+            else
+                opts << o.opt << "=" << o.val;
+        }
+
+        if (name.length() > 0) {
+            if (!first)
+                opts << ",";
+            opts << "name=" << name << "-" << f;
+        }
+
+        ret.push_back(fmt::format("{}/{}:{}", interface, f, opts.str()));
+    }
+
+    return ret;
+}
+
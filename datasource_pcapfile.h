@@ -43,14 +43,18 @@ public:
     // to do anything else
    
     // Override defaults for pcapfile - we don't want to reload a pcapfile once
-    // it finishes unless we're explicitly told to loop it
+    // it finishes unless we're explicitly told to loop it.  Max speed ingest
+    // sends the largest batches the capture binary supports.
     virtual std::string override_default_option(std::string in_opt) override {
         if (in_opt == "retry")
             return "false";
 
+        if (in_opt == "batch_max" && str_lower(get_definition_opt("ingest")) == "max")
+            return "256";
+
         return "";
     }
-    
+
 };
 
 
@@ -86,6 +90,10 @@ public:
         return shared_datasource_pcapfile(new kis_datasource_pcapfile(in_sh_this));
     }
 
+    // A directory opens a source per capture file, so they're ingested in parallel,
+    // unless the files are to be merged in timestamp order by a single source
+    virtual std::vector<std::string> expand_definition(const std::string& in_definition) override;
+
     virtual void initialize() override {
         // Set up our basic parameters for the pcapfile driver
         
@@ -24,7 +24,7 @@ int kis_datasource_rzkillerbee::handle_rx_data_content(kis_packet *packet,
     if (content_sz < 9) {
         packet->error = 1;
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
@@ -35,7 +35,7 @@ int kis_datasource_rzkillerbee::handle_rx_data_content(kis_packet *packet,
         if (content_sz < rz_payload_len + 9) {
             packet->error = 1;
             // error, but preserve the packet for logging
-            packet->set_data((const char *) content, content_sz);
+            packet->set_data(nonstd::string_view((const char *) content, content_sz));
             datachunk->set_data(packet->data);
             return 1;
         }
@@ -91,7 +91,7 @@ int kis_datasource_rzkillerbee::handle_rx_data_content(kis_packet *packet,
         return 1;
     } else {
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
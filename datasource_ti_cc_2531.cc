@@ -26,7 +26,7 @@ int kis_datasource_ticc2531::handle_rx_data_content(kis_packet *packet, kis_data
     if (content_sz < 8) {
         packet->error = 1;
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
@@ -35,7 +35,7 @@ int kis_datasource_ticc2531::handle_rx_data_content(kis_packet *packet, kis_data
     if (cc_len != content_sz - 3) {
         packet->error = 1;
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
@@ -43,7 +43,7 @@ int kis_datasource_ticc2531::handle_rx_data_content(kis_packet *packet, kis_data
     unsigned int cc_payload_len = content[7] - 0x02;
     if ((cc_payload_len + 8 != content_sz - 2) || (cc_payload_len > 104)) {
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
@@ -106,7 +106,7 @@ int kis_datasource_ticc2531::handle_rx_data_content(kis_packet *packet, kis_data
     } else {
         packet->error = 1;
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
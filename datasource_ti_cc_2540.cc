@@ -47,7 +47,7 @@ int kis_datasource_ticc2540::handle_rx_data_content(kis_packet *packet, kis_data
     if (content_sz < 8) {
         packet->error = 1;
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
@@ -56,7 +56,7 @@ int kis_datasource_ticc2540::handle_rx_data_content(kis_packet *packet, kis_data
     if (cc_len != content_sz - 3) {
         packet->error = 1;
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
@@ -65,7 +65,7 @@ int kis_datasource_ticc2540::handle_rx_data_content(kis_packet *packet, kis_data
     if (cc_payload_len + 8 != content_sz - 2) {
         packet->error = 1;
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
@@ -60,7 +60,7 @@ int kis_datasource_ubertooth_one::handle_rx_data_content(kis_packet *packet, kis
     if (content_sz != sizeof(usb_pkt_rx)) {
         packet->error = 1;
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
@@ -72,7 +72,7 @@ int kis_datasource_ubertooth_one::handle_rx_data_content(kis_packet *packet, kis
     if (payload_len > DMA_SIZE) {
         packet->error = 1;
         // error, but preserve the packet for logging
-        packet->set_data((const char *) content, content_sz);
+        packet->set_data(nonstd::string_view((const char *) content, content_sz));
         datachunk->set_data(packet->data);
         return 1;
     }
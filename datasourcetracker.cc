@@ -512,6 +512,8 @@ void datasource_tracker::trigger_deferred_startup() {
 
     config_defaults->set_remote_cap_timestamp(Globalreg::globalreg->kismet_config->fetch_opt_bool("override_remote_timestamp", true));
 
+    compile_prefilter();
+
     // Register js module for UI
     std::shared_ptr<kis_httpd_registry> httpregistry =
         Globalreg::fetch_mandatory_global_as<kis_httpd_registry>("WEBREGISTRY");
@@ -1194,6 +1196,130 @@ void datasource_tracker::trigger_deferred_startup() {
     return;
 }
 
+void datasource_tracker::compile_prefilter() {
+    std::array<uint16_t, 4> dot11_types{};
+    std::vector<std::tuple<uint8_t, uint64_t, uint64_t>> macs;
+
+    for (const auto& t : Globalreg::globalreg->kismet_config->fetch_opt_vec("source_prefilter_dot11")) {
+        auto v = str_tokenize(t, ",");
+        auto type = v.size() > 0 ? str_lower(v[0]) : "";
+        unsigned int subtype;
+        int type_n;
+
+        if (type == "management" || type == "mgmt")
+            type_n = 0;
+        else if (type == "control" || type == "ctrl")
+            type_n = 1;
+        else if (type == "data")
+            type_n = 2;
+        else
+            type_n = -1;
+
+        if (type_n < 0 || v.size() > 2) {
+            _MSG_ERROR("Invalid source_prefilter_dot11={}, expected type[,subtype] where type is "
+                    "management, control, or data", t);
+            continue;
+        }
+
+        if (v.size() == 1) {
+            dot11_types[type_n] = 0xFFFF;
+            continue;
+        }
+
+        if (sscanf(v[1].c_str(), "%u", &subtype) != 1 || subtype > 15) {
+            _MSG_ERROR("Invalid source_prefilter_dot11={}, expected a subtype from 0 to 15", t);
+            continue;
+        }
+
+        dot11_types[type_n] |= (1 << subtype);
+    }
+
+    for (const auto& m : Globalreg::globalreg->kismet_config->fetch_opt_vec("source_prefilter_mac")) {
+        auto v = str_tokenize(m, ",");
+        uint8_t role;
+
+        if (v.size() != 2) {
+            _MSG_ERROR("Invalid source_prefilter_mac={}, expected addresstype,macaddress", m);
+            continue;
+        }
+
+        auto role_s = str_lower(v[0]);
+
+        if (role_s == "source")
+            role = KIS_EXTERNAL_V3_PREFILTER_ROLE_SOURCE;
+        else if (role_s == "destination")
+            role = KIS_EXTERNAL_V3_PREFILTER_ROLE_DEST;
+        else if (role_s == "network")
+            role = KIS_EXTERNAL_V3_PREFILTER_ROLE_NETWORK;
+        else if (role_s == "any")
+            role = KIS_EXTERNAL_V3_PREFILTER_ROLE_ANY;
+        else {
+            _MSG_ERROR("Invalid source_prefilter_mac={}, expected source, destination, "
+                    "network, or any address type", m);
+            continue;
+        }
+
+        auto mac = mac_addr(v[1]);
+
+        if (mac.error() || mac.length() != 6) {
+            _MSG_ERROR("Invalid source_prefilter_mac={}, expected a MAC address", m);
+            continue;
+        }
+
+        auto mask = mac.maskbits == 0 ? 0 : mac.bits_to_mask(mac.maskbits);
+
+        macs.push_back(std::make_tuple(role, mac.longmac & mask, mask));
+    }
+
+    prefilter.clear();
+
+    if (macs.size() == 0 &&
+            std::all_of(dot11_types.begin(), dot11_types.end(), [](uint16_t t) { return t == 0; }))
+        return;
+
+    char *data = nullptr;
+    size_t size;
+    mpack_writer_t writer;
+
+    mpack_writer_init_growable(&writer, &data, &size);
+
+    mpack_build_map(&writer);
+
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_PREFILTER_FIELD_DOT11_TYPES);
+    mpack_start_array(&writer, dot11_types.size());
+    for (auto t : dot11_types)
+        mpack_write_u16(&writer, t);
+    mpack_finish_array(&writer);
+
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_PREFILTER_FIELD_MACS);
+    mpack_start_array(&writer, macs.size());
+    for (const auto& r : macs) {
+        mpack_start_array(&writer, 3);
+        mpack_write_u8(&writer, std::get<0>(r));
+        mpack_write_u64(&writer, std::get<1>(r));
+        mpack_write_u64(&writer, std::get<2>(r));
+        mpack_finish_array(&writer);
+    }
+    mpack_finish_array(&writer);
+
+    mpack_complete_map(&writer);
+
+    if (mpack_writer_destroy(&writer) != mpack_ok) {
+        _MSG_ERROR("Failed to compile the capture source prefilter, packets will not be "
+                "filtered by capture sources");
+        if (data != nullptr)
+            free(data);
+        return;
+    }
+
+    prefilter = std::string(data, size);
+    free(data);
+
+    _MSG_INFO("Capture sources will drop packets matching {} address(es) and {} 802.11 frame "
+            "type(s) before sending them", macs.size(),
+            std::count_if(dot11_types.begin(), dot11_types.end(), [](uint16_t t) { return t != 0; }));
+}
+
 void datasource_tracker::trigger_deferred_shutdown() {
     kis_lock_guard<kis_mutex> lk(dst_lock, "dst trigger_deferred_shutdown");
 
@@ -1366,6 +1492,15 @@ void datasource_tracker::open_datasource(const std::string& in_source,
             return;
         }
 
+        // Some drivers open several sources from one definition
+        auto expanded = proto->expand_definition(in_source);
+
+        if (expanded.size() > 0) {
+            for (const auto& e : expanded)
+                open_datasource(e, proto, in_cb);
+            return;
+        }
+
         // Open the source with the processed options
         open_datasource(in_source, proto, in_cb);
         return;
@@ -1938,7 +2073,9 @@ double datasource_tracker::string_to_rate(std::string in_str, double in_default)
 
 
 dst_incoming_remote::dst_incoming_remote(callback_t in_cb) :
-    kis_datasource() {
+    kis_datasource(),
+    mux_allowed{false},
+    mux_session{false} {
 
     cb = in_cb;
 
@@ -2004,6 +2141,12 @@ bool dst_incoming_remote::dispatch_rx_packet_v3(std::shared_ptr<boost::asio::str
         return true;
     }
 
+    if (command == KIS_EXTERNAL_V3_CMD_MUX) {
+        // dispatch is called with the code and sequence number swapped
+        handle_packet_mux_v3(buffer, seqno, content);
+        return true;
+    }
+
     if (kis_external_interface::dispatch_rx_packet_v3(buffer, command, seqno, code, content)) {
         return true;
     }
@@ -2057,8 +2200,91 @@ void dst_incoming_remote::handle_packet_newsource_v3(uint32_t in_seqno, uint16_t
     kill();
 }
 
+void dst_incoming_remote::handle_packet_mux_v3(std::shared_ptr<boost::asio::streambuf> buffer,
+        uint16_t in_channel, nonstd::string_view in_packet) {
+
+    if (!mux_allowed || io_ == nullptr) {
+        _MSG_ERROR("Incoming remote capture connection sent a multiplexed frame, but "
+                "multiplexing is only supported on the remote capture TCP socket.");
+        trigger_error("unsupported multiplexed frame");
+        return;
+    }
+
+    if (!mux_session) {
+        // The connection stays with us as a session, so the setup timeout no
+        // longer applies
+        mux_session = true;
+        timetracker->remove_timer(timerid);
+
+        _MSG_INFO("Incoming remote capture connection is a multiplexed session");
+    }
+
+    if (in_packet.length() < sizeof(kismet_external_frame_v3_t)) {
+        _MSG_ERROR("Multiplexed remote capture session got a truncated frame on channel {}",
+                in_channel);
+        trigger_error("invalid multiplexed frame");
+        return;
+    }
+
+    auto ci = mux_channels.find(in_channel);
+
+    if (ci != mux_channels.end() && ci->second->stopped()) {
+        mux_channels.erase(ci);
+        ci = mux_channels.end();
+    }
+
+    if (ci != mux_channels.end()) {
+        auto iface = ci->second->interface_;
+
+        if (iface == nullptr)
+            return;
+
+        auto r = iface->handle_packet(in_packet.data(), in_packet.length(), buffer);
+
+        // A bad frame only takes down the source on this channel
+        if (r < 0 || r == result_handle_packet_needbuf)
+            iface->trigger_error("invalid frame on multiplexed channel");
+
+        return;
+    }
+
+    // A new channel has to announce its source before anything else; frames left
+    // over from a source which was closed are dropped
+    auto frame = reinterpret_cast<const kismet_external_frame_v3_t *>(in_packet.data());
+
+    if (kis_ntoh16(frame->pkt_type) != KIS_EXTERNAL_V3_KDS_NEWSOURCE)
+        return;
+
+    // Each channel gets its own incoming remote to resolve the source, exactly
+    // like a dedicated connection would
+    auto channel_remote = std::make_shared<dst_incoming_remote>(cb);
+    auto channel_io = std::make_shared<kis_external_mux_io>(channel_remote, io_, in_channel);
+
+    mux_channels[in_channel] = channel_io;
+
+    channel_remote->attach_io(channel_io);
+    channel_remote->handle_packet(in_packet.data(), in_packet.length(), buffer);
+}
+
 void dst_incoming_remote::handle_error(const std::string& error) {
-    _MSG_ERROR("(DST SETUP REMOTE ERROR) {}", error);
+    if (mux_session) {
+        _MSG_ERROR("(DST REMOTE MULTIPLEXED SESSION ERROR) {}", error);
+
+        // Every source on the session loses its connection with it
+        auto channels = std::move(mux_channels);
+        mux_channels.clear();
+
+        for (const auto& c : channels) {
+            auto iface = c.second->interface_;
+
+            c.second->close();
+
+            if (iface != nullptr)
+                iface->trigger_error("multiplexed remote capture connection closed");
+        }
+    } else {
+        _MSG_ERROR("(DST SETUP REMOTE ERROR) {}", error);
+    }
 
     kill();
 }
@@ -2115,6 +2341,7 @@ void datasource_tracker_remote_server::handle_accept(const boost::system::error_
                     datasourcetracker->open_remote_datasource(initiator, in_type, in_def, in_uuid, true);
                     });
 
+        remote->allow_multiplex();
         remote->attach_tcp_socket(socket);
     }
 }
@@ -385,6 +385,12 @@ public:
     // Access the defaults
     std::shared_ptr<datasource_tracker_defaults> get_config_defaults();
 
+    // Capture-side prefilter sub-block compiled from the config, sent to sources when
+    // they're opened; empty when no prefilter rules are configured
+    const std::string& get_prefilter() const {
+        return prefilter;
+    }
+
     // Merge a source into the source list, preserving UUID and source number
     virtual void merge_source(shared_datasource in_source);
 
@@ -464,6 +470,10 @@ protected:
 
     std::shared_ptr<datasource_tracker_defaults> config_defaults;
 
+    // Compile the source_prefilter_ rules into a prefilter sub-block
+    void compile_prefilter();
+    std::string prefilter;
+
     // Re-assign channel hopping because we've opened a new source
     // and want to do channel split
     void calculate_source_hopping(shared_datasource in_ds);
@@ -490,6 +500,10 @@ struct dst_websocket_ds_bridge {
 // simple packet protocol enough to get a NEWSOURCE command; The resulting source
 // type, definition, uuid, and rbufhandler is passed to the callback function; the cb
 // is responsible for looking up the type, closing the connection if it is invalid, etc.
+//
+// A connection which starts with a MUX frame instead becomes a multiplexed session;
+// the incoming remote stays attached to the connection and hands each channel to
+// its own source, which is announced with a NEWSOURCE on the channel.
 class dst_incoming_remote : public kis_datasource {
 public:
     using callback_t = std::function<void (dst_incoming_remote *, std::string, std::string, uuid)>;
@@ -508,6 +522,13 @@ public:
             uint16_t command, uint16_t code, uint32_t seqno,
             const nonstd::string_view& content) override;
     virtual void handle_packet_newsource_v3(uint32_t in_seqno, uint16_t in_code, nonstd::string_view in_packet);
+    virtual void handle_packet_mux_v3(std::shared_ptr<boost::asio::streambuf> buffer,
+            uint16_t in_channel, nonstd::string_view in_packet);
+
+    // Accept multiplexed sessions on this connection
+    void allow_multiplex() {
+        mux_allowed = true;
+    }
 
     virtual void handle_msg_proxy(const std::string& msg, const int msgtype) override {
         _MSG(fmt::format("(Remote) - {}", msg), msgtype);
@@ -528,6 +549,11 @@ protected:
     callback_t cb;
 
     std::thread handshake_thread;
+
+    // Channels of a multiplexed session, only touched from the connection strand
+    bool mux_allowed;
+    bool mux_session;
+    std::map<uint16_t, std::shared_ptr<kis_external_mux_io>> mux_channels;
 };
 
 
@@ -65,11 +65,22 @@ device_tracker::device_tracker() :
 
     phy_mutex.set_name("device_tracker::phy_mutex");
     devicelist_mutex.set_name("devicetracker::devicelist");
+    shard_update_mutex.set_name("devicetracker::shard_update");
 
     next_phy_id = 0;
 
-    // create a vector
-    immutable_tracked_vec = std::make_shared<tracker_element_vector>();
+    // Split the device list into a power-of-two number of lock-striped shards
+    auto num_shards =
+        Globalreg::globalreg->kismet_config->fetch_opt_uint("tracker_device_shards", 16);
+
+    device_shard_bits = 0;
+    while ((1U << device_shard_bits) < num_shards && device_shard_bits < 10)
+        device_shard_bits++;
+
+    for (unsigned int s = 0; s < (1U << device_shard_bits); s++)
+        device_shards.push_back(std::make_unique<device_shard>());
+
+    devicelist_mutex.set_stripes(device_shards.size());
 
     entrytracker =
         Globalreg::fetch_mandatory_global_as<entry_tracker>();
@@ -168,7 +179,7 @@ device_tracker::device_tracker() :
         packetchain->register_handler([](void *auxdata, const std::shared_ptr<kis_packet>& in_packet) -> int {
 				auto devicetracker = reinterpret_cast<device_tracker *>(auxdata);
                 return devicetracker->common_tracker(in_packet);
-            }, this, CHAINPOS_TRACKER, -100);
+            }, this, CHAINPOS_TRACKER, -100, "devicetracker common_tracker");
 
 
     // Post any events related to the device generated during tracking mode
@@ -182,7 +193,7 @@ device_tracker::device_tracker() :
 				for (const auto& e : in_packet->process_complete_events)
 					devicetracker->eventbus->publish(e);
 				return 1;
-        }, this, CHAINPOS_TRACKER, 0x7FFFFFFF);
+        }, this, CHAINPOS_TRACKER, 0x7FFFFFFF, "devicetracker tracking complete events");
 
     if (!Globalreg::globalreg->kismet_config->fetch_opt_bool("track_device_rrds", true)) {
         _MSG("Not tracking historical packet data to save RAM", MSGFLAG_INFO);
@@ -257,7 +268,8 @@ device_tracker::device_tracker() :
     unsigned int preload_sz = 
         Globalreg::globalreg->kismet_config->fetch_opt_uint("tracker_device_presize", 1000);
 
-    immutable_tracked_vec->reserve(preload_sz);
+    for (const auto& s : device_shards)
+        s->immutable_tracked_vec->reserve(preload_sz / device_shards.size() + 1);
 
     // Set up the device timeout
     device_idle_expiration =
@@ -347,7 +359,10 @@ device_tracker::device_tracker() :
             std::make_shared<kis_net_web_tracked_endpoint>(
                 [this](shared_con con) -> std::shared_ptr<tracker_element> {
                     auto device_ro = std::make_shared<tracker_element_vector>();
-                    device_ro->set(immutable_tracked_vec->begin(), immutable_tracked_vec->end());
+                    for (const auto& s : device_shards)
+                        for (const auto& d : *s->immutable_tracked_vec)
+                            if (d != nullptr)
+                                device_ro->push_back(d);
                     return device_ro;
                 }, get_devicelist_mutex()));
 
@@ -366,7 +381,17 @@ device_tracker::device_tracker() :
                         throw std::runtime_error("nonexistent device key");
 
                     return dev;
-                }, get_devicelist_mutex()));
+                },
+                [this](shared_con con) -> kis_mutex& {
+                    // Only the shard holding the device needs to be locked
+                    auto key_k = con->uri_params().find(":key");
+                    auto devkey = string_to_n<device_key>(key_k->second);
+
+                    if (devkey.get_error())
+                        return get_devicelist_mutex();
+
+                    return get_device_shard_mutex(devkey);
+                }));
 
     httpd->register_route("/devices/by-mac/:mac/devices", {"GET", "POST"}, httpd->RO_ROLE, {},
             std::make_shared<kis_net_web_tracked_endpoint>(
@@ -379,12 +404,20 @@ device_tracker::device_tracker() :
 
                     auto devvec = std::make_shared<tracker_element_vector>();
 
-                    const auto mmp = tracked_mac_multimap.equal_range(mac);
-                    for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi)
-                        devvec->push_back(mmpi->second);
+                    for (const auto& d : fetch_devices(mac))
+                        devvec->push_back(d);
 
                     return devvec;
-                }, get_devicelist_mutex()));
+                },
+                [this](shared_con con) -> kis_mutex& {
+                    auto mac_k = con->uri_params().find(":mac");
+                    auto mac = string_to_n<mac_addr>(mac_k->second);
+
+                    if (mac.error())
+                        return get_devicelist_mutex();
+
+                    return get_device_shard_mutex(mac);
+                }));
 
     httpd->register_route("/devices/last-time/:timestamp/devices", {"GET", "POST"}, httpd->RO_ROLE, {},
             std::make_shared<kis_net_web_tracked_endpoint>(
@@ -715,7 +748,7 @@ device_tracker::device_tracker() :
 
                                                     do_device_work(worker);
                                                 } else if (!dev_k.get_error()) {
-                                                    kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "ws monitor timer serialize lambda");
+                                                    kis_lock_guard<kis_mutex> lk(get_device_shard_mutex(dev_k), "ws monitor timer serialize lambda");
 
                                                     auto dev = fetch_device(dev_k);
                                                     if (dev != nullptr) {
@@ -727,13 +760,12 @@ device_tracker::device_tracker() :
                                                         }
                                                     }
                                                 } else if (!dev_m.error()) {
-                                                    kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "ws monitor timer serialize lambda");
+                                                    kis_lock_guard<kis_mutex> lk(get_device_shard_mutex(dev_m), "ws monitor timer serialize lambda");
 
-                                                    const auto mmp = tracked_mac_multimap.equal_range(dev_m);
-                                                    for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-                                                        if (mmpi->second->get_mod_time() > last_tm) {
+                                                    for (const auto& d : fetch_devices(dev_m)) {
+                                                        if (d->get_mod_time() > last_tm) {
                                                             std::stringstream ss;
-                                                            entrytracker->serialize_with_json_summary(format_t, ss, mmpi->second, json);
+                                                            entrytracker->serialize_with_json_summary(format_t, ss, d, json);
                                                             auto data = ss.str();
                                                             ws->write(data);
                                                         }
@@ -919,8 +951,10 @@ device_tracker::~device_tracker() {
     for (auto p : phy_handler_map)
         delete(p.second);
 
-    immutable_tracked_vec->clear();
-    tracked_mac_multimap.clear();
+    for (const auto& s : device_shards) {
+        s->immutable_tracked_vec->clear();
+        s->tracked_mac_multimap.clear();
+    }
 }
 
 void device_tracker::macdevice_timer_event() {
@@ -986,9 +1020,14 @@ std::string device_tracker::fetch_phy_name(int in_phy) {
 }
 
 int device_tracker::fetch_num_devices() {
-    kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker fetch_num_devices");
+    int num = 0;
 
-    return tracked_map.size();
+    for (size_t s = 0; s < device_shards.size(); s++) {
+        kis_lock_guard<kis_mutex> lk(devicelist_mutex.get_stripe(s), "device_tracker fetch_num_devices");
+        num += device_shards[s]->tracked_map.size();
+    }
+
+    return num;
 }
 
 int device_tracker::fetch_num_packets() {
@@ -1053,20 +1092,17 @@ void device_tracker::update_full_refresh() {
 }
 
 std::shared_ptr<kis_tracked_device_base> device_tracker::fetch_device(const device_key& in_key) {
-    kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker fetch_device");
-
-	device_itr i = tracked_map.find(in_key);
+    kis_lock_guard<kis_mutex> lk(get_device_shard_mutex(in_key), "device_tracker fetch_device");
 
-	if (i != tracked_map.end())
-		return i->second;
-
-	return NULL;
+    return fetch_device_nr(in_key);
 }
 
 std::shared_ptr<kis_tracked_device_base> device_tracker::fetch_device_nr(const device_key& in_key) {
-	device_itr i = tracked_map.find(in_key);
+    auto& shard = get_device_shard(in_key);
+
+	device_itr i = shard.tracked_map.find(in_key);
 
-	if (i != tracked_map.end())
+	if (i != shard.tracked_map.end())
 		return i->second;
 
 	return NULL;
@@ -1074,17 +1110,150 @@ std::shared_ptr<kis_tracked_device_base> device_tracker::fetch_device_nr(const d
 
 // Fetch one or more devices by mac address or mac mask
 std::vector<std::shared_ptr<kis_tracked_device_base>> device_tracker::fetch_devices(const mac_addr& in_mac) {
-    kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker fetch_device mac");
     std::vector<std::shared_ptr<kis_tracked_device_base>> ret;
-   
-    const auto mmp = tracked_mac_multimap.equal_range(in_mac);
-    for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-        ret.push_back(mmpi->second);
+
+    // A complete MAC can only be in one shard, a masked MAC could be in any of them
+    size_t first_shard = 0;
+    size_t last_shard = device_shards.size();
+
+    if (in_mac.maskbits == 64) {
+        first_shard = device_shard_index(in_mac.longmac);
+        last_shard = first_shard + 1;
+    }
+
+    for (size_t s = first_shard; s < last_shard; s++) {
+        kis_lock_guard<kis_mutex> lk(devicelist_mutex.get_stripe(s), "device_tracker fetch_device mac");
+
+        const auto mmp = device_shards[s]->tracked_mac_multimap.equal_range(in_mac);
+        for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
+            ret.push_back(mmpi->second);
+        }
     }
 
     return ret;
 }
 
+void device_tracker::for_each_device_shard(const std::function<void (const std::shared_ptr<tracker_element_vector>&)>& fn) {
+    for (size_t s = 0; s < device_shards.size(); s++) {
+        kis_lock_guard<kis_mutex> lk(devicelist_mutex.get_stripe(s), "device_tracker for_each_device_shard");
+        fn(device_shards[s]->immutable_tracked_vec);
+    }
+}
+
+device_shard_locker::device_shard_locker(device_tracker *tracker, kis_phy_handler *phy,
+        const std::shared_ptr<kis_packet>& in_pack,
+        std::initializer_list<mac_addr> macs, bool create, const std::string& op) :
+    tracker{tracker},
+    op{op},
+    num_shards{0},
+    list_locked{false} {
+
+    // Setting device tags locks the device list itself
+    bool need_list = in_pack->has(tracker->pack_comp_devicetag) || macs.size() > max_shards;
+
+    if (!need_list) {
+        for (const auto& m : macs) {
+            if (m.longmac == 0)
+                continue;
+
+            // A masked MAC can match devices in any shard
+            if (m.maskbits != 64) {
+                need_list = true;
+                break;
+            }
+
+            shards[num_shards++] = tracker->device_shard_index(m.longmac);
+        }
+    }
+
+    if (!need_list) {
+        std::sort(shards.begin(), shards.begin() + num_shards);
+        num_shards = std::unique(shards.begin(), shards.begin() + num_shards) - shards.begin();
+
+        for (size_t s = 0; s < num_shards; s++)
+            tracker->devicelist_mutex.get_stripe(shards[s]).lock();
+
+        if (create) {
+            for (const auto& m : macs) {
+                if (m.longmac == 0)
+                    continue;
+
+                if (tracker->fetch_device_nr(device_key(phy->fetch_phyname_hash(), m)) == nullptr) {
+                    need_list = true;
+                    break;
+                }
+            }
+        }
+
+        if (!need_list)
+            return;
+
+        unlock_shards();
+    }
+
+    tracker->devicelist_mutex.lock();
+    list_locked = true;
+}
+
+device_shard_locker::~device_shard_locker() {
+    if (list_locked)
+        tracker->devicelist_mutex.unlock();
+    else
+        unlock_shards();
+}
+
+void device_shard_locker::lock_devicelist() {
+    if (list_locked)
+        return;
+
+    unlock_shards();
+
+    tracker->devicelist_mutex.lock();
+    list_locked = true;
+}
+
+void device_shard_locker::unlock_shards() {
+    while (num_shards > 0)
+        tracker->devicelist_mutex.get_stripe(shards[--num_shards]).unlock();
+}
+
+void device_tracker::insert_device_nr(const std::shared_ptr<kis_tracked_device_base>& device) {
+    auto s = device_shard_index(device->get_key().get_dkey());
+    auto& shard = *device_shards[s];
+
+    // Device ID encodes the next slot in the shard vector so a new device always gets
+    // put in it's numbered slot
+    device->set_kis_internal_id((shard.immutable_tracked_vec->size() << device_shard_bits) | s);
+
+    shard.tracked_map[device->get_key()] = device;
+    shard.immutable_tracked_vec->push_back(device);
+    shard.tracked_mac_multimap.emplace(device->get_macaddr(), device);
+}
+
+void device_tracker::remove_device_nr(const std::shared_ptr<kis_tracked_device_base>& device) {
+    auto& shard = get_device_shard(device->get_key());
+
+    device_itr mi = shard.tracked_map.find(device->get_key());
+    if (mi != shard.tracked_map.end())
+        shard.tracked_map.erase(mi);
+
+    // Erase it from the multimap
+    auto mmp = shard.tracked_mac_multimap.equal_range(device->get_macaddr());
+
+    for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
+        if (mmpi->second->get_key() == device->get_key()) {
+            shard.tracked_mac_multimap.erase(mmpi);
+            break;
+        }
+    }
+
+    // Forget the immutable vec pointer to it, but keep its position; we need
+    // the slot to match the device ID
+    auto slot = device->get_kis_internal_id() >> device_shard_bits;
+    if (slot < shard.immutable_tracked_vec->size())
+        (shard.immutable_tracked_vec->begin() + slot)->reset();
+}
+
 int device_tracker::common_tracker(const std::shared_ptr<kis_packet>& in_pack) {
     kis_lock_guard<kis_mutex> lk(phy_mutex, "device_tracker common_tracker");
 
@@ -1163,11 +1332,6 @@ std::shared_ptr<kis_tracked_device_base>
             const mac_addr& in_mac, kis_phy_handler *in_phy, const std::shared_ptr<kis_packet>& in_pack,
             unsigned int in_flags, const std::string& in_basic_type) {
 
-    // Updating devices can only happen in serial because we don't know that a device is being
-    // created & we don't know how to append the data until we get to the end of processing
-    // so the entire chain is perforce locked
-    kis_lock_guard<kis_mutex> lg(get_devicelist_mutex(), "device_tracker update_common_device");
-
     std::stringstream sstr;
 
     bool new_device = false;
@@ -1183,16 +1347,41 @@ std::shared_ptr<kis_tracked_device_base>
 
     key = device_key(in_phy->fetch_phyname_hash(), in_mac);
 
-	if ((device = fetch_device_nr(key)) == NULL) {
+    // Updating an existing device only needs the shard holding it; adding a device, or
+    // setting tags (which locks the device list itself) needs the whole device list.  A
+    // thread holding only a shard may not take the device list, so drop the shard first
+    // and look again once the whole list is held.  If the caller already holds the
+    // device list, all of this is simply recursive; callers holding shards through a
+    // device_shard_locker only get here for devices which already exist, since the
+    // locker takes the whole list when a device will be created.
+    kis_unique_lock<kis_mutex> shard_lk(get_device_shard_mutex(key), std::defer_lock,
+            "device_tracker update_common_device");
+    kis_unique_lock<kis_mutex> list_lk(get_devicelist_mutex(), std::defer_lock,
+            "device_tracker update_common_device");
+
+    if (pack_tags == nullptr) {
+        shard_lk.lock("device_tracker update_common_device");
+        device = fetch_device_nr(key);
+
+        if (device == nullptr) {
+            shard_lk.unlock();
+
+            if (in_flags & UCD_UPDATE_EXISTING_ONLY)
+                return NULL;
+        }
+    }
+
+    if (device == nullptr) {
+        list_lk.lock("device_tracker update_common_device");
+        device = fetch_device_nr(key);
+    }
+
+	if (device == NULL) {
         if (in_flags & UCD_UPDATE_EXISTING_ONLY)
             return NULL;
 
         device = std::make_shared<kis_tracked_device_base>(device_builder.get());
 
-        // Device ID is the size of the vector so a new device always gets put
-        // in it's numbered slot
-        device->set_kis_internal_id(immutable_tracked_vec->size());
-
         device->set_key(key);
 
         device->set_macaddr(in_mac);
@@ -1253,6 +1442,7 @@ std::shared_ptr<kis_tracked_device_base>
                            device->get_channel(), alrt);
             }
             if (k->second & 0x2) {
+                kis_lock_guard<kis_mutex> lk(shard_update_mutex, "device_tracker update_common_device");
                 macdevice_flagged_vec.push_back(device);
             }
         }
@@ -1399,8 +1589,16 @@ std::shared_ptr<kis_tracked_device_base>
             device->inc_seenby_count(pack_datasrc->ref_source, in_pack->ts.tv_sec, 0, 0, false);
         }
 
-        if (map_seenby_views)
-            update_view_device(device);
+        // Views are shared by every shard; readers of a view hold the whole device list,
+        // so serializing against other shard holders is enough here
+        if (map_seenby_views) {
+            kis_lock_guard<kis_mutex> lk(shard_update_mutex, "device_tracker update_common_device");
+
+            for (const auto& i : *view_vec) {
+                auto vi = dynamic_cast<device_tracker_view *>(i.get());
+                vi->update_device(device);
+            }
+        }
 
         if (sc != nullptr)
             delete(sc);
@@ -1417,12 +1615,7 @@ std::shared_ptr<kis_tracked_device_base>
 
     if (new_device) {
         // Add the new device to the list
-        tracked_map[key] = device;
-
-        immutable_tracked_vec->push_back(device);
-
-        auto mm_pair = std::make_pair(in_mac, device);
-        tracked_mac_multimap.insert(mm_pair);
+        insert_device_nr(device);
 
         // If we have no packet info, add it to the device list immediately,
         // otherwise, flag the packet to trigger a new device event at the
@@ -1464,110 +1657,119 @@ std::shared_ptr<tracker_element_vector> device_tracker::do_device_work(device_tr
 }
 
 std::shared_ptr<tracker_element_vector> device_tracker::do_readonly_device_work(device_tracker_view_worker& worker) {
-    return all_view->do_readonly_device_work(worker);
-}
+    // Walk the shards directly instead of copying the all-devices view under the
+    // whole device list lock
+    auto ret = std::make_shared<tracker_element_vector>();
 
-// Simple std::sort comparison function to order by the least frequently
-// seen devices
-bool devicetracker_sort_lastseen(const std::shared_ptr<tracker_element>& a,
-    const std::shared_ptr<tracker_element>& b) {
-    
-    if (a == nullptr)
-        return true;
-    if (b == nullptr)
-        return true;
+    for_each_device_shard([&worker, &ret](const std::shared_ptr<tracker_element_vector>& devices) {
+            for (const auto& i : *devices) {
+                if (i == nullptr)
+                    continue;
+
+                auto dev = std::static_pointer_cast<kis_tracked_device_base>(i);
 
-    return dynamic_cast<kis_tracked_device_base *>(a.get())->get_last_time() <
-        dynamic_cast<kis_tracked_device_base *>(b.get())->get_last_time();
+                if (worker.match_device(dev))
+                    ret->push_back(dev);
+            }
+        });
+
+    worker.set_matched_devices(ret);
+
+    worker.finalize();
+
+    return ret;
 }
 
 void device_tracker::timetracker_event(int eventid) {
     if (eventid == device_idle_timer) {
-        kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker timetracker_event device_idle_timer");
-
         time_t ts_now = Globalreg::globalreg->last_tv_sec;
-        bool purged = false;
 
-        // Reset the smart pointer of any devices we're dropping from the device list
-        for (size_t pi = 0; pi < immutable_tracked_vec->size(); pi++) {
-            auto d = std::static_pointer_cast<kis_tracked_device_base>(*(immutable_tracked_vec->begin() + pi));
-
-            if (d == nullptr)
-                continue;
-
-            if (ts_now - d->get_last_time() > device_idle_expiration &&
+        auto is_idle = [this, ts_now](const std::shared_ptr<kis_tracked_device_base>& d) -> bool {
+            return ts_now - d->get_last_time() > device_idle_expiration &&
                 (d->get_packets() < device_idle_min_packets ||
-                 device_idle_min_packets <= 0)) {
+                 device_idle_min_packets <= 0);
+        };
 
-                device_itr mi = tracked_map.find(d->get_key());
-                if (mi != tracked_map.end())
-                    tracked_map.erase(mi);
+        // Find the idle devices one shard at a time, so we only hold the whole device
+        // list while we remove them
+        std::vector<std::shared_ptr<kis_tracked_device_base>> idle_devices;
 
-                // Erase it from the multimap
-                auto mmp = tracked_mac_multimap.equal_range(d->get_macaddr());
+        for_each_device_shard([&](const std::shared_ptr<tracker_element_vector>& devices) {
+                for (const auto& i : *devices) {
+                    auto d = std::static_pointer_cast<kis_tracked_device_base>(i);
 
-                for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-                    if (mmpi->second->get_key() == d->get_key()) {
-                        tracked_mac_multimap.erase(mmpi);
-                        break;
-                    }
+                    if (d != nullptr && is_idle(d))
+                        idle_devices.push_back(d);
                 }
+            });
 
-                // Forget it from any views
-                remove_view_device(d);
+        if (idle_devices.size() == 0)
+            return;
 
-                // Forget the immutable vec pointer to it
-                (immutable_tracked_vec->begin() + pi)->reset();
+        kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker timetracker_event device_idle_timer");
 
-                purged = true;
+        bool purged = false;
 
-            }
+        for (const auto& d : idle_devices) {
+            // Skip devices which have seen new traffic since we looked, or
+            // which were already removed
+            if (!is_idle(d) || fetch_device_nr(d->get_key()) != d)
+                continue;
+
+            remove_device_nr(d);
+
+            // Forget it from any views
+            remove_view_device(d);
+
+            purged = true;
         }
 
         if (purged)
             update_full_refresh();
 
     } else if (eventid == max_devices_timer) {
-        kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker timetracker_event max_devices_timer");
-
 		// Do nothing if we don't care
 		if (max_num_devices <= 0)
             return;
 
 		// Do nothing if the number of devices is less than the max
-		if (tracked_map.size() <= max_num_devices)
+		if ((unsigned int) fetch_num_devices() <= max_num_devices)
             return;
 
-        // Now this gets expensive; clone the immutable vec, sort it, and then we start
-        // zeroing out the immutable vec records
-        tracker_element_vector sorted_vec(immutable_tracked_vec);
+        // Now this gets expensive; gather the last time of every device one shard at a
+        // time, sort it, and then we start removing device records
+        std::vector<std::pair<time_t, std::shared_ptr<kis_tracked_device_base>>> sorted_vec;
+
+        for_each_device_shard([&sorted_vec](const std::shared_ptr<tracker_element_vector>& devices) {
+                for (const auto& i : *devices) {
+                    auto d = std::static_pointer_cast<kis_tracked_device_base>(i);
+
+                    if (d != nullptr)
+                        sorted_vec.push_back(std::make_pair(d->get_last_time(), d));
+                }
+            });
+
+        if (sorted_vec.size() <= max_num_devices)
+            return;
+
+        auto sort_lastseen = [](const std::pair<time_t, std::shared_ptr<kis_tracked_device_base>>& a,
+                const std::pair<time_t, std::shared_ptr<kis_tracked_device_base>>& b) -> bool {
+            return a.first < b.first;
+        };
 
 #if defined(HAVE_CPP17_PARALLEL)
-        std::stable_sort(std::execution::par_unseq, sorted_vec.begin(), sorted_vec.end(), devicetracker_sort_lastseen);
+        std::stable_sort(std::execution::par_unseq, sorted_vec.begin(), sorted_vec.end(), sort_lastseen);
 #else
-        std::stable_sort(sorted_vec.begin(), sorted_vec.end(), devicetracker_sort_lastseen);
+        std::stable_sort(sorted_vec.begin(), sorted_vec.end(), sort_lastseen);
 #endif
 
-        for (auto i = sorted_vec.begin() + max_num_devices; i != sorted_vec.end(); ++i) {
-            auto d = std::static_pointer_cast<kis_tracked_device_base>(*i);
-
-            device_itr mi = tracked_map.find(d->get_key());
-            if (mi != tracked_map.end())
-                tracked_map.erase(mi);
-
-            // Erase it from the multimap
-            auto mmp = tracked_mac_multimap.equal_range(d->get_macaddr());
+        kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker timetracker_event max_devices_timer");
 
-            for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-                if (mmpi->second->get_key() == d->get_key()) {
-                    tracked_mac_multimap.erase(mmpi);
-                    break;
-                }
-            }
+        for (auto i = sorted_vec.begin() + max_num_devices; i != sorted_vec.end(); ++i) {
+            if (fetch_device_nr(i->second->get_key()) != i->second)
+                continue;
 
-            // Forget it from the immutable vec, but keep its
-            // position; we need to have vecpos = devid
-            (immutable_tracked_vec->begin() + d->get_kis_internal_id())->reset();
+            remove_device_nr(i->second);
         }
 
         // Do an update since we're trimming something
@@ -1677,15 +1879,7 @@ void device_tracker::add_device(std::shared_ptr<kis_tracked_device_base> device)
         return;
     }
 
-    // Device ID is the size of the vector so a new device always gets put
-    // in it's numbered slot
-    device->set_kis_internal_id(immutable_tracked_vec->size());
-
-    tracked_map[device->get_key()] = device;
-    immutable_tracked_vec->push_back(device);
-
-    auto mm_pair = std::make_pair(device->get_macaddr(), device);
-    tracked_mac_multimap.emplace(mm_pair);
+    insert_device_nr(device);
 }
 
 bool device_tracker::add_view(std::shared_ptr<device_tracker_view> in_view) {
@@ -1699,9 +1893,14 @@ bool device_tracker::add_view(std::shared_ptr<device_tracker_view> in_view) {
 
     view_vec->push_back(in_view);
 
-    for (const auto& i : *immutable_tracked_vec) {
-        auto di = std::static_pointer_cast<kis_tracked_device_base>(i);
-        in_view->new_device(di);
+    for (const auto& s : device_shards) {
+        for (const auto& i : *s->immutable_tracked_vec) {
+            if (i == nullptr)
+                continue;
+
+            auto di = std::static_pointer_cast<kis_tracked_device_base>(i);
+            in_view->new_device(di);
+        }
     }
 
     return true;
@@ -1729,7 +1928,11 @@ void device_tracker::new_view_device(std::shared_ptr<kis_tracked_device_base> in
 }
 
 void device_tracker::update_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
-    kis_lock_guard<kis_mutex> lk(devicelist_mutex);
+    // Updating a device only needs its shard; views are shared by every shard, so as in
+    // update_common_device, serialize against other shard holders
+    kis_lock_guard<kis_mutex> lk(get_device_shard_mutex(in_device->get_key()),
+            "device_tracker update_view_device");
+    kis_lock_guard<kis_mutex> ulk(shard_update_mutex, "device_tracker update_view_device");
 
     for (const auto& i : *view_vec) {
         auto vi = dynamic_cast<device_tracker_view *>(i.get());
@@ -21,6 +21,7 @@
 
 #include "config.h"
 
+#include <array>
 #include <atomic>
 #include <stdio.h>
 #include <time.h>
@@ -115,17 +116,19 @@ public:
     // components due to timeouts / max device cleanup
     void update_full_refresh();
 
-	// Look for an existing device record under read-only shared lock
+	// Look for an existing device record, locking only the shard which holds it
     std::shared_ptr<kis_tracked_device_base> fetch_device(const device_key& in_key);
 
-    // Fetch one or more devices by mac address or mac mask
+    // Fetch one or more devices by mac address or mac mask; a masked lookup searches
+    // each shard in turn
     std::vector<std::shared_ptr<kis_tracked_device_base>> fetch_devices(const mac_addr& in_mac);
 
     // Look for an existing device record, without lock - must be called under some form of existing
     // lock to be safely used
     std::shared_ptr<kis_tracked_device_base> fetch_device_nr(const device_key& in_key);
 
-    // Do work on all devices, this applies to the 'all' device view
+    // Do work on all devices, this applies to the 'all' device view.  Read-only work is
+    // done one shard at a time, holding only the lock of the shard being examined.
     std::shared_ptr<tracker_element_vector> do_device_work(device_tracker_view_worker& worker);
     std::shared_ptr<tracker_element_vector> do_readonly_device_work(device_tracker_view_worker& worker);
 
@@ -231,11 +234,49 @@ public:
     // Get a cached phyname; use this to de-dup thousands of devices phynames
     std::shared_ptr<tracker_element_string> get_cached_phyname(const std::string& phyname);
 
-    // Expose to devicelist mutex for external batch locking
+    // Expose to devicelist mutex for external batch locking.  Holding this locks every
+    // device shard, which is required to add or remove devices; callers which only
+    // look at devices should prefer the per-shard locks.
     kis_mutex& get_devicelist_mutex() {
         return devicelist_mutex;
     }
 
+    // The device records are split into lock-striped shards keyed by the device MAC, so
+    // that lookups and read-only work only contend with other work on the same shard.  A
+    // shard lock protects the shard records and the contents of the devices in it.
+    //
+    // A thread holding a shard lock must not take the devicelist mutex or the lock of
+    // another shard; packet handlers which update several devices together lock all of
+    // their shards at once with a device_shard_locker.
+    size_t fetch_num_device_shards() const {
+        return device_shards.size();
+    }
+
+    // Number of times the whole device list has been locked, for benchmarking how often
+    // the packet path still takes every shard
+    uint64_t fetch_num_devicelist_locks() const {
+        return devicelist_mutex.num_parent_locks();
+    }
+
+    kis_mutex& get_device_shard_mutex(const device_key& in_key) {
+        return devicelist_mutex.get_stripe(device_shard_index(in_key.get_dkey()));
+    }
+
+    // Get the shard lock covering a MAC address; a masked MAC can match devices in any
+    // shard so the whole device list lock is returned
+    kis_mutex& get_device_shard_mutex(const mac_addr& in_mac) {
+        if (in_mac.maskbits != 64)
+            return devicelist_mutex;
+
+        return devicelist_mutex.get_stripe(device_shard_index(in_mac.longmac));
+    }
+
+    // Call a function with the devices of each shard in turn, holding only the lock of
+    // that shard.  Removed devices are null in the vector.  This is the preferred way
+    // for batch callers to walk every device without stalling the packet path for the
+    // whole list.
+    void for_each_device_shard(const std::function<void (const std::shared_ptr<tracker_element_vector>&)>& fn);
+
 protected:
     std::shared_ptr<entry_tracker> entrytracker;
     std::shared_ptr<packet_chain> packetchain;
@@ -336,18 +377,43 @@ protected:
     // Signal threshold
     int device_location_signal_threshold;
 
-	// Tracked devices
-    device_map_t tracked_map;
+    class device_shard {
+    public:
+        device_shard() :
+            immutable_tracked_vec{std::make_shared<tracker_element_vector>()} { }
+
+        // Tracked devices
+        device_map_t tracked_map;
+
+        // MAC address lookups are incredibly expensive from the webui if we don't
+        // track by map; in theory multiple objects in different PHYs could have the
+        // same MAC so it's not a simple 1:1 map
+        std::multimap<mac_addr, std::shared_ptr<kis_tracked_device_base> > tracked_mac_multimap;
+
+        // Immutable vector, one entry per device; may never be sorted.  Devices
+        // which are removed are set to 'null'.  Each position corresponds to the
+        // slot encoded in the device ID.
+        std::shared_ptr<tracker_element_vector> immutable_tracked_vec;
+    };
+
+    // Device shards, the shard count is always a power of two; shard N is guarded by
+    // stripe N of the devicelist mutex.  Device keys are built from the device MAC so the
+    // key and MAC lookups of a device land in the same shard.  The device ID is
+    // (slot << device_shard_bits) | shard.
+    std::vector<std::unique_ptr<device_shard>> device_shards;
+    unsigned int device_shard_bits;
+
+    size_t device_shard_index(uint64_t in_mackey) const {
+        return ankerl::unordered_dense::hash<uint64_t>{}(in_mackey) & (device_shards.size() - 1);
+    }
 
-    // MAC address lookups are incredibly expensive from the webui if we don't
-    // track by map; in theory multiple objects in different PHYs could have the
-    // same MAC so it's not a simple 1:1 map
-    std::multimap<mac_addr, std::shared_ptr<kis_tracked_device_base> > tracked_mac_multimap;
+    device_shard& get_device_shard(const device_key& in_key) {
+        return *device_shards[device_shard_index(in_key.get_dkey())];
+    }
 
-    // Immutable vector, one entry per device; may never be sorted.  Devices
-    // which are removed are set to 'null'.  Each position corresponds to the
-    // device ID.
-    std::shared_ptr<tracker_element_vector> immutable_tracked_vec;
+    // Insert or remove a device record, must be called under the devicelist mutex
+    void insert_device_nr(const std::shared_ptr<kis_tracked_device_base>& device);
+    void remove_device_nr(const std::shared_ptr<kis_tracked_device_base>& device);
 
     // List of views using new API as we transition the rest to the new API
     std::shared_ptr<tracker_element_vector> view_vec;
@@ -367,8 +433,14 @@ protected:
     ankerl::unordered_dense::map<int, kis_phy_handler *> phy_handler_map;
     kis_mutex phy_mutex;
 
-    // New multimutex primitive
-    kis_mutex devicelist_mutex;
+    // New multimutex primitive; locking it locks every device shard
+    kis_striped_mutex devicelist_mutex;
+    friend class device_shard_locker;
+
+    // Packet updates of existing devices hold only the device shard; this serializes the
+    // state they share across shards (view membership and monitored device alerts).  It
+    // is always taken after a shard or the devicelist, never before.
+    kis_mutex shard_update_mutex;
 
     kis_mutex storing_mutex;
     std::atomic<bool> devices_storing;
@@ -408,6 +480,47 @@ protected:
 
 };
 
+// Locks the devices a packet handler updates together.  When every device already
+// exists, only the shards holding them are locked, in shard order so that handlers
+// locking overlapping shards can't deadlock; when one of them has to be created, or
+// the packet carries device tags, the whole device list is locked instead, since
+// update_common_device needs it to add a device or set tags.
+//
+// Empty MACs are skipped, so a handler can pass an empty MAC for a device it won't
+// update.  While only the shards are held the handler may only touch the listed
+// devices; work which walks other devices must call lock_devicelist() first.
+class device_shard_locker {
+public:
+    device_shard_locker(device_tracker *tracker, kis_phy_handler *phy,
+            const std::shared_ptr<kis_packet>& in_pack,
+            std::initializer_list<mac_addr> macs, bool create, const std::string& op);
+    ~device_shard_locker();
+
+    device_shard_locker(const device_shard_locker&) = delete;
+    device_shard_locker& operator=(const device_shard_locker&) = delete;
+
+    // Trade the shard locks for the whole device list.  Devices fetched before stay
+    // valid, but other handlers may have updated them in between.
+    void lock_devicelist();
+
+    bool holds_devicelist() const {
+        return list_locked;
+    }
+
+protected:
+    void unlock_shards();
+
+    // The most devices a handler locks by shard; more than this takes the whole list
+    static constexpr size_t max_shards = 8;
+
+    device_tracker *tracker;
+    std::string op;
+
+    std::array<size_t, max_shards> shards;
+    size_t num_shards;
+    bool list_locked;
+};
+
 class devicelist_scope_locker {
 public:
     devicelist_scope_locker(device_tracker *in_tracker) {
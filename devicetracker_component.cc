@@ -24,6 +24,7 @@
 #include <map>
 #include <vector>
 #include <algorithm>
+#include <mutex>
 #include <string>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -31,6 +32,7 @@
 #include <pthread.h>
 
 #include "datasourcetracker.h"
+#include "devicetracker.h"
 #include "devicetracker_component.h"
 #include "kis_datasource.h"
 
@@ -461,13 +463,39 @@ void kis_tracked_device_base::inc_seenby_count(kis_datasource *source,
     }
 }
 
+// Position of each inline field in inline_field_ids(), indexed by field id; field ids
+// are global so one table serves every device
+namespace {
+    enum inline_field_slot {
+        slot_key, slot_macaddr, slot_basic_type_set, slot_basic_crypt_set,
+        slot_first_time, slot_last_time, slot_mod_time, slot_packets, slot_rx_packets,
+        slot_tx_packets, slot_llc_packets, slot_error_packets, slot_data_packets,
+        slot_crypt_packets, slot_filter_packets, slot_datasize, slot_frequency, slot_alert,
+        slot_none
+    };
+
+    std::vector<uint8_t> inline_field_slots;
+    std::once_flag inline_field_slots_once;
+
+    inline int inline_slot(int id) {
+        if (id < 0 || (size_t) id >= inline_field_slots.size())
+            return slot_none;
+
+        return inline_field_slots[id];
+    }
+}
+
 void kis_tracked_device_base::register_fields() {
     tracker_component::register_fields();
     
     phy_id = 0;
 
-    register_field("kismet.device.base.key", "unique device key across phy and server", &key);
-    register_field("kismet.device.base.macaddr", "mac address", &macaddr);
+    key_id =
+        register_field("kismet.device.base.key",
+                tracker_element_factory<tracker_element_device_key>(), "unique device key across phy and server");
+    macaddr_id =
+        register_field("kismet.device.base.macaddr",
+                tracker_element_factory<tracker_element_mac_addr>(), "mac address");
     register_field("kismet.device.base.phyname", "phy name", &phyname);
     register_field("kismet.device.base.name", "printable device name", &devicename);
     username_id = 
@@ -475,25 +503,51 @@ void kis_tracked_device_base::register_fields() {
     register_field("kismet.device.base.commonname", 
             "common name alias of custom or device names", &commonname);
     register_field("kismet.device.base.type", "printable device type", &type_string);
-    register_field("kismet.device.base.basic_type_set", "bitset of basic type", &basic_type_set);
+    basic_type_set_id =
+        register_field("kismet.device.base.basic_type_set",
+                tracker_element_factory<tracker_element_uint64>(), "bitset of basic type");
 
     register_field("kismet.device.base.crypt", "printable basic encryption information", &crypt_string);
 
-    register_field("kismet.device.base.basic_crypt_set", 
-            "bitset of basic encryption", &basic_crypt_set);
-    register_field("kismet.device.base.first_time", "first time seen time_t", &first_time);
-    register_field("kismet.device.base.last_time", "last time seen time_t", &last_time);
-    register_field("kismet.device.base.mod_time", 
-            "timestamp of last seen time (local clock)", &mod_time);
-    register_field("kismet.device.base.packets.total", "total packets seen of all types", &packets);
-    register_field("kismet.device.base.packets.rx_total", "total transmitted packets seen of all types", &rx_packets);
-    register_field("kismet.device.base.packets.tx_total", "total received packets (addressed to this device) seen of all types", &tx_packets);
-    register_field("kismet.device.base.packets.llc", "observed protocol control packets", &llc_packets);
-    register_field("kismet.device.base.packets.error", "corrupt/error packets", &error_packets);
-    register_field("kismet.device.base.packets.data", "data packets", &data_packets);
-    register_field("kismet.device.base.packets.crypt", "data packets using encryption", &crypt_packets);
-    register_field("kismet.device.base.packets.filtered", "packets dropped by filter", &filter_packets);
-    register_field("kismet.device.base.datasize", "transmitted data in bytes", &datasize);
+    basic_crypt_set_id =
+        register_field("kismet.device.base.basic_crypt_set",
+                tracker_element_factory<tracker_element_uint64>(), "bitset of basic encryption");
+    first_time_id =
+        register_field("kismet.device.base.first_time",
+                tracker_element_factory<tracker_element_uint64>(), "first time seen time_t");
+    last_time_id =
+        register_field("kismet.device.base.last_time",
+                tracker_element_factory<tracker_element_uint64>(), "last time seen time_t");
+    mod_time_id =
+        register_field("kismet.device.base.mod_time",
+                tracker_element_factory<tracker_element_uint64>(), "timestamp of last seen time (local clock)");
+    packets_id =
+        register_field("kismet.device.base.packets.total",
+                tracker_element_factory<tracker_element_uint64>(), "total packets seen of all types");
+    rx_packets_id =
+        register_field("kismet.device.base.packets.rx_total",
+                tracker_element_factory<tracker_element_uint64>(), "total transmitted packets seen of all types");
+    tx_packets_id =
+        register_field("kismet.device.base.packets.tx_total",
+                tracker_element_factory<tracker_element_uint64>(), "total received packets (addressed to this device) seen of all types");
+    llc_packets_id =
+        register_field("kismet.device.base.packets.llc",
+                tracker_element_factory<tracker_element_uint64>(), "observed protocol control packets");
+    error_packets_id =
+        register_field("kismet.device.base.packets.error",
+                tracker_element_factory<tracker_element_uint64>(), "corrupt/error packets");
+    data_packets_id =
+        register_field("kismet.device.base.packets.data",
+                tracker_element_factory<tracker_element_uint64>(), "data packets");
+    crypt_packets_id =
+        register_field("kismet.device.base.packets.crypt",
+                tracker_element_factory<tracker_element_uint64>(), "data packets using encryption");
+    filter_packets_id =
+        register_field("kismet.device.base.packets.filtered",
+                tracker_element_factory<tracker_element_uint64>(), "packets dropped by filter");
+    datasize_id =
+        register_field("kismet.device.base.datasize",
+                tracker_element_factory<tracker_element_uint64>(), "transmitted data in bytes");
     
     packets_rrd_id =
         register_dynamic_field<kis_tracked_rrd<>>("kismet.device.base.packets.rrd", "packet rate rrd");
@@ -509,9 +563,13 @@ void kis_tracked_device_base::register_fields() {
 
     register_field("kismet.device.base.freq_khz_map", "packets seen per frequency (khz)", &freq_khz_map);
     register_field("kismet.device.base.channel", "channel (phy specific)", &channel);
-    register_field("kismet.device.base.frequency", "frequency", &frequency);
+    frequency_id =
+        register_field("kismet.device.base.frequency",
+                tracker_element_factory<tracker_element_double>(), "frequency");
     register_field("kismet.device.base.manuf", "manufacturer name", &manuf);
-    register_field("kismet.device.base.num_alerts", "number of alerts on this device", &alert);
+    alert_id =
+        register_field("kismet.device.base.num_alerts",
+                tracker_element_factory<tracker_element_uint32>(), "number of alerts on this device");
     
     tag_map_id =
         register_dynamic_field("kismet.device.base.tags", "set of arbitrary tags, including user notes", &tag_map);
@@ -544,6 +602,15 @@ void kis_tracked_device_base::register_fields() {
 
     location_cloud_id = register_dynamic_field<kis_location_rrd>(
         "kismet.device.base.location_cloud", "RRD-like location history");
+
+    std::call_once(inline_field_slots_once, [this]() {
+        auto ids = inline_field_ids();
+
+        inline_field_slots.assign(*std::max_element(ids.begin(), ids.end()) + 1, slot_none);
+
+        for (size_t i = 0; i < ids.size(); i++)
+            inline_field_slots[ids[i]] = i;
+    });
 }
 
 void kis_tracked_device_base::reserve_fields(std::shared_ptr<tracker_element_map> e) {
@@ -562,9 +629,220 @@ void kis_tracked_device_base::reserve_fields(std::shared_ptr<tracker_element_map
             // And assign it over the same key
             s.second = sbd;
         }
+
+        // Scalar fields are kept inline, so pull their values out of the map we're
+        // inheriting from
+        auto import_inline = [&e](uint16_t id, auto& v) {
+            auto ie = e->get_sub(id);
+
+            if (ie != nullptr)
+                v = get_tracker_value<std::remove_reference_t<decltype(v)>>(ie);
+        };
+
+        import_inline(key_id, key);
+        import_inline(macaddr_id, macaddr);
+        import_inline(basic_type_set_id, basic_type_set);
+        import_inline(basic_crypt_set_id, basic_crypt_set);
+        import_inline(first_time_id, first_time);
+        import_inline(last_time_id, last_time);
+        import_inline(mod_time_id, mod_time);
+        import_inline(packets_id, packets);
+        import_inline(rx_packets_id, rx_packets);
+        import_inline(tx_packets_id, tx_packets);
+        import_inline(llc_packets_id, llc_packets);
+        import_inline(error_packets_id, error_packets);
+        import_inline(data_packets_id, data_packets);
+        import_inline(crypt_packets_id, crypt_packets);
+        import_inline(filter_packets_id, filter_packets);
+        import_inline(datasize_id, datasize);
+        import_inline(frequency_id, frequency);
+        import_inline(alert_id, alert);
     }
 }
 
+shared_tracker_element kis_tracked_device_base::materialize_sub(int id) {
+    switch (inline_slot(id)) {
+        case slot_key:
+            return get_tracker_key();
+        case slot_macaddr:
+            return get_tracker_macaddr();
+        case slot_basic_type_set:
+            return get_tracker_basic_type_set();
+        case slot_basic_crypt_set:
+            return get_tracker_basic_crypt_set();
+        case slot_first_time:
+            return get_tracker_first_time();
+        case slot_last_time:
+            return get_tracker_last_time();
+        case slot_mod_time:
+            return get_tracker_mod_time();
+        case slot_packets:
+            return get_tracker_packets();
+        case slot_rx_packets:
+            return get_tracker_rx_packets();
+        case slot_tx_packets:
+            return get_tracker_tx_packets();
+        case slot_llc_packets:
+            return get_tracker_llc_packets();
+        case slot_error_packets:
+            return get_tracker_error_packets();
+        case slot_data_packets:
+            return get_tracker_data_packets();
+        case slot_crypt_packets:
+            return get_tracker_crypt_packets();
+        case slot_filter_packets:
+            return get_tracker_filter_packets();
+        case slot_datasize:
+            return get_tracker_datasize();
+        case slot_frequency:
+            return get_tracker_frequency();
+        case slot_alert:
+            return get_tracker_num_alerts();
+    }
+
+    return nullptr;
+}
+
+bool kis_tracked_device_base::get_inline_sub(int id, tracker_element_inline_value& value) const {
+    auto set_uint = [&value](tracker_type t, uint64_t v) {
+        value.type = t;
+        value.uint_value = v;
+        return true;
+    };
+
+    switch (inline_slot(id)) {
+        case slot_key:
+            value.type = tracker_type::tracker_key;
+            value.key_value = key;
+            return true;
+        case slot_macaddr:
+            value.type = tracker_type::tracker_mac_addr;
+            value.mac_value = macaddr;
+            return true;
+        case slot_basic_type_set:
+            return set_uint(tracker_type::tracker_uint64, basic_type_set);
+        case slot_basic_crypt_set:
+            return set_uint(tracker_type::tracker_uint64, basic_crypt_set);
+        case slot_first_time:
+            return set_uint(tracker_type::tracker_uint64, first_time);
+        case slot_last_time:
+            return set_uint(tracker_type::tracker_uint64, last_time);
+        case slot_mod_time:
+            return set_uint(tracker_type::tracker_uint64, mod_time);
+        case slot_packets:
+            return set_uint(tracker_type::tracker_uint64, packets);
+        case slot_rx_packets:
+            return set_uint(tracker_type::tracker_uint64, rx_packets);
+        case slot_tx_packets:
+            return set_uint(tracker_type::tracker_uint64, tx_packets);
+        case slot_llc_packets:
+            return set_uint(tracker_type::tracker_uint64, llc_packets);
+        case slot_error_packets:
+            return set_uint(tracker_type::tracker_uint64, error_packets);
+        case slot_data_packets:
+            return set_uint(tracker_type::tracker_uint64, data_packets);
+        case slot_crypt_packets:
+            return set_uint(tracker_type::tracker_uint64, crypt_packets);
+        case slot_filter_packets:
+            return set_uint(tracker_type::tracker_uint64, filter_packets);
+        case slot_datasize:
+            return set_uint(tracker_type::tracker_uint64, datasize);
+        case slot_frequency:
+            value.type = tracker_type::tracker_double;
+            value.double_value = frequency;
+            return true;
+        case slot_alert:
+            return set_uint(tracker_type::tracker_uint32, alert);
+    }
+
+    return false;
+}
+
+std::array<uint16_t, 18> kis_tracked_device_base::inline_field_ids() const {
+    return {key_id, macaddr_id, basic_type_set_id, basic_crypt_set_id,
+        first_time_id, last_time_id, mod_time_id, packets_id, rx_packets_id,
+        tx_packets_id, llc_packets_id, error_packets_id, data_packets_id,
+        crypt_packets_id, filter_packets_id, datasize_id, frequency_id, alert_id};
+}
+
+namespace {
+    // The shard lock held by a device while it is being serialized
+    kis_mutex *device_serialize_mutex(const device_key& key) {
+        auto devicetracker = Globalreg::fetch_global_as<device_tracker>();
+
+        if (devicetracker == nullptr)
+            return nullptr;
+
+        return &devicetracker->get_device_shard_mutex(key);
+    }
+}
+
+void kis_tracked_device_base::pre_serialize() {
+    // Serializing inserts the inline fields into the device map, so the device has to be
+    // held against anything else reading or updating it for the whole serialization.  Take
+    // the lock of the device shard here and keep it until post_serialize, the same way
+    // views hold the device list in their hooks; serializer_scope pairs the two even when
+    // serialization throws.  For callers already holding the shard or the whole device
+    // list this is simply recursive.
+    //
+    // A thread holding the lock of a different shard must not serialize this device, as
+    // taking a second shard can deadlock; serializing devices from several shards is done
+    // under the whole device list.
+    auto shard_mutex = device_serialize_mutex(get_key());
+
+    if (shard_mutex != nullptr)
+        shard_mutex->lock();
+
+    try {
+        tracker_component::pre_serialize();
+
+        if (serialize_depth == 0) {
+            for (auto id : inline_field_ids())
+                insert(materialize_sub(id));
+        }
+    } catch (...) {
+        // post_serialize is never called for a failed pre_serialize, so undo it here
+        if (serialize_depth == 0) {
+            for (auto id : inline_field_ids())
+                map.erase(id);
+        }
+
+        if (shard_mutex != nullptr)
+            shard_mutex->unlock();
+
+        throw;
+    }
+
+    serialize_depth++;
+}
+
+void kis_tracked_device_base::post_serialize() {
+    if (serialize_depth == 0) {
+        tracker_component::post_serialize();
+        return;
+    }
+
+    if (--serialize_depth == 0) {
+        for (auto id : inline_field_ids())
+            map.erase(id);
+    }
+
+    // Release the shard lock kept by pre_serialize even if a component hook throws
+    auto shard_mutex = device_serialize_mutex(get_key());
+
+    try {
+        tracker_component::post_serialize();
+    } catch (...) {
+        if (shard_mutex != nullptr)
+            shard_mutex->unlock();
+
+        throw;
+    }
+
+    if (shard_mutex != nullptr)
+        shard_mutex->unlock();
+}
+
 void kis_tracked_device_base::add_related_device(const std::string& in_relationship, const device_key in_key) {
     auto related_group_i = related_devices_map->find(in_relationship);
 
@@ -22,6 +22,7 @@
 #include "config.h"
 
 #include <algorithm>
+#include <array>
 #include <list>
 #include <map>
 #include <string>
@@ -336,8 +337,8 @@ public:
 
     kis_tracked_device_base(const kis_tracked_device_base *p) :
         tracker_component{p} {
-            __ImportField(key, p);
-            __ImportField(macaddr, p);
+            __ImportId(key_id, p);
+            __ImportId(macaddr_id, p);
             __ImportField(phyname, p);
             __ImportField(devicename, p);
 
@@ -345,24 +346,24 @@ public:
 
             __ImportField(commonname, p);
             __ImportField(type_string, p);
-            __ImportField(basic_type_set,p );
+            __ImportId(basic_type_set_id, p);
             __ImportField(crypt_string, p);
-            __ImportField(basic_crypt_set, p);
-            __ImportField(first_time, p);
-            __ImportField(last_time, p);
-            __ImportField(mod_time, p);
+            __ImportId(basic_crypt_set_id, p);
+            __ImportId(first_time_id, p);
+            __ImportId(last_time_id, p);
+            __ImportId(mod_time_id, p);
 
-            __ImportField(packets, p);
-            __ImportField(rx_packets, p);
-            __ImportField(tx_packets, p);
-            __ImportField(llc_packets, p);
-            __ImportField(error_packets, p);
-            __ImportField(data_packets, p);
-            __ImportField(crypt_packets, p);
-            __ImportField(filter_packets, p);
+            __ImportId(packets_id, p);
+            __ImportId(rx_packets_id, p);
+            __ImportId(tx_packets_id, p);
+            __ImportId(llc_packets_id, p);
+            __ImportId(error_packets_id, p);
+            __ImportId(data_packets_id, p);
+            __ImportId(crypt_packets_id, p);
+            __ImportId(filter_packets_id, p);
 
 
-            __ImportField(datasize, p);
+            __ImportId(datasize_id, p);
 
             __ImportId(packets_rrd_id, p);
             __ImportId(data_rrd_id, p);
@@ -371,13 +372,13 @@ public:
             __ImportId(packets_rx_rrd_id, p);
 
             __ImportField(channel, p);
-            __ImportField(frequency, p);
+            __ImportId(frequency_id, p);
 
             __ImportId(signal_data_id, p);
 
             __ImportField(freq_khz_map, p);
             __ImportField(manuf, p);
-            __ImportField(alert, p);
+            __ImportId(alert_id, p);
 
             __ImportId(tag_map_id, p);
             __ImportId(tag_entry_id, p);
@@ -415,8 +416,8 @@ public:
         return r;
     }
 
-    __Proxy(key, device_key, device_key, device_key, key);
-    __ProxyL(macaddr, mac_addr, mac_addr, mac_addr, macaddr,
+    __ProxyInline(key, tracker_element_device_key, device_key, device_key, key, key_id);
+    __ProxyInlineL(macaddr, tracker_element_mac_addr, mac_addr, mac_addr, macaddr, macaddr_id,
             [this](mac_addr m) -> bool {
 
             // Only set the mac as the common name to the mac if it's empty
@@ -469,8 +470,9 @@ public:
     // __Proxy(type_string, std::string, std::string, std::string, type_string);
     __ProxySwappingTrackable(type_string, tracker_element_string, type_string);
 
-    __Proxy(basic_type_set, uint64_t, uint64_t, uint64_t, basic_type_set);
-    __ProxyBitset(basic_type_set, uint64_t, basic_type_set);
+    __ProxyInline(basic_type_set, tracker_element_uint64, uint64_t, uint64_t, basic_type_set, 
+            basic_type_set_id);
+    __ProxyInlineBitset(basic_type_set, uint64_t, basic_type_set);
 
     __ProxyGet(type_string, std::string, std::string, type_string);
 
@@ -513,46 +515,47 @@ public:
         crypt_string->set(Globalreg::cache_string(string));
     }
 
-    __Proxy(basic_crypt_set, uint64_t, uint64_t, uint64_t, basic_crypt_set);
-    void add_basic_crypt(uint64_t in) { (*basic_crypt_set) |= in; }
+    __ProxyInline(basic_crypt_set, tracker_element_uint64, uint64_t, uint64_t, basic_crypt_set,
+            basic_crypt_set_id);
+    void add_basic_crypt(uint64_t in) { basic_crypt_set |= in; }
 
-    __Proxy(first_time, uint64_t, time_t, time_t, first_time);
-    __ProxySetIfLess(first_time, uint64_t, uint64_t, first_time);
-    __Proxy(last_time, uint64_t, time_t, time_t, last_time);
-    __ProxySetIfLess(last_time, uint64_t, uint64_t, last_time);
+    __ProxyInline(first_time, tracker_element_uint64, time_t, time_t, first_time, first_time_id);
+    __ProxyInlineSetIfLess(first_time, uint64_t, first_time);
+    __ProxyInline(last_time, tracker_element_uint64, time_t, time_t, last_time, last_time_id);
+    __ProxyInlineSetIfLess(last_time, uint64_t, last_time);
 
     // Simple management of last modified time
-    __Proxy(mod_time, uint64_t, time_t, time_t, mod_time);
+    __ProxyInline(mod_time, tracker_element_uint64, time_t, time_t, mod_time, mod_time_id);
     void update_modtime() {
         set_mod_time(Globalreg::globalreg->last_tv_sec);
     }
 
-    __Proxy(packets, uint64_t, uint64_t, uint64_t, packets);
-    __ProxyIncDec(packets, uint64_t, uint64_t, packets);
+    __ProxyInline(packets, tracker_element_uint64, uint64_t, uint64_t, packets, packets_id);
+    __ProxyInlineIncDec(packets, uint64_t, packets);
 
-    __Proxy(tx_packets, uint64_t, uint64_t, uint64_t, tx_packets);
-    __ProxyIncDec(tx_packets, uint64_t, uint64_t, tx_packets);
+    __ProxyInline(tx_packets, tracker_element_uint64, uint64_t, uint64_t, tx_packets, tx_packets_id);
+    __ProxyInlineIncDec(tx_packets, uint64_t, tx_packets);
 
-    __Proxy(rx_packets, uint64_t, uint64_t, uint64_t, rx_packets);
-    __ProxyIncDec(rx_packets, uint64_t, uint64_t, rx_packets);
+    __ProxyInline(rx_packets, tracker_element_uint64, uint64_t, uint64_t, rx_packets, rx_packets_id);
+    __ProxyInlineIncDec(rx_packets, uint64_t, rx_packets);
 
-    __Proxy(llc_packets, uint64_t, uint64_t, uint64_t, llc_packets);
-    __ProxyIncDec(llc_packets, uint64_t, uint64_t, llc_packets);
+    __ProxyInline(llc_packets, tracker_element_uint64, uint64_t, uint64_t, llc_packets, llc_packets_id);
+    __ProxyInlineIncDec(llc_packets, uint64_t, llc_packets);
 
-    __Proxy(error_packets, uint64_t, uint64_t, uint64_t, error_packets);
-    __ProxyIncDec(error_packets, uint64_t, uint64_t, error_packets);
+    __ProxyInline(error_packets, tracker_element_uint64, uint64_t, uint64_t, error_packets, error_packets_id);
+    __ProxyInlineIncDec(error_packets, uint64_t, error_packets);
 
-    __Proxy(data_packets, uint64_t, uint64_t, uint64_t, data_packets);
-    __ProxyIncDec(data_packets, uint64_t, uint64_t, data_packets);
+    __ProxyInline(data_packets, tracker_element_uint64, uint64_t, uint64_t, data_packets, data_packets_id);
+    __ProxyInlineIncDec(data_packets, uint64_t, data_packets);
 
-    __Proxy(crypt_packets, uint64_t, uint64_t, uint64_t, crypt_packets);
-    __ProxyIncDec(crypt_packets, uint64_t, uint64_t, crypt_packets);
+    __ProxyInline(crypt_packets, tracker_element_uint64, uint64_t, uint64_t, crypt_packets, crypt_packets_id);
+    __ProxyInlineIncDec(crypt_packets, uint64_t, crypt_packets);
 
-    __Proxy(filter_packets, uint64_t, uint64_t, uint64_t, filter_packets);
-    __ProxyIncDec(filter_packets, uint64_t, uint64_t, filter_packets);
+    __ProxyInline(filter_packets, tracker_element_uint64, uint64_t, uint64_t, filter_packets, filter_packets_id);
+    __ProxyInlineIncDec(filter_packets, uint64_t, filter_packets);
 
-    __Proxy(datasize, uint64_t, uint64_t, uint64_t, datasize);
-    __ProxyIncDec(datasize, uint64_t, uint64_t, datasize);
+    __ProxyInline(datasize, tracker_element_uint64, uint64_t, uint64_t, datasize, datasize_id);
+    __ProxyInlineIncDec(datasize, uint64_t, datasize);
 
     typedef kis_tracked_rrd<> rrdt;
     __ProxyFullyDynamicTrackable(packets_rrd, kis_tracked_rrd<>, packets_rrd_id);
@@ -563,12 +566,12 @@ public:
     __ProxyFullyDynamicTrackable(data_rrd, rrdt, data_rrd_id);
 
     __Proxy(channel, std::string, std::string, std::string, channel);
-    __Proxy(frequency, double, double, double, frequency);
+    __ProxyInline(frequency, tracker_element_double, double, double, frequency, frequency_id);
 
     __ProxyTrackable(manuf, tracker_element_string, manuf);
     __Proxy(manuf, std::string, std::string, std::string, manuf);
 
-    __Proxy(num_alerts, uint32_t, unsigned int, unsigned int, alert);
+    __ProxyInline(num_alerts, tracker_element_uint32, unsigned int, unsigned int, alert, alert_id);
 
     __ProxyDynamicTrackable(signal_data, kis_tracked_signal_data, signal_data,
             signal_data_id);
@@ -603,10 +606,27 @@ public:
     // Optional location cloud
     __ProxyFullyDynamicTrackable(location_cloud, kis_location_rrd, location_cloud_id);
 
+    // Scalar fields are kept inline in the device and are only inserted into the
+    // map as tracked elements while the device is being serialized.  Serialization
+    // holds the lock of the device shard from pre_serialize until post_serialize.
+    virtual void pre_serialize() override;
+    virtual void post_serialize() override;
+
+    virtual bool get_inline_sub(int id, tracker_element_inline_value& value) const override;
+
 protected:
     virtual void register_fields() override;
     virtual void reserve_fields(std::shared_ptr<tracker_element_map> e) override;
 
+    virtual shared_tracker_element materialize_sub(int id) override;
+
+    // Field ids of the scalar fields kept inline
+    std::array<uint16_t, 18> inline_field_ids() const;
+
+    // Nested serialization depth; inline fields are materialized into the map on the
+    // first pre_serialize and removed on the last post_serialize
+    unsigned int serialize_depth{0};
+
     // Unique, meaningless, incremental ID.  Practically, this is the order
     // in which kismet saw devices; it has no purpose other than a sorting
     // key which will always preserve order - time, etc, will not.  Used for breaking
@@ -614,10 +634,12 @@ protected:
     uint64_t kis_internal_id;
 
     // Unique key
-    std::shared_ptr<tracker_element_device_key> key;
+    device_key key;
+    uint16_t key_id;
 
     // Mac address (probably the key, but could be different)
-    std::shared_ptr<tracker_element_mac_addr> macaddr;
+    mac_addr macaddr;
+    uint16_t macaddr_id;
 
     // Phy name
     std::shared_ptr<tracker_element_string> phyname;
@@ -639,7 +661,8 @@ protected:
     std::shared_ptr<tracker_element_string> type_string;
 
     // Basic phy-neutral type for sorting and classification
-    std::shared_ptr<tracker_element_uint64> basic_type_set;
+    uint64_t basic_type_set{0};
+    uint16_t basic_type_set_id;
 
     // Printable crypt string, which is set by the phy and is the best printable
     // representation of the phy crypt options.  This should be empty if the phy
@@ -647,24 +670,37 @@ protected:
     std::shared_ptr<tracker_element_string_ptr> crypt_string;
 
     // Bitset of basic phy-neutral crypt options
-    std::shared_ptr<tracker_element_uint64> basic_crypt_set;
+    uint64_t basic_crypt_set{0};
+    uint16_t basic_crypt_set_id;
 
     // First and last seen
-    std::shared_ptr<tracker_element_uint64> first_time;
-    std::shared_ptr<tracker_element_uint64> last_time;
-    std::shared_ptr<tracker_element_uint64> mod_time;
+    uint64_t first_time{0};
+    uint64_t last_time{0};
+    uint64_t mod_time{0};
+    uint16_t first_time_id;
+    uint16_t last_time_id;
+    uint16_t mod_time_id;
 
     // Packet counts
-    std::shared_ptr<tracker_element_uint64> packets;
-    std::shared_ptr<tracker_element_uint64> rx_packets;
-    std::shared_ptr<tracker_element_uint64> tx_packets;
-    std::shared_ptr<tracker_element_uint64> llc_packets;
-    std::shared_ptr<tracker_element_uint64> error_packets;
-    std::shared_ptr<tracker_element_uint64> data_packets;
-    std::shared_ptr<tracker_element_uint64> crypt_packets;
-    std::shared_ptr<tracker_element_uint64> filter_packets;
-
-    std::shared_ptr<tracker_element_uint64> datasize;
+    uint64_t packets{0};
+    uint64_t rx_packets{0};
+    uint64_t tx_packets{0};
+    uint64_t llc_packets{0};
+    uint64_t error_packets{0};
+    uint64_t data_packets{0};
+    uint64_t crypt_packets{0};
+    uint64_t filter_packets{0};
+    uint16_t packets_id;
+    uint16_t rx_packets_id;
+    uint16_t tx_packets_id;
+    uint16_t llc_packets_id;
+    uint16_t error_packets_id;
+    uint16_t data_packets_id;
+    uint16_t crypt_packets_id;
+    uint16_t filter_packets_id;
+
+    uint64_t datasize{0};
+    uint16_t datasize_id;
 
     // Packets and data RRDs
     uint16_t packets_rrd_id;
@@ -675,7 +711,8 @@ protected:
 
 	// Channel and frequency as per PHY type
     std::shared_ptr<tracker_element_string> channel;
-    std::shared_ptr<tracker_element_double> frequency;
+    double frequency{0};
+    uint16_t frequency_id;
 
     // Signal data
     uint16_t signal_data_id;
@@ -689,7 +726,8 @@ protected:
     std::shared_ptr<tracker_element_string> manuf;
 
     // Alerts triggered on this device
-    std::shared_ptr<tracker_element_uint32> alert;
+    uint32_t alert{0};
+    uint16_t alert_id;
 
     // Stringmap of tags
     std::shared_ptr<tracker_element_string_map> tag_map;
@@ -88,8 +88,10 @@ void device_tracker_view::register_urls(const std::string& in_id) {
     httpd->register_route(uri, {"GET", "POST"}, httpd->RO_ROLE, {},
             std::make_shared<kis_net_web_function_endpoint>(
                 [this](std::shared_ptr<kis_net_beast_httpd_connection> con) {
+                    // Locks the device list itself, so that filtering only holds one
+                    // device shard at a time
                     return device_endpoint_handler(con);
-                }, devicetracker->get_devicelist_mutex()));
+                }));
 
     uri = fmt::format("/devices/views/{}/last-time/:timestamp/devices", in_id);
     httpd->register_route(uri, {"GET", "POST"}, httpd->RO_ROLE, {},
@@ -298,39 +300,48 @@ std::shared_ptr<tracker_element_vector> device_tracker_view::do_device_work(devi
 std::shared_ptr<tracker_element_vector> device_tracker_view::do_readonly_device_work(device_tracker_view_worker& worker,
         std::shared_ptr<tracker_element_vector> devices) {
 
-    // read-only workers are currently disabled because it may not be reasonable to solve conflicts
-    // at the per-device level, use the locked worker.
-
-    return do_device_work(worker, devices);
-
-#if 0
+    // Read-only workers only need the lock of the shard holding each device, so hold
+    // one shard at a time instead of the whole device list; the worker must not modify
+    // devices or take the device list lock.  If the caller already holds the device list
+    // this is simply recursive.
     auto ret = std::make_shared<tracker_element_vector>();
     ret->reserve(devices->size());
 
-    kis_lock_guard<kis_mutex> ul_devlist(devicetracker->get_devicelist_mutex(), 
-            "device_tracker_view do_readonly_device_work");
+    kis_mutex *shard_mutex = nullptr;
 
-    std::for_each(devices->begin(), devices->end(),
-            [&](shared_tracker_element val) {
+    for (const auto& val : *devices) {
+        if (val == nullptr)
+            continue;
 
-            if (val == nullptr)
-                return;
+        auto dev = std::static_pointer_cast<kis_tracked_device_base>(val);
 
-            auto dev = std::static_pointer_cast<kis_tracked_device_base>(val);
+        auto& dev_mutex = devicetracker->get_device_shard_mutex(dev->get_key());
 
-            auto m = worker.match_device(dev);
+        if (&dev_mutex != shard_mutex) {
+            if (shard_mutex != nullptr)
+                shard_mutex->unlock();
 
-            if (m) 
+            shard_mutex = &dev_mutex;
+            shard_mutex->lock();
+        }
+
+        try {
+            if (worker.match_device(dev))
                 ret->push_back(dev);
+        } catch (...) {
+            shard_mutex->unlock();
+            throw;
+        }
+    }
 
-        });
+    if (shard_mutex != nullptr)
+        shard_mutex->unlock();
 
     worker.set_matched_devices(ret);
 
     worker.finalize();
 
     return ret;
-#endif
 }
 
 std::shared_ptr<kis_tracked_device_base> device_tracker_view::fetch_device(device_key in_key) {
@@ -726,7 +737,11 @@ void device_tracker_view::device_endpoint_handler(std::shared_ptr<kis_net_beast_
 
     // Copy the entire vector list, under lock, to the next work vector; this makes it an independent copy
     // we can sort and manipulate
+    kis_unique_lock<kis_mutex> list_locker(devicetracker->get_devicelist_mutex(), 
+            "device_tracker_view device_endpoint_handler");
     next_work_vec->set(device_list->begin(), device_list->end());
+    list_locker.unlock();
+
     total_sz_elem->set(next_work_vec->size());
 
     // If we have a time filter, apply that first, it's the fastest.
@@ -766,6 +781,10 @@ void device_tracker_view::device_endpoint_handler(std::shared_ptr<kis_net_beast_
         }
     }
 
+    // Sorting and summarizing looks at fields across all the remaining devices, so hold the
+    // whole device list again from here on
+    list_locker.lock();
+
     // Apply the filtered length
     filtered_sz_elem->set(next_work_vec->size());
 
@@ -793,7 +812,36 @@ void device_tracker_view::device_endpoint_handler(std::shared_ptr<kis_net_beast_
 
     // if (in_order_column_num.length() && order_field.size() > 0) {
     
-    if (order_field.size() > 0) {
+    // Fields the device keeps inline (times, packet counts, etc) compare directly, instead
+    // of building an element for both sides of every comparison
+    tracker_element_inline_value probe;
+
+    if (order_field.size() > 0 && next_work_vec->size() > 0 &&
+            get_tracker_element_path_inline(order_field, *next_work_vec->begin(), probe)) {
+        std::stable_sort(
+#if defined(HAVE_CPP17_PARALLEL)
+            std::execution::par_unseq,
+#endif
+            next_work_vec->begin(), next_work_vec->end(),
+                [&](const shared_tracker_element& a, const shared_tracker_element& b) -> bool {
+                tracker_element_inline_value va;
+                tracker_element_inline_value vb;
+
+                auto ha = get_tracker_element_path_inline(order_field, a, va);
+                auto hb = get_tracker_element_path_inline(order_field, b, vb);
+
+                if (!ha) 
+                    return in_order_direction == 0;
+
+                if (!hb)
+                    return in_order_direction != 0;
+
+                if (in_order_direction == 0)
+                    return va.less_than(vb);
+
+                return vb.less_than(va);
+            });
+    } else if (order_field.size() > 0) {
         std::stable_sort(
 #if defined(HAVE_CPP17_PARALLEL)
             std::execution::par_unseq,
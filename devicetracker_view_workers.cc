@@ -222,6 +222,18 @@ bool device_tracker_view_stringmatch_worker::match_device(std::shared_ptr<kis_tr
     bool matched = false;
 
     for (const auto& i : fieldpaths) {
+        tracker_element_inline_value inline_val;
+
+        // The device MAC is kept inline in the device, match it without building an element
+        if (get_tracker_element_path_inline(i, device, inline_val) &&
+                inline_val.type == tracker_type::tracker_mac_addr) {
+            if (mac_query_term_len != 0 &&
+                    inline_val.mac_value.partial_search(mac_query_term, mac_query_term_len))
+                return true;
+
+            continue;
+        }
+
         auto field = get_tracker_element_path(i, device);
         std::string val;
 
@@ -283,6 +295,18 @@ bool device_tracker_view_icasestringmatch_worker::match_device(std::shared_ptr<k
     };
 
     for (const auto& i : fieldpaths) {
+        tracker_element_inline_value inline_val;
+
+        // The device MAC is kept inline in the device, match it without building an element
+        if (get_tracker_element_path_inline(i, device, inline_val) &&
+                inline_val.type == tracker_type::tracker_mac_addr) {
+            if (mac_query_term_len != 0 &&
+                    inline_val.mac_value.partial_search(mac_query_term, mac_query_term_len))
+                return true;
+
+            continue;
+        }
+
         auto field = get_tracker_element_path(i, device);
         std::string val;
 
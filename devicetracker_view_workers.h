@@ -54,6 +54,7 @@ public:
 
 protected:
     friend class device_tracker_view;
+    friend class device_tracker;
 
     virtual void set_matched_devices(std::shared_ptr<tracker_element_vector> devices);
 
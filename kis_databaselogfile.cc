@@ -411,7 +411,7 @@ bool kis_database_logfile::open_log(const std::string& in_template, const std::s
             packetchain->register_handler([](void *auxdata, const std::shared_ptr<kis_packet>& packet) -> int {
 					auto dbl = reinterpret_cast<kis_database_logfile *>(auxdata);
                     return dbl->log_packet(packet);
-                }, this, CHAINPOS_LOGGING, -100);
+                }, this, CHAINPOS_LOGGING, -100, "kismetdb log_packet");
     } else {
         packet_handler_id = -1;
         _MSG_INFO("Packets will not be saved to the Kismet database log.");
@@ -65,12 +65,34 @@ kis_datasource::kis_datasource(shared_datasource_builder in_builder) :
 	pack_comp_datasrc = packetchain->register_packet_component("KISDATASRC");
     pack_comp_json = packetchain->register_packet_component("JSON");
     pack_comp_protobuf = packetchain->register_packet_component("PROTOBUF");
+    pack_comp_beacon_summary = packetchain->register_packet_component("BEACONSUMMARY");
 
     suppress_gps = false;
 
     error_timer_id = -1;
     ping_timer_id = -1;
 
+    flow_credit_window =
+        Globalreg::globalreg->kismet_config->fetch_opt_uint("datasource_credit_window", 1024);
+    flow_control = false;
+    flow_credit_outstanding = 0;
+    flow_timer_id = -1;
+
+    report_node_pool.resize(KIS_DATASOURCE_REPORT_NODES);
+
+    batch_max =
+        Globalreg::globalreg->kismet_config->fetch_opt_uint("datasource_batch_max", 32);
+    batch_delay_us =
+        Globalreg::globalreg->kismet_config->fetch_opt_uint("datasource_batch_delay_us", 5000);
+
+    compression_level =
+        Globalreg::globalreg->kismet_config->fetch_opt_uint("remote_capture_compression", 1);
+
+    beacon_summary =
+        Globalreg::globalreg->kismet_config->fetch_opt_bool("datasource_beacon_summary", false);
+    beacon_summary_refresh =
+        Globalreg::globalreg->kismet_config->fetch_opt_uint("datasource_beacon_summary_refresh", 10);
+
     mode_probing = false;
     mode_listing = false;
 
@@ -93,6 +115,7 @@ kis_datasource::~kis_datasource() {
     // Cancel any timer
     timetracker->remove_timer(error_timer_id);
     timetracker->remove_timer(ping_timer_id);
+    timetracker->remove_timer(flow_timer_id);
 
     kis_unique_lock<kis_mutex> lk(ext_mutex, "~kisdatasource");
     cancel_all_commands("source deleted");
@@ -638,6 +661,13 @@ void kis_datasource::close_external_impl() {
         ping_timer_id = -1;
     }
 
+    if (flow_timer_id > 0) {
+        timetracker->remove_timer(flow_timer_id);
+        flow_timer_id = -1;
+    }
+
+    flow_control = false;
+
     set_int_source_running(false);
 
     lk.unlock();
@@ -1076,6 +1106,9 @@ bool kis_datasource::dispatch_rx_packet_v3(std::shared_ptr<boost::asio::streambu
         case KIS_EXTERNAL_V3_KDS_PACKET:
             handle_packet_data_report_v3(seqno, code, content, buffer);
             return true;
+        case KIS_EXTERNAL_V3_KDS_PACKETBATCH:
+            handle_packet_batch_report_v3(seqno, code, content, buffer);
+            return true;
         case KIS_EXTERNAL_V3_KDS_LISTREPORT:
             handle_packet_interfaces_report_v3(seqno, code, content);
             return true;
@@ -1085,6 +1118,15 @@ bool kis_datasource::dispatch_rx_packet_v3(std::shared_ptr<boost::asio::streambu
         case KIS_EXTERNAL_V3_KDS_PROBEREPORT:
             handle_packet_probesource_report_v3(seqno, code, content);
             return true;
+        case KIS_EXTERNAL_V3_KDS_CREDITREPORT:
+            handle_packet_credit_report_v3(seqno, code, content);
+            return true;
+        case KIS_EXTERNAL_V3_KDS_CAPTURESTATS:
+            handle_packet_capture_stats_v3(seqno, code, content);
+            return true;
+        case KIS_EXTERNAL_V3_KDS_BEACONSUMMARY:
+            handle_packet_beacon_summary_v3(seqno, code, content);
+            return true;
     }
 
     return false;
@@ -1853,10 +1895,46 @@ void kis_datasource::handle_packet_opensource_report_v3(uint32_t seqno, uint16_t
 
     }
 
+    flow_control = false;
+    flow_credit_outstanding = 0;
+
+    auto flow_n = mpack_node_map_uint_optional(root, KIS_EXTERNAL_V3_KDS_OPENREPORT_FIELD_FLOWCONTROL);
+    if (!mpack_node_is_missing(flow_n)) {
+        auto flow = mpack_node_bool(flow_n);
+        if (mpack_tree_error(&tree) != mpack_ok) {
+            _MSG_ERROR("Kismet datasource got malformed v3 OPENREPORT");
+            trigger_error("invalid v3 OPENREPORT");
+            handle_opensource_report_v3_callback(report_seqno, 1, lock, "invalid v3 OPENREPORT");
+            return;
+        }
+
+        flow_control = flow && flow_credit_window != 0;
+    }
+
     set_int_source_running(code != 0);
     set_source_paused(0);
     set_int_source_error(code == 0);
 
+    if (flow_control && code != 0) {
+        grant_flow_credit();
+
+        if (flow_timer_id > 0)
+            timetracker->remove_timer(flow_timer_id);
+
+        flow_timer_id = timetracker->register_timer(time_tracker::slice(1), true,
+                [this](int) -> int {
+            kis_lock_guard<kis_mutex> lk(ext_mutex, "datasource flow_timer lambda");
+
+            if (!get_source_running() || !flow_control) {
+                flow_timer_id = -1;
+                return 0;
+            }
+
+            grant_flow_credit();
+            return 1;
+        });
+    }
+
     handle_opensource_report_v3_callback(report_seqno, code, lock, msg);
 }
 
@@ -2030,38 +2108,32 @@ void kis_datasource::handle_rx_datalayer_v3(std::shared_ptr<kis_packet> packet,
         return;
     }
 
-    auto datachunk = packetchain->new_packet_component<kis_datachunk>();
+    kis_v3_packet_report report;
 
-    if (clobber_timestamp && get_source_remote()) {
-        gettimeofday(&(packet->ts), NULL);
-    } else {
-        auto ts_s_n = mpack_node_map_uint_optional(datamap, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_S);
-        if (!mpack_node_is_missing(ts_s_n)) {
-            packet->ts.tv_sec = mpack_node_u64(ts_s_n);
+    auto ts_s_n = mpack_node_map_uint_optional(datamap, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_S);
+    if (!mpack_node_is_missing(ts_s_n)) {
+        report.has_ts = true;
+        report.ts_s = mpack_node_u64(ts_s_n);
 
-            auto ts_us_n = mpack_node_map_uint_optional(datamap, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_US);
-            if (!mpack_node_is_missing(ts_us_n)) {
-                packet->ts.tv_usec = mpack_node_u64(ts_us_n);
-            }
-        } else {
-            gettimeofday(&(packet->ts), NULL);
+        auto ts_us_n = mpack_node_map_uint_optional(datamap, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_US);
+        if (!mpack_node_is_missing(ts_us_n)) {
+            report.ts_us = mpack_node_u64(ts_us_n);
         }
     }
 
-    // Override the DLT if we have one
-    if (get_source_override_linktype()) {
-        datachunk->dlt = get_source_override_linktype();
-    } else {
-        auto dlt_m = mpack_node_map_uint_optional(datamap, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_DLT);
-        if (!mpack_node_is_missing(dlt_m)) {
-            datachunk->dlt = mpack_node_u32(dlt_m);
-        }
+    auto dlt_m = mpack_node_map_uint_optional(datamap, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_DLT);
+    if (!mpack_node_is_missing(dlt_m)) {
+        report.dlt = mpack_node_u32(dlt_m);
     }
 
     auto olen_n = mpack_node_map_uint_optional(datamap, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_LENGTH);
+    if (!mpack_node_is_missing(olen_n)) {
+        report.has_length = true;
+        report.length = mpack_node_u32(olen_n);
+    }
 
-    auto content_sz = mpack_node_data_len(content_n);
-    auto content_data = mpack_node_data(content_n);
+    report.has_content = true;
+    report.content = nonstd::string_view(mpack_node_data(content_n), mpack_node_data_len(content_n));
 
     if (mpack_tree_error(tree) != mpack_ok) {
         _MSG_ERROR("Kismet datasource got malformed v3 DATAREPORT");
@@ -2069,26 +2141,47 @@ void kis_datasource::handle_rx_datalayer_v3(std::shared_ptr<kis_packet> packet,
         return;
     }
 
-    if (!mpack_node_is_missing(olen_n)) {
-        packet->original_len = mpack_node_u32(olen_n);
+    handle_rx_datalayer_v3(packet, report);
+}
+
+void kis_datasource::handle_rx_datalayer_v3(std::shared_ptr<kis_packet> packet,
+        const kis_v3_packet_report& report) {
+    if (!report.has_content) {
+        return;
+    }
+
+    auto datachunk = packetchain->new_packet_component<kis_datachunk>();
+
+    if (clobber_timestamp && get_source_remote()) {
+        gettimeofday(&(packet->ts), NULL);
+    } else if (report.has_ts) {
+        packet->ts.tv_sec = report.ts_s;
+        packet->ts.tv_usec = report.ts_us;
     } else {
-        packet->original_len = content_sz;
+        gettimeofday(&(packet->ts), NULL);
     }
 
-    if (mpack_tree_error(tree) != mpack_ok) {
-        _MSG_ERROR("Kismet datasource got malformed v3 DATAREPORT");
-        trigger_error("invalid v3 DATAREPORT");
-        return;
+    // Override the DLT if we have one
+    if (get_source_override_linktype()) {
+        datachunk->dlt = get_source_override_linktype();
+    } else {
+        datachunk->dlt = report.dlt;
+    }
+
+    if (report.has_length) {
+        packet->original_len = report.length;
+    } else {
+        packet->original_len = report.content.length();
     }
 
     if (!handle_rx_data_content(packet.get(), datachunk.get(),
-                (const uint8_t *) content_data, content_sz)) {
+                (const uint8_t *) report.content.data(), report.content.length())) {
         return;
     }
 
     packet->insert(pack_comp_linkframe, datachunk);
 
-    get_source_packet_size_rrd()->add_sample(content_sz, Globalreg::globalreg->last_tv_sec);
+    get_source_packet_size_rrd()->add_sample(report.content.length(), Globalreg::globalreg->last_tv_sec);
 }
 
 int kis_datasource::handle_rx_data_content(kis_packet *packet, kis_datachunk *datachunk,
@@ -2163,45 +2256,211 @@ void kis_datasource::handle_packet_data_report_v3(uint32_t in_seqno, uint16_t co
         std::shared_ptr<boost::asio::streambuf> buffer) {
     kis_lock_guard<kis_mutex> lk(ext_mutex, "datasource handle_packet_data_report_v3");
 
+    // Every data frame used a credit, even if we discard it
+    consume_flow_credit(1);
+
     if (get_source_paused()) {
         return;
     }
 
+    auto packet = packetchain->generate_packet();
+
+    // use the buffer alias if we can, copy the packet content once if we can't; the
+    // report is parsed out of whichever buffer the packet holds so that the content
+    // views handed to the datalayer are backed by the packet itself
+    nonstd::string_view frame = in_packet;
+
+    if (buffer != nullptr) {
+        packet->set_streambuf(buffer);
+    } else {
+        packet->set_data(in_packet.data(), in_packet.length());
+        frame = packet->data;
+    }
+
+    // acquire and remember the gpstracker on the first packet, if we haven't done so
+    if (gpstracker == nullptr) {
+        gpstracker = Globalreg::fetch_mandatory_global_as<gps_tracker>();
+    }
+
+    // Most reports are only a signal and packet block, which are decoded directly
+    // without building a tree
+    kis_v3_packet_report report;
+
+    if (kis_v3_decode_packet_report(frame, report)) {
+        handle_rx_report_v3(packet, report);
+        return;
+    }
+
     mpack_tree_raii tree;
     mpack_node_t root;
 
-    mpack_tree_init_data(&tree, in_packet.data(), in_packet.length());
+    if (!parse_report_v3(&tree, frame)) {
+        _MSG_ERROR("Kismet external interface got unparseable v3 DATAREPORT");
+        trigger_error("invalid v3 DATAREPORT");
+        return;
+    }
 
-    if (!mpack_tree_try_parse(&tree)) {
-        _MSG_ERROR("Kismet external interface got unparseable v3 OPENREPORT");
-        trigger_error("invalid v3 OPENREPORT");
+    root = mpack_tree_root(&tree);
+
+    handle_rx_report_v3(packet, root, &tree, nullptr, nullptr);
+}
+
+void kis_datasource::handle_packet_batch_report_v3(uint32_t in_seqno, uint16_t code,
+        const nonstd::string_view& in_packet,
+        std::shared_ptr<boost::asio::streambuf> buffer) {
+    kis_lock_guard<kis_mutex> lk(ext_mutex, "datasource handle_packet_batch_report_v3");
+
+    // Every packet in the batch shares the frame buffer; if we don't have the network
+    // buffer, copy the frame once and share the copy instead.  The copy is charged to
+    // the first packet of the batch.
+    nonstd::string_view frame = in_packet;
+    kis_packet_buffer frame_copy;
+
+    if (buffer == nullptr) {
+        frame_copy = kis_packet::make_buffer(in_packet.data(), in_packet.length());
+        frame = nonstd::string_view{*frame_copy};
+    }
+
+    mpack_tree_raii tree;
+    mpack_node_t root;
+
+    if (!parse_report_v3(&tree, frame)) {
+        _MSG_ERROR("Kismet external interface got unparseable v3 PACKETBATCH");
+        trigger_error("invalid v3 PACKETBATCH");
         return;
     }
 
     root = mpack_tree_root(&tree);
 
-    // acquire and remember the gpstracker on the first packet, if we haven't done so
+    auto reports = mpack_node_map_uint_optional(root, KIS_EXTERNAL_V3_KDS_PACKETBATCH_FIELD_REPORTS);
+    if (mpack_node_is_missing(reports)) {
+        return;
+    }
+
+    auto n_reports = mpack_node_array_length(reports);
+
+    if (mpack_tree_error(&tree) != mpack_ok) {
+        _MSG_ERROR("Kismet datasource got malformed v3 PACKETBATCH");
+        trigger_error("invalid v3 PACKETBATCH");
+        return;
+    }
+
+    // Each report in the batch used a credit, even if we discard it
+    consume_flow_credit(n_reports);
+
+    if (get_source_paused()) {
+        return;
+    }
+
     if (gpstracker == nullptr) {
         gpstracker = Globalreg::fetch_mandatory_global_as<gps_tracker>();
     }
 
-    auto packet = packetchain->generate_packet();
+    // The batch level gps and signal blocks use the same fields as a single report
+    auto batch_gps = handle_sub_gps(root, &tree);
+    if (cancelled) {
+        return;
+    }
 
-    // use the buffer alias if we can, copy the packet content if we can't
-    if (buffer != nullptr) {
-        packet->set_streambuf(buffer);
-    } else {
-        packet->set_data(std::string(in_packet));
+    auto batch_signal = handle_sub_signal(root, &tree);
+    if (cancelled) {
+        return;
     }
 
-    auto gpsinfo = handle_sub_gps(root, &tree);
+    for (size_t i = 0; i < n_reports; i++) {
+        auto report = mpack_node_array_at(reports, i);
+
+        auto packet = packetchain->generate_packet();
+
+        if (buffer != nullptr) {
+            packet->set_streambuf(buffer);
+        } else {
+            packet->set_data(frame_copy, frame);
+
+            if (i == 0)
+                packet->bytes_copied += frame_copy->length();
+        }
+
+        handle_rx_report_v3(packet, report, &tree, batch_gps, batch_signal);
+        if (cancelled) {
+            return;
+        }
+    }
+}
+
+void kis_datasource::handle_rx_report_v3(std::shared_ptr<kis_packet> packet,
+        mpack_node_t& root, mpack_tree_t *tree,
+        const std::shared_ptr<kis_gps_packinfo>& default_gps,
+        const std::shared_ptr<kis_layer1_packinfo>& default_signal) {
+    auto gpsinfo = handle_sub_gps(root, tree);
     if (cancelled) {
         return;
     }
 
+    if (gpsinfo == nullptr)
+        gpsinfo = default_gps;
+
     if (gpsinfo != nullptr) {
         packet->insert(pack_comp_gps, gpsinfo);
-    } else if (suppress_gps) {
+    } else {
+        handle_rx_source_gps(packet);
+    }
+
+    auto siginfo = handle_sub_signal(root, tree);
+    if (cancelled) {
+        return;
+    }
+
+    // Signal records are unique per packet, so batch defaults are copied
+    if (siginfo == nullptr && default_signal != nullptr) {
+        siginfo = packetchain->new_packet_component<kis_layer1_packinfo>();
+        *siginfo = *default_signal;
+    }
+
+    if (siginfo != nullptr) {
+        packet->insert(pack_comp_l1info, siginfo);
+    }
+
+    handle_rx_jsonlayer_v3(packet, root, tree);
+    if (cancelled) {
+        return;
+    }
+
+    handle_rx_datalayer_v3(packet, root, tree);
+    if (cancelled) {
+        return;
+    }
+
+    handle_rx_packet(packet);
+}
+
+void kis_datasource::handle_rx_report_v3(std::shared_ptr<kis_packet> packet,
+        const kis_v3_packet_report& report) {
+    handle_rx_source_gps(packet);
+
+    if (report.has_signal) {
+        auto siginfo = packetchain->new_packet_component<kis_layer1_packinfo>();
+
+        siginfo->signal_dbm = report.signal_dbm;
+        siginfo->noise_dbm = report.noise_dbm;
+        siginfo->signal_rssi = report.signal_rssi;
+        siginfo->noise_rssi = report.noise_rssi;
+        siginfo->freq_khz = report.freq_khz;
+        siginfo->datarate = report.datarate;
+
+        if (report.has_channel)
+            siginfo->channel = std::string(report.channel);
+
+        packet->insert(pack_comp_l1info, siginfo);
+    }
+
+    handle_rx_datalayer_v3(packet, report);
+
+    handle_rx_packet(packet);
+}
+
+void kis_datasource::handle_rx_source_gps(const std::shared_ptr<kis_packet>& packet) {
+    if (suppress_gps) {
         auto nogpsinfo = packetchain->new_packet_component<kis_no_gps_packinfo>();
         packet->insert(pack_comp_no_gps, nogpsinfo);
     } else if (device_gps != nullptr) {
@@ -2210,27 +2469,373 @@ void kis_datasource::handle_packet_data_report_v3(uint32_t in_seqno, uint16_t co
         if (gpsinfo != nullptr)
             packet->insert(pack_comp_gps, gpsinfo);
     }
+}
 
-    auto siginfo = handle_sub_signal(root, &tree);
-    if (cancelled) {
+bool kis_datasource::parse_report_v3(mpack_tree_t *tree, const nonstd::string_view& frame) {
+    mpack_tree_init_pool(tree, frame.data(), frame.length(),
+            report_node_pool.data(), report_node_pool.size());
+
+    if (mpack_tree_try_parse(tree))
+        return true;
+
+    if (mpack_tree_error(tree) != mpack_error_too_big)
+        return false;
+
+    // Larger than the pool; parse again with allocated nodes
+    mpack_tree_destroy(tree);
+    mpack_tree_init_data(tree, frame.data(), frame.length());
+
+    return mpack_tree_try_parse(tree);
+}
+
+bool kis_v3_decode_packet_report(const nonstd::string_view& frame, kis_v3_packet_report& report) {
+    mpack_reader_t reader;
+
+    mpack_reader_init_data(&reader, frame.data(), frame.length());
+
+    auto n_blocks = mpack_expect_map(&reader);
+
+    for (uint32_t b = 0; b < n_blocks && mpack_reader_error(&reader) == mpack_ok; b++) {
+        auto block = mpack_expect_uint(&reader);
+
+        if (block == KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_SIGNALBLOCK) {
+            report.has_signal = true;
+
+            auto n_fields = mpack_expect_map(&reader);
+
+            for (uint32_t f = 0; f < n_fields && mpack_reader_error(&reader) == mpack_ok; f++) {
+                switch (mpack_expect_uint(&reader)) {
+                    case KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_SIGNAL_DBM:
+                        report.signal_dbm = mpack_expect_u32(&reader);
+                        break;
+                    case KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_NOISE_DBM:
+                        report.noise_dbm = mpack_expect_u32(&reader);
+                        break;
+                    case KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_SIGNAL_RSSI:
+                        report.signal_rssi = mpack_expect_u32(&reader);
+                        break;
+                    case KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_NOISE_RSSI:
+                        report.noise_rssi = mpack_expect_u32(&reader);
+                        break;
+                    case KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_FREQ_KHZ:
+                        report.freq_khz = mpack_expect_u64(&reader);
+                        break;
+                    case KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_DATARATE:
+                        report.datarate = mpack_expect_u64(&reader);
+                        break;
+                    case KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_CHANNEL: {
+                        auto len = mpack_expect_str(&reader);
+                        auto str = mpack_read_bytes_inplace(&reader, len);
+                        mpack_done_str(&reader);
+                        report.has_channel = true;
+                        report.channel = nonstd::string_view(str, len);
+                        break;
+                    }
+                    default:
+                        mpack_discard(&reader);
+                        break;
+                }
+            }
+
+            mpack_done_map(&reader);
+        } else if (block == KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_PACKETBLOCK) {
+            auto n_fields = mpack_expect_map(&reader);
+
+            for (uint32_t f = 0; f < n_fields && mpack_reader_error(&reader) == mpack_ok; f++) {
+                switch (mpack_expect_uint(&reader)) {
+                    case KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_DLT:
+                        report.dlt = mpack_expect_u32(&reader);
+                        break;
+                    case KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_S:
+                        report.has_ts = true;
+                        report.ts_s = mpack_expect_u64(&reader);
+                        break;
+                    case KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_US:
+                        report.ts_us = mpack_expect_u64(&reader);
+                        break;
+                    case KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_LENGTH:
+                        report.has_length = true;
+                        report.length = mpack_expect_u32(&reader);
+                        break;
+                    case KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_CONTENT: {
+                        auto len = mpack_expect_bin(&reader);
+                        auto data = mpack_read_bytes_inplace(&reader, len);
+                        mpack_done_bin(&reader);
+                        report.has_content = true;
+                        report.content = nonstd::string_view(data, len);
+                        break;
+                    }
+                    default:
+                        mpack_discard(&reader);
+                        break;
+                }
+            }
+
+            mpack_done_map(&reader);
+        } else {
+            // gps, json, and anything else need the full tree decoder
+            mpack_reader_destroy(&reader);
+            return false;
+        }
+    }
+
+    mpack_done_map(&reader);
+
+    return mpack_reader_destroy(&reader) == mpack_ok;
+}
+
+void kis_datasource::consume_flow_credit(size_t in_count) {
+    if (!flow_control)
+        return;
+
+    flow_credit_outstanding -= std::min(flow_credit_outstanding, in_count);
+
+    if (flow_credit_outstanding <= flow_credit_window / 2)
+        grant_flow_credit();
+}
+
+void kis_datasource::grant_flow_credit() {
+    // Top the capture back up to the full window, limited to what the packet queue
+    // can currently absorb.  Small grants are held back until the capture has run dry,
+    // so a nearly-full queue doesn't turn into a credit frame per packet.
+    if (!flow_control || cancelled)
         return;
+
+    if (flow_credit_outstanding >= flow_credit_window)
+        return;
+
+    auto grant = std::min(flow_credit_window - flow_credit_outstanding,
+            packetchain->queue_headroom());
+
+    if (grant == 0)
+        return;
+
+    if (grant < flow_credit_window / 4 && flow_credit_outstanding != 0)
+        return;
+
+    if (send_credit_v3(grant) != 0)
+        flow_credit_outstanding += grant;
+}
+
+unsigned int kis_datasource::send_credit_v3(uint32_t in_grant) {
+    char *data = NULL;
+    size_t size;
+
+    mpack_writer_t writer;
+
+    mpack_writer_init_growable(&writer, &data, &size);
+
+    mpack_build_map(&writer);
+
+    mpack_write_u16(&writer, KIS_EXTERNAL_V3_KDS_CREDIT_FIELD_GRANT);
+    mpack_write_u32(&writer, in_grant);
+
+    mpack_complete_map(&writer);
+
+    if (mpack_writer_destroy(&writer) != mpack_ok) {
+        if (data != nullptr) {
+            free(data);
+        }
+
+        _MSG_ERROR("Kismet datasource failed serializing v3 CREDIT");
+        trigger_error("failed to serialize v3 CREDIT");
+        return 0;
     }
 
-    if (siginfo != nullptr) {
-        packet->insert(pack_comp_l1info, siginfo);
+    auto seqno = send_packet_v3(KIS_EXTERNAL_V3_KDS_CREDIT, 0, 1, data, size);
+
+    free(data);
+
+    return seqno;
+}
+
+void kis_datasource::handle_packet_credit_report_v3(uint32_t in_seqno, uint16_t code,
+        const nonstd::string_view& in_packet) {
+    kis_lock_guard<kis_mutex> lk(ext_mutex, "datasource handle_packet_credit_report_v3");
+
+    mpack_tree_raii tree;
+    mpack_node_t root;
+
+    mpack_tree_init_data(&tree, in_packet.data(), in_packet.length());
+
+    if (!mpack_tree_try_parse(&tree)) {
+        _MSG_ERROR("Kismet external interface got unparseable v3 CREDITREPORT");
+        trigger_error("invalid v3 CREDITREPORT");
+        return;
     }
 
-    handle_rx_jsonlayer_v3(packet, root, &tree);
-    if (cancelled) {
+    root = mpack_tree_root(&tree);
+
+    auto dropped = mpack_node_u64(mpack_node_map_uint(root, KIS_EXTERNAL_V3_KDS_CREDITREPORT_FIELD_DROPPED));
+    if (mpack_tree_error(&tree) != mpack_ok) {
+        _MSG_ERROR("Kismet external interface got unparseable v3 CREDITREPORT");
+        trigger_error("invalid v3 CREDITREPORT");
         return;
     }
 
-    handle_rx_datalayer_v3(packet, root, &tree);
-    if (cancelled) {
+    set_source_num_local_dropped(dropped);
+
+    auto bytes_n = mpack_node_map_uint_optional(root, KIS_EXTERNAL_V3_KDS_CREDITREPORT_FIELD_DROPPED_BYTES);
+    if (!mpack_node_is_missing(bytes_n)) {
+        auto bytes = mpack_node_u64(bytes_n);
+        if (mpack_tree_error(&tree) != mpack_ok) {
+            _MSG_ERROR("Kismet external interface got unparseable v3 CREDITREPORT");
+            trigger_error("invalid v3 CREDITREPORT");
+            return;
+        }
+
+        set_source_num_local_dropped_bytes(bytes);
+    }
+}
+
+void kis_datasource::handle_packet_capture_stats_v3(uint32_t in_seqno, uint16_t code,
+        const nonstd::string_view& in_packet) {
+    kis_lock_guard<kis_mutex> lk(ext_mutex, "datasource handle_packet_capture_stats_v3");
+
+    mpack_tree_raii tree;
+    mpack_node_t root;
+
+    mpack_tree_init_data(&tree, in_packet.data(), in_packet.length());
+
+    if (!mpack_tree_try_parse(&tree)) {
+        _MSG_ERROR("Kismet external interface got unparseable v3 CAPTURESTATS");
+        trigger_error("invalid v3 CAPTURESTATS");
         return;
     }
 
-    handle_rx_packet(packet);
+    root = mpack_tree_root(&tree);
+
+    auto packets = mpack_node_u64(mpack_node_map_uint(root, KIS_EXTERNAL_V3_KDS_CAPTURESTATS_FIELD_PACKETS));
+    auto dropped = mpack_node_u64(mpack_node_map_uint(root, KIS_EXTERNAL_V3_KDS_CAPTURESTATS_FIELD_DROPPED));
+    auto freezes = mpack_node_u64(mpack_node_map_uint(root, KIS_EXTERNAL_V3_KDS_CAPTURESTATS_FIELD_FREEZES));
+
+    if (mpack_tree_error(&tree) != mpack_ok) {
+        _MSG_ERROR("Kismet external interface got unparseable v3 CAPTURESTATS");
+        trigger_error("invalid v3 CAPTURESTATS");
+        return;
+    }
+
+    set_source_num_kernel_packets(packets);
+    set_source_num_kernel_dropped(dropped);
+    set_source_num_kernel_freezes(freezes);
+}
+
+void kis_datasource::handle_compression_stats(size_t in_wire_sz, size_t in_raw_sz,
+        uint64_t in_usec) {
+    kis_lock_guard<kis_mutex> lk(data_mutex, "datasource handle_compression_stats");
+
+    (*source_num_compressed_bytes) += in_wire_sz;
+    (*source_num_uncompressed_bytes) += in_raw_sz;
+    (*source_decompress_usec) += in_usec;
+
+    source_compression_ratio->set((double) source_num_uncompressed_bytes->get() /
+            source_num_compressed_bytes->get());
+}
+
+void kis_datasource::handle_packet_beacon_summary_v3(uint32_t in_seqno, uint16_t code,
+        const nonstd::string_view& in_packet) {
+    kis_lock_guard<kis_mutex> lk(ext_mutex, "datasource handle_packet_beacon_summary_v3");
+
+    if (get_source_paused()) {
+        return;
+    }
+
+    mpack_tree_raii tree;
+    mpack_node_t root;
+
+    mpack_tree_init_data(&tree, in_packet.data(), in_packet.length());
+
+    if (!mpack_tree_try_parse(&tree)) {
+        _MSG_ERROR("Kismet external interface got unparseable v3 BEACONSUMMARY");
+        trigger_error("invalid v3 BEACONSUMMARY");
+        return;
+    }
+
+    root = mpack_tree_root(&tree);
+
+    auto summaries = mpack_node_map_uint(root, KIS_EXTERNAL_V3_KDS_BEACONSUMMARY_FIELD_SUMMARIES);
+    auto n_summaries = mpack_node_array_length(summaries);
+
+    if (mpack_tree_error(&tree) != mpack_ok) {
+        _MSG_ERROR("Kismet external interface got unparseable v3 BEACONSUMMARY");
+        trigger_error("invalid v3 BEACONSUMMARY");
+        return;
+    }
+
+    for (size_t i = 0; i < n_summaries; i++) {
+        auto s = mpack_node_array_at(summaries, i);
+
+        auto bssid_n = mpack_node_array_at(s, 0);
+        auto count = mpack_node_u32(mpack_node_array_at(s, 1));
+        auto freq_khz = mpack_node_u64(mpack_node_array_at(s, 2));
+        auto last_dbm = mpack_node_i32(mpack_node_array_at(s, 3));
+        auto peak_dbm = mpack_node_i32(mpack_node_array_at(s, 4));
+        auto noise_dbm = mpack_node_i32(mpack_node_array_at(s, 5));
+        auto ts_sec = mpack_node_u64(mpack_node_array_at(s, 6));
+        auto ts_usec = mpack_node_u64(mpack_node_array_at(s, 7));
+
+        if (mpack_tree_error(&tree) != mpack_ok || mpack_node_bin_size(bssid_n) != 6) {
+            _MSG_ERROR("Kismet external interface got unparseable v3 BEACONSUMMARY");
+            trigger_error("invalid v3 BEACONSUMMARY");
+            return;
+        }
+
+        if (count == 0)
+            continue;
+
+        auto packet = packetchain->generate_packet();
+
+        if (clobber_timestamp && get_source_remote()) {
+            gettimeofday(&(packet->ts), NULL);
+        } else {
+            packet->ts.tv_sec = ts_sec;
+            packet->ts.tv_usec = ts_usec;
+        }
+
+        auto summaryinfo = packetchain->new_packet_component<kis_beacon_summary_packinfo>();
+        summaryinfo->bssid = mac_addr((const uint8_t *) mpack_node_bin_data(bssid_n), 6);
+        summaryinfo->count = count;
+        summaryinfo->peak_dbm = peak_dbm;
+        packet->insert(pack_comp_beacon_summary, summaryinfo);
+
+        // Signals of 0 are radios which don't report a dBm level
+        if (last_dbm != 0 || freq_khz != 0) {
+            auto siginfo = packetchain->new_packet_component<kis_layer1_packinfo>();
+
+            if (last_dbm != 0) {
+                siginfo->signal_type = kis_l1_signal_type_dbm;
+                siginfo->signal_dbm = last_dbm;
+                siginfo->noise_dbm = noise_dbm;
+            }
+
+            siginfo->freq_khz = freq_khz;
+
+            packet->insert(pack_comp_l1info, siginfo);
+        }
+
+        handle_rx_source_gps(packet);
+
+        {
+            kis_lock_guard<kis_mutex> dlk(data_mutex, "datasource handle_packet_beacon_summary_v3");
+            (*source_num_summarized_beacons) += count;
+        }
+
+        // Summaries are not packets from the source, so they skip handle_rx_packet
+        // and the packet counts
+        auto datasrcinfo = packetchain->new_packet_component<packetchain_comp_datasource>();
+        datasrcinfo->ref_source = this;
+        packet->insert(pack_comp_datasrc, datasrcinfo);
+
+        if (packet->fetch(pack_comp_gps) == nullptr &&
+                packet->fetch(pack_comp_no_gps) == nullptr) {
+            auto gpsloc = gpstracker->get_best_location();
+
+            if (gpsloc != nullptr)
+                packet->insert(pack_comp_gps, std::move(gpsloc));
+        }
+
+        packetchain->process_packet(packet);
+    }
 }
 
 unsigned int kis_datasource::send_configure_channel_v3(const std::string& in_channel,
@@ -2434,6 +3039,43 @@ unsigned int kis_datasource::send_open_source_v3(const std::string& in_definitio
     mpack_write_u16(&writer, KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_DEFINITION);
     mpack_write_cstr(&writer, in_definition.c_str());
 
+    // Offer batching; captures which don't support it ignore the fields and keep
+    // sending a frame per packet
+    auto source_batch_max = string_to_n_dfl<unsigned int>(get_definition_opt("batch_max"), batch_max);
+
+    if (source_batch_max > 1) {
+        mpack_write_u16(&writer, KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_BATCH_MAX);
+        mpack_write_u32(&writer, source_batch_max);
+        mpack_write_u16(&writer, KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_BATCH_DELAY_US);
+        mpack_write_u32(&writer, batch_delay_us);
+    }
+
+    // Push the prefilter; captures which don't support it send everything
+    auto datasourcetracker =
+        Globalreg::fetch_mandatory_global_as<datasource_tracker>("DATASOURCETRACKER");
+    const auto& prefilter = datasourcetracker->get_prefilter();
+
+    if (prefilter.length() > 0 && get_definition_opt_bool("prefilter", true)) {
+        mpack_write_u16(&writer, KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_PREFILTER);
+        mpack_write_object_bytes(&writer, prefilter.data(), prefilter.length());
+    }
+
+    // Offer compression; local captures and captures which don't support it send
+    // uncompressed frames
+    auto level = string_to_n_dfl<unsigned int>(get_definition_opt("compression"), compression_level);
+
+    if (level > 0) {
+        mpack_write_u16(&writer, KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_COMPRESSION);
+        mpack_write_u8(&writer, std::min(level, 9U));
+    }
+
+    // Ask for repeated beacons to be summarized; captures which can't summarize
+    // send every beacon
+    if (get_definition_opt_bool("beacon_summary", beacon_summary) && beacon_summary_refresh > 0) {
+        mpack_write_u16(&writer, KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_BEACON_REFRESH);
+        mpack_write_u32(&writer, beacon_summary_refresh);
+    }
+
     mpack_complete_map(&writer);
 
     if (mpack_writer_destroy(&writer) != mpack_ok) {
@@ -3487,6 +4129,37 @@ void kis_datasource::register_fields() {
     register_field("kismet.datasource.num_error_packets",
             "Number of invalid/error packets seen by source",
             &source_num_error_packets);
+    register_field("kismet.datasource.num_local_dropped",
+            "Number of packets dropped by the capture for lack of flow control credit",
+            &source_num_local_dropped);
+    register_field("kismet.datasource.num_local_dropped_bytes",
+            "Number of bytes dropped by the capture for lack of flow control credit",
+            &source_num_local_dropped_bytes);
+    register_field("kismet.datasource.num_kernel_packets",
+            "Number of packets seen by the kernel capture ring, including drops",
+            &source_num_kernel_packets);
+    register_field("kismet.datasource.num_kernel_dropped",
+            "Number of packets dropped by the kernel capture ring",
+            &source_num_kernel_dropped);
+    register_field("kismet.datasource.num_kernel_freezes",
+            "Number of times the kernel capture ring queue was frozen",
+            &source_num_kernel_freezes);
+
+    register_field("kismet.datasource.num_compressed_bytes",
+            "Bytes of compressed frames received from the capture",
+            &source_num_compressed_bytes);
+    register_field("kismet.datasource.num_uncompressed_bytes",
+            "Bytes of compressed frames after decompression",
+            &source_num_uncompressed_bytes);
+    register_field("kismet.datasource.compression_ratio",
+            "Ratio of decompressed to compressed data from the capture",
+            &source_compression_ratio);
+    register_field("kismet.datasource.decompress_usec",
+            "Time spent decompressing data from the capture, in microseconds",
+            &source_decompress_usec);
+    register_field("kismet.datasource.num_summarized_beacons",
+            "Repeated beacons counted in summaries from the capture instead of being sent",
+            &source_num_summarized_beacons);
 
     packet_rate_rrd_id =
         register_dynamic_field("kismet.datasource.packets_rrd",
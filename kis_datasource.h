@@ -58,6 +58,38 @@ class kis_datasource;
 
 class kis_gps;
 
+// Nodes kept per datasource for parsing reports without allocating; large enough for a
+// full batch of typical reports
+#define KIS_DATASOURCE_REPORT_NODES     1024
+
+// Fields of a v3 data report which only carries signal and packet blocks, the common
+// report from a local capture.  The views point into the report frame.
+struct kis_v3_packet_report {
+    bool has_signal = false;
+    uint32_t signal_dbm = 0;
+    uint32_t noise_dbm = 0;
+    uint32_t signal_rssi = 0;
+    uint32_t noise_rssi = 0;
+    uint64_t freq_khz = 0;
+    uint64_t datarate = 0;
+    bool has_channel = false;
+    nonstd::string_view channel;
+
+    uint32_t dlt = 0;
+    bool has_ts = false;
+    uint64_t ts_s = 0;
+    uint64_t ts_us = 0;
+    bool has_length = false;
+    uint32_t length = 0;
+    bool has_content = false;
+    nonstd::string_view content;
+};
+
+// Decode a v3 data report directly from the frame, without building an mpack tree.
+// Returns false if the report is malformed or carries any other blocks (such as gps or
+// json), in which case it needs the full tree decoder.
+bool kis_v3_decode_packet_report(const nonstd::string_view& frame, kis_v3_packet_report& report);
+
 class kis_datasource_builder : public tracker_component {
 public:
     kis_datasource_builder() :
@@ -105,6 +137,13 @@ public:
     virtual std::shared_ptr<kis_datasource>
         build_datasource(std::shared_ptr<kis_datasource_builder> in_shared_builder) { return nullptr; };
 
+    // Split a definition which names several inputs (such as a directory of capture
+    // files) into one definition per source; an empty vector opens the definition
+    // as a single source
+    virtual std::vector<std::string> expand_definition(const std::string& in_definition __attribute__((unused))) {
+        return std::vector<std::string>{};
+    }
+
     __Proxy(source_type, std::string, std::string, std::string, source_type);
     __Proxy(source_description, std::string, std::string, std::string, source_description);
 
@@ -391,6 +430,20 @@ public:
     __ProxyM(source_num_error_packets, uint64_t, uint64_t, uint64_t, source_num_error_packets, data_mutex);
     __ProxyIncDecM(Msource_num_error_packets, uint64_t, uint64_t, source_num_error_packets, data_mutex);
 
+    __ProxyM(source_num_local_dropped, uint64_t, uint64_t, uint64_t, source_num_local_dropped, data_mutex);
+    __ProxyM(source_num_local_dropped_bytes, uint64_t, uint64_t, uint64_t, source_num_local_dropped_bytes, data_mutex);
+
+    __ProxyM(source_num_kernel_packets, uint64_t, uint64_t, uint64_t, source_num_kernel_packets, data_mutex);
+    __ProxyM(source_num_kernel_dropped, uint64_t, uint64_t, uint64_t, source_num_kernel_dropped, data_mutex);
+    __ProxyM(source_num_kernel_freezes, uint64_t, uint64_t, uint64_t, source_num_kernel_freezes, data_mutex);
+
+    __ProxyGetM(source_num_compressed_bytes, uint64_t, uint64_t, source_num_compressed_bytes, data_mutex);
+    __ProxyGetM(source_num_uncompressed_bytes, uint64_t, uint64_t, source_num_uncompressed_bytes, data_mutex);
+    __ProxyGetM(source_compression_ratio, double, double, source_compression_ratio, data_mutex);
+    __ProxyGetM(source_decompress_usec, uint64_t, uint64_t, source_decompress_usec, data_mutex);
+
+    __ProxyGetM(source_num_summarized_beacons, uint64_t, uint64_t, source_num_summarized_beacons, data_mutex);
+
     __ProxyDynamicTrackableM(source_packet_rrd, kis_tracked_rrd<>,
             packet_rate_rrd, packet_rate_rrd_id, data_mutex);
 
@@ -469,9 +522,13 @@ public:
     // Manipulate incoming packet data before it is inserted into the base packet; Subclasses can use
     // this to modify the data before it hits the linkframe to minimize copy overhead.  When replacing
     // this function, replacements MUST implement the full timestamp, RRD update, etc found in the
-    // base function.
+    // base function.  The tree form extracts the packet block and passes it to the report form,
+    // which is also called directly for reports decoded without a tree, so replacements should
+    // override the report form.
     virtual void handle_rx_datalayer_v3(std::shared_ptr<kis_packet> packet,
             mpack_node_t& root, mpack_tree_t *tree);
+    virtual void handle_rx_datalayer_v3(std::shared_ptr<kis_packet> packet,
+            const kis_v3_packet_report& report);
 
     // Manipulate incoming packet json before it is inserted into the base packet; Subclasses can use
     // this to modify the json before it hits the jsoninfo buffer
@@ -618,6 +675,9 @@ protected:
     virtual void handle_packet_data_report_v3(uint32_t in_seqno, uint16_t code,
             const nonstd::string_view& in_packet,
             std::shared_ptr<boost::asio::streambuf> buffer);
+    virtual void handle_packet_batch_report_v3(uint32_t in_seqno, uint16_t code,
+            const nonstd::string_view& in_packet,
+            std::shared_ptr<boost::asio::streambuf> buffer);
 
 	virtual void handle_interfaces_report_v3_callback(uint32_t in_seqno, uint16_t code,
 			kis_unique_lock<kis_mutex>& lock, std::vector<shared_interface>& interfaces);
@@ -634,6 +694,18 @@ protected:
     virtual void handle_packet_probesource_report_v3(uint32_t in_seqno, uint16_t code,
             const nonstd::string_view& in_packet);
 
+    virtual void handle_packet_credit_report_v3(uint32_t in_seqno, uint16_t code,
+            const nonstd::string_view& in_packet);
+
+    virtual void handle_packet_capture_stats_v3(uint32_t in_seqno, uint16_t code,
+            const nonstd::string_view& in_packet);
+
+    virtual void handle_compression_stats(size_t in_wire_sz, size_t in_raw_sz,
+            uint64_t in_usec) override;
+
+    virtual void handle_packet_beacon_summary_v3(uint32_t in_seqno, uint16_t code,
+            const nonstd::string_view& in_packet);
+
     virtual unsigned int send_configure_channel_v3(const std::string& in_channel,
             unsigned int in_transaction, configure_callback_t in_cb);
     virtual unsigned int send_configure_channel_hop_v3(double in_rate,
@@ -646,6 +718,7 @@ protected:
             unsigned int in_transaction, open_callback_t in_cb);
     virtual unsigned int send_probe_source_v3(const std::string& in_defintion,
             unsigned int in_transaction, probe_callback_t in_cb);
+    virtual unsigned int send_credit_v3(uint32_t in_grant);
 
     virtual void handle_msg_proxy(const std::string& msg, const int type) override;
 
@@ -657,6 +730,23 @@ protected:
     virtual std::shared_ptr<kis_layer1_packinfo> handle_sub_signal(mpack_node_t& root,
             mpack_tree_t *tree);
 
+    // process a single data report, from either a packet frame or an entry in a batch; the
+    // defaults are the batch level gps and signal records, if any
+    virtual void handle_rx_report_v3(std::shared_ptr<kis_packet> packet,
+            mpack_node_t& root, mpack_tree_t *tree,
+            const std::shared_ptr<kis_gps_packinfo>& default_gps,
+            const std::shared_ptr<kis_layer1_packinfo>& default_signal);
+    virtual void handle_rx_report_v3(std::shared_ptr<kis_packet> packet,
+            const kis_v3_packet_report& report);
+
+    // add the no-gps marker or device gps to a packet which didn't report a location
+    void handle_rx_source_gps(const std::shared_ptr<kis_packet>& packet);
+
+    // parse a report frame into a tree using the node pool, falling back to allocated
+    // nodes if it doesn't fit; must be called under ext_mutex
+    bool parse_report_v3(mpack_tree_t *tree, const nonstd::string_view& frame);
+    std::vector<mpack_node_data_t> report_node_pool;
+
 #ifdef HAVE_PROTOBUF_CPP
     // legacy v2 protocol handlers, to be phased out.  these are all optional, and require Kismet to be
     // compiled with protobufs support.
@@ -778,6 +868,24 @@ protected:
     std::shared_ptr<tracker_element_uint64> source_num_packets;
     std::shared_ptr<tracker_element_uint64> source_num_error_packets;
 
+    // Packets and bytes dropped by the capture itself for lack of flow control credit
+    std::shared_ptr<tracker_element_uint64> source_num_local_dropped;
+    std::shared_ptr<tracker_element_uint64> source_num_local_dropped_bytes;
+
+    // Totals from the kernel capture ring, for captures which use one
+    std::shared_ptr<tracker_element_uint64> source_num_kernel_packets;
+    std::shared_ptr<tracker_element_uint64> source_num_kernel_dropped;
+    std::shared_ptr<tracker_element_uint64> source_num_kernel_freezes;
+
+    // Compressed data from network captures, and what it cost us to decompress it
+    std::shared_ptr<tracker_element_uint64> source_num_compressed_bytes;
+    std::shared_ptr<tracker_element_uint64> source_num_uncompressed_bytes;
+    std::shared_ptr<tracker_element_double> source_compression_ratio;
+    std::shared_ptr<tracker_element_uint64> source_decompress_usec;
+
+    // Beacons the capture counted in a summary instead of sending
+    std::shared_ptr<tracker_element_uint64> source_num_summarized_beacons;
+
     int packet_rate_rrd_id;
     std::shared_ptr<kis_tracked_rrd<>> packet_rate_rrd;
 
@@ -822,6 +930,31 @@ protected:
     // Timer ID for trying to recover from an error
     int error_timer_id;
 
+    // Credit based flow control, enabled when the capture advertises support in the
+    // open report.  Credit is topped back up to the window as the capture uses it, as
+    // long as the packet queue has room; the timer re-grants credit to a capture which
+    // has run dry while the queue was full.
+    size_t flow_credit_window;
+    bool flow_control;
+    size_t flow_credit_outstanding;
+    int flow_timer_id;
+
+    void grant_flow_credit();
+    void consume_flow_credit(size_t in_count);
+
+    // Batching limits offered to the capture in the open request
+    unsigned int batch_max;
+    unsigned int batch_delay_us;
+
+    // Deflate level offered to the capture in the open request; captures only use it
+    // over network connections
+    unsigned int compression_level;
+
+    // Beacon summaries requested from the capture, and how often a repeated beacon
+    // is sent in full anyway
+    bool beacon_summary;
+    unsigned int beacon_summary_refresh;
+
     // Function that gets called when we encounter an error; allows for scheduling
     // bringup, etc
     virtual void handle_source_error();
@@ -881,7 +1014,7 @@ protected:
     // Packet components we inject
     int pack_comp_report, pack_comp_linkframe, pack_comp_l1info, pack_comp_l1_agg,
         pack_comp_gps, pack_comp_no_gps,
-        pack_comp_datasrc, pack_comp_json, pack_comp_protobuf;
+        pack_comp_datasrc, pack_comp_json, pack_comp_protobuf, pack_comp_beacon_summary;
 
 };
 
@@ -37,8 +37,31 @@ kis_dlt_handler::kis_dlt_handler() :
         packetchain->register_handler([](void *auxdata, const std::shared_ptr<kis_packet>& p) -> int {
                 auto dlthandler = reinterpret_cast<kis_dlt_handler *>(auxdata);
                 return dlthandler->handle_packet(p);
-            }, this, CHAINPOS_POSTCAP, 0);
+            }, this, CHAINPOS_POSTCAP, 0, "dlt handler");
 
+    register_components();
+}
+
+kis_dlt_handler::kis_dlt_handler(int in_dlt, const std::string& in_dlt_name) :
+    lifetime_global(),
+    dlt_name {in_dlt_name},
+    dlt {in_dlt} {
+
+    packetchain =
+        Globalreg::fetch_mandatory_global_as<packet_chain>();
+
+    register_components();
+
+    chainid =
+        packetchain->register_handler([](void *auxdata, const std::shared_ptr<kis_packet>& p) -> int {
+                auto dlthandler = reinterpret_cast<kis_dlt_handler *>(auxdata);
+                return dlthandler->handle_packet(p);
+            }, this, CHAINPOS_POSTCAP, 0,
+            packet_chain::pc_interest{{dlt}, {pack_comp_linkframe}},
+            fmt::format("{} dlt handler", dlt_name));
+}
+
+void kis_dlt_handler::register_components() {
 	pack_comp_linkframe =
 		packetchain->register_packet_component("LINKFRAME");
     pack_comp_l1data =
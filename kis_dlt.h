@@ -30,12 +30,16 @@
 class kis_dlt_handler : public lifetime_global {
 public:
 	kis_dlt_handler();
+	// Handlers which declare their DLT up front are only called for packets of that DLT
+	kis_dlt_handler(int in_dlt, const std::string& in_dlt_name);
 	virtual ~kis_dlt_handler();
 
 	virtual int fetch_dlt() { return dlt; }
 	virtual std::string fetch_dlt_name() { return dlt_name; }
 
 protected:
+	void register_components();
+
 	virtual int handle_packet(const std::shared_ptr<kis_packet>& in_pack) = 0;
 
 	std::string dlt_name;
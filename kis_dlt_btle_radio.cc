@@ -30,10 +30,7 @@
 #include "kis_dlt_btle_radio.h"
 
 kis_dlt_btle_radio::kis_dlt_btle_radio() :
-    kis_dlt_handler() {
-
-    dlt_name = "BTLE_RADIO";
-    dlt = KDLT_BTLE_RADIO;
+    kis_dlt_handler(KDLT_BTLE_RADIO, "BTLE_RADIO") {
 
     _MSG("Registering support for DLT_BTLE_RADIO packet header decoding", MSGFLAG_INFO);
 }
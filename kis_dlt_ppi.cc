@@ -35,10 +35,7 @@
 #include "gpstracker.h"
 
 kis_dlt_ppi::kis_dlt_ppi() :
-    kis_dlt_handler() {
-
-        dlt_name = "PPI";
-        dlt = DLT_PPI;
+    kis_dlt_handler(DLT_PPI, "PPI") {
 
         _MSG("Registering support for DLT_PPI packet header decoding", MSGFLAG_INFO);
     }
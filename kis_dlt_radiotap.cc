@@ -69,10 +69,7 @@
 #endif
 
 kis_dlt_radiotap::kis_dlt_radiotap() :
-	kis_dlt_handler() {
-
-	dlt_name = "Radiotap";
-	dlt = DLT_IEEE802_11_RADIO;
+	kis_dlt_handler(DLT_IEEE802_11_RADIO, "Radiotap") {
 
 	_MSG("Registering support for DLT_RADIOTAP packet header decoding", MSGFLAG_INFO);
 
@@ -447,8 +444,9 @@ int kis_dlt_radiotap::handle_packet(const std::shared_ptr<kis_packet>& in_pack)
     if (!fcs_cut && fcs_flag_invalid) {
         fcschunk = packetchain->new_packet_component<kis_packet_checksum>();
 
-        char junkfcs[] = "\xFF\xFF\xFF\xFF";
-        fcschunk->copy_raw_data(junkfcs, 4);
+        // static junk, so it can be a view instead of a per-packet copy
+        static const char junkfcs[] = "\xFF\xFF\xFF\xFF";
+        fcschunk->set_data(nonstd::string_view(junkfcs, 4));
 
         fcschunk->checksum_valid = 0;
 
@@ -17,8 +17,16 @@
 */
 
 #include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include <zlib.h>
+
 #include "boost/asio/use_future.hpp"
 #include "configfile.h"
 
@@ -42,6 +50,87 @@
 #include "protobuf_cpp/eventbus.pb.h"
 #endif
 
+kis_external_shm::~kis_external_shm() {
+    if (ring != nullptr)
+        munmap(ring, map_sz);
+
+    if (mem_fd >= 0)
+        ::close(mem_fd);
+
+    if (data_fd >= 0)
+        ::close(data_fd);
+
+    if (space_fd >= 0)
+        ::close(space_fd);
+}
+
+bool kis_external_shm::create(size_t in_ring_sz) {
+#ifdef __linux__
+    in_ring_sz -= in_ring_sz % KIS_EXTERNAL_SHM_ALIGN;
+
+    if (in_ring_sz < MAX_EXTERNAL_FRAME_LEN * 2) {
+        _MSG_ERROR("Kismet external interface shared memory ring must be at least {} bytes",
+                MAX_EXTERNAL_FRAME_LEN * 2);
+        return false;
+    }
+
+    data_sz = in_ring_sz;
+    map_sz = sizeof(kismet_external_shm_ring_t) + data_sz;
+
+    if ((mem_fd = memfd_create("kismet_ipc", MFD_CLOEXEC)) < 0) {
+        _MSG_ERROR("Kismet external interface could not create shared memory ring: {}",
+                kis_strerror_r(errno));
+        return false;
+    }
+
+    if (ftruncate(mem_fd, map_sz) < 0) {
+        _MSG_ERROR("Kismet external interface could not size shared memory ring: {}",
+                kis_strerror_r(errno));
+        return false;
+    }
+
+    auto map = mmap(nullptr, map_sz, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+
+    if (map == MAP_FAILED) {
+        _MSG_ERROR("Kismet external interface could not map shared memory ring: {}",
+                kis_strerror_r(errno));
+        return false;
+    }
+
+    ring = static_cast<kismet_external_shm_ring_t *>(map);
+
+    ring->signature = KIS_EXTERNAL_SHM_SIG;
+    ring->version = KIS_EXTERNAL_SHM_VERSION;
+    ring->data_sz = data_sz;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->producer_waiting = 0;
+    // Nothing is reading until the helper registers, so the first frame always
+    // wakes the server
+    ring->consumer_waiting = 1;
+
+    if ((data_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0 ||
+            (space_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+        _MSG_ERROR("Kismet external interface could not create shared memory ring events: {}",
+                kis_strerror_r(errno));
+        return false;
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::string kis_external_shm::env() const {
+    return fmt::format("{},{},{}", mem_fd, data_fd, space_fd);
+}
+
+void kis_external_shm::inherit() const {
+    for (auto fd : {mem_fd, data_fd, space_fd})
+        fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) & ~FD_CLOEXEC);
+}
+
 kis_external_ipc::~kis_external_ipc() {
     close_impl();
 
@@ -238,6 +327,107 @@ void kis_external_ipc::write_impl() {
             }));
 }
 
+bool kis_external_ipc::start_shm_read() {
+    if (shm_ == nullptr || shm_evt_.is_open())
+        return false;
+
+    // The descriptor takes over the data event
+    shm_evt_.assign(shm_->data_fd);
+    shm_->data_fd = -1;
+
+    shm_drain();
+
+    return true;
+}
+
+void kis_external_ipc::shm_release(uint64_t tail) {
+    auto ring = shm_->ring;
+
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_SEQ_CST);
+
+    if (__atomic_exchange_n(&ring->producer_waiting, 0, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        if (::write(shm_->space_fd, &one, sizeof(one)) < 0) { }
+    }
+}
+
+void kis_external_ipc::shm_drain() {
+    if (stopped_)
+        return;
+
+    auto ring = shm_->ring;
+
+    // Don't hold the strand for too long at a time, so that the pipe is still serviced
+    for (unsigned int n = 0; n < 256; n++) {
+        auto tail = ring->tail;
+        auto head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            // Flag that we're waiting before checking one last time, so the helper
+            // either sees the flag or we see its frame
+            __atomic_store_n(&ring->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+
+            if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == tail)
+                return shm_wait();
+
+            __atomic_store_n(&ring->consumer_waiting, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        auto offt = tail % shm_->data_sz;
+        auto contig = shm_->data_sz - offt;
+        auto frame = reinterpret_cast<const kismet_external_frame_v3_t *>(ring->data + offt);
+
+        // The rest of the ring was skipped so the next frame didn't wrap
+        if (contig < sizeof(kismet_external_frame_v3_t) || frame->signature == 0) {
+            shm_release(tail + contig);
+            continue;
+        }
+
+        size_t frame_sz = sizeof(kismet_external_frame_v3_t) + kis_ntoh32(frame->length);
+
+        if (frame_sz > contig || frame_sz >= MAX_EXTERNAL_FRAME_LEN || frame_sz > head - tail) {
+            _MSG_ERROR("Kismet external interface got an invalid frame from the shared "
+                    "memory ring; the helper may have crashed or be out of date.");
+            close();
+            return interface_->trigger_error("invalid frame in shared memory ring");
+        }
+
+        auto r = interface_->handle_packet(reinterpret_cast<const char *>(frame), frame_sz, nullptr);
+
+        shm_release(tail + frame_sz + (KIS_EXTERNAL_SHM_ALIGN - 1) - 
+                ((frame_sz + (KIS_EXTERNAL_SHM_ALIGN - 1)) % KIS_EXTERNAL_SHM_ALIGN));
+
+        if (r < 0) {
+            if (!stopped_)
+                close();
+            return;
+        }
+    }
+
+    boost::asio::post(strand(),
+            [self = shared_from_base<kis_external_ipc>()]() {
+                self->shm_drain();
+            });
+}
+
+void kis_external_ipc::shm_wait() {
+    shm_evt_.async_read_some(boost::asio::buffer(&shm_evt_val_, sizeof(shm_evt_val_)),
+            boost::asio::bind_executor(strand(),
+                [self = shared_from_base<kis_external_ipc>()](const boost::system::error_code& ec, std::size_t) {
+                    if (ec) {
+                        if (self->stopped_ || ec.value() == boost::asio::error::operation_aborted)
+                            return;
+
+                        self->close();
+                        return self->interface_->trigger_error(fmt::format("IPC shared memory "
+                                    "ring error: {}", ec.message()));
+                    }
+
+                    self->shm_drain();
+                }));
+}
+
 void kis_external_ipc::close() {
     if (strand().running_in_this_thread()) {
         close_impl();
@@ -270,6 +460,13 @@ void kis_external_ipc::close_impl() {
         } catch (...) { }
     }
 
+    if (shm_evt_.is_open()) {
+        try {
+            shm_evt_.cancel();
+            shm_evt_.close();
+        } catch (...) { }
+    }
+
     if (ipc_.pid > 0) {
         kill(ipc_.pid, SIGTERM);
     }
@@ -363,7 +560,9 @@ int kis_external_tcp::packet_read() {
 
     total_length -= sizeof(kismet_external_frame_stub_t);
 
-    if (total_length > MAX_EXTERNAL_FRAME_LEN) {
+    // Multiplexed frames wrap a full-size frame in one more header; the
+    // frame type is checked once the whole frame has been read
+    if (total_length > MAX_EXTERNAL_MUX_FRAME_LEN) {
         _MSG_ERROR("Kismet external interface got command frame which is "
                 "too large to be processed ({}); either the frame is malformed "
                 "or the connection is from a very old legacy Kismet version using "
@@ -490,6 +689,28 @@ void kis_external_tcp::write_impl() {
             }));
 }
 
+void kis_external_mux_io::write(const char *data, size_t len) {
+    if (stopped())
+        return;
+
+    std::string frame_buf;
+    frame_buf.resize(sizeof(kismet_external_frame_v3_t) + len);
+
+    auto frame = reinterpret_cast<kismet_external_frame_v3_t *>(&frame_buf[0]);
+
+    frame->signature = kis_hton32(KIS_EXTERNAL_PROTO_SIG);
+    frame->v3_sentinel = kis_hton16(KIS_EXTERNAL_V3_SIG);
+    frame->v3_version = kis_hton16(3);
+    frame->length = kis_hton32(len);
+    frame->pkt_type = kis_hton16(KIS_EXTERNAL_V3_CMD_MUX);
+    frame->code = kis_hton16(channel_);
+    frame->seqno = 0;
+
+    memcpy(frame->data, data, len);
+
+    parent_->write(frame_buf.data(), frame_buf.size());
+}
+
 void kis_external_ws::write_impl() {
     if (out_bufs_.size() == 0)
         return;
@@ -543,6 +764,7 @@ kis_external_interface::kis_external_interface() :
     ping_timer_id{-1},
     io_{nullptr},
     protocol_version{3},
+    inflating{false},
     eventbus{Globalreg::fetch_mandatory_global_as<event_bus>()},
     http_session_id{0} {
 
@@ -767,6 +989,20 @@ bool kis_external_interface::run_ipc() {
         return false;
     }
 
+    // Offer the helper a shared memory ring for data; helpers which don't support it
+    // ignore the environment and keep using the pipe
+    std::shared_ptr<kis_external_shm> shm;
+
+    auto shm_kb =
+        Globalreg::globalreg->kismet_config->fetch_opt_as<size_t>("ipc_shm_ring_kb", 4096);
+
+    if (shm_kb > 0) {
+        shm = std::make_shared<kis_external_shm>();
+
+        if (!shm->create(shm_kb * 1024))
+            shm.reset();
+    }
+
     // We don't need to do signal masking because we run a dedicated signal handling thread
 
     char **cmdarg;
@@ -810,6 +1046,11 @@ bool kis_external_interface::run_ipc() {
         ::close(inpipepair[1]);
         ::close(outpipepair[0]);
 
+        if (shm != nullptr) {
+            shm->inherit();
+            setenv(KIS_EXTERNAL_SHM_ENV, shm->env().c_str(), 1);
+        }
+
         execvp(cmdarg[0], cmdarg);
 
         exit(255);
@@ -838,29 +1079,40 @@ bool kis_external_interface::run_ipc() {
 
     ipctracker->register_ipc(ipc);
 
-    io_ = std::make_shared<kis_external_ipc>(shared_from_this(), ipc, ipc_in, ipc_out);
+    // Only the helper needs the ring memfd now that it's mapped
+    if (shm != nullptr) {
+        ::close(shm->mem_fd);
+        shm->mem_fd = -1;
+    }
+
+    io_ = std::make_shared<kis_external_ipc>(shared_from_this(), ipc, ipc_in, ipc_out, shm);
     io_->start_read();
 
     return true;
 }
 
 int kis_external_interface::handle_packet(std::shared_ptr<boost::asio::streambuf> buffer) {
+    return handle_packet(static_cast<const char *>(buffer->data().data()), buffer->size(), buffer);
+}
+
+int kis_external_interface::handle_packet(const char *data, size_t len,
+        std::shared_ptr<boost::asio::streambuf> buffer) {
     const kismet_external_frame_t *frame = nullptr;
     const kismet_external_frame_v2_t *frame_v2 = nullptr;
     const kismet_external_frame_v3_t *frame_v3 = nullptr;
     uint32_t frame_sz, data_sz;
 
     // See if we have enough to get a frame header
-    size_t buffamt = buffer->size();
+    size_t buffamt = len;
 
     if (buffamt < sizeof(kismet_external_frame_t)) {
         _MSG_ERROR("Kismet external interface got command frame with invalid size");
         return result_handle_packet_needbuf;
     }
 
-    frame = static_cast<const kismet_external_frame_t *>(buffer->data().data());
-    frame_v2 = static_cast<const kismet_external_frame_v2_t *>(buffer->data().data());
-    frame_v3 = static_cast<const kismet_external_frame_v3_t *>(buffer->data().data());
+    frame = reinterpret_cast<const kismet_external_frame_t *>(data);
+    frame_v2 = reinterpret_cast<const kismet_external_frame_v2_t *>(data);
+    frame_v3 = reinterpret_cast<const kismet_external_frame_v3_t *>(data);
 
     // Check the frame signature
     if (kis_ntoh32(frame->signature) != KIS_EXTERNAL_PROTO_SIG) {
@@ -927,7 +1179,15 @@ int kis_external_interface::handle_packet(std::shared_ptr<boost::asio::streambuf
         data_sz = kis_ntoh32(frame_v3->length);
         frame_sz = data_sz + sizeof(kismet_external_frame_v3);
 
-        if (frame_sz >= MAX_EXTERNAL_FRAME_LEN) {
+        uint32_t seqno = kis_ntoh32(frame_v3->seqno);
+        uint16_t command = kis_ntoh16(frame_v3->pkt_type);
+        uint16_t code = kis_ntoh16(frame_v3->code);
+
+        size_t max_frame_sz = MAX_EXTERNAL_FRAME_LEN;
+        if (command == KIS_EXTERNAL_V3_CMD_MUX)
+            max_frame_sz = MAX_EXTERNAL_MUX_FRAME_LEN;
+
+        if (frame_sz >= max_frame_sz) {
             _MSG_ERROR("Kismet external interface got an oversized command "
                     "frame.  You most likely need to upgrade the Kismet datasource "
                     "binaries (kismet_cap_...) to match your Kismet server version.");
@@ -940,10 +1200,6 @@ int kis_external_interface::handle_packet(std::shared_ptr<boost::asio::streambuf
             return result_handle_packet_needbuf;
         }
 
-        uint32_t seqno = kis_ntoh32(frame_v3->seqno);
-        uint16_t command = kis_ntoh16(frame_v3->pkt_type);
-        uint16_t code = kis_ntoh16(frame_v3->code);
-
         nonstd::string_view content((const char *) frame_v3->data, data_sz);
 
         // If we've gotten this far it's a valid newer protocol, switch to v2 mode
@@ -990,6 +1246,12 @@ bool kis_external_interface::dispatch_rx_packet_v3(std::shared_ptr<boost::asio::
     // their own dispatch if this returns false.
 
     switch (command) {
+        case KIS_EXTERNAL_V3_CMD_REGISTER:
+            handle_packet_register_v3(seqno, code, content);
+            return true;
+        case KIS_EXTERNAL_V3_CMD_COMPRESSED:
+            handle_packet_compressed_v3(seqno, code, content);
+            return true;
         case KIS_EXTERNAL_V3_CMD_MESSAGE:
             handle_packet_message_v3(seqno, code, content);
             return true;
@@ -1108,6 +1370,94 @@ void kis_external_interface::handle_packet_shutdown_v3(uint32_t in_seqno,
 }
 
 // Send events from the eventbus to any subscribed consumers on the external protocol
+void kis_external_interface::handle_packet_register_v3(uint32_t in_seqno,
+        uint16_t code, const nonstd::string_view& in_content) {
+    mpack_tree_raii tree;
+    mpack_node_t root;
+
+    mpack_tree_init_data(&tree, in_content.data(), in_content.length());
+
+    if (!mpack_tree_try_parse(&tree)) {
+        _MSG_ERROR("Kismet external interface got unparseable v3 REGISTER");
+        trigger_error("invalid v3 REGISTER");
+        return;
+    }
+
+    root = mpack_tree_root(&tree);
+
+    auto shm_n = mpack_node_map_uint_optional(root, KIS_EXTERNAL_V3_REGISTER_FIELD_SHMRING);
+    if (mpack_node_is_missing(shm_n) || mpack_node_u8(shm_n) == 0)
+        return;
+
+    auto ipc_io = std::dynamic_pointer_cast<kis_external_ipc>(io_);
+
+    if (ipc_io == nullptr || !ipc_io->start_shm_read()) {
+        _MSG_ERROR("Kismet external interface got a shared memory ring registration "
+                "from a helper which was not offered a ring");
+        trigger_error("unexpected shared memory ring registration");
+    }
+}
+
+void kis_external_interface::handle_packet_compressed_v3(uint32_t in_seqno,
+        uint16_t code, const nonstd::string_view& in_content) {
+
+    if (inflating) {
+        _MSG_ERROR("Kismet external interface got a nested v3 COMPRESSED frame");
+        trigger_error("nested v3 COMPRESSED");
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (inflater == nullptr) {
+        inflater = std::shared_ptr<z_stream>(new z_stream{},
+                [](z_stream *z) {
+                    inflateEnd(z);
+                    delete z;
+                });
+
+        if (inflateInit(inflater.get()) != Z_OK) {
+            inflater.reset();
+            _MSG_ERROR("Kismet external interface could not initialize decompression");
+            trigger_error("could not initialize decompression");
+            return;
+        }
+
+        inflate_buf.resize(MAX_EXTERNAL_FRAME_LEN);
+    } else if (code & KIS_EXTERNAL_V3_COMPRESSED_RESET) {
+        inflateReset(inflater.get());
+    }
+
+    inflater->next_in = (Bytef *) in_content.data();
+    inflater->avail_in = in_content.length();
+    inflater->next_out = (Bytef *) inflate_buf.data();
+    inflater->avail_out = inflate_buf.size();
+
+    auto r = inflate(inflater.get(), Z_SYNC_FLUSH);
+
+    // Each compressed frame holds exactly one complete frame
+    if ((r != Z_OK && r != Z_BUF_ERROR) || inflater->avail_in != 0) {
+        _MSG_ERROR("Kismet external interface got an invalid v3 COMPRESSED frame");
+        trigger_error("invalid v3 COMPRESSED");
+        return;
+    }
+
+    auto raw_sz = inflate_buf.size() - inflater->avail_out;
+
+    handle_compression_stats(in_content.length() + sizeof(kismet_external_frame_v3_t), raw_sz,
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                start).count());
+
+    inflating = true;
+    auto hr = handle_packet(inflate_buf.data(), raw_sz, nullptr);
+    inflating = false;
+
+    if (hr == result_handle_packet_needbuf) {
+        _MSG_ERROR("Kismet external interface got a truncated frame in a v3 COMPRESSED frame");
+        trigger_error("truncated v3 COMPRESSED");
+    }
+}
+
 void kis_external_interface::proxy_event(std::shared_ptr<eventbus_event> evt) {
     std::stringstream ss;
     json_adapter::pack(ss, evt);
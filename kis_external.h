@@ -58,6 +58,40 @@ using boost::asio::ip::tcp;
 // maximum size of a single IPC protocol frame
 #define MAX_EXTERNAL_FRAME_LEN       16384
 
+// maximum size of a multiplexed frame, which wraps a frame of up to the maximum size
+#define MAX_EXTERNAL_MUX_FRAME_LEN   (MAX_EXTERNAL_FRAME_LEN + sizeof(kismet_external_frame_v3_t))
+
+// Shared memory ring offered to a local helper for its data frames; the ring layout
+// and handshake are described in kis_external_packet.h
+class kis_external_shm {
+public:
+    kis_external_shm() = default;
+    ~kis_external_shm();
+
+    // Create and map the ring and its eventfds; fails if shared memory isn't
+    // available on this platform
+    bool create(size_t in_ring_sz);
+
+    // Environment value handing the ring to the helper
+    std::string env() const;
+
+    // Let the descriptors survive exec in the forked helper
+    void inherit() const;
+
+    int mem_fd = -1;
+    int data_fd = -1;
+    int space_fd = -1;
+
+    kismet_external_shm_ring_t *ring = nullptr;
+    size_t map_sz = 0;
+
+    // Size of the ring data area as created; the copy in the mapping is writable by
+    // the helper and must not be trusted
+    size_t data_sz = 0;
+};
+
+struct z_stream_s;
+
 // Namespace stub and forward class definition to make deps hopefully easier going forward
 namespace KismetExternal {
     class Command;
@@ -147,12 +181,16 @@ public:
     kis_external_ipc(std::shared_ptr<kis_external_interface> iface,
             kis_ipc_record& ipc,
             boost::asio::posix::stream_descriptor &ipc_in,
-            boost::asio::posix::stream_descriptor &ipc_out) :
+            boost::asio::posix::stream_descriptor &ipc_out,
+            std::shared_ptr<kis_external_shm> shm = nullptr) :
         kis_external_io{iface},
         ipc_in_{std::move(ipc_in)},
         ipc_out_{std::move(ipc_out)},
         ipc_{ipc},
-        ipctracker_{Globalreg::fetch_mandatory_global_as<ipc_tracker_v2>()} { }
+        ipctracker_{Globalreg::fetch_mandatory_global_as<ipc_tracker_v2>()},
+        shm_{shm},
+        shm_evt_{Globalreg::globalreg->io},
+        shm_evt_val_{0} { }
 
     virtual ~kis_external_ipc() override;
 
@@ -169,11 +207,25 @@ public:
 
     void close_impl();
 
+    // Start reading data frames from the shared memory ring once the helper has
+    // registered that it uses it; fails if no ring was offered
+    bool start_shm_read();
+
     boost::asio::posix::stream_descriptor ipc_in_, ipc_out_;
 
     kis_ipc_record &ipc_;
 
     std::shared_ptr<ipc_tracker_v2> ipctracker_;
+
+protected:
+    // Process the frames in the ring in place, then wait for the helper to signal more
+    void shm_drain();
+    void shm_wait();
+    void shm_release(uint64_t tail);
+
+    std::shared_ptr<kis_external_shm> shm_;
+    boost::asio::posix::stream_descriptor shm_evt_;
+    uint64_t shm_evt_val_;
 };
 
 class kis_external_tcp : public kis_external_io {
@@ -233,6 +285,45 @@ public:
     cb_func_t write_cb_;
 };
 
+// One channel of a multiplexed remote connection; frames written to the channel are
+// wrapped in MUX frames and sent over the parent connection.  Frames are read by the
+// session which owns the parent connection and handed to the channel interface, so
+// the channel shares the strand of the parent.
+class kis_external_mux_io : public kis_external_io {
+public:
+    kis_external_mux_io(std::shared_ptr<kis_external_interface> iface,
+            std::shared_ptr<kis_external_io> parent, uint16_t channel) :
+        kis_external_io{iface},
+        parent_{parent},
+        channel_{channel} { }
+
+    virtual boost::asio::io_context::strand &strand() override {
+        return parent_->strand();
+    }
+
+    virtual void start_read() override { };
+    virtual int packet_read() override { return 0; };
+
+    virtual void write(const char *data, size_t len) override;
+    virtual void write_impl() override { };
+
+    virtual bool connected() override {
+        return !stopped_ && parent_->connected();
+    }
+
+    virtual bool stopped() override {
+        return stopped_ || parent_->stopped();
+    }
+
+    uint16_t channel() const {
+        return channel_;
+    }
+
+protected:
+    std::shared_ptr<kis_external_io> parent_;
+    uint16_t channel_;
+};
+
 // External interface API bridge;
 class kis_external_interface : public std::enable_shared_from_this<kis_external_interface> {
 public:
@@ -463,6 +554,12 @@ protected:
     virtual void handle_packet_ping_v3(uint32_t in_seqno, uint16_t code, const nonstd::string_view& in_content);
     virtual void handle_packet_pong_v3(uint32_t in_seqno, uint16_t code, const nonstd::string_view& in_content);
     virtual void handle_packet_shutdown_v3(uint32_t in_seqno, uint16_t code, const nonstd::string_view& in_content);
+    virtual void handle_packet_register_v3(uint32_t in_seqno, uint16_t code, const nonstd::string_view& in_content);
+    virtual void handle_packet_compressed_v3(uint32_t in_seqno, uint16_t code, const nonstd::string_view& in_content);
+
+    // Called for each compressed frame with the compressed and decompressed sizes and the
+    // time spent decompressing it
+    virtual void handle_compression_stats(size_t in_wire_sz, size_t in_raw_sz, uint64_t in_usec) { }
 
     // Eventbus
     virtual void handle_packet_eventbus_register_v3(uint32_t in_seqno, uint16_t code, const nonstd::string_view& in_content);
@@ -497,6 +594,11 @@ protected:
 
     std::atomic<unsigned int> protocol_version;
 
+    // Inflate stream shared by all the compressed frames on this connection
+    std::shared_ptr<z_stream_s> inflater;
+    std::vector<char> inflate_buf;
+    bool inflating;
+
     // Eventbus proxy code
     std::shared_ptr<event_bus> eventbus;
     std::map<std::string, unsigned long> eventbus_callback_map;
@@ -547,6 +649,10 @@ public:
     // any longer-lifespan data like packet records; this is allocated from
     // the global buffer pool and will be recycled there automatically
     int handle_packet(std::shared_ptr<boost::asio::streambuf> buffer);
+
+    // Process a frame in place; buffer is null when the frame isn't in a network
+    // buffer, such as frames read from a shared memory ring
+    int handle_packet(const char *data, size_t len, std::shared_ptr<boost::asio::streambuf> buffer);
 };
 
 #endif
@@ -195,6 +195,8 @@ typedef struct kismet_external_frame_v3 {
 #define KIS_EXTERNAL_V3_CMD_SHUTDOWN                            4
 #define KIS_EXTERNAL_V3_CMD_MESSAGE                             5
 #define KIS_EXTERNAL_V3_CMD_ERROR                               6
+#define KIS_EXTERNAL_V3_CMD_COMPRESSED                          7
+#define KIS_EXTERNAL_V3_CMD_MUX                                 8
 
 
 /* datasource commands */
@@ -208,6 +210,11 @@ typedef struct kismet_external_frame_v3 {
 #define KIS_EXTERNAL_V3_KDS_CONFIGREQ                           17
 #define KIS_EXTERNAL_V3_KDS_CONFIGREPORT                        18
 #define KIS_EXTERNAL_V3_KDS_NEWSOURCE                           19
+#define KIS_EXTERNAL_V3_KDS_CREDIT                              20
+#define KIS_EXTERNAL_V3_KDS_CREDITREPORT                        21
+#define KIS_EXTERNAL_V3_KDS_PACKETBATCH                         22
+#define KIS_EXTERNAL_V3_KDS_CAPTURESTATS                        23
+#define KIS_EXTERNAL_V3_KDS_BEACONSUMMARY                       24
 
 /* eventbus commands */
 #define KIS_EXTERNAL_V3_EVT_REGISTER                            32
@@ -253,6 +260,56 @@ typedef struct kismet_external_frame_v3 {
  */
 /* string */
 #define KIS_EXTERNAL_V3_REGISTER_FIELD_SUBSYSTEM                1
+/* uint8, helper has mapped the shared memory ring offered in the environment and
+ * sends data frames through it from now on */
+#define KIS_EXTERNAL_V3_REGISTER_FIELD_SHMRING                  2
+
+
+/* Shared memory ring
+ *
+ * Helpers launched over IPC may be offered a shared memory ring for data frames,
+ * so that packets don't have to be copied through a pipe.  The server passes the
+ * ring memfd and two eventfds to the helper in the environment as
+ * "ring_fd,data_fd,space_fd".
+ *
+ * The ring has a single producer (the helper) and a single consumer (the server).
+ * Records are complete v3 frames, padded to KIS_EXTERNAL_SHM_ALIGN, and never wrap;
+ * a frame which would run past the end of the ring is preceded by a zero signature
+ * and written at the start of the ring instead.  Head and tail are free-running
+ * byte counts, in host order.
+ *
+ * The helper writes data_fd after publishing a frame if the server was waiting
+ * for data, and the server writes space_fd after consuming frames if the helper
+ * was waiting for space.
+ *
+ * Only KDS_PACKET and KDS_PACKETBATCH frames go through the ring, everything else
+ * stays on the pipe.  Data frames must not be sent through the ring until the
+ * helper has sent a CMD_REGISTER with FIELD_SHMRING.
+ */
+#define KIS_EXTERNAL_SHM_ENV            "KISMET_IPC_SHM"
+#define KIS_EXTERNAL_SHM_SIG            0x4B534852
+#define KIS_EXTERNAL_SHM_VERSION        1
+#define KIS_EXTERNAL_SHM_ALIGN          8
+
+typedef struct kismet_external_shm_ring {
+    uint32_t signature;
+    uint32_t version;
+
+    /* Size of the data area following the header */
+    uint64_t data_sz;
+
+    /* Helper write position */
+    uint64_t head __attribute__((aligned(64)));
+    /* Set by the helper when the ring is full, cleared by the server when it wakes it */
+    uint32_t producer_waiting;
+
+    /* Server read position */
+    uint64_t tail __attribute__((aligned(64)));
+    /* Set by the server when the ring is empty, cleared by the helper when it wakes it */
+    uint32_t consumer_waiting;
+
+    uint8_t data[0] __attribute__((aligned(64)));
+} kismet_external_shm_ring_t;
 
 
 /* KIS_EXTERNAL_V3_CMD_PING - no content required */
@@ -282,6 +339,41 @@ typedef struct kismet_external_frame_v3 {
 #define KIS_EXTERNAL_V3_ERROR_FIELD_STRING                      1
 
 
+/* KIS_EXTERNAL_V3_CMD_COMPRESSED
+ * External -> KS
+ *
+ * A complete v3 frame compressed with deflate (zlib format) and ended with a
+ * Z_SYNC_FLUSH; the content is the raw compressed data, not msgpack.  All the
+ * compressed frames on a connection share one deflate stream, so later frames
+ * compress against earlier ones.  A frame code of KIS_EXTERNAL_V3_COMPRESSED_RESET
+ * marks the start of a new stream.
+ *
+ * Only sent by datasources once the server has offered compression in the open
+ * request.
+ */
+#define KIS_EXTERNAL_V3_COMPRESSED_RESET                        1
+
+
+/* KIS_EXTERNAL_V3_CMD_MUX
+ * KS <-> External
+ *
+ * A complete v3 frame for one of several datasources sharing a single remote
+ * capture connection; the content is the raw inner frame, not msgpack.  The
+ * frame code carries the channel the inner frame belongs to, and the sequence
+ * number is unused; the inner frame has its own.
+ *
+ * Channels are assigned by the remote side.  The first frame on a channel
+ * must be a KDS_NEWSOURCE, after which the channel behaves exactly like a
+ * dedicated connection to that source: the server answers with MUX frames on
+ * the same channel.  A closed source stops answering on its channel; the
+ * remote side may re-use a channel by sending a new KDS_NEWSOURCE.
+ *
+ * An inner frame may be up to the maximum frame size, so a MUX frame may
+ * exceed it by one frame header.  Multiplexing is only supported on the remote
+ * capture TCP socket.
+ */
+
+
 /* Datasource specific commands and sub-blocks */
 
 
@@ -419,6 +511,26 @@ typedef struct kismet_external_frame_v3 {
     }
 
 
+/* KDS_PREFILTER_BLOCK
+ *
+ * Drop rules compiled by the server and evaluated by the datasource before a
+ * packet is encoded and sent.  Rules only apply to 802.11 packets (plain,
+ * radiotap, or PPI); everything else is always sent.  A datasource which doesn't
+ * support prefilters sends everything.
+ */
+/* array[u16] indexed by 802.11 frame type, bitmask of subtypes to drop */
+#define KIS_EXTERNAL_V3_KDS_SUB_PREFILTER_FIELD_DOT11_TYPES     1
+/* array of [u8 roles, u64 mac, u64 mask] rules; mac and mask hold the address
+ * bytes from the most significant byte down, and the rule drops a packet with an
+ * address in one of the roles where (address & mask) == mac */
+#define KIS_EXTERNAL_V3_KDS_SUB_PREFILTER_FIELD_MACS            2
+
+#define KIS_EXTERNAL_V3_PREFILTER_ROLE_SOURCE                   0x01
+#define KIS_EXTERNAL_V3_PREFILTER_ROLE_DEST                     0x02
+#define KIS_EXTERNAL_V3_PREFILTER_ROLE_NETWORK                  0x04
+#define KIS_EXTERNAL_V3_PREFILTER_ROLE_ANY                      0x07
+
+
 /* KIS_EXTERNAL_V3_KDS_PACKET
  *
  * datasource data report
@@ -471,6 +583,21 @@ typedef struct kismet_external_frame_v3 {
  * */
 /* source definition, as string */
 #define KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_DEFINITION            1
+/* uint32, maximum number of data reports the datasource may combine into
+ * a single KDS_PACKETBATCH; absent or 0 disables batching */
+#define KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_BATCH_MAX             2
+/* uint32, maximum time in microseconds a data report may be held waiting
+ * for the rest of a batch */
+#define KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_BATCH_DELAY_US        3
+/* prefilter sub-block */
+#define KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_PREFILTER             4
+/* uint8, deflate level the datasource may use to send data as CMD_COMPRESSED
+ * frames over a network connection; absent or 0 disables compression */
+#define KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_COMPRESSION           5
+/* uint32, seconds between full beacons from an access point whose beacon content
+ * hasn't changed; beacons in between are counted in KDS_BEACONSUMMARY frames.
+ * Absent or 0 disables beacon summaries */
+#define KIS_EXTERNAL_V3_KDS_OPENREQ_FIELD_BEACON_REFRESH        6
 
 
 
@@ -497,6 +624,8 @@ typedef struct kismet_external_frame_v3 {
 #define KIS_EXTERNAL_V3_KDS_OPENREPORT_FIELD_UUID               8
 /* string */
 #define KIS_EXTERNAL_V3_KDS_OPENREPORT_FIELD_MSG                9
+/* bool, datasource honors KDS_CREDIT flow control */
+#define KIS_EXTERNAL_V3_KDS_OPENREPORT_FIELD_FLOWCONTROL        10
 
 
 
@@ -567,6 +696,83 @@ typedef struct kismet_external_frame_v3 {
 #define KIS_EXTERNAL_V3_KDS_NEWSOURCE_FIELD_UUID                3
 
 
+/* KIS_EXTERNAL_V3_KDS_CREDIT
+ *
+ * KS -> Datasource
+ *
+ * Grant additional packet credit to a datasource which advertised flow control
+ * in the open report.  Once the first credit is received, the datasource may only
+ * send as many packets as it has been granted; packets captured without credit are
+ * dropped at the datasource and counted instead of being sent.
+ */
+/* uint32, number of additional packets the datasource may send */
+#define KIS_EXTERNAL_V3_KDS_CREDIT_FIELD_GRANT                  1
+
+
+/* KIS_EXTERNAL_V3_KDS_CREDITREPORT
+ *
+ * Datasource -> KS
+ *
+ * Totals of packets dropped locally for lack of credit, sent when a new credit
+ * grant arrives and the totals have changed.
+ */
+/* uint64, total packets dropped */
+#define KIS_EXTERNAL_V3_KDS_CREDITREPORT_FIELD_DROPPED          1
+/* uint64, total bytes dropped */
+#define KIS_EXTERNAL_V3_KDS_CREDITREPORT_FIELD_DROPPED_BYTES    2
+
+
+/* KIS_EXTERNAL_V3_KDS_PACKETBATCH
+ *
+ * Datasource -> KS
+ *
+ * Multiple data reports in a single frame, only sent when batching was enabled
+ * in the open request.  Each report is the same map as a KDS_PACKET frame and
+ * uses one flow control credit.  The batch GPS and signal blocks apply to any
+ * report which doesn't carry its own, and use the same field numbers as the
+ * data report so the same sub-block parsers handle both.
+ */
+/* gps sub-block */
+#define KIS_EXTERNAL_V3_KDS_PACKETBATCH_FIELD_GPSBLOCK          1
+/* signal sub-block */
+#define KIS_EXTERNAL_V3_KDS_PACKETBATCH_FIELD_SIGNALBLOCK       2
+/* array of data report maps */
+#define KIS_EXTERNAL_V3_KDS_PACKETBATCH_FIELD_REPORTS           3
+
+
+/* KIS_EXTERNAL_V3_KDS_CAPTURESTATS
+ *
+ * Datasource -> KS
+ *
+ * Totals from a kernel capture ring, sent periodically by captures which read from
+ * one and only when the totals have changed.
+ */
+/* uint64, total packets seen by the kernel, including drops */
+#define KIS_EXTERNAL_V3_KDS_CAPTURESTATS_FIELD_PACKETS          1
+/* uint64, total packets dropped by the kernel because the ring was full */
+#define KIS_EXTERNAL_V3_KDS_CAPTURESTATS_FIELD_DROPPED          2
+/* uint64, total times the kernel froze the ring queue */
+#define KIS_EXTERNAL_V3_KDS_CAPTURESTATS_FIELD_FREEZES          3
+
+
+/* KIS_EXTERNAL_V3_KDS_BEACONSUMMARY
+ *
+ * Datasource -> KS
+ *
+ * Beacons which were counted but not sent because their content matched the last
+ * full beacon from the same BSSID, sent periodically by captures which summarize
+ * beacons.  Each summary is an array of:
+ *
+ *   [bin BSSID (6 bytes), uint32 count, uint64 frequency in kHz,
+ *    int32 last signal dBm, int32 peak signal dBm, int32 last noise dBm,
+ *    uint64 last timestamp sec, uint64 last timestamp usec]
+ *
+ * Signal, noise, and frequency are 0 when the capture didn't report them.
+ */
+/* array[array] */
+#define KIS_EXTERNAL_V3_KDS_BEACONSUMMARY_FIELD_SUMMARIES       1
+
+
 /* KIS_EXTERNAL_V3_EVT_REGISTER
  *
  * remote -> KS
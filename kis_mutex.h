@@ -30,6 +30,7 @@
 #include <mutex>
 #include <shared_mutex>
 #include <thread>
+#include <vector>
 
 #include <limits.h>
 
@@ -52,7 +53,7 @@ public:
     kis_mutex(const kis_mutex&) = delete;
     kis_mutex& operator=(const kis_mutex&) = delete;
 
-    ~kis_mutex() = default;
+    virtual ~kis_mutex() = default;
 
     void set_name(const std::string& name) {
         this->name = name;
@@ -62,6 +63,37 @@ public:
         return name;
     }
 
+    // Locking is virtual so that mutexes which guard a group of other mutexes (such as
+    // the lock-striped device list) can be used anywhere a kis_mutex is expected
+    virtual void lock() {
+        std::recursive_timed_mutex::lock();
+    }
+
+    virtual bool try_lock() {
+        return std::recursive_timed_mutex::try_lock();
+    }
+
+    virtual void unlock() {
+        std::recursive_timed_mutex::unlock();
+    }
+
+    // Timed locks hide the non-virtual recursive_timed_mutex versions and funnel through a
+    // single virtual steady-clock deadline, so that they also go through the overrides
+    template<class Rep, class Period>
+    bool try_lock_for(const std::chrono::duration<Rep, Period>& timeout_duration) {
+        return try_lock_deadline(std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout_duration));
+    }
+
+    template<class Clock, class Duration>
+    bool try_lock_until(const std::chrono::time_point<Clock, Duration>& timeout_time) {
+        return try_lock_for(timeout_time - Clock::now());
+    }
+
+    virtual bool try_lock_deadline(const std::chrono::steady_clock::time_point& deadline) {
+        return std::recursive_timed_mutex::try_lock_until(deadline);
+    }
+
     // Previous workaround for gcc try_lock_for bugs here, but now we require c++14 so we don't
     // need them
 
@@ -88,6 +120,102 @@ public:
     }
 };
 
+// A mutex guarding a set of lock-striped child mutexes.  Locking the parent locks every
+// stripe in order, so it can be used as a normal kis_mutex by code which needs exclusive
+// access to everything the stripes protect, while code which only touches the data under
+// one stripe locks just that stripe.
+//
+// A thread holding only a stripe must never lock the parent; two threads doing so can
+// deadlock each other.  A thread may hold several stripes at once only if it takes them
+// in ascending order, the same order the parent takes them in.
+class kis_striped_mutex : public kis_mutex {
+public:
+    kis_striped_mutex() :
+        kis_mutex{} { }
+    kis_striped_mutex(const std::string& name) :
+        kis_mutex{name} { }
+
+    // Set the number of stripes; this must be done before the mutex is used
+    void set_stripes(size_t num_stripes) {
+        stripes.clear();
+
+        for (size_t s = 0; s < num_stripes; s++)
+            stripes.push_back(std::make_unique<kis_mutex>(fmt::format("{}::stripe{}", get_name(), s)));
+    }
+
+    size_t num_stripes() const {
+        return stripes.size();
+    }
+
+    kis_mutex& get_stripe(size_t stripe) {
+        return *stripes[stripe];
+    }
+
+    // Number of times the parent has been locked, including recursive locks; this lets
+    // benchmarks see which paths still take every stripe
+    uint64_t num_parent_locks() const {
+        return parent_locks.load(std::memory_order_relaxed);
+    }
+
+    virtual void lock() override {
+        kis_mutex::lock();
+
+        for (const auto& s : stripes)
+            s->lock();
+
+        parent_locks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    virtual bool try_lock() override {
+        if (!kis_mutex::try_lock())
+            return false;
+
+        for (size_t s = 0; s < stripes.size(); s++) {
+            if (!stripes[s]->try_lock()) {
+                while (s > 0)
+                    stripes[--s]->unlock();
+
+                kis_mutex::unlock();
+                return false;
+            }
+        }
+
+        parent_locks.fetch_add(1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    virtual bool try_lock_deadline(const std::chrono::steady_clock::time_point& deadline) override {
+        if (!kis_mutex::try_lock_deadline(deadline))
+            return false;
+
+        for (size_t s = 0; s < stripes.size(); s++) {
+            if (!stripes[s]->try_lock_deadline(deadline)) {
+                while (s > 0)
+                    stripes[--s]->unlock();
+
+                kis_mutex::unlock();
+                return false;
+            }
+        }
+
+        parent_locks.fetch_add(1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    virtual void unlock() override {
+        for (auto s = stripes.rbegin(); s != stripes.rend(); ++s)
+            (*s)->unlock();
+
+        kis_mutex::unlock();
+    }
+
+protected:
+    std::vector<std::unique_ptr<kis_mutex>> stripes;
+    std::atomic<uint64_t> parent_locks{0};
+};
+
 class kis_shared_mutex {
 private:
     std::shared_timed_mutex mutex;
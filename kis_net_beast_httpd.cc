@@ -1841,7 +1841,8 @@ nlohmann::json kis_net_beast_auth::as_json() {
 
 
 void kis_net_web_tracked_endpoint::handle_request(std::shared_ptr<kis_net_beast_httpd_connection> con) {
-    kis_unique_lock<kis_mutex> lk(mutex, std::defer_lock, "tracked endpoint");
+    auto& req_mutex = mutex_func != nullptr ? mutex_func(con) : mutex;
+    kis_unique_lock<kis_mutex> lk(req_mutex, std::defer_lock, "tracked endpoint");
 
     if (use_mutex)
         lk.lock();
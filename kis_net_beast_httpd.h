@@ -471,6 +471,8 @@ public:
     using gen_func_t =
         std::function<std::shared_ptr<tracker_element> (std::shared_ptr<kis_net_beast_httpd_connection>)>;
     using wrapper_func_t = std::function<void (std::shared_ptr<tracker_element>)>;
+    using mutex_func_t =
+        std::function<kis_mutex& (std::shared_ptr<kis_net_beast_httpd_connection>)>;
 
     kis_net_web_tracked_endpoint(std::shared_ptr<tracker_element> content,
             kis_mutex& mutex,
@@ -500,6 +502,14 @@ public:
         use_mutex{true},
         generator{generator} { }
 
+    // Lock a mutex picked per request, such as the device list shard holding the
+    // device named in the URI; the mutex function must not throw
+    kis_net_web_tracked_endpoint(gen_func_t generator, mutex_func_t mutex_func) :
+        mutex{dfl_mutex},
+        use_mutex{true},
+        generator{generator},
+        mutex_func{mutex_func} { }
+
     virtual void handle_request(std::shared_ptr<kis_net_beast_httpd_connection> con) override;
 
 protected:
@@ -512,6 +522,8 @@ protected:
     gen_func_t generator;
     wrapper_func_t pre_func;
     wrapper_func_t post_func;
+
+    mutex_func_t mutex_func;
 };
 
 class kis_net_web_websocket_endpoint : public kis_net_web_endpoint,
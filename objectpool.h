@@ -19,11 +19,14 @@
 #ifndef __OBJECTPOOL_H__
 #define __OBJECTPOOL_H__ 
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <stack>
 #include <thread>
 #include <mutex>
+#include <typeinfo>
+#include <vector>
 
 #include "kis_mutex.h"
 
@@ -128,5 +131,208 @@ private:
     std::function<void (T*)> reset_;
 };
 
+// Common stats interface for local_object_pool, so that all the per-type pools can
+// be enumerated
+class local_object_pool_base {
+public:
+    virtual ~local_object_pool_base() { }
+
+    virtual const std::type_info& pool_type() const = 0;
+
+    // Objects allocated from the heap, objects reused from a cache, and objects freed
+    // because the cache they were returned to was full
+    virtual void fetch_stats(uint64_t& allocated, uint64_t& reused, uint64_t& discarded) = 0;
+
+    static std::vector<local_object_pool_base *> registered_pools() {
+        kis_lock_guard<kis_mutex> lg(registry_mutex(), "local_object_pool registered_pools");
+        return registry();
+    }
+
+protected:
+    static void register_pool(local_object_pool_base *pool) {
+        kis_lock_guard<kis_mutex> lg(registry_mutex(), "local_object_pool register_pool");
+        registry().push_back(pool);
+    }
+
+private:
+    static kis_mutex& registry_mutex() {
+        static kis_mutex m{"local_object_pool registry"};
+        return m;
+    }
+
+    static std::vector<local_object_pool_base *>& registry() {
+        static std::vector<local_object_pool_base *> r;
+        return r;
+    }
+};
+
+// Per-type object pool with a free list per thread, which never locks when acquiring
+// or returning objects.
+//
+// Objects always return to the cache of the thread which allocated them; returns
+// from the owning thread are a plain push onto the local free list, returns from
+// other threads are pushed lock-free onto the owner's remote list, which the owner
+// reclaims in a single exchange when the local list runs dry.
+//
+// Thread caches are never freed; when a thread exits, its cache is handed to the
+// next thread to use the pool, so objects returned to it late are not lost.  The
+// pool itself is intentionally never destroyed for the same reason.
+//
+// T must provide reset(), which is called when the object is returned.
+template <class T>
+class local_object_pool : public local_object_pool_base {
+private:
+    struct thread_cache;
+
+    struct node {
+        T obj;
+        node *next;
+        thread_cache *owner;
+    };
+
+    struct thread_cache {
+        // Only touched by the owning thread
+        std::vector<node *> free_list;
+
+        // Objects returned by other threads
+        std::atomic<node *> remote_head{nullptr};
+
+        std::atomic<uint64_t> allocated{0};
+        std::atomic<uint64_t> reused{0};
+        std::atomic<uint64_t> discarded{0};
+    };
+
+    struct thread_handle {
+        thread_handle() :
+            cache{local_object_pool<T>::get().adopt_cache()} { }
+
+        ~thread_handle() {
+            local_object_pool<T>::get().orphan_cache(cache);
+        }
+
+        thread_cache *cache;
+    };
+
+    local_object_pool(size_t max_cached) :
+        max_cached{max_cached} {
+        pool_mutex.set_name(fmt::format("local_object_pool<{}>", typeid(T).name()));
+        register_pool(this);
+    }
+
+public:
+    static local_object_pool<T>& get() {
+        static auto pool = new local_object_pool<T>(1024);
+        return *pool;
+    }
+
+    std::shared_ptr<T> acquire() {
+        auto cache = current_cache();
+
+        if (cache->free_list.empty())
+            reclaim_remote(cache);
+
+        node *n;
+
+        if (!cache->free_list.empty()) {
+            n = cache->free_list.back();
+            cache->free_list.pop_back();
+            cache->reused.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            n = new node();
+            n->owner = cache;
+            cache->allocated.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        return std::shared_ptr<T>(&n->obj, [n](T *) { local_object_pool<T>::get().release(n); });
+    }
+
+    virtual const std::type_info& pool_type() const override {
+        return typeid(T);
+    }
+
+    virtual void fetch_stats(uint64_t& allocated, uint64_t& reused, uint64_t& discarded) override {
+        kis_lock_guard<kis_mutex> lg(pool_mutex, "local_object_pool fetch_stats");
+
+        allocated = reused = discarded = 0;
+
+        for (const auto& c : caches) {
+            allocated += c->allocated.load(std::memory_order_relaxed);
+            reused += c->reused.load(std::memory_order_relaxed);
+            discarded += c->discarded.load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static thread_cache *current_cache() {
+        thread_local thread_handle handle;
+        return handle.cache;
+    }
+
+    void release(node *n) {
+        n->obj.reset();
+
+        auto owner = n->owner;
+
+        if (owner == current_cache()) {
+            if (owner->free_list.size() < max_cached) {
+                owner->free_list.push_back(n);
+            } else {
+                owner->discarded.fetch_add(1, std::memory_order_relaxed);
+                delete n;
+            }
+
+            return;
+        }
+
+        auto head = owner->remote_head.load(std::memory_order_relaxed);
+
+        do {
+            n->next = head;
+        } while (!owner->remote_head.compare_exchange_weak(head, n,
+                    std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    void reclaim_remote(thread_cache *cache) {
+        auto n = cache->remote_head.exchange(nullptr, std::memory_order_acquire);
+
+        while (n != nullptr) {
+            auto next = n->next;
+
+            if (cache->free_list.size() < max_cached) {
+                cache->free_list.push_back(n);
+            } else {
+                cache->discarded.fetch_add(1, std::memory_order_relaxed);
+                delete n;
+            }
+
+            n = next;
+        }
+    }
+
+    thread_cache *adopt_cache() {
+        kis_lock_guard<kis_mutex> lg(pool_mutex, "local_object_pool adopt_cache");
+
+        if (!orphaned.empty()) {
+            auto c = orphaned.back();
+            orphaned.pop_back();
+            return c;
+        }
+
+        caches.push_back(std::make_unique<thread_cache>());
+        return caches.back().get();
+    }
+
+    void orphan_cache(thread_cache *cache) {
+        kis_lock_guard<kis_mutex> lg(pool_mutex, "local_object_pool orphan_cache");
+        orphaned.push_back(cache);
+    }
+
+    kis_mutex pool_mutex;
+    size_t max_cached;
+
+    std::vector<std::unique_ptr<thread_cache>> caches;
+    std::vector<thread_cache *> orphaned;
+};
+
 #endif /* ifndef OBJECTPOOL_H */
 
@@ -44,8 +44,13 @@ kis_packet::kis_packet() {
 	filtered = 0;
     duplicate = 0;
     hash = 0;
+    bytes_copied = 0;
 
     assignment_id = 0;
+    assignment_slot = -1;
+    low_priority = false;
+    component_mask = 0;
+    content_vec.reserve(PACKET_COMPONENTS_RESERVE);
 
     raw_streambuf = nullptr;
     data = nonstd::string_view(nullptr, 0);
@@ -61,6 +66,8 @@ kis_packet::~kis_packet() {
 
 void kis_packet::reset() {
     assignment_id = 0;
+    assignment_slot = -1;
+    low_priority = false;
     packet_no = 0;
     error = 0;
     crc_ok = 0;
@@ -70,15 +77,18 @@ void kis_packet::reset() {
     original.reset();
 
     hash = 0;
+    bytes_copied = 0;
 
-    // reset raw data if in use
-    raw_data.clear();
+    // release the backing buffers so they can be reclaimed while the packet is pooled
+    raw_data.reset();
+    raw_streambuf.reset();
     data = nonstd::string_view{nullptr, 0};
 
     process_complete_events.clear();
 
-    for (size_t x = 0; x < MAX_PACKET_COMPONENTS; x++)
-        content_vec[x].reset();
+    // Keeps the capacity for the next use of a pooled packet
+    content_vec.clear();
+    component_mask = 0;
 
     tag_map.clear();
 }
@@ -92,7 +102,7 @@ void kis_packet::insert(const unsigned int index, std::shared_ptr<packet_compone
         throw std::runtime_error(e);
     }
 
-	content_vec[index] = data;
+    set_component(index, data);
 
     if (original != nullptr) {
         kis_lock_guard<kis_mutex> lg(original->mutex);
@@ -100,17 +110,47 @@ void kis_packet::insert(const unsigned int index, std::shared_ptr<packet_compone
     }
 }
 
+void kis_packet::set_component(const unsigned int index, const std::shared_ptr<packet_component>& data) {
+    const auto bit = 1ULL << index;
+    const auto pos = component_pos(index);
+
+    if (component_mask & bit) {
+        if (data != nullptr) {
+            content_vec[pos] = data;
+        } else {
+            content_vec.erase(content_vec.begin() + pos);
+            component_mask &= ~bit;
+        }
+    } else if (data != nullptr) {
+        content_vec.insert(content_vec.begin() + pos, data);
+        component_mask |= bit;
+    }
+}
+
+void kis_packet::alias_components(const kis_packet& in_original) {
+    auto mask = in_original.component_mask;
+
+    for (size_t pos = 0; mask != 0; pos++, mask &= mask - 1) {
+        const auto& cp = in_original.content_vec[pos];
+
+        if (cp->unique())
+            continue;
+
+        set_component(__builtin_ctzll(mask), cp);
+    }
+}
+
 std::shared_ptr<packet_component> kis_packet::fetch(const unsigned int index) const {
-	if (index >= MAX_PACKET_COMPONENTS)
+	if (index >= MAX_PACKET_COMPONENTS || !(component_mask & (1ULL << index)))
 	    return nullptr;
 
-	return content_vec[index];
+	return content_vec[component_pos(index)];
 }
 
 void kis_packet::erase(const unsigned int index) {
 	if (index >= MAX_PACKET_COMPONENTS)
 		return;
 
-    content_vec[index].reset();
+    set_component(index, nullptr);
 }
 
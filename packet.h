@@ -29,6 +29,7 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <map>
@@ -46,10 +47,14 @@
 
 #include "boost/asio/streambuf.hpp"
 
-// This is the main switch for how big the vector is.  If something ever starts
-// bumping up against this we'll need to increase it, but that'll slow down 
-// generating a packet (slightly) so I'm leaving it relatively low.
+// Maximum number of registered packet component types.  Packets only store the
+// components they carry, indexed by a 64 bit mask, so this can't grow past 64.
 #define MAX_PACKET_COMPONENTS	64
+static_assert(MAX_PACKET_COMPONENTS <= 64, "packet component mask must fit in 64 bits");
+
+// Component slots reserved when a packet is created; typical frames carry fewer
+// than this, and pooled packets keep their storage between uses
+#define PACKET_COMPONENTS_RESERVE	16
 
 // Maximum length of a frame
 #define MAX_PACKET_LEN			8192
@@ -58,6 +63,11 @@
 // even when we don't have pcap
 #define KDLT_IEEE802_11			105
 
+// Reference counted, immutable packet payload.  Payloads which can't alias the buffer
+// they were received in are copied into one of these once, and every view of the
+// payload shares the same allocation.
+typedef std::shared_ptr<const std::string> kis_packet_buffer;
+
 class packet_component {
 public:
     packet_component() { };
@@ -80,6 +90,14 @@ public:
     // packets from the same device the same identifier as consistently as possible.
     uint32_t assignment_id;
 
+    // Assignment slot the packet was queued under by the packetchain, or -1; used to
+    // track in-flight packets per slot so slots are only migrated when drained
+    int32_t assignment_slot;
+
+    // Bulk traffic which is shed first when the packet queue is overloaded; set by
+    // phy handlers in the post-capture stage
+    bool low_priority;
+
     // Unique number of this packet
     uint64_t packet_no;
 
@@ -100,8 +118,9 @@ public:
     uint32_t hash;
 
     // if packet is based on raw data, this contains the data backing and data is a
-    // view into it that other components should slice
-    std::string raw_data;
+    // view into it that other components should slice.  The buffer is shared and
+    // immutable, so decapsulated chunks and duplicates can hold it without copying
+    kis_packet_buffer raw_data;
     // if packet is based on network data, this contains the original network buffer
     // which must be returned as part of the reset/destructor process, and data is
     // a view into it that other components should slice
@@ -113,23 +132,58 @@ public:
     // Original length of capture, if truncated
     uint64_t original_len;
 
+    // Payload bytes copied on behalf of this packet instead of aliasing the buffer
+    // it was captured in
+    uint64_t bytes_copied;
+
     // Did this packet trigger creation of a new device?  Since a 
     // single packet can create multiple devices in some phys, maintain
     // a vector of device events to publish when all devices are done
     // processing
     std::vector<std::shared_ptr<eventbus_event>> process_complete_events;
 
-    // pre-allocated vector of broken down packet components
-    std::shared_ptr<packet_component> content_vec[MAX_PACKET_COMPONENTS];
+    // Components present in this packet, stored densely in component id order.  A
+    // component is present when its bit is set in the mask, and its position in the
+    // vector is the number of mask bits set below it.  The packetchain also uses the
+    // mask to skip handlers which require a component without fetching it.
+    std::vector<std::shared_ptr<packet_component>> content_vec;
+    uint64_t component_mask;
 
     kis_packet();
     ~kis_packet();
 
+protected:
+    // Position of a component id in content_vec, whether or not it is present
+    unsigned int component_pos(const unsigned int index) const {
+        return __builtin_popcountll(component_mask & ((1ULL << index) - 1));
+    }
+
+    // Set or clear a component in this packet only
+    void set_component(const unsigned int index, const std::shared_ptr<packet_component>& data);
+
+public:
     void reset();
 
+    // Copy a payload into a new shared packet buffer
+    static kis_packet_buffer make_buffer(const char *data, size_t len) {
+        return std::make_shared<const std::string>(data, len);
+    }
+
+    // Copy a payload into a new shared packet buffer, charging the copy to this packet
+    kis_packet_buffer copy_buffer(const char *data, size_t len) {
+        bytes_copied += len;
+        return make_buffer(data, len);
+    }
+
     void set_data(const std::string& sdata) {
-        raw_data = sdata;
-        data = nonstd::string_view{raw_data};
+        raw_data = copy_buffer(sdata.data(), sdata.length());
+        data = nonstd::string_view{*raw_data};
+    }
+
+    // take an existing shared buffer and a view into it
+    void set_data(const kis_packet_buffer& buffer, const nonstd::string_view& view) {
+        raw_data = buffer;
+        data = view;
     }
 
     // set just the streambuf, the data can be set as views of this later
@@ -147,8 +201,8 @@ public:
     // take a raw byte range and assign it to the raw data string, then create a string view
     template<typename T>
     void set_data(const T* tdata, size_t len) {
-        raw_data = std::string(tdata, len);
-        data = nonstd::string_view{raw_data};
+        raw_data = copy_buffer((const char *) tdata, len);
+        data = nonstd::string_view{*raw_data};
     }
 
     // take a raw stringview and assign it to the data view.  either the lifecycle
@@ -197,9 +251,13 @@ public:
             throw std::runtime_error(fmt::format("invalid packet component index {} greater than {}",
                         index, MAX_PACKET_COMPONENTS));
 
-        return content_vec[index] != nullptr;
+        return component_mask & (1ULL << index);
     }
 
+    // Copy the non-unique components of the original packet into this duplicate,
+    // without propagating them back to the original
+    void alias_components(const kis_packet& in_original);
+
     // Tags applied to the packet
     ankerl::unordered_dense::map<std::string, bool> tag_map;
 
@@ -299,7 +357,7 @@ protected:
 class kis_datachunk : public packet_component, public nonstd::string_view {
 public:
     // Underlying raw data if this isn't a subset of another chunk
-    std::string raw_data_;
+    kis_packet_buffer raw_data_;
 
     int dlt;
     uint16_t source_id;
@@ -311,8 +369,8 @@ public:
     virtual ~kis_datachunk() { }
 
     virtual void reset() {
-        raw_data_.clear();
-        nonstd::string_view::operator=(raw_data_);
+        raw_data_.reset();
+        nonstd::string_view::operator=(nonstd::string_view{});
     }
 
     // set a stringview as the data block; the lifetime of the backing data of this
@@ -326,19 +384,21 @@ public:
         nonstd::string_view::operator=(data);
     }
 
+    // set a view of a shared buffer, holding a reference to the buffer
+    void set_data(const kis_packet_buffer& buffer, const nonstd::string_view& view) {
+        raw_data_ = buffer;
+        nonstd::string_view::operator=(view);
+    }
+
     virtual void copy_raw_data(const std::string& sdata) {
-        raw_data_ = sdata;
-        nonstd::string_view::operator=(raw_data_);
+        raw_data_ = kis_packet::make_buffer(sdata.data(), sdata.length());
+        nonstd::string_view::operator=(*raw_data_);
     }
 
     template<typename T>
     void copy_raw_data(const T* rd, size_t sz) {
-        raw_data_ = std::string(rd, sz);
-        nonstd::string_view::operator=(raw_data_);
-    }
-
-    std::string& raw() {
-        return raw_data_;
+        raw_data_ = kis_packet::make_buffer((const char *) rd, sz);
+        nonstd::string_view::operator=(*raw_data_);
     }
 };
 
@@ -643,6 +703,25 @@ public:
     std::string buffer_string;
 };
 
+// Repeated beacons counted by the capture instead of being sent; the packet carries
+// the signal of the most recent beacon and the strongest signal seen in the summary
+class kis_beacon_summary_packinfo : public packet_component {
+public:
+    kis_beacon_summary_packinfo() {
+        reset();
+    }
+
+    void reset() {
+        bssid = mac_addr(0);
+        count = 0;
+        peak_dbm = 0;
+    }
+
+    mac_addr bssid;
+    uint32_t count;
+    int peak_dbm;
+};
+
 // Device tags added at capture time by the capture or scan engine 
 class kis_devicetag_packetinfo : public packet_component { 
 public: 
@@ -25,6 +25,9 @@
 #include <inttypes.h>
 #endif
 
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <limits>
 #include <pthread.h>
 
 #include "alertracker.h"
@@ -50,11 +53,33 @@ public:
 packet_chain::packet_chain() {
     packetcomp_mutex.set_name("packetchain packet_comp");
     packetchain_mutex.set_name("packetchain packetchain");
-    pack_no_mutex.set_name("packetchain packetno");
 
     unique_packet_no = 1;
 
-    dedupe_list_pos = 0;
+    packet_threads = nullptr;
+    n_packet_threads = 0;
+
+    n_incoming_packets = 0;
+    n_dropped_packets = 0;
+    n_dropped_low = 0;
+    n_dropped_high = 0;
+    n_slot_migrations = 0;
+
+    packet_thread_rebalance =
+        Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_thread_rebalance", 64);
+
+    for (unsigned int i = 0; i < dedupe_n_shards; i++)
+        dedupe_shards[i].mutex.set_name(fmt::format("packetchain dedupe {}", i));
+
+    dedupe_hits = 0;
+    dedupe_misses = 0;
+    dedupe_evictions = 0;
+
+    dedupe_window_us =
+        Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_dedup_window_ms", 250) * 1000ULL;
+    dedupe_shard_max =
+        std::max<size_t>(1, Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_dedup_size", 8192) /
+                dedupe_n_shards);
 
     Globalreg::enable_pool_type<kis_tracked_packet>([](auto *a) { a->reset(); });
 
@@ -68,6 +93,8 @@ packet_chain::packet_chain() {
         Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_log_warning", 0);
     packet_queue_drop =
         Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_backlog_limit", 8192);
+    packet_queue_priority_reserve =
+        Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_backlog_priority_reserve", 1024);
 
     auto entrytracker = 
         Globalreg::fetch_mandatory_global_as<entry_tracker>();
@@ -125,14 +152,120 @@ packet_chain::packet_chain() {
     packet_processed_rrd =
         std::make_shared<kis_tracked_rrd<>>(packet_processed_rrd_id);
 
+    dedupe_hits_elem =
+        entrytracker->register_and_get_field_as<tracker_element_uint64>("kismet.packetchain.dedupe_hits",
+                tracker_element_factory<tracker_element_uint64>(),
+                "packets matched as duplicates");
+    dedupe_misses_elem =
+        entrytracker->register_and_get_field_as<tracker_element_uint64>("kismet.packetchain.dedupe_misses",
+                tracker_element_factory<tracker_element_uint64>(),
+                "packets not found in the dedupe window");
+    dedupe_evictions_elem =
+        entrytracker->register_and_get_field_as<tracker_element_uint64>("kismet.packetchain.dedupe_evictions",
+                tracker_element_factory<tracker_element_uint64>(),
+                "packets expired or evicted from the dedupe window");
+
+    component_pool_id =
+        entrytracker->register_field("kismet.packetchain.component_pool",
+                tracker_element_factory<tracker_element_map>(),
+                "packet component pool");
+    component_pool_type_id =
+        entrytracker->register_field("kismet.packetchain.component_pool.type",
+                tracker_element_factory<tracker_element_string>(),
+                "packet component type");
+    component_pool_allocated_id =
+        entrytracker->register_field("kismet.packetchain.component_pool.allocated",
+                tracker_element_factory<tracker_element_uint64>(),
+                "components allocated from the heap");
+    component_pool_reused_id =
+        entrytracker->register_field("kismet.packetchain.component_pool.reused",
+                tracker_element_factory<tracker_element_uint64>(),
+                "components reused from the pool");
+    component_pool_discarded_id =
+        entrytracker->register_field("kismet.packetchain.component_pool.discarded",
+                tracker_element_factory<tracker_element_uint64>(),
+                "components freed because the pool was full");
+
+    handler_profiling =
+        Globalreg::globalreg->kismet_config->fetch_opt_bool("packet_handler_profiling", false);
+
+    handler_stats_id =
+        entrytracker->register_field("kismet.packetchain.handler",
+                tracker_element_factory<tracker_element_map>(),
+                "packet chain handler profile");
+    handler_name_id =
+        entrytracker->register_field("kismet.packetchain.handler.name",
+                tracker_element_factory<tracker_element_string>(),
+                "packet handler name");
+    handler_id_id =
+        entrytracker->register_field("kismet.packetchain.handler.id",
+                tracker_element_factory<tracker_element_int32>(),
+                "packet handler id");
+    handler_priority_id =
+        entrytracker->register_field("kismet.packetchain.handler.priority",
+                tracker_element_factory<tracker_element_int32>(),
+                "packet handler priority");
+    handler_calls_id =
+        entrytracker->register_field("kismet.packetchain.handler.calls",
+                tracker_element_factory<tracker_element_uint64>(),
+                "profiled handler calls");
+    handler_mean_id =
+        entrytracker->register_field("kismet.packetchain.handler.mean_usec",
+                tracker_element_factory<tracker_element_double>(),
+                "mean handler latency (usec)");
+    handler_p50_id =
+        entrytracker->register_field("kismet.packetchain.handler.p50_usec",
+                tracker_element_factory<tracker_element_double>(),
+                "50th percentile handler latency (usec, histogram bucket upper bound)");
+    handler_p99_id =
+        entrytracker->register_field("kismet.packetchain.handler.p99_usec",
+                tracker_element_factory<tracker_element_double>(),
+                "99th percentile handler latency (usec, histogram bucket upper bound)");
+    handler_max_id =
+        entrytracker->register_field("kismet.packetchain.handler.max_usec",
+                tracker_element_factory<tracker_element_double>(),
+                "maximum handler latency (usec)");
+
+    packet_thread_queue_vec_id =
+        entrytracker->register_field("kismet.packetchain.thread_queue_rrds",
+                tracker_element_factory<tracker_element_vector>(),
+                "per packet thread backlog queue rrds");
+    packet_thread_queue_rrd_id =
+        entrytracker->register_field("kismet.packetchain.thread_queue_rrd",
+                tracker_element_factory<kis_tracked_rrd<kis_tracked_rrd_extreme_aggregator>>(),
+                "packet thread backlog queue rrd");
+    packet_thread_queue_vec =
+        std::make_shared<tracker_element_vector>(packet_thread_queue_vec_id);
+
+    slot_migrations_elem =
+        entrytracker->register_and_get_field_as<tracker_element_uint64>("kismet.packetchain.thread_migrations",
+                tracker_element_factory<tracker_element_uint64>(),
+                "device assignments migrated to a less loaded packet thread");
+
+    dropped_low_elem =
+        entrytracker->register_and_get_field_as<tracker_element_uint64>("kismet.packetchain.dropped_low_priority",
+                tracker_element_factory<tracker_element_uint64>(),
+                "low priority (bulk) packets dropped due to a full packet queue");
+    dropped_high_elem =
+        entrytracker->register_and_get_field_as<tracker_element_uint64>("kismet.packetchain.dropped_high_priority",
+                tracker_element_factory<tracker_element_uint64>(),
+                "high priority packets dropped due to a full packet queue");
+
     packet_stats_map = 
         std::make_shared<tracker_element_map>();
     packet_stats_map->insert(packet_peak_rrd);
     packet_stats_map->insert(packet_rate_rrd);
     packet_stats_map->insert(packet_error_rrd);
     packet_stats_map->insert(packet_dupe_rrd);
+    packet_stats_map->insert(dedupe_hits_elem);
+    packet_stats_map->insert(dedupe_misses_elem);
+    packet_stats_map->insert(dedupe_evictions_elem);
     packet_stats_map->insert(packet_queue_rrd);
+    packet_stats_map->insert(packet_thread_queue_vec);
+    packet_stats_map->insert(slot_migrations_elem);
     packet_stats_map->insert(packet_drop_rrd);
+    packet_stats_map->insert(dropped_low_elem);
+    packet_stats_map->insert(dropped_high_elem);
     packet_stats_map->insert(packet_processed_rrd);
 
     packet_pool.set_max(1024);
@@ -158,6 +291,21 @@ packet_chain::packet_chain() {
             std::make_shared<kis_net_web_tracked_endpoint>(packet_drop_rrd));
     httpd->register_route("/packetchain/packet_processed", {"GET", "POST"}, httpd->RO_ROLE, {},
             std::make_shared<kis_net_web_tracked_endpoint>(packet_processed_rrd));
+    httpd->register_route("/packetchain/handler_stats", {"GET", "POST"}, httpd->RO_ROLE, {},
+            std::make_shared<kis_net_web_tracked_endpoint>(
+                [this](std::shared_ptr<kis_net_beast_httpd_connection>) {
+                    return handler_profile_stats();
+                }));
+    httpd->register_route("/packetchain/handler_stats/config", {"POST"}, httpd->LOGON_ROLE, {"cmd"},
+            std::make_shared<kis_net_web_function_endpoint>(
+                [this](std::shared_ptr<kis_net_beast_httpd_connection> con) {
+                    return handler_profile_endpoint(con);
+                }));
+    httpd->register_route("/packetchain/component_pools", {"GET", "POST"}, httpd->RO_ROLE, {},
+            std::make_shared<kis_net_web_tracked_endpoint>(
+                [this](std::shared_ptr<kis_net_beast_httpd_connection>) {
+                    return component_pool_stats();
+                }));
 
     packetchain_shutdown = false;
 
@@ -168,6 +316,15 @@ packet_chain::packet_chain() {
         timetracker->register_timer(std::chrono::seconds(1), true, 
                 [this](int) -> int {
 
+                update_packet_rrds();
+
+                slot_migrations_elem->set(n_slot_migrations.load());
+                dedupe_hits_elem->set(dedupe_hits.load());
+                dedupe_misses_elem->set(dedupe_misses.load());
+                dedupe_evictions_elem->set(dedupe_evictions.load());
+                dropped_low_elem->set(n_dropped_low.load());
+                dropped_high_elem->set(n_dropped_high.load());
+
                 auto evt = eventbus->get_eventbus_event(event_packetstats());
                 evt->get_event_content()->insert(event_packetstats(), packet_stats_map);
                 eventbus->publish(evt);
@@ -181,81 +338,8 @@ packet_chain::packet_chain() {
     pack_comp_l1_agg = register_packet_component("RADIODATA_AGG");
 	pack_comp_datasource = register_packet_component("KISDATASRC");
 
-    postcap_chain_update = false;
-    llcdissect_chain_update = false;
-    decrypt_chain_update = false;
-    datadissect_chain_update = false;
-    classifier_chain_update = false;
-    tracker_chain_update = false;
-    logging_chain_update = false;
-
-    // Because dedupe has to actually store references to packets, we run it outside of the chain functions
-
-#if 0
-    // Checksum and dedupe function runs at the end of LLC dissection, which should be
-    // after any phy demangling and DLT demangling; lock the packet for the rest of the 
-    // packet chain
-    register_handler([](void *auxdata, std::shared_ptr<kis_packet> in_pack) -> int {
-			auto packetchain = reinterpret_cast<packet_chain *>(auxdata);
-
-			// Lock the hash list, gating all hash comparisons 
-			kis_lock_guard<kis_shared_mutex> lk(packetchain->pack_no_mutex, "hash handler");
-
-			auto chunk = in_pack->fetch<kis_datachunk>(packetchain->pack_comp_decap, packetchain->pack_comp_linkframe);
-
-			if (chunk == nullptr)
-				return 1;
-
-			if (chunk->data() == nullptr)
-				return 1;
-
-			if (chunk->length() == 0)
-				return 1;
-
-			in_pack->hash = crc32_fast(chunk->data(), chunk->length(), 0);
-
-			for (unsigned int i = 0; i < 1024; i++) {
-			if (packetchain->dedupe_list[i].hash == in_pack->hash) {
-				in_pack->duplicate = true;
-				in_pack->packet_no = packetchain->dedupe_list[i].packno;
-				in_pack->original = packetchain->dedupe_list[i].original_pkt;
-
-				// We have to wait until everything is done being changed in the packet
-				// before we can copy the duplicate decoded state over, grab the lock that
-				// is released at the end of the chain
-				kis_lock_guard<kis_mutex> lg(packetchain->dedupe_list[i].original_pkt->mutex);
-				for (unsigned int c = 0; c < MAX_PACKET_COMPONENTS; c++) {
-					auto cp = packetchain->dedupe_list[i].original_pkt->content_vec[c];
-					if (cp != nullptr) {
-						if (cp->unique())
-							continue;
-
-						in_pack->content_vec[c] = cp;
-					}
-				}
-
-				// Merge the signal levels
-				if (in_pack->has(packetchain->pack_comp_l1) && in_pack->has(packetchain->pack_comp_datasource)) {
-					auto l1 = in_pack->original->fetch<kis_layer1_packinfo>(packetchain->pack_comp_l1);
-					auto radio_agg = in_pack->fetch_or_add<kis_layer1_aggregate_packinfo>(packetchain->pack_comp_l1_agg);
-					auto datasrc = in_pack->fetch<packetchain_comp_datasource>(packetchain->pack_comp_datasource);
-					radio_agg->source_l1_map[datasrc->ref_source->get_source_uuid()] = l1;
-				}
-			}
-			}
-
-			// Assign a new packet number and cache it in the dedupe
-			if (!in_pack->duplicate) {
-				auto listpos = packetchain->dedupe_list_pos++ % 1024;
-				in_pack->packet_no = packetchain->unique_packet_no++;
-				packetchain->dedupe_list[listpos].hash = in_pack->hash;
-				packetchain->dedupe_list[listpos].packno = packetchain->unique_packet_no++;
-				packetchain->dedupe_list[listpos].original_pkt = in_pack;
-			}
-
-			return 1;
-		}, this, CHAINPOS_LLCDISSECT, -100000);
-#endif
+    publish_chains(std::make_unique<chain_set>());
+
 
 }
 
@@ -265,6 +349,7 @@ packet_chain::~packet_chain() {
     {
         // Tell the packet thread we're dying and unlock it
         packetchain_shutdown = true;
+        n_running_packet_threads.store(0, std::memory_order_release);
 
         // packet_queue.enqueue(nullptr);
 
@@ -274,7 +359,7 @@ packet_chain::~packet_chain() {
             if (t == nullptr)
                 continue;
 
-            t->packet_queue.enqueue(nullptr);
+            t->enqueue(nullptr, true);
 
             if (t->packet_thread.joinable())
                 t->packet_thread.join();
@@ -293,14 +378,7 @@ packet_chain::~packet_chain() {
         Globalreg::globalreg->remove_global("PACKETCHAIN");
         Globalreg::globalreg->packetchain = NULL;
 
-        postcap_chain.clear();
-        llcdissect_chain.clear();
-        decrypt_chain.clear();
-        datadissect_chain.clear();
-        classifier_chain.clear();
-        tracker_chain.clear();
-        logging_chain.clear();
-
+        publish_chains(std::make_unique<chain_set>());
     }
 
 }
@@ -311,7 +389,15 @@ void packet_chain::start_processing() {
     if (n_packet_threads == 0)
         n_packet_threads = static_cast<unsigned int>(std::thread::hardware_concurrency());
 
-    packet_threads = new packet_thread*[n_packet_threads];
+    assignment_slots.reset(new std::atomic<uint64_t>[n_assignment_slots]);
+    for (unsigned int s = 0; s < n_assignment_slots; s++)
+        assignment_slots[s] = static_cast<uint64_t>(s % n_packet_threads) << 32;
+
+    for (unsigned int n = 0; n < n_packet_threads; n++)
+        packet_thread_queue_vec->push_back(
+                std::make_shared<kis_tracked_rrd<kis_tracked_rrd_extreme_aggregator>>(packet_thread_queue_rrd_id));
+
+    packet_threads = new packet_thread*[n_packet_threads]();
 
     for (unsigned int n = 0; n < n_packet_threads; n++) {
         packet_threads[n] = new packet_thread();
@@ -319,10 +405,11 @@ void packet_chain::start_processing() {
             std::thread([this, n]() {
             auto name = fmt::format("PACKET {}/{}", n, n_packet_threads);
             thread_set_process_name(name);
-            packet_queue_processor(&packet_threads[n]->packet_queue);
+            packet_queue_processor(packet_threads[n]);
         });
     }
 
+    n_running_packet_threads.store(n_packet_threads, std::memory_order_release);
 }
 
 int packet_chain::register_packet_component(std::string in_component) {
@@ -374,177 +461,481 @@ std::string packet_chain::fetch_packet_component_name(int in_id) {
 	return component_id_map[in_id];
 }
 
+std::shared_ptr<tracker_element_vector> packet_chain::component_pool_stats() {
+    auto ret = std::make_shared<tracker_element_vector>();
+
+    for (const auto& p : local_object_pool_base::registered_pools()) {
+        uint64_t allocated, reused, discarded;
+        p->fetch_stats(allocated, reused, discarded);
+
+        int status;
+        std::unique_ptr<char, void (*)(void *)> demangled{
+            abi::__cxa_demangle(p->pool_type().name(), nullptr, nullptr, &status), std::free};
+
+        auto m = std::make_shared<tracker_element_map>(component_pool_id);
+        m->insert(std::make_shared<tracker_element_string>(component_pool_type_id,
+                    demangled != nullptr ? demangled.get() : p->pool_type().name()));
+        m->insert(std::make_shared<tracker_element_uint64>(component_pool_allocated_id, allocated));
+        m->insert(std::make_shared<tracker_element_uint64>(component_pool_reused_id, reused));
+        m->insert(std::make_shared<tracker_element_uint64>(component_pool_discarded_id, discarded));
+
+        ret->push_back(m);
+    }
+
+    return ret;
+}
+
 std::shared_ptr<kis_packet> packet_chain::generate_packet() {
     return packet_pool.acquire();
     // return std::make_shared<kis_packet>();
 }
 
-void packet_chain::packet_queue_processor(moodycamel::BlockingConcurrentQueue<std::shared_ptr<kis_packet>> *packet_queue) {
-    std::shared_ptr<kis_packet> packet;
+void packet_chain::packet_queue_processor(packet_thread *thread) {
+    std::shared_ptr<kis_packet> packets[packet_bulk_max];
 
     while (!packetchain_shutdown && 
             !Globalreg::globalreg->spindown && 
             !Globalreg::globalreg->fatal_condition &&
             !Globalreg::globalreg->complete) {
 
-        packet_queue->wait_dequeue(packet);
+        // Claim up to a bulk worth of packets, then pull them from the priority queue
+        // first and fill the rest from the bulk queue; the semaphore guarantees they
+        // are there, even if a dequeue momentarily misses them
+        auto n_packets = static_cast<size_t>(thread->pending.waitMany(packet_bulk_max));
+        size_t n_dequeued = 0;
 
-        if (packet == nullptr)
-            break;
+        while (n_dequeued < n_packets) {
+            n_dequeued += thread->priority_queue.try_dequeue_bulk(packets + n_dequeued,
+                    n_packets - n_dequeued);
 
+            if (n_dequeued < n_packets)
+                n_dequeued += thread->packet_queue.try_dequeue_bulk(packets + n_dequeued,
+                        n_packets - n_dequeued);
+        }
 
-        // Lock the packet chain and update any processing queues by replacing
-        // the old queue with the new one.
+        // Grab the current handler snapshot; it is never modified once published, and
+        // is not freed until the packetchain is destroyed
+        const auto cs = chains.load(std::memory_order_acquire);
+        const bool profile = handler_profiling.load(std::memory_order_relaxed);
 
-        kis_unique_lock<kis_shared_mutex> lk(packetchain_mutex, "packet processor");
+        uint64_t n_processed = 0, n_dupe = 0, n_error = 0;
 
-        if (llcdissect_chain_update) {
-            llcdissect_chain = llcdissect_chain_new;
-            llcdissect_chain_new.clear();
-            llcdissect_chain_update = false;
-        }
+        for (size_t i = 0; i < n_packets; i++) {
+            auto& packet = packets[i];
 
-        if (decrypt_chain_update) {
-            decrypt_chain = decrypt_chain_new;
-            decrypt_chain_new.clear();
-            decrypt_chain_update = false;
-        }
+            // Shutdown sentinel
+            if (packet == nullptr) {
+                for (size_t j = i; j < n_packets; j++)
+                    packets[j].reset();
+                return;
+            }
 
-        if (datadissect_chain_update) {
-            datadissect_chain = datadissect_chain_new;
-            datadissect_chain_new.clear();
-            datadissect_chain_update = false;
-        }
+            // Lock the individual packet to make sure no competing processing threads
+            // manipulate it while we're processing
+            packet->mutex.lock();
 
-        if (classifier_chain_update) {
-            classifier_chain = classifier_chain_new;
-            classifier_chain_new.clear();
-            classifier_chain_update = false;
-        }
+            dedupe_packet(packet);
 
-        if (tracker_chain_update) {
-            tracker_chain = tracker_chain_new;
-            tracker_chain_new.clear();
-            tracker_chain_update = false;
-        }
+            const auto& dispatch = cs->dispatch(packet_dlt(packet));
 
-        if (logging_chain_update) {
-            logging_chain = logging_chain_new;
-            logging_chain_new.clear();
-            logging_chain_update = false;
-        }
+            run_chain(dispatch.llcdissect, packet, profile);
 
-        lk.unlock();
-
-        // These can only be perturbed inside a sync, which can only occur when
-        // the worker thread is in the sync block above, so we shouldn't
-        // need to worry about the integrity of these vectors while running
-
-        /* Postcap is now handled before it gets into the per-thread chain
-           for (const auto& pcl : postcap_chain) {
-           if (pcl->callback != nullptr)
-           pcl->callback(pcl->auxdata, packet);
-           else if (pcl->l_callback != nullptr)
-           pcl->l_callback(packet);
-           }
-           */
-
-        // Lock the individual packet to make sure no competing processing threads
-        // manipulate it while we're processing
-        packet->mutex.lock();
-
-        // Lock the hash list, gating all hash comparisons
-        auto no_lk = kis_unique_lock<kis_shared_mutex>(pack_no_mutex, "hash handler");
-
-        const auto& chunk = packet->fetch<kis_datachunk>(pack_comp_decap, pack_comp_linkframe);
-
-        if (chunk != nullptr && chunk->data() != nullptr && chunk->length() != 0) {
-            packet->hash = crc32_fast(chunk->data(), chunk->length(), 0);
-
-            for (unsigned int i = 0; i < 1024; i++) {
-                if (dedupe_list[i].hash == packet->hash) {
-                    packet->duplicate = true;
-                    packet->packet_no = dedupe_list[i].packno;
-                    packet->original = dedupe_list[i].original_pkt;
-
-                    // We have to wait until everything is done being changed in the packet
-                    // before we can copy the duplicate decoded state over, grab the lock that
-                    // is released at the end of the chain
-                    kis_lock_guard<kis_mutex> lg(dedupe_list[i].original_pkt->mutex);
-                    for (unsigned int c = 0; c < MAX_PACKET_COMPONENTS; c++) {
-                        auto cp = dedupe_list[i].original_pkt->content_vec[c];
-                        if (cp != nullptr) {
-                            if (cp->unique())
-                                continue;
-
-                            packet->content_vec[c] = cp;
-                        }
-                    }
-
-                    // Merge the signal levels
-                    if (packet->has(pack_comp_l1) && packet->has(pack_comp_datasource)) {
-                        auto l1 = packet->original->fetch<kis_layer1_packinfo>(pack_comp_l1);
-                        auto radio_agg = packet->fetch_or_add<kis_layer1_aggregate_packinfo>(pack_comp_l1_agg);
-                        auto datasrc = packet->fetch<packetchain_comp_datasource>(pack_comp_datasource);
-                        radio_agg->source_l1_map[datasrc->ref_source->get_source_uuid()] = l1;
-                    }
-                }
-            }
+            run_chain(dispatch.decrypt, packet, profile);
 
-            // Assign a new packet number and cache it in the dedupe
-            if (!packet->duplicate) {
-                auto listpos = dedupe_list_pos++ % 1024;
-                packet->packet_no = unique_packet_no++;
-                dedupe_list[listpos].hash = packet->hash;
-                dedupe_list[listpos].packno = unique_packet_no++;
-                dedupe_list[listpos].original_pkt = packet;
-            }
+            run_chain(dispatch.datadissect, packet, profile);
+
+            run_chain(dispatch.classifier, packet, profile);
+
+            run_chain(dispatch.tracker, packet, profile);
+
+            run_chain(dispatch.logging, packet, profile);
+
+            packet->mutex.unlock();
+
+            release_slot(packet->assignment_slot);
+
+            if (packet->error)
+                n_error++;
+
+            if (packet->duplicate)
+                n_dupe++;
+
+            n_processed++;
+
+            // Release the packet now instead of holding it until the next bulk dequeue
+            packet.reset();
         }
 
-        for (const auto& pcl : llcdissect_chain) {
+        thread->n_processed.fetch_add(n_processed, std::memory_order_relaxed);
+        thread->n_dupe.fetch_add(n_dupe, std::memory_order_relaxed);
+        thread->n_error.fetch_add(n_error, std::memory_order_relaxed);
+    }
+}
+
+void packet_chain::run_chain(const std::vector<std::shared_ptr<packet_chain::pc_link>>& chain,
+        const std::shared_ptr<kis_packet>& packet, bool profile) {
+    if (!profile) {
+        for (const auto& pcl : chain) {
+            if ((packet->component_mask & pcl->component_mask) != pcl->component_mask)
+                continue;
+
             if (pcl->callback != nullptr)
                 pcl->callback(pcl->auxdata, packet);
         }
 
-        for (const auto& pcl : decrypt_chain) {
-            if (pcl->callback != nullptr)
-                pcl->callback(pcl->auxdata, packet);
+        return;
+    }
+
+    for (const auto& pcl : chain) {
+        if (pcl->callback == nullptr)
+            continue;
+
+        if ((packet->component_mask & pcl->component_mask) != pcl->component_mask)
+            continue;
+
+        auto start = std::chrono::steady_clock::now();
+        pcl->callback(pcl->auxdata, packet);
+        auto end = std::chrono::steady_clock::now();
+
+        pcl->profile.add_sample(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+}
+
+void packet_chain::handler_profile::add_sample(uint64_t ns) {
+    calls.fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+
+    auto prev_max = max_ns.load(std::memory_order_relaxed);
+    while (ns > prev_max &&
+            !max_ns.compare_exchange_weak(prev_max, ns, std::memory_order_relaxed))
+        ;
+
+    unsigned int bucket = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+    if (bucket >= n_buckets)
+        bucket = n_buckets - 1;
+
+    histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t packet_chain::handler_profile::percentile_ns(double pct) const {
+    uint64_t counts[n_buckets];
+    uint64_t total = 0;
+
+    for (unsigned int b = 0; b < n_buckets; b++) {
+        counts[b] = histogram[b].load(std::memory_order_relaxed);
+        total += counts[b];
+    }
+
+    if (total == 0)
+        return 0;
+
+    auto target = static_cast<uint64_t>(total * pct);
+    uint64_t seen = 0;
+
+    for (unsigned int b = 0; b < n_buckets; b++) {
+        seen += counts[b];
+
+        if (seen > target)
+            return 1ULL << b;
+    }
+
+    return 1ULL << (n_buckets - 1);
+}
+
+void packet_chain::handler_profile::reset() {
+    calls = 0;
+    total_ns = 0;
+    max_ns = 0;
+
+    for (auto& h : histogram)
+        h = 0;
+}
+
+void packet_chain::reset_handler_profiles() {
+    const auto cs = chains.load(std::memory_order_acquire);
+
+    for (const auto& c : {&cs->postcap, &cs->llcdissect, &cs->decrypt, &cs->datadissect,
+            &cs->classifier, &cs->tracker, &cs->logging}) {
+        for (const auto& pcl : *c)
+            pcl->profile.reset();
+    }
+}
+
+void packet_chain::visit_handler_chains(const std::function<void (const std::string&,
+            const std::vector<std::shared_ptr<pc_link>>&)>& in_fn) {
+    const auto cs = chains.load(std::memory_order_acquire);
+
+    in_fn("postcap", cs->postcap);
+    in_fn("llcdissect", cs->llcdissect);
+    in_fn("decrypt", cs->decrypt);
+    in_fn("datadissect", cs->datadissect);
+    in_fn("classifier", cs->classifier);
+    in_fn("tracker", cs->tracker);
+    in_fn("logging", cs->logging);
+}
+
+std::shared_ptr<tracker_element_string_map> packet_chain::handler_profile_stats() {
+    auto ret = std::make_shared<tracker_element_string_map>();
+
+    visit_handler_chains([this, ret](const std::string& stage,
+                const std::vector<std::shared_ptr<pc_link>>& chain) {
+        auto vec = std::make_shared<tracker_element_vector>();
+
+        for (const auto& pcl : chain) {
+            const auto& prof = pcl->profile;
+            auto calls = prof.calls.load(std::memory_order_relaxed);
+
+            auto m = std::make_shared<tracker_element_map>(handler_stats_id);
+            m->insert(std::make_shared<tracker_element_string>(handler_name_id, pcl->name));
+            m->insert(std::make_shared<tracker_element_int32>(handler_id_id, pcl->id));
+            m->insert(std::make_shared<tracker_element_int32>(handler_priority_id, pcl->priority));
+            m->insert(std::make_shared<tracker_element_uint64>(handler_calls_id, calls));
+            m->insert(std::make_shared<tracker_element_double>(handler_mean_id,
+                        calls == 0 ? 0 : prof.total_ns.load(std::memory_order_relaxed) / (double) calls / 1000));
+            m->insert(std::make_shared<tracker_element_double>(handler_p50_id,
+                        prof.percentile_ns(0.50) / 1000.0f));
+            m->insert(std::make_shared<tracker_element_double>(handler_p99_id,
+                        prof.percentile_ns(0.99) / 1000.0f));
+            m->insert(std::make_shared<tracker_element_double>(handler_max_id,
+                        prof.max_ns.load(std::memory_order_relaxed) / 1000.0f));
+
+            vec->push_back(m);
         }
 
-        for (const auto& pcl : datadissect_chain) {
-            if (pcl->callback != nullptr)
-                pcl->callback(pcl->auxdata, packet);
+        ret->insert(stage, vec);
+    });
+
+    return ret;
+}
+
+void packet_chain::handler_profile_endpoint(std::shared_ptr<kis_net_beast_httpd_connection> con) {
+    std::ostream os(&con->response_stream());
+
+    try {
+        if (con->json().value("reset", false))
+            reset_handler_profiles();
+
+        if (con->json().contains("enabled"))
+            set_handler_profiling(con->json()["enabled"].get<bool>());
+
+        os << "Packet handler profiling " <<
+            (get_handler_profiling() ? "enabled" : "disabled") << "\n";
+    } catch (const std::exception& e) {
+        con->set_status(400);
+        os << "Invalid request: " << e.what() << "\n";
+        return;
+    }
+}
+
+void packet_chain::update_packet_rrds() {
+    time_t now = (time_t) Globalreg::globalreg->last_tv_sec;
+
+    uint64_t n_processed = 0, n_dupe = 0, n_error = 0;
+    size_t n_queued = 0;
+
+    const auto n_running = n_running_packet_threads.load(std::memory_order_acquire);
+
+    for (size_t i = 0; i < n_running; i++) {
+        auto t = packet_threads[i];
+
+        if (t == nullptr)
+            continue;
+
+        n_processed += t->n_processed.exchange(0, std::memory_order_relaxed);
+        n_dupe += t->n_dupe.exchange(0, std::memory_order_relaxed);
+        n_error += t->n_error.exchange(0, std::memory_order_relaxed);
+        auto qsize = t->depth();
+        n_queued += qsize;
+
+        if (i < packet_thread_queue_vec->size())
+            std::static_pointer_cast<kis_tracked_rrd<kis_tracked_rrd_extreme_aggregator>>(
+                    packet_thread_queue_vec->at(i))->add_sample(qsize, now);
+    }
+
+    auto n_incoming = n_incoming_packets.exchange(0, std::memory_order_relaxed);
+
+    packet_rate_rrd->add_sample(n_incoming, now);
+    packet_peak_rrd->add_sample(n_incoming, now);
+    packet_drop_rrd->add_sample(n_dropped_packets.exchange(0, std::memory_order_relaxed), now);
+    packet_processed_rrd->add_sample(n_processed, now);
+    packet_dupe_rrd->add_sample(n_dupe, now);
+    packet_error_rrd->add_sample(n_error, now);
+    packet_queue_rrd->add_sample(n_queued, now);
+}
+
+void packet_chain::dedupe_packet(const std::shared_ptr<kis_packet>& packet) {
+    const auto& chunk = packet->fetch<kis_datachunk>(pack_comp_decap, pack_comp_linkframe);
+
+    if (chunk == nullptr || chunk->data() == nullptr || chunk->length() == 0)
+        return;
+
+    // Hash outside of the lock, only the lookup and insert are serialized
+    packet->hash = crc32_fast(chunk->data(), chunk->length(), 0);
+
+    uint64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    std::shared_ptr<kis_packet> original;
+
+    // Expired originals are released after the shard lock is dropped, so that returning
+    // them to the packet pool doesn't happen under the lock
+    thread_local std::vector<std::shared_ptr<kis_packet>> evicted;
+
+    {
+        auto& shard = dedupe_shards[packet->hash % dedupe_n_shards];
+        kis_lock_guard<kis_mutex> lk(shard.mutex, "dedupe_packet");
+
+        // Age out anything that has fallen out of the window, and anything over the
+        // shard size limit
+        while (!shard.age_queue.empty()) {
+            const auto& front = shard.age_queue.front();
+
+            if (front.second + dedupe_window_us >= now_us && shard.index.size() < dedupe_shard_max)
+                break;
+
+            auto ei = shard.index.find(front.first);
+
+            // Only remove the index entry if it hasn't been replaced since
+            if (ei != shard.index.end() && ei->second.ts_us == front.second) {
+                evicted.push_back(std::move(ei->second.original_pkt));
+                shard.index.erase(ei);
+                dedupe_evictions++;
+            }
+
+            shard.age_queue.pop_front();
         }
 
-        for (const auto& pcl : classifier_chain) {
-            if (pcl->callback != nullptr)
-                pcl->callback(pcl->auxdata, packet);
+        auto hi = shard.index.find(packet->hash);
+
+        if (hi != shard.index.end() && hi->second.ts_us + dedupe_window_us >= now_us) {
+            original = hi->second.original_pkt;
+            packet->packet_no = hi->second.packno;
+        } else {
+            // Assign a new packet number and cache it in the dedupe
+            packet->packet_no = unique_packet_no++;
+
+            if (hi != shard.index.end()) {
+                evicted.push_back(std::move(hi->second.original_pkt));
+                hi->second = dedupe_entry{packet->packet_no, now_us, packet};
+            } else {
+                shard.index.insert({packet->hash, dedupe_entry{packet->packet_no, now_us, packet}});
+            }
+
+            shard.age_queue.push_back({packet->hash, now_us});
         }
+    }
 
-        for (const auto& pcl : tracker_chain) {
-            if (pcl->callback != nullptr)
-                pcl->callback(pcl->auxdata, packet);
+    evicted.clear();
+
+    if (original == nullptr) {
+        dedupe_misses++;
+        return;
+    }
+
+    dedupe_hits++;
+
+    packet->duplicate = true;
+    packet->original = original;
+
+    // We have to wait until everything is done being changed in the original packet
+    // before we can copy the duplicate decoded state over; the original packet lock
+    // is held by whichever thread is processing it until the end of the chain, so
+    // this only blocks on that single packet, not the entire dedupe index.
+    //
+    // The signal merge has to stay under the same lock:  other duplicates of this
+    // packet insert into the original's component vector, which shifts it.
+    kis_lock_guard<kis_mutex> lg(original->mutex, "dedupe_packet original");
+    packet->alias_components(*original);
+
+    // Merge the signal levels
+    if (packet->has(pack_comp_l1) && packet->has(pack_comp_datasource)) {
+        auto l1 = original->fetch<kis_layer1_packinfo>(pack_comp_l1);
+        auto radio_agg = packet->fetch_or_add<kis_layer1_aggregate_packinfo>(pack_comp_l1_agg);
+        auto datasrc = packet->fetch<packetchain_comp_datasource>(pack_comp_datasource);
+        radio_agg->source_l1_map[datasrc->ref_source->get_source_uuid()] = l1;
+    }
+}
+
+unsigned int packet_chain::least_loaded_thread() {
+    if (n_packet_threads == 1)
+        return 0;
+
+    // Cheap per-thread xorshift instead of rand(), which locks
+    thread_local uint32_t seed =
+        static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id())) | 1;
+
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    unsigned int a = seed % n_packet_threads;
+    unsigned int b = (a + 1 + (seed >> 16) % (n_packet_threads - 1)) % n_packet_threads;
+
+    if (packet_threads[b]->depth() < packet_threads[a]->depth())
+        return b;
+
+    return a;
+}
+
+unsigned int packet_chain::assign_slot(unsigned int slot) {
+    auto& state = assignment_slots[slot];
+    auto cur = state.load(std::memory_order_acquire);
+
+    while (true) {
+        unsigned int owner = cur >> 32;
+        uint32_t pending = cur & 0xFFFFFFFF;
+        unsigned int target = owner;
+
+        // Only an idle slot can move; everything queued for it has already been
+        // processed, so the next packet can't overtake an earlier one
+        if (pending == 0 && packet_thread_rebalance != 0) {
+            auto depth = packet_threads[owner]->depth();
+
+            if (depth > packet_thread_rebalance) {
+                auto alt = least_loaded_thread();
+
+                if (alt != owner && packet_threads[alt]->depth() * 2 < depth)
+                    target = alt;
+            }
         }
 
-        for (const auto& pcl : logging_chain) {
-            if (pcl->callback != nullptr)
-                pcl->callback(pcl->auxdata, packet);
+        uint64_t next = (static_cast<uint64_t>(target) << 32) | (pending + 1);
+
+        if (state.compare_exchange_weak(cur, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            if (target != owner)
+                n_slot_migrations.fetch_add(1, std::memory_order_relaxed);
+
+            return target;
         }
+    }
+}
 
-        packet->mutex.unlock();
+void packet_chain::release_slot(int slot) {
+    if (slot < 0)
+        return;
 
-        uint64_t now = Globalreg::globalreg->last_tv_sec;
+    assignment_slots[slot].fetch_sub(1, std::memory_order_release);
+}
 
-        if (packet->error)
-            packet_error_rrd->add_sample(1, now);
+size_t packet_chain::queue_headroom() {
+    if (packet_queue_drop == 0)
+        return std::numeric_limits<size_t>::max();
 
-        if (packet->duplicate)
-            packet_dupe_rrd->add_sample(1, now);
+    size_t deepest = 0;
 
-        packet_processed_rrd->add_sample(1, now);
+    const auto n_running = n_running_packet_threads.load(std::memory_order_acquire);
 
-        continue;
+    for (size_t i = 0; i < n_running; i++) {
+        if (packet_threads[i] == nullptr)
+            continue;
+
+        deepest = std::max(deepest, packet_threads[i]->depth());
     }
+
+    if (deepest >= packet_queue_drop)
+        return 0;
+
+    return packet_queue_drop - deepest;
 }
 
 int packet_chain::process_packet(std::shared_ptr<kis_packet> in_pack) {
@@ -554,43 +945,35 @@ int packet_chain::process_packet(std::shared_ptr<kis_packet> in_pack) {
     time_t now = (time_t) Globalreg::globalreg->last_tv_sec;
 
     // Total packet rate always gets added, even when we drop, so we can compare
-    packet_rate_rrd->add_sample(1, now);
-    packet_peak_rrd->add_sample(1, now);
+    n_incoming_packets.fetch_add(1, std::memory_order_relaxed);
 
-    // Import the new postcap chain, if it has been modified
-    kis_unique_lock<kis_shared_mutex> lk(packetchain_mutex, "process_packet");
-    if (postcap_chain_update) {
-        postcap_chain = postcap_chain_new;
-        postcap_chain_new.clear();
-        postcap_chain_update = false;
-    }
-    lk.unlock();
+    const auto cs = chains.load(std::memory_order_acquire);
 
     // Run the post-capture processing
-    for (const auto& pcl : postcap_chain) {
-        if (pcl->callback != nullptr)
-            pcl->callback(pcl->auxdata, in_pack);
-    }
+    run_chain(cs->dispatch(packet_dlt(in_pack)).postcap, in_pack,
+            handler_profiling.load(std::memory_order_relaxed));
 
-    // assign it to a thread
+    // Assign it to a thread.  Packets without an assignment id have no ordering
+    // requirements and go to the less loaded of two random workers; packets with an
+    // assignment id go to the worker which currently owns their slot.
     unsigned int processing_id;
 
-    // If there is no assignment id, randomly assign the packet to a thread.
-    // Otherwise transform the assignment id to a consistent thread.
-    // If the packet is a duplicate, assign it to the same thread as the original.
     if (in_pack->assignment_id == 0) {
-        if (in_pack->original != nullptr) {
-            processing_id = in_pack->original->assignment_id % n_packet_threads;
-        } else {
-            processing_id = rand() % n_packet_threads;
-        }
+        processing_id = least_loaded_thread();
     } else {
-        processing_id = in_pack->assignment_id % n_packet_threads;
+        in_pack->assignment_slot = in_pack->assignment_id % n_assignment_slots;
+        processing_id = assign_slot(in_pack->assignment_slot);
     }
 
-    auto qsize = packet_threads[processing_id]->packet_queue.size_approx();
+    auto qsize = packet_threads[processing_id]->depth();
+
+    // Low priority packets are shed at the backlog limit, high priority packets are
+    // only dropped once the reserve above it is exhausted as well
+    auto drop_limit = packet_queue_drop;
+    if (!in_pack->low_priority)
+        drop_limit += packet_queue_priority_reserve;
 
-    if (packet_queue_drop != 0 && qsize > packet_queue_drop) {
+    if (packet_queue_drop != 0 && qsize > drop_limit) {
         time_t offt = now - last_packet_drop_user_warning;
 
         if (offt > 30) {
@@ -607,7 +990,15 @@ int packet_chain::process_packet(std::shared_ptr<kis_packet> in_pack) {
                         "packet_backlog_limit configuration parameter.", packet_queue_drop), -1);
         }
 
-        packet_drop_rrd->add_sample(1, now);
+        n_dropped_packets.fetch_add(1, std::memory_order_relaxed);
+
+        if (in_pack->low_priority)
+            n_dropped_low.fetch_add(1, std::memory_order_relaxed);
+        else
+            n_dropped_high.fetch_add(1, std::memory_order_relaxed);
+
+        release_slot(in_pack->assignment_slot);
+        in_pack->assignment_slot = -1;
 
         return 1;
     }
@@ -631,322 +1022,187 @@ int packet_chain::process_packet(std::shared_ptr<kis_packet> in_pack) {
 
 
     // Queue the packet to the target thread
-    packet_threads[processing_id]->packet_queue.enqueue(in_pack);
-    packet_queue_rrd->add_sample(qsize, now);
+    const auto low_priority = in_pack->low_priority;
+    packet_threads[processing_id]->enqueue(std::move(in_pack), low_priority);
 
     return 1;
 }
 
-int packet_chain::register_int_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio) {
-
-    kis_lock_guard<kis_shared_mutex> lk(packetchain_mutex, "register_int_handler");
-
-    auto link = std::make_shared<pc_link>();
-
-    // Generate packet, we'll nuke it if it's invalid later
-    link->priority = in_prio;
-    link->callback = in_cb;
-    link->auxdata = in_aux;
-    link->id = next_handlerid++;
-
+std::vector<std::shared_ptr<packet_chain::pc_link>> *packet_chain::select_chain(chain_set *set,
+        int in_chain) {
     switch (in_chain) {
         case CHAINPOS_POSTCAP:
-            if (!postcap_chain_update) {
-                postcap_chain_update = true;
-                postcap_chain_new = postcap_chain;
-            }
-
-            postcap_chain_new.push_back(link);
-            stable_sort(postcap_chain_new.begin(), postcap_chain_new.end(), 
-                    SortLinkPriority());
-            break;
-
+            return &set->postcap;
         case CHAINPOS_LLCDISSECT:
-            if (!llcdissect_chain_update) {
-                llcdissect_chain_update = true;
-                llcdissect_chain_new = llcdissect_chain;
-            }
-
-            llcdissect_chain_new.push_back(link);
-            stable_sort(llcdissect_chain_new.begin(), llcdissect_chain_new.end(), 
-                    SortLinkPriority());
-            break;
-
+            return &set->llcdissect;
         case CHAINPOS_DECRYPT:
-            if (!decrypt_chain_update) {
-                decrypt_chain_update = true;
-                decrypt_chain_new = decrypt_chain;
-            }
-
-            decrypt_chain_new.push_back(link);
-            stable_sort(decrypt_chain_new.begin(), decrypt_chain_new.end(), 
-                    SortLinkPriority());
-            break;
-
+            return &set->decrypt;
         case CHAINPOS_DATADISSECT:
-            if (!datadissect_chain_update) {
-                datadissect_chain_update = true;
-                datadissect_chain_new = datadissect_chain;
-            }
-
-            datadissect_chain_new.push_back(link);
-            stable_sort(datadissect_chain_new.begin(), datadissect_chain_new.end(), 
-                    SortLinkPriority());
-            break;
-
+            return &set->datadissect;
         case CHAINPOS_CLASSIFIER:
-            if (!classifier_chain_update) {
-                classifier_chain_update = true;
-                classifier_chain_new = classifier_chain;
-            }
-
-            classifier_chain_new.push_back(link);
-            stable_sort(classifier_chain_new.begin(), classifier_chain_new.end(), 
-                    SortLinkPriority());
-            break;
-
+            return &set->classifier;
         case CHAINPOS_TRACKER:
-            if (!tracker_chain_update) {
-                tracker_chain_update = true;
-                tracker_chain_new = tracker_chain;
-            }
-
-            tracker_chain_new.push_back(link);
-            stable_sort(tracker_chain_new.begin(), tracker_chain_new.end(), 
-                    SortLinkPriority());
-            break;
-
+            return &set->tracker;
         case CHAINPOS_LOGGING:
-            if (!logging_chain_update) {
-                logging_chain_update = true;
-                logging_chain_new = logging_chain;
-            }
-
-            logging_chain_new.push_back(link);
-            stable_sort(logging_chain_new.begin(), logging_chain_new.end(), 
-                    SortLinkPriority());
-            break;
-
+            return &set->logging;
         default:
-            _MSG("packet_chain::register_handler requested unknown chain", MSGFLAG_ERROR);
-            return -1;
+            return nullptr;
     }
-
-    return link->id;
-}
-
-int packet_chain::register_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio) {
-    return register_int_handler(in_cb, in_aux, in_chain, in_prio);
 }
 
-int packet_chain::remove_handler(int in_id, int in_chain) {
-    kis_lock_guard<kis_shared_mutex> lk(packetchain_mutex, "remove_handler");
-
-    unsigned int x;
-
-    switch (in_chain) {
-        case CHAINPOS_POSTCAP:
-            if (!postcap_chain_update) {
-                postcap_chain_update = true;
-                postcap_chain_new = postcap_chain;
-            }
-
-            for (x = 0; x < postcap_chain_new.size(); x++) {
-                if (postcap_chain_new[x]->id == in_id) {
-                    postcap_chain_new.erase(postcap_chain_new.begin() + x);
-                }
-            }
-            break;
+void packet_chain::build_dispatch(chain_set *set) {
+    // Every DLT any handler is interested in gets its own set of chains
+    set->dlt_dispatch.clear();
 
-        case CHAINPOS_LLCDISSECT:
-            if (!llcdissect_chain_update) {
-                llcdissect_chain_update = true;
-                llcdissect_chain_new = llcdissect_chain;
-            }
+    for (const auto& c : {&set->postcap, &set->llcdissect, &set->decrypt, &set->datadissect,
+            &set->classifier, &set->tracker, &set->logging}) {
+        for (const auto& pcl : *c) {
+            for (const auto& d : pcl->dlts)
+                set->dlt_dispatch[d];
+        }
+    }
 
-            for (x = 0; x < llcdissect_chain_new.size(); x++) {
-                if (llcdissect_chain_new[x]->id == in_id) {
-                    llcdissect_chain_new.erase(llcdissect_chain_new.begin() + x);
-                }
-            }
-            break;
+    auto filter = [](const std::vector<std::shared_ptr<pc_link>>& chain,
+            std::vector<std::shared_ptr<pc_link>>& out, int dlt) {
+        out.clear();
 
-        case CHAINPOS_DECRYPT:
-            if (!decrypt_chain_update) {
-                decrypt_chain_update = true;
-                decrypt_chain_new = decrypt_chain;
-            }
+        for (const auto& pcl : chain) {
+            if (pcl->dlts.empty() ||
+                    std::find(pcl->dlts.begin(), pcl->dlts.end(), dlt) != pcl->dlts.end())
+                out.push_back(pcl);
+        }
+    };
+
+    auto fill = [set, &filter](chain_dispatch& d, int dlt) {
+        filter(set->postcap, d.postcap, dlt);
+        filter(set->llcdissect, d.llcdissect, dlt);
+        filter(set->decrypt, d.decrypt, dlt);
+        filter(set->datadissect, d.datadissect, dlt);
+        filter(set->classifier, d.classifier, dlt);
+        filter(set->tracker, d.tracker, dlt);
+        filter(set->logging, d.logging, dlt);
+    };
+
+    // Handlers with no DLT interest only, for packets of any other DLT
+    fill(set->other_dlt, -1);
+
+    for (auto& d : set->dlt_dispatch)
+        fill(d.second, d.first);
+}
 
-            for (x = 0; x < decrypt_chain_new.size(); x++) {
-                if (decrypt_chain_new[x]->id == in_id) {
-                    decrypt_chain_new.erase(decrypt_chain_new.begin() + x);
-                }
-            }
-            break;
+int packet_chain::packet_dlt(const std::shared_ptr<kis_packet>& packet) const {
+    if (!(packet->component_mask & (1ULL << pack_comp_linkframe)))
+        return -1;
 
-        case CHAINPOS_DATADISSECT:
-            if (!datadissect_chain_update) {
-                datadissect_chain_update = true;
-                datadissect_chain_new = datadissect_chain;
-            }
+    return packet->fetch<kis_datachunk>(pack_comp_linkframe)->dlt;
+}
 
-            for (x = 0; x < datadissect_chain_new.size(); x++) {
-                if (datadissect_chain_new[x]->id == in_id) {
-                    datadissect_chain_new.erase(datadissect_chain_new.begin() + x);
-                }
-            }
-            break;
+void packet_chain::publish_chains(std::unique_ptr<chain_set> set) {
+    build_dispatch(set.get());
 
-        case CHAINPOS_CLASSIFIER:
-            if (!classifier_chain_update) {
-                classifier_chain_update = true;
-                classifier_chain_new = classifier_chain;
-            }
+    chains.store(set.get(), std::memory_order_release);
+    chain_sets.push_back(std::move(set));
+}
 
-            for (x = 0; x < classifier_chain_new.size(); x++) {
-                if (classifier_chain_new[x]->id == in_id) {
-                    classifier_chain_new.erase(classifier_chain_new.begin() + x);
-                }
-            }
-            break;
+int packet_chain::register_int_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio,
+        const pc_interest& in_interest, const std::string& in_name) {
+    kis_lock_guard<kis_shared_mutex> lk(packetchain_mutex, "register_int_handler");
 
-        case CHAINPOS_TRACKER:
-            if (!tracker_chain_update) {
-                tracker_chain_update = true;
-                tracker_chain_new = tracker_chain;
-            }
+    auto set = std::make_unique<chain_set>(*chains.load(std::memory_order_acquire));
+    auto chain = select_chain(set.get(), in_chain);
 
-            for (x = 0; x < tracker_chain_new.size(); x++) {
-                if (tracker_chain_new[x]->id == in_id) {
-                    tracker_chain_new.erase(tracker_chain_new.begin() + x);
-                }
-            }
-            break;
+    if (chain == nullptr) {
+        _MSG("packet_chain::register_handler requested unknown chain", MSGFLAG_ERROR);
+        return -1;
+    }
 
-        case CHAINPOS_LOGGING:
-            if (!logging_chain_update) {
-                logging_chain_update = true;
-                logging_chain_new = logging_chain;
-            }
+    auto link = std::make_shared<pc_link>();
 
-            for (x = 0; x < logging_chain_new.size(); x++) {
-                if (logging_chain_new[x]->id == in_id) {
-                    logging_chain_new.erase(logging_chain_new.begin() + x);
-                }
-            }
-            break;
+    link->priority = in_prio;
+    link->callback = in_cb;
+    link->auxdata = in_aux;
+    link->id = next_handlerid++;
+    link->name = in_name;
+    link->dlts = in_interest.dlts;
+    link->component_mask = 0;
 
-        default:
-            _MSG("packet_chain::remove_handler requested unknown chain", 
-                    MSGFLAG_ERROR);
+    for (const auto& c : in_interest.components) {
+        if (c < 0 || c >= MAX_PACKET_COMPONENTS) {
+            _MSG_ERROR("packet_chain::register_handler requested invalid packet component {}", c);
             return -1;
+        }
+
+        link->component_mask |= (1ULL << c);
     }
 
-    return 1;
-}
+    // Fall back to the symbol name of the callback for profiling, if it's exported
+    if (link->name.empty()) {
+        Dl_info info;
 
-int packet_chain::remove_handler(pc_callback in_cb, int in_chain) {
-    kis_lock_guard<kis_shared_mutex> lk(packetchain_mutex, "remove_handler");
+        if (dladdr(reinterpret_cast<void *>(in_cb), &info) != 0 && info.dli_sname != nullptr) {
+            int status;
+            std::unique_ptr<char, void (*)(void *)> demangled{
+                abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status), std::free};
+            link->name = demangled != nullptr ? demangled.get() : info.dli_sname;
+        } else {
+            link->name = fmt::format("handler {}", link->id);
+        }
+    }
 
-    unsigned int x;
+    chain->push_back(link);
+    stable_sort(chain->begin(), chain->end(), SortLinkPriority());
 
-    switch (in_chain) {
-        case CHAINPOS_POSTCAP:
-            if (!postcap_chain_update) {
-                postcap_chain_update = true;
-                postcap_chain_new = postcap_chain;
-            }
+    publish_chains(std::move(set));
 
-            for (x = 0; x < postcap_chain_new.size(); x++) {
-                if (postcap_chain_new[x]->callback == in_cb) {
-                    postcap_chain_new.erase(postcap_chain_new.begin() + x);
-                }
-            }
-            break;
+    return link->id;
+}
 
-        case CHAINPOS_LLCDISSECT:
-            if (!llcdissect_chain_update) {
-                llcdissect_chain_update = true;
-                llcdissect_chain_new = llcdissect_chain;
-            }
+int packet_chain::register_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio,
+        const std::string& in_name) {
+    return register_int_handler(in_cb, in_aux, in_chain, in_prio, pc_interest{}, in_name);
+}
 
-            for (x = 0; x < llcdissect_chain_new.size(); x++) {
-                if (llcdissect_chain_new[x]->callback == in_cb) {
-                    llcdissect_chain_new.erase(llcdissect_chain_new.begin() + x);
-                }
-            }
-            break;
+int packet_chain::register_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio,
+        const pc_interest& in_interest, const std::string& in_name) {
+    return register_int_handler(in_cb, in_aux, in_chain, in_prio, in_interest, in_name);
+}
 
-        case CHAINPOS_DECRYPT:
-            if (!decrypt_chain_update) {
-                decrypt_chain_update = true;
-                decrypt_chain_new = decrypt_chain;
-            }
+int packet_chain::remove_handler(int in_id, int in_chain) {
+    kis_lock_guard<kis_shared_mutex> lk(packetchain_mutex, "remove_handler");
 
-            for (x = 0; x < decrypt_chain_new.size(); x++) {
-                if (decrypt_chain_new[x]->callback == in_cb) {
-                    decrypt_chain_new.erase(decrypt_chain_new.begin() + x);
-                }
-            }
-            break;
+    auto set = std::make_unique<chain_set>(*chains.load(std::memory_order_acquire));
+    auto chain = select_chain(set.get(), in_chain);
 
-        case CHAINPOS_DATADISSECT:
-            if (!datadissect_chain_update) {
-                datadissect_chain_update = true;
-                datadissect_chain_new = datadissect_chain;
-            }
+    if (chain == nullptr) {
+        _MSG("packet_chain::remove_handler requested unknown chain", 
+                MSGFLAG_ERROR);
+        return -1;
+    }
 
-            for (x = 0; x < datadissect_chain_new.size(); x++) {
-                if (datadissect_chain_new[x]->callback == in_cb) {
-                    datadissect_chain_new.erase(datadissect_chain_new.begin() + x);
-                }
-            }
-            break;
+    chain->erase(std::remove_if(chain->begin(), chain->end(),
+                [in_id](const auto& l) { return l->id == in_id; }), chain->end());
 
-        case CHAINPOS_CLASSIFIER:
-            if (!classifier_chain_update) {
-                classifier_chain_update = true;
-                classifier_chain_new = classifier_chain;
-            }
+    publish_chains(std::move(set));
 
-            for (x = 0; x < classifier_chain_new.size(); x++) {
-                if (classifier_chain_new[x]->callback == in_cb) {
-                    classifier_chain_new.erase(classifier_chain_new.begin() + x);
-                }
-            }
-            break;
+    return 1;
+}
 
-        case CHAINPOS_TRACKER:
-            if (!tracker_chain_update) {
-                tracker_chain_update = true;
-                tracker_chain_new = tracker_chain;
-            }
+int packet_chain::remove_handler(pc_callback in_cb, int in_chain) {
+    kis_lock_guard<kis_shared_mutex> lk(packetchain_mutex, "remove_handler");
 
-            for (x = 0; x < tracker_chain_new.size(); x++) {
-                if (tracker_chain_new[x]->callback == in_cb) {
-                    tracker_chain_new.erase(tracker_chain_new.begin() + x);
-                }
-            }
-            break;
+    auto set = std::make_unique<chain_set>(*chains.load(std::memory_order_acquire));
+    auto chain = select_chain(set.get(), in_chain);
 
-        case CHAINPOS_LOGGING:
-            if (!logging_chain_update) {
-                logging_chain_update = true;
-                logging_chain_new = logging_chain;
-            }
+    if (chain == nullptr) {
+        _MSG("packet_chain::remove_handler requested unknown chain", 
+                MSGFLAG_ERROR);
+        return -1;
+    }
 
-            for (x = 0; x < logging_chain_new.size(); x++) {
-                if (logging_chain_new[x]->callback == in_cb) {
-                    logging_chain_new.erase(logging_chain_new.begin() + x);
-                }
-            }
-            break;
+    chain->erase(std::remove_if(chain->begin(), chain->end(),
+                [in_cb](const auto& l) { return l->callback == in_cb; }), chain->end());
 
-        default:
-            _MSG("packet_chain::remove_handler requested unknown chain", 
-                    MSGFLAG_ERROR);
-            return -1;
-    }
+    publish_chains(std::move(set));
 
     return 1;
 }
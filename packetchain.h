@@ -29,6 +29,7 @@
 #endif
 
 #include <algorithm>
+#include <deque>
 #include <string>
 #include <vector>
 #include <map>
@@ -131,96 +132,220 @@ public:
     // Inject a packet into the chain
     int process_packet(std::shared_ptr<kis_packet> in_pack);
 
+    // How many more packets can be queued before the busiest packet thread reaches
+    // the backlog limit; used to grant flow control credit to datasources
+    size_t queue_headroom();
+
     // Callback and information
     typedef int (*pc_callback)(CHAINCALL_PARMS);
-    typedef struct {
+
+    // Optional per-handler timing, only collected while handler profiling is enabled.
+    // Latencies are kept as a log2 histogram in nanoseconds.
+    struct handler_profile {
+        static constexpr unsigned int n_buckets = 32;
+
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> total_ns{0};
+        std::atomic<uint64_t> max_ns{0};
+        std::atomic<uint64_t> histogram[n_buckets] = {};
+
+        void add_sample(uint64_t ns);
+        // Upper bound of the histogram bucket containing the given percentile
+        uint64_t percentile_ns(double pct) const;
+        void reset();
+    };
+
+    // Optional filter on the packets a handler is called for.  When DLTs are listed,
+    // the handler only sees packets whose link frame has one of them; when components
+    // are listed, the handler only sees packets which already carry all of them.
+    struct pc_interest {
+        std::vector<int> dlts;
+        std::vector<int> components;
+    };
+
+    struct pc_link {
         int priority;
 
 		packet_chain::pc_callback callback;
 
         void *auxdata;
 		int id;
-    } pc_link;
 
-    // Register a callback, aux data, a chain to put it in, and the priority
-    int register_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio);
+        std::string name;
+        handler_profile profile;
+
+        std::vector<int> dlts;
+        uint64_t component_mask;
+    };
+
+    // Register a callback, aux data, a chain to put it in, and the priority; the name
+    // is used for handler profiling, and if omitted, is looked up from the callback symbol
+    int register_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio,
+            const std::string& in_name = "");
+    // Register a callback which is only called for packets matching the interest
+    int register_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio,
+            const pc_interest& in_interest, const std::string& in_name = "");
     int remove_handler(pc_callback in_cb, int in_chain);
 	int remove_handler(int in_id, int in_chain);
 
+    // Enable or disable per-handler profiling at runtime
+    void set_handler_profiling(bool in_enable) {
+        handler_profiling = in_enable;
+    }
+
+    bool get_handler_profiling() const {
+        return handler_profiling;
+    }
+
+    void reset_handler_profiles();
+
+    // Call a function with each stage name and its handlers, in chain order
+    void visit_handler_chains(const std::function<void (const std::string&,
+                const std::vector<std::shared_ptr<pc_link>>&)>& in_fn);
+
     static std::string event_packetstats() { return "PACKETCHAIN_STATS"; }
 
+    // Packet components come from a per-type pool with a free list per thread, so
+    // allocating them doesn't lock or look up the pool
     template<typename T>
     std::shared_ptr<T> new_packet_component() {
-        kis_lock_guard<kis_mutex> lk(packetcomp_mutex);
-
-        auto p = component_pool_map.find(typeid(T).hash_code());
-
-        if (p != component_pool_map.end()) {
-            return std::static_pointer_cast<shared_object_pool<T>>(p->second)->acquire();
-        } else {
-            auto pool = std::make_shared<shared_object_pool<T>>();
-            pool->set_max(1024);
-            pool->set_reset([](T *c) { c->reset(); });
-            component_pool_map.insert({typeid(T).hash_code(), pool});
-            return pool->acquire();
-        }
+        return local_object_pool<T>::get().acquire();
     }
 
 protected:
-    void packet_queue_processor(moodycamel::BlockingConcurrentQueue<std::shared_ptr<kis_packet>> *packet_queue);
+    struct packet_thread;
+
+    void packet_queue_processor(packet_thread *thread);
+
+    // Hash the packet and compare it to the recent packets; the shard lock is only
+    // held for the lookup and insert, not for the rest of the chain
+    void dedupe_packet(const std::shared_ptr<kis_packet>& packet);
 
     // Common function for both insertion methods
-    int register_int_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio);
+    int register_int_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio,
+            const pc_interest& in_interest, const std::string& in_name);
+
+    // Run every handler in a chain whose component interest the packet satisfies,
+    // optionally timing each
+    void run_chain(const std::vector<std::shared_ptr<packet_chain::pc_link>>& chain,
+            const std::shared_ptr<kis_packet>& packet, bool profile);
+
+    // Link frame DLT of a packet, or -1
+    int packet_dlt(const std::shared_ptr<kis_packet>& packet) const;
+
+    std::atomic<bool> handler_profiling;
+
+    int handler_stats_id, handler_name_id, handler_id_id, handler_priority_id, handler_calls_id,
+        handler_mean_id, handler_p50_id, handler_p99_id, handler_max_id;
+
+    // Per-stage handler call counts and latencies
+    std::shared_ptr<tracker_element_string_map> handler_profile_stats();
+    void handler_profile_endpoint(std::shared_ptr<kis_net_beast_httpd_connection> con);
 
     int next_componentid, next_handlerid;
 
     std::map<std::string, int> component_str_map;
     std::map<int, std::string> component_id_map;
 
-    // Core chain components
-    std::vector<std::shared_ptr<packet_chain::pc_link>> postcap_chain;
-    std::vector<std::shared_ptr<packet_chain::pc_link>> llcdissect_chain;
-    std::vector<std::shared_ptr<packet_chain::pc_link>> decrypt_chain;
-    std::vector<std::shared_ptr<packet_chain::pc_link>> datadissect_chain;
-    std::vector<std::shared_ptr<packet_chain::pc_link>> classifier_chain;
-	std::vector<std::shared_ptr<packet_chain::pc_link>> tracker_chain;
-    std::vector<std::shared_ptr<packet_chain::pc_link>> logging_chain;
-
-    // Updated chain components
-    std::vector<std::shared_ptr<packet_chain::pc_link>> postcap_chain_new;
-    std::vector<std::shared_ptr<packet_chain::pc_link>> llcdissect_chain_new;
-    std::vector<std::shared_ptr<packet_chain::pc_link>> decrypt_chain_new;
-    std::vector<std::shared_ptr<packet_chain::pc_link>> datadissect_chain_new;
-    std::vector<std::shared_ptr<packet_chain::pc_link>> classifier_chain_new;
-	std::vector<std::shared_ptr<packet_chain::pc_link>> tracker_chain_new;
-    std::vector<std::shared_ptr<packet_chain::pc_link>> logging_chain_new;
-
-    bool postcap_chain_update;
-    bool llcdissect_chain_update;
-    bool decrypt_chain_update;
-    bool datadissect_chain_update;
-    bool classifier_chain_update;
-    bool tracker_chain_update;
-    bool logging_chain_update;
-
-    // Packet component mutex
+    // Handler chains are published as immutable snapshots; the packet path only does
+    // an atomic load of the current snapshot, while register_handler and remove_handler
+    // build a modified copy and swap it in.  Handlers only change at startup and plugin
+    // load, so retired snapshots are simply kept until the packetchain is destroyed,
+    // which guarantees no packet thread is still walking them.
+    //
+    // Each snapshot also carries the chains pre-filtered by DLT interest, one set per
+    // DLT any handler is interested in, plus one for every other DLT, so the packet
+    // path picks its handler lists once per packet instead of testing the DLT per handler.
+    struct chain_dispatch {
+        std::vector<std::shared_ptr<packet_chain::pc_link>> postcap;
+        std::vector<std::shared_ptr<packet_chain::pc_link>> llcdissect;
+        std::vector<std::shared_ptr<packet_chain::pc_link>> decrypt;
+        std::vector<std::shared_ptr<packet_chain::pc_link>> datadissect;
+        std::vector<std::shared_ptr<packet_chain::pc_link>> classifier;
+        std::vector<std::shared_ptr<packet_chain::pc_link>> tracker;
+        std::vector<std::shared_ptr<packet_chain::pc_link>> logging;
+    };
+
+    struct chain_set : public chain_dispatch {
+        chain_dispatch other_dlt;
+        ankerl::unordered_dense::map<int, chain_dispatch> dlt_dispatch;
+
+        const chain_dispatch& dispatch(int dlt) const {
+            auto d = dlt_dispatch.find(dlt);
+
+            if (d == dlt_dispatch.end())
+                return other_dlt;
+
+            return d->second;
+        }
+    };
+
+    // Rebuild the per-DLT chains of a snapshot from the full chains
+    static void build_dispatch(chain_set *set);
+
+    std::atomic<const chain_set *> chains;
+    std::vector<std::unique_ptr<chain_set>> chain_sets;
+
+    // Map a CHAINPOS_ to the chain in a set, or nullptr
+    static std::vector<std::shared_ptr<packet_chain::pc_link>> *select_chain(chain_set *set, int in_chain);
+
+    // Publish a new snapshot, must be called under packetchain_mutex
+    void publish_chains(std::unique_ptr<chain_set> set);
+
+    // Packet component registration mutex
     kis_mutex packetcomp_mutex;
 
-    // Packet chain mutex
+    // Packet chain mutex, serializes writers of the handler chains; never taken
+    // when processing packets
     kis_shared_mutex packetchain_mutex;
 
-    struct packet_thread {
+    // Maximum number of packets a worker pulls from its queue at once
+    static constexpr size_t packet_bulk_max = 32;
+
+    // Packet worker thread and queues; stats are counted locally by the worker and
+    // folded into the RRDs once per second by the stats timer, instead of locking
+    // each RRD for every packet.
+    //
+    // Each worker has a priority queue and a bulk queue; the semaphore counts the
+    // packets in both so the worker can block on either, and the priority queue is
+    // always drained first.
+    struct alignas(64) packet_thread {
         std::thread packet_thread;
-        moodycamel::BlockingConcurrentQueue<std::shared_ptr<kis_packet>> packet_queue;
+        moodycamel::ConcurrentQueue<std::shared_ptr<kis_packet>> priority_queue;
+        moodycamel::ConcurrentQueue<std::shared_ptr<kis_packet>> packet_queue;
+        moodycamel::LightweightSemaphore pending;
+
+        std::atomic<uint64_t> n_processed{0};
+        std::atomic<uint64_t> n_dupe{0};
+        std::atomic<uint64_t> n_error{0};
+
+        void enqueue(std::shared_ptr<kis_packet> packet, bool low_priority) {
+            if (low_priority)
+                packet_queue.enqueue(std::move(packet));
+            else
+                priority_queue.enqueue(std::move(packet));
+
+            pending.signal();
+        }
+
+        size_t depth() const {
+            return priority_queue.size_approx() + packet_queue.size_approx();
+        }
     };
 
     packet_thread **packet_threads;
     size_t n_packet_threads;
 
+    // Number of packet threads which are started and safe to look at from other threads,
+    // such as the stats timer; published after the thread array is built and cleared
+    // before it is torn down
+    std::atomic<unsigned int> n_running_packet_threads{0};
+
     bool packetchain_shutdown;
 
-    // Warning and discard levels for packet queue being full
-    unsigned int packet_queue_warning, packet_queue_drop;
+    // Warning and discard levels for packet queue being full; low priority packets are
+    // dropped at the backlog limit, high priority packets may use the reserve above it
+    unsigned int packet_queue_warning, packet_queue_drop, packet_queue_priority_reserve;
     time_t last_packet_queue_user_warning, last_packet_drop_user_warning;
 
     std::shared_ptr<kis_tracked_rrd<kis_tracked_rrd_default_aggregator,
@@ -246,6 +371,42 @@ protected:
     std::shared_ptr<kis_tracked_rrd<>> packet_processed_rrd;
     int packet_processed_rrd_id;
 
+    // Incoming and dropped packets, folded into the RRDs by the stats timer
+    std::atomic<uint64_t> n_incoming_packets, n_dropped_packets;
+
+    // Total drops by priority class
+    std::atomic<uint64_t> n_dropped_low, n_dropped_high;
+    std::shared_ptr<tracker_element_uint64> dropped_low_elem;
+    std::shared_ptr<tracker_element_uint64> dropped_high_elem;
+
+    // Fold the per-thread and incoming counters into the RRDs
+    void update_packet_rrds();
+
+    // Per-worker queue depth rrds
+    std::shared_ptr<tracker_element_vector> packet_thread_queue_vec;
+    int packet_thread_queue_vec_id, packet_thread_queue_rrd_id;
+
+    // Packets with an assignment id are mapped to a slot, and each slot is mapped to a
+    // worker thread.  The slot state packs the owning thread (upper 32 bits) and the
+    // number of packets queued or in processing (lower 32 bits), so that a slot can
+    // only be moved to another worker when it has fully drained, which preserves the
+    // order of packets for the same devices.
+    static constexpr unsigned int n_assignment_slots = 4096;
+    std::unique_ptr<std::atomic<uint64_t>[]> assignment_slots;
+
+    // Queue depth above which idle slots are migrated to a less loaded worker; 0 disables
+    unsigned int packet_thread_rebalance;
+    std::atomic<uint64_t> n_slot_migrations;
+    std::shared_ptr<tracker_element_uint64> slot_migrations_elem;
+
+    // Pick the less loaded of two random workers
+    unsigned int least_loaded_thread();
+
+    // Map a slot to a worker, migrating it if it's idle and its worker is overloaded,
+    // and count the packet as in flight
+    unsigned int assign_slot(unsigned int slot);
+    void release_slot(int slot);
+
     std::shared_ptr<tracker_element_map> packet_stats_map;
 
     std::shared_ptr<time_tracker> timetracker;
@@ -255,30 +416,44 @@ protected:
     // Packet & data component pools
     shared_object_pool<kis_packet> packet_pool;
 
-    ankerl::unordered_dense::map<size_t, std::shared_ptr<void>> component_pool_map;
+    int component_pool_id, component_pool_type_id, component_pool_allocated_id,
+        component_pool_reused_id, component_pool_discarded_id;
 
-    // Unique lock for packet number and dedupe
-    kis_shared_mutex pack_no_mutex;
+    // Allocation counts of each pooled packet component type
+    std::shared_ptr<tracker_element_vector> component_pool_stats();
 
     // Next unique packet number
     std::atomic<uint64_t> unique_packet_no;
 
-    // A simple array of hash to packet ID for the past 1024 unique packets
-    typedef struct packno_map {
-        packno_map() {
-            hash = 0;
-            packno = 0;
-        }
-
-        uint32_t hash;
+    // Recently seen packet hashes, used to detect the same packet seen by multiple
+    // datasources.  The index is sharded by hash so that packet threads rarely
+    // contend on the same lock, and entries expire once they fall out of the
+    // dedupe time window.
+    struct dedupe_entry {
         uint64_t packno;
+        uint64_t ts_us;
         std::shared_ptr<kis_packet> original_pkt;
-    } packno_map_t;
+    };
+
+    struct dedupe_shard {
+        kis_mutex mutex;
+        ankerl::unordered_dense::map<uint32_t, dedupe_entry> index;
+        // Insertion order of (hash, timestamp) for expiring old entries
+        std::deque<std::pair<uint32_t, uint64_t>> age_queue;
+    };
+
+    static constexpr unsigned int dedupe_n_shards = 16;
+    dedupe_shard dedupe_shards[dedupe_n_shards];
+
+    // Dedupe time window and maximum entries per shard
+    uint64_t dedupe_window_us;
+    size_t dedupe_shard_max;
 
-    packno_map_t dedupe_list[1024];
+    std::atomic<uint64_t> dedupe_hits, dedupe_misses, dedupe_evictions;
 
-    // Current position in the dedupe list
-    std::atomic<unsigned int> dedupe_list_pos;
+    std::shared_ptr<tracker_element_uint64> dedupe_hits_elem;
+    std::shared_ptr<tracker_element_uint64> dedupe_misses_elem;
+    std::shared_ptr<tracker_element_uint64> dedupe_evictions_elem;
 
 	int pack_comp_linkframe, pack_comp_decap, pack_comp_l1_agg, pack_comp_l1, pack_comp_datasource;
 
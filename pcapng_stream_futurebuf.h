@@ -698,7 +698,7 @@ public:
 					auto pcapng = reinterpret_cast<pcapng_stream_packetchain *>(auxdata);
                     pcapng->handle_packet(packet);
                     return 1;
-				}, this, CHAINPOS_LOGGING, -100);
+				}, this, CHAINPOS_LOGGING, -100, "pcapng stream");
 
     }
 
@@ -191,12 +191,6 @@ kis_80211_phy::kis_80211_phy(int in_phyid) :
                 "IEEE802.11 device");
     dot11_builder = std::make_shared<dot11_tracked_device>(dot11_device_entry_id);
 
-    // Packet classifier - makes basic records plus dot11 data
-    packetchain->register_handler(&packet_dot11_common_classifier, this, CHAINPOS_CLASSIFIER, -100);
-    packetchain->register_handler(&packet_dot11_scan_json_classifier, this, CHAINPOS_CLASSIFIER, -99);
-    packetchain->register_handler(&phydot11_packethook_wep, this, CHAINPOS_DECRYPT, -100);
-    packetchain->register_handler(&phydot11_packethook_dot11, this, CHAINPOS_LLCDISSECT, -100);
-
     // If we haven't registered packet components yet, do so.  We have to
     // co-exist with the old tracker core for some time
     pack_comp_80211 =
@@ -232,6 +226,24 @@ kis_80211_phy::kis_80211_phy(int in_phyid) :
     pack_comp_json =
         packetchain->register_packet_component("JSON");
 
+    pack_comp_beacon_summary =
+        packetchain->register_packet_component("BEACONSUMMARY");
+
+    // Packet classifier - makes basic records plus dot11 data
+    packetchain->register_handler(&packet_dot11_common_classifier, this, CHAINPOS_CLASSIFIER, -100,
+            packet_chain::pc_interest{{}, {pack_comp_80211}}, "dot11 common classifier");
+    packetchain->register_handler(&packet_dot11_scan_json_classifier, this, CHAINPOS_CLASSIFIER, -99,
+            packet_chain::pc_interest{{}, {pack_comp_json}}, "dot11 scan json classifier");
+    packetchain->register_handler(&packet_dot11_beacon_summary_classifier, this, CHAINPOS_CLASSIFIER, -98,
+            packet_chain::pc_interest{{}, {pack_comp_beacon_summary}}, "dot11 beacon summary classifier");
+    packetchain->register_handler(&phydot11_packethook_wep, this, CHAINPOS_DECRYPT, -100,
+            packet_chain::pc_interest{{}, {pack_comp_80211}}, "dot11 wep decrypt");
+    packetchain->register_handler(&phydot11_packethook_dot11, this, CHAINPOS_LLCDISSECT, -100,
+            "dot11 dissector");
+    // After the DLT handlers have decapsulated the frame
+    packetchain->register_handler(&packet_dot11_priority_classifier, this, CHAINPOS_POSTCAP, 100,
+            "dot11 priority classifier");
+
     devtype_adhoc = devicetracker->get_cached_devicetype("Wi-Fi Ad-Hoc");
     devtype_ap = devicetracker->get_cached_devicetype("Wi-Fi AP");
     devtype_client = devicetracker->get_cached_devicetype("Wi-Fi Client"); 
@@ -857,6 +869,11 @@ kis_80211_phy::kis_80211_phy(int in_phyid) :
     filter_survey_only =
         Globalreg::globalreg->kismet_config->fetch_opt_bool("dot11_ap_only_survey", false);
 
+    // Errored frames carry no dot11 record, so the survey filter can't use a component interest
+    if (filter_survey_only)
+        packetchain->register_handler(&packet_dot11_survey_filter, this, CHAINPOS_CLASSIFIER, -101,
+                "dot11 survey filter");
+
     process_11d_country_list =
         Globalreg::globalreg->kismet_config->fetch_opt_bool("dot11_11d_country_full", false);
 
@@ -1071,7 +1088,10 @@ kis_80211_phy::kis_80211_phy(int in_phyid) :
 kis_80211_phy::~kis_80211_phy() {
 	packetchain->remove_handler(&phydot11_packethook_wep, CHAINPOS_DECRYPT);
 	packetchain->remove_handler(&phydot11_packethook_dot11, CHAINPOS_LLCDISSECT);
+	packetchain->remove_handler(&packet_dot11_survey_filter, CHAINPOS_CLASSIFIER);
 	packetchain->remove_handler(&packet_dot11_common_classifier, CHAINPOS_CLASSIFIER);
+	packetchain->remove_handler(&packet_dot11_beacon_summary_classifier, CHAINPOS_CLASSIFIER);
+	packetchain->remove_handler(&packet_dot11_priority_classifier, CHAINPOS_POSTCAP);
 
     timetracker->remove_timer(device_idle_timer);
 }
@@ -1162,6 +1182,77 @@ std::shared_ptr<dot11_tracked_device> kis_80211_phy::fetch_dot11_record(
     return dev->get_sub_as<dot11_tracked_device>(dot11_device_entry_id);
 }
 
+// Minimal look at the raw frame in the capture thread, before any dissection; management
+// frames and EAPOL keep their default high priority, everything else is bulk
+int kis_80211_phy::packet_dot11_priority_classifier(CHAINCALL_PARMS) {
+    auto *d11phy = (kis_80211_phy *) auxdata;
+
+    auto chunk = in_pack->fetch<kis_datachunk>(d11phy->pack_comp_decap, d11phy->pack_comp_linkframe);
+
+    // Only the frame control is needed to classify; control frames such as ACK and CTS are
+    // shorter than a full header and are the bulk of the traffic
+    if (chunk == nullptr || chunk->dlt != KDLT_IEEE802_11 || chunk->length() < 2)
+        return 0;
+
+    const auto data = reinterpret_cast<const uint8_t *>(chunk->data());
+    const auto fc_type = (data[0] >> 2) & 0x03;
+    const auto fc_subtype = (data[0] >> 4) & 0x0F;
+    const auto fc_flags = data[1];
+
+    // Management
+    if (fc_type == 0)
+        return 0;
+
+    in_pack->low_priority = true;
+
+    // Only unencrypted data frames can be EAPOL, and only a frame with a full header
+    // can be checked for it
+    if (fc_type != 2 || (fc_flags & 0x40) || chunk->length() < 24)
+        return 0;
+
+    size_t hdr_len = 24;
+
+    // Address 4 when both to-ds and from-ds are set
+    if ((fc_flags & 0x03) == 0x03)
+        hdr_len += 6;
+
+    // QoS control, and HT control when the order bit is set on a QoS frame
+    if (fc_subtype & 0x08) {
+        hdr_len += 2;
+
+        if (fc_flags & 0x80)
+            hdr_len += 4;
+    }
+
+    static const uint8_t eapol_llc[] = { 0xAA, 0xAA, 0x03, 0x00, 0x00, 0x00, 0x88, 0x8E };
+
+    if (chunk->length() >= hdr_len + sizeof(eapol_llc) &&
+            memcmp(data + hdr_len, eapol_llc, sizeof(eapol_llc)) == 0)
+        in_pack->low_priority = false;
+
+    return 0;
+}
+
+// Survey mode only keeps beacons.  This runs for every 802.11 frame, not just those with a
+// dot11 record, so that errored and corrupt frames, which never reach the common classifier,
+// are filtered too
+int kis_80211_phy::packet_dot11_survey_filter(CHAINCALL_PARMS) {
+    auto *d11phy = (kis_80211_phy *) auxdata;
+
+    auto chunk = in_pack->fetch<kis_datachunk>(d11phy->pack_comp_decap, d11phy->pack_comp_linkframe);
+
+    if (chunk == nullptr || chunk->dlt != KDLT_IEEE802_11)
+        return 0;
+
+    auto dot11info = in_pack->fetch<dot11_packinfo>(d11phy->pack_comp_80211);
+
+    if (in_pack->error || dot11info == nullptr || dot11info->corrupt ||
+            dot11info->type != packet_management || dot11info->subtype != packet_sub_beacon)
+        in_pack->filtered = true;
+
+    return 0;
+}
+
 // Common classifier responsible for generating the common devices & mapping wifi packets
 // to those devices
 int kis_80211_phy::packet_dot11_common_classifier(CHAINCALL_PARMS) {
@@ -1169,14 +1260,12 @@ int kis_80211_phy::packet_dot11_common_classifier(CHAINCALL_PARMS) {
 
     auto *d11phy = (kis_80211_phy *) auxdata;
 
-    // Don't process errors, blocked, or dupes;  Filter them in survey mode
+    // Don't process errors or blocked packets; in survey mode everything but beacons
+    // has already been filtered by the survey filter
     //
     // TODO - handle duplicates where we combine attributes about them
-    if (in_pack->error || in_pack->filtered) {
-        if (d11phy->filter_survey_only)
-            in_pack->filtered = true;
+    if (in_pack->error || in_pack->filtered)
         return 0;
-    }
 
     // Get the 802.11 info
     auto dot11info = in_pack->fetch<dot11_packinfo>(d11phy->pack_comp_80211);
@@ -1184,21 +1273,9 @@ int kis_80211_phy::packet_dot11_common_classifier(CHAINCALL_PARMS) {
     if (dot11info == nullptr)
         return 0;
 
-    // Don't handle corrupt packets, and filter them if we're in survey only
-    if (dot11info->corrupt) {
-        if (d11phy->filter_survey_only)
-            in_pack->filtered = true;
-
+    // Don't handle corrupt packets
+    if (dot11info->corrupt)
         return 0;
-    }
-
-    // Do nothing if it's not a beacon in survey mode
-    if (d11phy->filter_survey_only &&
-            (dot11info->type != packet_management ||
-            dot11info->subtype != packet_sub_beacon)) {
-        in_pack->filtered = true;
-        return 0;
-    }
 
     auto commoninfo = in_pack->fetch<kis_common_info>(d11phy->pack_comp_common);
 
@@ -1252,8 +1329,29 @@ int kis_80211_phy::packet_dot11_common_classifier(CHAINCALL_PARMS) {
     auto pack_gpsinfo = in_pack->fetch<kis_gps_packinfo>(d11phy->pack_comp_gps);
     auto pack_datainfo = in_pack->fetch<kis_data_packinfo>(d11phy->pack_comp_basicdata);
 
-    kis_unique_lock<kis_mutex> list_locker(d11phy->devicetracker->get_devicelist_mutex(),
-            "phy80211 common_classifier");
+    // Lock only the shards of the devices this frame can update; the whole device list
+    // is only taken when one of them is new.  Phy frames and duplicates of anything but
+    // management frames don't update devices at all, and duplicates and null data
+    // frames never create them.
+    const bool updates_devices = dot11info->type != packet_phy &&
+        (!in_pack->duplicate || dot11info->type == packet_management);
+    const bool creates_devices = !in_pack->duplicate &&
+        !(dot11info->type == packet_data &&
+                (dot11info->subtype == packet_sub_data_null ||
+                 dot11info->subtype == packet_sub_data_qos_null));
+
+    auto device_mac = [updates_devices](const mac_addr& mac) {
+        if (!updates_devices || mac.bitwise_and(Globalreg::globalreg->multicast_mac))
+            return mac_addr{};
+        return mac;
+    };
+
+    device_shard_locker dev_locker(d11phy->devicetracker.get(), d11phy, in_pack,
+            {device_mac(dot11info->bssid_mac), device_mac(dot11info->source_mac),
+             device_mac(dot11info->dest_mac),
+             dot11info->type == packet_data ? device_mac(dot11info->transmit_mac) : mac_addr{},
+             dot11info->type == packet_data ? device_mac(dot11info->receive_mac) : mac_addr{}},
+            creates_devices, "phy80211 common_classifier");
 
     // Handle duplicates; we update seenby, location, and signals, but that's it
     if (in_pack->duplicate) {
@@ -1681,8 +1779,9 @@ int kis_80211_phy::packet_dot11_common_classifier(CHAINCALL_PARMS) {
                         return diff < d11phy->bss_ts_group_usec;
                 });
 
-            // We have to do write work because we're still holding the device list 
-            // write state 
+            // Walking the other APs needs the whole device list, and we have to do write
+            // work because we then hold the device list write state
+            dev_locker.lock_devicelist();
             d11phy->ap_view->do_device_work(bss_worker);
 
             for (const auto& ri : *(bss_worker.getMatchedDevices())) {
@@ -1703,7 +1802,7 @@ int kis_80211_phy::packet_dot11_common_classifier(CHAINCALL_PARMS) {
         // Reap the async ssid probe outside of lock
         if (handle_probed_ssid)
             d11phy->handle_probed_ssid(dot11info->source_dev, dot11info->source_dot11, 
-                    in_pack, dot11info, pack_gpsinfo);
+                    in_pack, dot11info, pack_gpsinfo, dev_locker);
 
     } else if (dot11info->type == packet_phy) {
         // Phy packets are so often bogus that we just ignore them for now; if we enable
@@ -2158,6 +2257,64 @@ int kis_80211_phy::packet_dot11_common_classifier(CHAINCALL_PARMS) {
     return 1;
 }
 
+int kis_80211_phy::packet_dot11_beacon_summary_classifier(CHAINCALL_PARMS) {
+    auto *d11phy = (kis_80211_phy *) auxdata;
+
+    if (in_pack->error || in_pack->filtered)
+        return 0;
+
+    auto summary =
+        in_pack->fetch<kis_beacon_summary_packinfo>(d11phy->pack_comp_beacon_summary);
+
+    if (summary == nullptr)
+        return 0;
+
+    auto pack_l1info =
+        in_pack->fetch<kis_layer1_packinfo>(d11phy->pack_comp_l1info);
+
+    // Summaries only ever update an existing AP, so only the shard holding it is locked
+    auto bssid_key = device_key(d11phy->fetch_phyname_hash(), summary->bssid);
+
+    kis_lock_guard<kis_mutex> lk(d11phy->devicetracker->get_device_shard_mutex(bssid_key),
+            "phy80211 beacon_summary_classifier");
+
+    // The capture always sends the first beacon of an AP in full, so a summary for
+    // an unknown AP means it was timed out; the next full beacon brings it back
+    auto bssid_dev = d11phy->devicetracker->fetch_device_nr(bssid_key);
+
+    if (bssid_dev == nullptr)
+        return 0;
+
+    // Record the peak before the last signal so the last signal stays current
+    if (pack_l1info != nullptr && pack_l1info->signal_type == kis_l1_signal_type_dbm &&
+            summary->peak_dbm > pack_l1info->signal_dbm) {
+        auto peak_l1 = *pack_l1info;
+        peak_l1.signal_dbm = summary->peak_dbm;
+        bssid_dev->get_signal_data()->append_signal(peak_l1, false, in_pack->ts.tv_sec);
+    }
+
+    d11phy->devicetracker->update_common_device(nullptr, summary->bssid, d11phy, in_pack,
+            (UCD_UPDATE_SEENBY | UCD_UPDATE_EXISTING_ONLY | UCD_UPDATE_FREQUENCIES |
+             UCD_UPDATE_LOCATION | UCD_UPDATE_SIGNAL), "Wi-Fi Device");
+
+    bssid_dev->inc_packets(summary->count);
+    bssid_dev->inc_llc_packets(summary->count);
+
+    auto dot11dev =
+        bssid_dev->get_sub_as<dot11_tracked_device>(d11phy->dot11_device_entry_id);
+
+    if (dot11dev != nullptr) {
+        auto ssid = dot11dev->get_last_adv_ssid();
+
+        if (ssid != nullptr) {
+            ssid->set_if_lt_last_time(in_pack->ts.tv_sec);
+            ssid->inc_beacons_sec(summary->count);
+        }
+    }
+
+    return 1;
+}
+
 int kis_80211_phy::packet_dot11_scan_json_classifier(CHAINCALL_PARMS) {
     auto *d11phy = (kis_80211_phy *) auxdata;
 
@@ -2248,7 +2405,7 @@ int kis_80211_phy::packet_dot11_scan_json_classifier(CHAINCALL_PARMS) {
                      UCD_UPDATE_SEENBY | UCD_UPDATE_ENCRYPTION),
                     "Wi-Fi AP");
 
-        kis_unique_lock<kis_mutex> list_locker(d11phy->devicetracker->get_devicelist_mutex(),
+        kis_lock_guard<kis_mutex> lk(d11phy->devicetracker->get_device_shard_mutex(bssid_dev->get_key()),
                 "phy80211 json_classifier");
 
         auto bssid_dot11 =
@@ -3303,9 +3460,11 @@ void kis_80211_phy::handle_probed_ssid(const std::shared_ptr<kis_tracked_device_
         const std::shared_ptr<dot11_tracked_device>& dot11dev,
         const std::shared_ptr<kis_packet>& in_pack,
         const std::shared_ptr<dot11_packinfo>& dot11info,
-        const std::shared_ptr<kis_gps_packinfo>& pack_gpsinfo) {
+        const std::shared_ptr<kis_gps_packinfo>& pack_gpsinfo,
+        device_shard_locker& dev_locker) {
 
-    // We're called under device list lock so we only lock the device we're interacting with
+    // We're called with the device locked by the classifier, either by its shard or under
+    // the whole device list
 
     if (dot11info == nullptr)
         throw std::runtime_error("handle_probed_ssid with null dot11dev");
@@ -3329,9 +3488,6 @@ void kis_80211_phy::handle_probed_ssid(const std::shared_ptr<kis_tracked_device_
             dot11info->subtype == packet_sub_association_req ||
             dot11info->subtype == packet_sub_reassociation_req) {
 
-        kis_unique_lock<kis_mutex> list_locker(devicetracker->get_devicelist_mutex(),
-                "phy80211 handle_probed_ssid");
-
         auto probemap(dot11dev->get_probed_ssid_map());
 
         auto ssid_itr = probemap->find(dot11info->ssid_csum);
@@ -3436,7 +3592,8 @@ void kis_80211_phy::handle_probed_ssid(const std::shared_ptr<kis_tracked_device_
 
         if (dot11info->wps_uuid_e != "") {
             if (probessid->get_wps_uuid_e() != dot11info->wps_uuid_e) {
-                // lk.unlock();
+                // Matching other devices walks the whole device list
+                dev_locker.lock_devicelist();
 
                 device_tracker_view_function_worker dev_worker(
                         [this, dot11info, basedev, dot11dev](std::shared_ptr<kis_tracked_device_base> dev) -> bool {
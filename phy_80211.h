@@ -457,12 +457,22 @@ public:
     // TODO - what do we do with the strings?  Can we make them phy-neutral?
     // int packet_dot11string_dissector(kis_packet *in_pack);
 
+    // Post-capture priority classifier; marks data frames other than EAPOL as low
+    // priority so they are shed before management frames when the queue is full
+    static int packet_dot11_priority_classifier(CHAINCALL_PARMS);
+
+    // Survey-only filter; filters every 802.11 frame other than a valid beacon
+    static int packet_dot11_survey_filter(CHAINCALL_PARMS);
+
     // 802.11 packet classifier to common for the devicetracker layer
     static int packet_dot11_common_classifier(CHAINCALL_PARMS);
 
     // 802.11 virtual source scan classifier
     static int packet_dot11_scan_json_classifier(CHAINCALL_PARMS);
 
+    // Beacons summarized by the capture, applied to the existing AP
+    static int packet_dot11_beacon_summary_classifier(CHAINCALL_PARMS);
+
     // Dot11 tracker for building phy-specific elements
     int tracker_dot11(const std::shared_ptr<kis_packet>& in_pack);
 
@@ -526,12 +536,13 @@ protected:
             const std::shared_ptr<dot11_packinfo>& dot11info,
             const std::shared_ptr<kis_gps_packinfo>& pack_gpsinfo);
 
-    // Handle probed SSIDs
+    // Handle probed SSIDs, with the device locked by the classifier's device locker
     void handle_probed_ssid(const std::shared_ptr<kis_tracked_device_base>& basedev,
             const std::shared_ptr<dot11_tracked_device>& dot11dev,
             const std::shared_ptr<kis_packet>& in_pack,
             const std::shared_ptr<dot11_packinfo>& dot11info,
-            const std::shared_ptr<kis_gps_packinfo>& pack_gpsinfo);
+            const std::shared_ptr<kis_gps_packinfo>& pack_gpsinfo,
+            device_shard_locker& dev_locker);
 
     // Map a device as a client of an acceess point, fill in any data in the
     // per-client records
@@ -572,7 +583,7 @@ protected:
     int pack_comp_80211, pack_comp_basicdata, pack_comp_mangleframe,
         pack_comp_strings, pack_comp_checksum, pack_comp_linkframe,
         pack_comp_decap, pack_comp_common, pack_comp_datapayload,
-        pack_comp_gps, pack_comp_l1info, pack_comp_json;
+        pack_comp_gps, pack_comp_l1info, pack_comp_json, pack_comp_beacon_summary;
 
     // Do we do any data dissection or do we hide it all (legal safety
     // cutout)
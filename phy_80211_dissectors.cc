@@ -2754,6 +2754,9 @@ int kis_80211_phy::packet_wep_decryptor(const std::shared_ptr<kis_packet>& in_pa
     (bwmitr->second)->decrypted++;
     packinfo->decrypted = 1;
 
+    // The decrypted frame is a copy of the payload
+    in_pack->bytes_copied += manglechunk->length();
+
     in_pack->insert(pack_comp_mangleframe, manglechunk);
 
     in_pack->erase(pack_comp_datapayload);
@@ -111,7 +111,8 @@ kis_adsb_phy::kis_adsb_phy(int in_phyid) :
         Globalreg::fetch_mandatory_global_as<kis_httpd_registry>();
     httpregistry->register_js_module("kismet_ui_adsb", "js/kismet.ui.adsb.js");
 
-	packetchain->register_handler(&packet_handler, this, CHAINPOS_CLASSIFIER, -100);
+	packetchain->register_handler(&packet_handler, this, CHAINPOS_CLASSIFIER, -100,
+            packet_chain::pc_interest{{}, {pack_comp_json}});
 
     icaodb = std::make_shared<kis_adsb_icao>();
 
@@ -626,7 +627,7 @@ bool kis_adsb_phy::process_adsb_hex(nlohmann::json& json, const std::shared_ptr<
     common->source = mac;
     common->transmitter = mac;
 
-    kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex(), "adsb_raw");
+    device_shard_locker lk(devicetracker.get(), this, packet, {common->source}, true, "adsb_raw");
 
     // Update the base dev without setting location, because we want to
     // override that location ourselves later once we've gotten our
@@ -840,7 +841,8 @@ bool kis_adsb_phy::json_to_rtl(nlohmann::json& json, const std::shared_ptr<kis_p
                 (UCD_UPDATE_FREQUENCIES | UCD_UPDATE_PACKETS |
                  UCD_UPDATE_SEENBY), "ADSB");
 
-    kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex(), "adsb_json_to_rtl");
+    kis_lock_guard<kis_mutex> lk(devicetracker->get_device_shard_mutex(basedev->get_key()),
+            "adsb_json_to_rtl");
 
     std::string dn = "Airplane";
 
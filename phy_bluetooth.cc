@@ -76,12 +76,6 @@ kis_bluetooth_phy::kis_bluetooth_phy(int in_phyid) :
                 tracker_element_factory<bluetooth_tracked_device>(),
                 "Bluetooth device");
 
-    packetchain->register_handler(&common_classifier_bluetooth, this, CHAINPOS_CLASSIFIER, -100);
-    packetchain->register_handler(&packet_tracker_bluetooth, this, CHAINPOS_TRACKER, -100);
-    packetchain->register_handler(&packet_tracker_h4_linux, this, CHAINPOS_TRACKER, -100);
-    packetchain->register_handler(&packet_bluetooth_scan_json_classifier, this, CHAINPOS_CLASSIFIER, -99);
-    packetchain->register_handler(&packet_bluetooth_hci_json_classifier, this, CHAINPOS_CLASSIFIER, -99);
-
     pack_comp_btdevice = packetchain->register_packet_component("BTDEVICE");
 	pack_comp_common = packetchain->register_packet_component("COMMON");
     pack_comp_l1info = packetchain->register_packet_component("RADIODATA");
@@ -89,6 +83,17 @@ kis_bluetooth_phy::kis_bluetooth_phy(int in_phyid) :
     pack_comp_json = packetchain->register_packet_component("JSON");
     pack_comp_linkframe = packetchain->register_packet_component("LINKFRAME");
 
+    packetchain->register_handler(&common_classifier_bluetooth, this, CHAINPOS_CLASSIFIER, -100,
+            packet_chain::pc_interest{{}, {pack_comp_btdevice}});
+    packetchain->register_handler(&packet_tracker_bluetooth, this, CHAINPOS_TRACKER, -100,
+            packet_chain::pc_interest{{}, {pack_comp_btdevice, pack_comp_common}});
+    packetchain->register_handler(&packet_tracker_h4_linux, this, CHAINPOS_TRACKER, -100,
+            packet_chain::pc_interest{{KDLT_BT_H4_LINUX}, {}});
+    packetchain->register_handler(&packet_bluetooth_scan_json_classifier, this, CHAINPOS_CLASSIFIER, -99,
+            packet_chain::pc_interest{{}, {pack_comp_json}});
+    packetchain->register_handler(&packet_bluetooth_hci_json_classifier, this, CHAINPOS_CLASSIFIER, -99,
+            packet_chain::pc_interest{{}, {pack_comp_json}});
+
     btdev_bredr = devicetracker->get_cached_devicetype("BR/EDR");
     btdev_btle = devicetracker->get_cached_devicetype("BTLE");
     btdev_bt = devicetracker->get_cached_devicetype("BT");
@@ -189,7 +194,7 @@ int kis_bluetooth_phy::packet_bluetooth_hci_json_classifier(CHAINCALL_PARMS) {
 
         in_pack->insert(btphy->pack_comp_common, commoninfo);
 
-        kis_lock_guard<kis_mutex> lk(btphy->devicetracker->get_devicelist_mutex(),
+        device_shard_locker lk(btphy->devicetracker.get(), btphy, in_pack, {btaddr_mac}, true,
                 "packet_bluetooth_hci_json_classifier");
 
         auto basedev =
@@ -303,7 +308,7 @@ int kis_bluetooth_phy::packet_bluetooth_scan_json_classifier(CHAINCALL_PARMS) {
 
         in_pack->insert(btphy->pack_comp_common, commoninfo);
 
-        kis_lock_guard<kis_mutex> lk(btphy->devicetracker->get_devicelist_mutex(),
+        device_shard_locker lk(btphy->devicetracker.get(), btphy, in_pack, {btaddr_mac}, true,
                 "packet_bluetooth_scan_json_classifier");
 
         auto btdev =
@@ -514,7 +519,7 @@ int kis_bluetooth_phy::packet_tracker_bluetooth(CHAINCALL_PARMS) {
     if (ci == nullptr)
         return 0;
 
-    kis_lock_guard<kis_mutex> lk(btphy->devicetracker->get_devicelist_mutex(), 
+    device_shard_locker lk(btphy->devicetracker.get(), btphy, in_pack, {ci->source}, true,
             "packet_tracker_bluetooth");
 
     std::shared_ptr<kis_tracked_device_base> basedev =
@@ -201,7 +201,8 @@ kis_btle_phy::kis_btle_phy(int in_phyid) :
                 "or cause other problems with some Bluetooth devices.", phyid);
 
     packetchain->register_handler(&dissector, this, CHAINPOS_LLCDISSECT, -100);
-    packetchain->register_handler(&common_classifier, this, CHAINPOS_CLASSIFIER, -100);
+    packetchain->register_handler(&common_classifier, this, CHAINPOS_CLASSIFIER, -100,
+            packet_chain::pc_interest{{}, {pack_comp_btle, pack_comp_common}});
 
     btle_device_id = 
         entrytracker->register_field("btle.device",
@@ -352,7 +353,8 @@ int kis_btle_phy::common_classifier(CHAINCALL_PARMS) {
                  UCD_UPDATE_SEENBY | UCD_UPDATE_ENCRYPTION),
                 "BTLE Device");
 
-    kis_lock_guard<kis_mutex> lk(mphy->devicetracker->get_devicelist_mutex(), "btle_common_classifier");
+    kis_lock_guard<kis_mutex> lk(mphy->devicetracker->get_device_shard_mutex(device->get_key()),
+            "btle_common_classifier");
 
     auto new_dev = false;
 
@@ -62,7 +62,8 @@ kis_meter_phy::kis_meter_phy(int in_phyid) :
     auto httpregistry = Globalreg::fetch_mandatory_global_as<kis_httpd_registry>();
     httpregistry->register_js_module("kismet_ui_meter", "js/kismet.ui.meter.js");
 
-	packetchain->register_handler(&PacketHandler, this, CHAINPOS_CLASSIFIER, -100);
+	packetchain->register_handler(&PacketHandler, this, CHAINPOS_CLASSIFIER, -100,
+            packet_chain::pc_interest{{}, {pack_comp_json}});
 }
 
 kis_meter_phy::~kis_meter_phy() {
@@ -169,7 +170,8 @@ bool kis_meter_phy::rtlamr_json_to_phy(nlohmann::json json, std::shared_ptr<kis_
                 (UCD_UPDATE_FREQUENCIES | UCD_UPDATE_PACKETS | UCD_UPDATE_LOCATION |
                  UCD_UPDATE_SEENBY), "AMR Meter");
 
-    kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex(), "rtlamr_json_to_phy");
+    kis_lock_guard<kis_mutex> lk(devicetracker->get_device_shard_mutex(basedev->get_key()),
+            "rtlamr_json_to_phy");
 
     auto meterdev = 
         basedev->get_sub_as<tracked_meter>(tracked_meter_id);
@@ -424,7 +426,8 @@ bool kis_meter_phy::rtl433_json_to_phy(nlohmann::json json, std::shared_ptr<kis_
                  UCD_UPDATE_SEENBY), "AMR Meter");
     }
 
-    kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex(), "rtlamr_json_to_phy");
+    kis_lock_guard<kis_mutex> lk(devicetracker->get_device_shard_mutex(basedev->get_key()),
+            "rtlamr_json_to_phy");
 
     auto meterdev = 
         basedev->get_sub_as<tracked_meter>(tracked_meter_id);
@@ -54,7 +54,8 @@ kis_radiation_phy::kis_radiation_phy(int in_phyid) :
     pack_comp_datasrc =
         packetchain->register_packet_component("KISDATASRC");
 
-	packetchain->register_handler(&packet_handler, this, CHAINPOS_CLASSIFIER, -100);
+	packetchain->register_handler(&packet_handler, this, CHAINPOS_CLASSIFIER, -100,
+            packet_chain::pc_interest{{}, {pack_comp_json}});
 
     geiger_counters = 
         std::make_shared<tracker_element_uuid_map>();
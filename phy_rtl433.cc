@@ -94,7 +94,8 @@ Kis_RTL433_Phy::Kis_RTL433_Phy(int in_phyid) :
         Globalreg::fetch_mandatory_global_as<kis_httpd_registry>();
     httpregistry->register_js_module("kismet_ui_rtl433", "js/kismet.ui.rtl433.js");
 
-	packetchain->register_handler(&PacketHandler, this, CHAINPOS_CLASSIFIER, -100);
+	packetchain->register_handler(&PacketHandler, this, CHAINPOS_CLASSIFIER, -100,
+            packet_chain::pc_interest{{}, {pack_comp_json}});
 }
 
 Kis_RTL433_Phy::~Kis_RTL433_Phy() {
@@ -207,7 +208,8 @@ bool Kis_RTL433_Phy::json_to_rtl(nlohmann::json json, std::shared_ptr<kis_packet
                 (UCD_UPDATE_FREQUENCIES | UCD_UPDATE_PACKETS | UCD_UPDATE_LOCATION |
                  UCD_UPDATE_SEENBY), "RTL433 Sensor");
 
-    kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex(), "rtl433_json_to_rtl");
+    kis_lock_guard<kis_mutex> lk(devicetracker->get_device_shard_mutex(basedev->get_key()),
+            "rtl433_json_to_rtl");
 
     std::string dn = "Sensor";
 
@@ -105,7 +105,8 @@ kis_sensor_phy::kis_sensor_phy(int in_phyid) :
         Globalreg::fetch_mandatory_global_as<kis_httpd_registry>();
     httpregistry->register_js_module("kismet_ui_sensor", "js/kismet.ui.sensor.js");
 
-	packetchain->register_handler(&packet_handler, this, CHAINPOS_CLASSIFIER, -100);
+	packetchain->register_handler(&packet_handler, this, CHAINPOS_CLASSIFIER, -100,
+            packet_chain::pc_interest{{}, {pack_comp_json}});
 
     track_last_record = 
         Globalreg::globalreg->kismet_config->fetch_opt_bool("rtl433_track_last", false);
@@ -230,7 +231,8 @@ bool kis_sensor_phy::json_to_rtl(nlohmann::json json, std::shared_ptr<kis_packet
                 (UCD_UPDATE_FREQUENCIES | UCD_UPDATE_PACKETS | UCD_UPDATE_LOCATION |
                  UCD_UPDATE_SEENBY), "RF Sensor");
 
-    kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex(), "sensor_json_to_rtl");
+    kis_lock_guard<kis_mutex> lk(devicetracker->get_device_shard_mutex(basedev->get_key()),
+            "sensor_json_to_rtl");
 
     std::string dn = "Sensor";
 
@@ -294,7 +294,8 @@ int kis_uav_phy::common_classifier(CHAINCALL_PARMS) {
                 return 0;
             }
 
-            auto lg = kis_lock_guard<kis_mutex>(uavphy->devicetracker->get_devicelist_mutex(), "uav rf droneid");
+            auto lg = kis_lock_guard<kis_mutex>(uavphy->devicetracker->get_device_shard_mutex(basedev->get_key()),
+                    "uav rf droneid");
 
             basedev->set_manuf(uavphy->dji_manuf);
             basedev->set_tracker_type_string(uavphy->devicetracker->get_cached_devicetype("DJI UAV"));
@@ -348,8 +349,6 @@ int kis_uav_phy::common_classifier(CHAINCALL_PARMS) {
         return 1;
     }
 
-    kis_lock_guard<kis_mutex> lk(uavphy->devicetracker->get_devicelist_mutex(), "uav_phy common_classifier");
-
     for (auto di : devinfo->devrefs) {
         auto basedev = di.second;
 
@@ -360,6 +359,9 @@ int kis_uav_phy::common_classifier(CHAINCALL_PARMS) {
         if (basedev->get_macaddr() != dot11info->bssid_mac)
             continue;
 
+        kis_lock_guard<kis_mutex> lk(uavphy->devicetracker->get_device_shard_mutex(basedev->get_key()),
+                "uav_phy common_classifier");
+
         if (dot11info->droneid != NULL) {
             try {
                 if (dot11info->droneid->subcommand() == 0x00) {
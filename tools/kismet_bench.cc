@@ -0,0 +1,884 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Headless packet pipeline benchmark.
+ *
+ * Brings up the packet chain, device tracker, and phy handlers the same way the
+ * server does, but without the webserver, datasources, logging, or plugins, and
+ * feeds a pcap or pcapng file straight into the packet chain as fast as the
+ * packet threads will take it.
+ *
+ * The capture is loaded into memory before the timed run so that only the
+ * packet chain is measured.  The feeder waits whenever the packet queues are
+ * full instead of letting the packet chain drop, the same way flow-controlled
+ * datasources do.
+ *
+ * Reports packets per second, the time spent in each stage and handler of the
+ * packet chain, peak RSS, and the number of devices created.
+ *
+ * Before the run, each packet is also encoded as a v3 KDS_PACKET report and decoded
+ * with a malloc'd mpack tree, a pooled mpack tree, and the direct report decoder the
+ * datasources use, to show the per-packet decode cost of each.
+ *
+ * With --devices, builds that many device records instead of running a capture, and
+ * reports the heap used per device and the time to sort them by last seen time the
+ * way the device views do, with and without the inline field accessor.
+ *
+ * With --survey-check, turns on dot11_ap_only_survey and feeds an errored 802.11
+ * frame and a beacon instead of a capture; exits non-zero unless only the errored
+ * frame is filtered.
+ */
+
+#include "config.h"
+
+#include <getopt.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef HAVE_PCAPPCAP_H
+#include <pcap.h>
+#else
+#include <pcap/pcap.h>
+#endif
+
+#include "version.h"
+
+#include "globalregistry.h"
+#include "configfile.h"
+#include "messagebus.h"
+#include "eventbus.h"
+#include "timetracker.h"
+#include "entrytracker.h"
+#include "manuf.h"
+#include "ipctracker_v2.h"
+#include "streamtracker.h"
+#include "kis_net_beast_httpd.h"
+#include "kis_httpd_registry.h"
+#include "packetchain.h"
+#include "dlttracker.h"
+#include "antennatracker.h"
+#include "datasourcetracker.h"
+#include "datasource_virtual.h"
+#include "alertracker.h"
+#include "devicetracker.h"
+#include "channeltracker2.h"
+#include "gpstracker.h"
+#include "kis_datasource.h"
+#include "kis_external_packet.h"
+
+#include "kis_dlt_ppi.h"
+#include "kis_dlt_radiotap.h"
+#include "kis_dlt_btle_radio.h"
+#include "kis_dissector_ipdata.h"
+
+#include "phy_80211.h"
+#include "phy_sensor.h"
+#include "phy_meter.h"
+#include "phy_adsb.h"
+#include "phy_zwave.h"
+#include "phy_bluetooth.h"
+#include "phy_uav_drone.h"
+#include "phy_nrf_mousejack.h"
+#include "phy_btle.h"
+#include "phy_802154.h"
+#include "phy_radiation.h"
+
+#include "json_adapter.h"
+
+#include "mpack/mpack.h"
+
+struct bench_record {
+    struct timeval ts;
+    uint64_t original_len;
+    std::string data;
+};
+
+std::atomic<uint64_t> bench_completed{0};
+std::atomic<uint64_t> bench_copied{0};
+std::atomic<uint64_t> bench_copied_packets{0};
+
+// Last handler in the chain; counts packets which have made it all the way through,
+// and the payload bytes each of them copied
+int bench_chain_handler(CHAINCALL_PARMS) {
+    if (in_pack->bytes_copied != 0) {
+        bench_copied.fetch_add(in_pack->bytes_copied, std::memory_order_relaxed);
+        bench_copied_packets.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bench_completed.fetch_add(1, std::memory_order_relaxed);
+    return 1;
+}
+
+// Filtered state of each survey check frame, indexed by the frame timestamp; -1 until
+// the frame has made it through the chain
+std::atomic<int> bench_survey_filtered[2];
+
+int bench_survey_handler(CHAINCALL_PARMS) {
+    if (in_pack->ts.tv_sec >= 0 && in_pack->ts.tv_sec < 2)
+        bench_survey_filtered[in_pack->ts.tv_sec].store(in_pack->filtered ? 1 : 0);
+
+    return 1;
+}
+
+void usage(const char *argv0) {
+    printf("Usage: %s [options] capture.pcap[ng]\n"
+           "       %s [options] --devices [n]\n"
+           "       %s [options] --survey-check\n"
+           "Feed a pcap or pcapng file through the Kismet packet chain and report\n"
+           "the throughput, per-stage timing, memory, and device count.\n"
+           "\n"
+           " -f, --config-file [file]    Use an alternate kismet.conf\n"
+           " -r, --repeat [n]            Feed the capture n times (default 1)\n"
+           " -t, --threads [n]           Number of packet threads (default: config)\n"
+           " -d, --devices [n]           Measure memory and sorting of n device records\n"
+           "                             instead of running a capture\n"
+           " -s, --survey-check          Check that survey-only mode filters errored\n"
+           "                             802.11 frames instead of running a capture\n"
+           " -v, --verbose               Print Kismet info messages\n"
+           " -h, --help                  This help\n",
+           argv0, argv0, argv0);
+}
+
+long peak_rss_kb() {
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) < 0)
+        return 0;
+
+    // Linux reports kilobytes, macOS reports bytes
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+}
+
+// Shut down the same way the server does
+void bench_shutdown() {
+    auto globalreg = Globalreg::globalreg;
+
+    globalreg->shutdown_deferred();
+    globalreg->spindown = 1;
+    globalreg->io.stop();
+
+    globalreg->delete_lifetime_globals();
+    globalreg->complete = true;
+}
+
+// Load every packet of a capture into memory, exiting if it can't be read
+void bench_load_capture(const std::string& capfilename, std::vector<bench_record>& records,
+        size_t& total_bytes, int& dlt) {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t *pd = pcap_open_offline(capfilename.c_str(), errbuf);
+
+    if (pd == nullptr) {
+        fprintf(stderr, "ERROR: Could not open capture '%s': %s\n", capfilename.c_str(), errbuf);
+        exit(1);
+    }
+
+    dlt = pcap_datalink(pd);
+
+    struct pcap_pkthdr *hdr;
+    const u_char *pkt;
+    int r;
+
+    while ((r = pcap_next_ex(pd, &hdr, &pkt)) >= 0) {
+        if (r == 0)
+            continue;
+
+        bench_record rec;
+        rec.ts = hdr->ts;
+        rec.original_len = hdr->len;
+        rec.data = std::string((const char *) pkt, hdr->caplen);
+        total_bytes += hdr->caplen;
+
+        records.push_back(std::move(rec));
+    }
+
+    if (r == -1)
+        fprintf(stderr, "WARNING: Capture '%s' ended with an error: %s\n",
+                capfilename.c_str(), pcap_geterr(pd));
+
+    pcap_close(pd);
+
+    if (records.size() == 0) {
+        fprintf(stderr, "ERROR: No packets in capture '%s'\n", capfilename.c_str());
+        exit(1);
+    }
+}
+
+// Bytes of heap in use, where the allocator can tell us
+size_t heap_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+// Build n device records the way the device tracker does, and report the memory used
+// per device and the cost of sorting them by last time through a field path
+void bench_devices(unsigned int n_devices) {
+    auto entrytracker = Globalreg::fetch_mandatory_global_as<entry_tracker>();
+
+    auto builder =
+        std::make_shared<kis_tracked_device_base>(entrytracker->get_field_id("kismet.device.base"));
+    auto phy_hash = device_key::gen_pkey("kismet_bench");
+
+    auto devices = std::make_shared<tracker_element_vector>();
+    devices->reserve(n_devices);
+
+    uint32_t seed = 1;
+    auto next_rand = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    };
+
+    auto start_heap = heap_in_use();
+    auto start_tm = std::chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < n_devices; i++) {
+        auto mac = mac_addr(0x020000000000ULL | i);
+        auto dev = std::make_shared<kis_tracked_device_base>(builder.get());
+
+        dev->set_key(device_key(phy_hash, mac));
+        dev->set_macaddr(mac);
+        dev->set_first_time(1000000 + i);
+        dev->set_last_time(1000000 + (next_rand() % 100000));
+        dev->set_mod_time(dev->get_last_time());
+        dev->inc_packets(next_rand() % 10000);
+        dev->set_frequency(2412000 + 5000 * (next_rand() % 11));
+
+        devices->push_back(dev);
+    }
+
+    auto build_tm = std::chrono::steady_clock::now();
+    auto used_heap = heap_in_use() - start_heap;
+
+    auto sort_path = std::vector<int>{entrytracker->get_field_id("kismet.device.base.last_time")};
+
+    // Sort the same way device_tracker_view sorts a device table, once with the
+    // inline accessor and once through tracked elements
+    auto inline_vec = std::vector<shared_tracker_element>(devices->begin(), devices->end());
+    auto inline_start_tm = std::chrono::steady_clock::now();
+
+    std::stable_sort(inline_vec.begin(), inline_vec.end(),
+            [&sort_path](const shared_tracker_element& a, const shared_tracker_element& b) -> bool {
+                tracker_element_inline_value va;
+                tracker_element_inline_value vb;
+
+                if (!get_tracker_element_path_inline(sort_path, a, va))
+                    return true;
+                if (!get_tracker_element_path_inline(sort_path, b, vb))
+                    return false;
+
+                return va.less_than(vb);
+            });
+
+    auto inline_end_tm = std::chrono::steady_clock::now();
+
+    auto element_vec = std::vector<shared_tracker_element>(devices->begin(), devices->end());
+    auto element_start_tm = std::chrono::steady_clock::now();
+
+    std::stable_sort(element_vec.begin(), element_vec.end(),
+            [&sort_path](const shared_tracker_element& a, const shared_tracker_element& b) -> bool {
+                auto fa = get_tracker_element_path(sort_path, a);
+                auto fb = get_tracker_element_path(sort_path, b);
+
+                if (fa == nullptr)
+                    return true;
+                if (fb == nullptr)
+                    return false;
+
+                return fast_sort_tracker_element_less(fa, fb);
+            });
+
+    auto element_end_tm = std::chrono::steady_clock::now();
+
+    if (!std::equal(inline_vec.begin(), inline_vec.end(), element_vec.begin()))
+        fprintf(stderr, "WARNING: Inline and element sorts produced different orders\n");
+
+    fmt::print("\n");
+    fmt::print("Devices:        {}\n", n_devices);
+    fmt::print("Build time:     {:.3f} s\n",
+            std::chrono::duration<double>(build_tm - start_tm).count());
+    fmt::print("Device object:  {} bytes\n", sizeof(kis_tracked_device_base));
+
+    if (start_heap != 0 || used_heap != 0)
+        fmt::print("Heap per dev:   {:.0f} bytes\n", (double) used_heap / n_devices);
+    else
+        fmt::print("Heap per dev:   (not available from this allocator)\n");
+
+    fmt::print("Sort last_time: {:.3f} s inline, {:.3f} s via tracked elements\n",
+            std::chrono::duration<double>(inline_end_tm - inline_start_tm).count(),
+            std::chrono::duration<double>(element_end_tm - element_start_tm).count());
+    fmt::print("Peak RSS:       {} KB\n", peak_rss_kb());
+}
+
+// Encode a record the way a local capture reports it; signal and packet blocks only
+std::string bench_encode_report(const bench_record& rec, int dlt) {
+    char *data;
+    size_t size;
+    mpack_writer_t writer;
+
+    mpack_writer_init_growable(&writer, &data, &size);
+
+    mpack_build_map(&writer);
+
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_SIGNALBLOCK);
+    mpack_build_map(&writer);
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_CHANNEL);
+    mpack_write_cstr(&writer, "6");
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_SIGNAL_DBM);
+    mpack_write_u32(&writer, (uint32_t) -50);
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_FREQ_KHZ);
+    mpack_write_u64(&writer, 2437000);
+    mpack_complete_map(&writer);
+
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_PACKETBLOCK);
+    mpack_build_map(&writer);
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_DLT);
+    mpack_write_u32(&writer, dlt);
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_S);
+    mpack_write_u64(&writer, rec.ts.tv_sec);
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_US);
+    mpack_write_u64(&writer, rec.ts.tv_usec);
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_LENGTH);
+    mpack_write_u32(&writer, rec.original_len);
+    mpack_write_uint(&writer, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_CONTENT);
+    mpack_write_bin(&writer, rec.data.data(), rec.data.length());
+    mpack_complete_map(&writer);
+
+    mpack_complete_map(&writer);
+
+    std::string ret;
+
+    if (mpack_writer_destroy(&writer) == mpack_ok)
+        ret = std::string(data, size);
+
+    MPACK_FREE(data);
+
+    return ret;
+}
+
+// Pull the same fields out of a parsed tree that the datasource tree path does
+uint64_t bench_walk_tree(mpack_tree_t *tree) {
+    auto root = mpack_tree_root(tree);
+    uint64_t sum = 0;
+
+    auto sig = mpack_node_map_uint_optional(root, KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_SIGNALBLOCK);
+    if (!mpack_node_is_missing(sig)) {
+        sum += mpack_node_u32(mpack_node_map_uint(sig, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_SIGNAL_DBM));
+        sum += mpack_node_u64(mpack_node_map_uint(sig, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_FREQ_KHZ));
+        sum += mpack_node_strlen(mpack_node_map_uint(sig, KIS_EXTERNAL_V3_KDS_SUB_SIGNAL_FIELD_CHANNEL));
+    }
+
+    auto pkt = mpack_node_map_uint_optional(root, KIS_EXTERNAL_V3_KDS_DATAREPORT_FIELD_PACKETBLOCK);
+    if (!mpack_node_is_missing(pkt)) {
+        sum += mpack_node_u32(mpack_node_map_uint(pkt, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_DLT));
+        sum += mpack_node_u64(mpack_node_map_uint(pkt, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_S));
+        sum += mpack_node_u64(mpack_node_map_uint(pkt, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_TS_US));
+        sum += mpack_node_u32(mpack_node_map_uint(pkt, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_LENGTH));
+        sum += mpack_node_bin_size(mpack_node_map_uint(pkt, KIS_EXTERNAL_V3_KDS_SUB_PACKET_FIELD_CONTENT));
+    }
+
+    return sum;
+}
+
+// Time decoding every record as a v3 report, returning ns per report for the malloc'd
+// tree, pooled tree, and direct decoders
+void bench_report_decode(const std::vector<bench_record>& records, int dlt,
+        double& tree_ns, double& pool_ns, double& direct_ns) {
+    const unsigned int passes = 5;
+
+    std::vector<std::string> reports;
+    reports.reserve(records.size());
+
+    for (const auto& rec : records)
+        reports.push_back(bench_encode_report(rec, dlt));
+
+    std::vector<mpack_node_data_t> node_pool(KIS_DATASOURCE_REPORT_NODES);
+
+    uint64_t sink = 0;
+    const double n = (double) reports.size() * passes;
+
+    auto start_tm = std::chrono::steady_clock::now();
+
+    for (unsigned int pass = 0; pass < passes; pass++) {
+        for (const auto& r : reports) {
+            mpack_tree_t tree;
+            mpack_tree_init_data(&tree, r.data(), r.length());
+            mpack_tree_parse(&tree);
+            sink += bench_walk_tree(&tree);
+            mpack_tree_destroy(&tree);
+        }
+    }
+
+    auto tree_tm = std::chrono::steady_clock::now();
+
+    for (unsigned int pass = 0; pass < passes; pass++) {
+        for (const auto& r : reports) {
+            mpack_tree_t tree;
+            mpack_tree_init_pool(&tree, r.data(), r.length(), node_pool.data(), node_pool.size());
+            mpack_tree_parse(&tree);
+            sink += bench_walk_tree(&tree);
+            mpack_tree_destroy(&tree);
+        }
+    }
+
+    auto pool_tm = std::chrono::steady_clock::now();
+
+    for (unsigned int pass = 0; pass < passes; pass++) {
+        for (const auto& r : reports) {
+            kis_v3_packet_report report;
+            if (kis_v3_decode_packet_report(r, report))
+                sink += report.signal_dbm + report.freq_khz + report.channel.length() +
+                    report.dlt + report.ts_s + report.ts_us + report.length +
+                    report.content.length();
+        }
+    }
+
+    auto direct_tm = std::chrono::steady_clock::now();
+
+    // Keep the decoders from being optimized away
+    if (sink == 0)
+        fprintf(stderr, "WARNING: Report decoders extracted nothing\n");
+
+    tree_ns = std::chrono::duration<double, std::nano>(tree_tm - start_tm).count() / n;
+    pool_ns = std::chrono::duration<double, std::nano>(pool_tm - tree_tm).count() / n;
+    direct_ns = std::chrono::duration<double, std::nano>(direct_tm - pool_tm).count() / n;
+}
+
+// Feed an errored frame and a beacon through the packet chain in survey-only mode; the
+// errored frame never gets a dot11 record, so only a filter which sees every 802.11 frame
+// will catch it.  Returns 0 if only the errored frame was filtered
+int bench_survey_check(const std::shared_ptr<kis_datasource>& source) {
+    auto packetchain = Globalreg::fetch_mandatory_global_as<packet_chain>();
+    auto pack_comp_linkframe = packetchain->register_packet_component("LINKFRAME");
+    auto pack_comp_datasrc = packetchain->register_packet_component("KISDATASRC");
+
+    // Beacon for SSID "bench" with no FCS, as a capture which strips it would deliver
+    static const char beacon[] =
+        "\x80\x00\x00\x00"
+        "\xff\xff\xff\xff\xff\xff"
+        "\x02\x00\x00\x00\x00\x01"
+        "\x02\x00\x00\x00\x00\x01"
+        "\x10\x00"
+        "\x00\x00\x00\x00\x00\x00\x00\x00"
+        "\x64\x00"
+        "\x01\x04"
+        "\x00\x05" "bench"
+        "\x01\x01\x82"
+        "\x03\x01\x06";
+
+    for (auto& f : bench_survey_filtered)
+        f.store(-1);
+
+    packetchain->register_handler(&bench_survey_handler, nullptr, CHAINPOS_LOGGING, 0x7FFFFFFE,
+            "kismet_bench survey check");
+
+    // The same beacon twice; the first is marked in error the way the DLT handlers mark
+    // a frame with a bad FCS
+    for (unsigned int i = 0; i < 2; i++) {
+        auto packet = packetchain->generate_packet();
+
+        packet->ts.tv_sec = i;
+        packet->ts.tv_usec = 0;
+        packet->original_len = sizeof(beacon) - 1;
+        packet->set_data(nonstd::string_view(beacon, sizeof(beacon) - 1));
+        packet->error = (i == 0);
+
+        auto datachunk = packetchain->new_packet_component<kis_datachunk>();
+        datachunk->dlt = KDLT_IEEE802_11;
+        datachunk->set_data(packet->data);
+        packet->insert(pack_comp_linkframe, datachunk);
+
+        auto srcinfo = packetchain->new_packet_component<packetchain_comp_datasource>();
+        srcinfo->ref_source = source.get();
+        packet->insert(pack_comp_datasrc, srcinfo);
+
+        packetchain->process_packet(packet);
+    }
+
+    while (bench_completed.load(std::memory_order_relaxed) < 2)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+    packetchain->remove_handler(&bench_survey_handler, CHAINPOS_LOGGING);
+
+    auto errored_filtered = bench_survey_filtered[0].load();
+    auto beacon_filtered = bench_survey_filtered[1].load();
+
+    fmt::print("Survey check:   errored frame {}, beacon {}\n",
+            errored_filtered == 1 ? "filtered" : "NOT filtered",
+            beacon_filtered == 0 ? "kept" : "NOT kept");
+
+    return (errored_filtered == 1 && beacon_filtered == 0) ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    std::string configfilename;
+    std::string capfilename;
+    unsigned int repeat = 1;
+    unsigned int n_threads = 0;
+    unsigned int n_devices = 0;
+    bool survey_check = false;
+    bool verbose = false;
+
+    static struct option longopt[] = {
+        { "config-file", required_argument, 0, 'f' },
+        { "repeat", required_argument, 0, 'r' },
+        { "threads", required_argument, 0, 't' },
+        { "devices", required_argument, 0, 'd' },
+        { "survey-check", no_argument, 0, 's' },
+        { "verbose", no_argument, 0, 'v' },
+        { "help", no_argument, 0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+
+    int option_idx = 0;
+
+    while (1) {
+        int r = getopt_long(argc, argv, "f:r:t:d:svh", longopt, &option_idx);
+
+        if (r < 0)
+            break;
+
+        if (r == 'f') {
+            configfilename = std::string(optarg);
+        } else if (r == 'r') {
+            if (sscanf(optarg, "%u", &repeat) != 1 || repeat == 0) {
+                fprintf(stderr, "ERROR: Expected a number of repeats, got '%s'\n", optarg);
+                exit(1);
+            }
+        } else if (r == 't') {
+            if (sscanf(optarg, "%u", &n_threads) != 1) {
+                fprintf(stderr, "ERROR: Expected a number of threads, got '%s'\n", optarg);
+                exit(1);
+            }
+        } else if (r == 'd') {
+            if (sscanf(optarg, "%u", &n_devices) != 1 || n_devices == 0) {
+                fprintf(stderr, "ERROR: Expected a number of devices, got '%s'\n", optarg);
+                exit(1);
+            }
+        } else if (r == 's') {
+            survey_check = true;
+        } else if (r == 'v') {
+            verbose = true;
+        } else {
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (optind >= argc && n_devices == 0 && !survey_check) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    std::vector<bench_record> records;
+    size_t total_bytes = 0;
+    int dlt = 0;
+
+    double decode_tree_ns = 0, decode_pool_ns = 0, decode_direct_ns = 0;
+
+    // Load the capture before bringing anything up
+    if (n_devices == 0 && !survey_check) {
+        capfilename = argv[optind];
+
+        bench_load_capture(capfilename, records, total_bytes, dlt);
+
+        fmt::print("Loaded {} packets ({} bytes, DLT {}) from {}\n",
+                records.size(), total_bytes, dlt, capfilename);
+
+        bench_report_decode(records, dlt, decode_tree_ns, decode_pool_ns, decode_direct_ns);
+    }
+
+    // Bring up the same core as the server, in the same order
+    Globalreg::globalreg = new global_registry;
+    auto globalreg = Globalreg::globalreg;
+
+    Globalreg::n_tracked_fields = 0;
+    Globalreg::n_tracked_components = 0;
+
+    globalreg->version_major = VERSION_MAJOR;
+    globalreg->version_minor = VERSION_MINOR;
+    globalreg->version_tiny = VERSION_TINY;
+    globalreg->version_git_rev = VERSION_GIT_COMMIT;
+    globalreg->build_date = VERSION_BUILD_TIME;
+
+    // Modules which look at the command line (such as the datasource tracker looking
+    // for -c) should not see our options
+    globalreg->argc = 1;
+    globalreg->argv = argv;
+    globalreg->envp = nullptr;
+
+    auto entrytracker = entry_tracker::create_entrytracker();
+
+    globalreg->server_uuid =
+        globalreg->entrytracker->register_and_get_field_as<tracker_element_uuid>("kismet.server.uuid",
+                tracker_element_factory<tracker_element_uuid>(),
+                "unique server UUID");
+
+    uuid server_uuid;
+    server_uuid.generate_random_time_uuid();
+    globalreg->server_uuid->set(server_uuid);
+    globalreg->server_uuid_hash = server_uuid.hash;
+
+    auto timetracker = time_tracker::create_timetracker();
+    auto eventbus = event_bus::create_eventbus();
+
+    auto messagebus = message_bus::create_messagebus();
+    globalreg->messagebus = messagebus;
+
+    eventbus->register_listener(message_bus::event_message(),
+            [verbose](std::shared_ptr<eventbus_event> evt) {
+            auto msg_k = evt->get_event_content()->find(message_bus::event_message());
+            if (msg_k == evt->get_event_content()->end())
+                return;
+
+            auto msg = std::static_pointer_cast<tracked_message>(msg_k->second);
+
+            if (msg->get_flags() & (MSGFLAG_ERROR | MSGFLAG_FATAL))
+                fprintf(stderr, "ERROR: %s\n", msg->get_message().c_str());
+            else if (verbose)
+                fprintf(stderr, "INFO: %s\n", msg->get_message().c_str());
+            });
+
+    if (configfilename == "") {
+        configfilename = fmt::format("{}/{}",
+                getenv("KISMET_CONF") != NULL ? getenv("KISMET_CONF") : SYSCONF_LOC,
+                "kismet.conf");
+    }
+
+    auto conf = new config_file;
+
+    if (conf->parse_config(configfilename) < 0) {
+        fprintf(stderr, "ERROR: Could not load config file %s\n", configfilename.c_str());
+        exit(1);
+    }
+
+    globalreg->kismet_config = conf;
+
+    // Nothing but the capture file goes into the packet chain
+    conf->set_opt_vec("source", {}, 1);
+    conf->set_opt("remote_capture_enabled", "false", 1);
+    conf->set_opt("kis_log_datasources", "false", 1);
+
+    if (n_threads != 0)
+        conf->set_opt("kismet_packet_threads", n_threads, 1);
+
+    if (survey_check)
+        conf->set_opt("dot11_ap_only_survey", "true", 1);
+
+    kis_net_beast_httpd::create_httpd();
+    globalreg->manufdb = new kis_manuf();
+
+    entrytracker->register_serializer("json", std::make_shared<json_adapter::serializer>());
+
+    ipc_tracker_v2::create_ipctracker();
+    stream_tracker::create_streamtracker();
+    kis_httpd_registry::create_http_registry();
+
+    auto packetchain = packet_chain::create_packetchain();
+    dlt_tracker::create_dltt();
+    antenna_tracker::create_at();
+    datasource_tracker::create_dst();
+    alert_tracker::create_alertracker();
+
+    auto devicetracker = device_tracker::create_device_tracker();
+    channel_tracker_v2::create_channeltracker();
+
+    kis_dlt_ppi::create_dlt();
+    kis_dlt_radiotap::create_dlt();
+    kis_dlt_btle_radio::create_dlt();
+
+    kis_dissector_ip_data::create_dissector_ip_data();
+
+    devicetracker->register_phy_handler(dynamic_cast<kis_phy_handler *>(new kis_80211_phy()));
+    devicetracker->register_phy_handler(dynamic_cast<kis_phy_handler *>(new kis_sensor_phy()));
+    devicetracker->register_phy_handler(dynamic_cast<kis_phy_handler *>(new Kis_Zwave_Phy()));
+    devicetracker->register_phy_handler(dynamic_cast<kis_phy_handler *>(new kis_bluetooth_phy()));
+    devicetracker->register_phy_handler(dynamic_cast<kis_phy_handler *>(new kis_uav_phy()));
+    devicetracker->register_phy_handler(dynamic_cast<kis_phy_handler *>(new Kis_Mousejack_Phy()));
+    devicetracker->register_phy_handler(dynamic_cast<kis_phy_handler *>(new kis_btle_phy()));
+    devicetracker->register_phy_handler(dynamic_cast<kis_phy_handler *>(new kis_meter_phy()));
+    devicetracker->register_phy_handler(dynamic_cast<kis_phy_handler *>(new kis_adsb_phy()));
+    devicetracker->register_phy_handler(dynamic_cast<kis_phy_handler *>(new kis_802154_phy()));
+    devicetracker->register_phy_handler(dynamic_cast<kis_phy_handler *>(new kis_radiation_phy()));
+
+    datasource_virtual_builder::create_virtualbuilder();
+
+    gps_tracker::create_gpsmanager();
+
+    globalreg->start_deferred();
+
+    if (globalreg->fatal_condition) {
+        fprintf(stderr, "ERROR: Failed to start the Kismet core\n");
+        exit(1);
+    }
+
+    if (n_devices != 0) {
+        bench_devices(n_devices);
+        bench_shutdown();
+        return 0;
+    }
+
+    // The DLT handlers need a datasource to attribute packets to
+    auto datasourcetracker = Globalreg::fetch_mandatory_global_as<datasource_tracker>();
+    auto virtual_builder = Globalreg::fetch_mandatory_global_as<datasource_virtual_builder>();
+    auto virtual_source = virtual_builder->build_datasource(virtual_builder);
+    auto vs_cast = std::static_pointer_cast<kis_datasource_virtual>(virtual_source);
+
+    uuid src_uuid;
+    src_uuid.generate_random_time_uuid();
+
+    vs_cast->set_virtual_hardware("kismet_bench");
+    virtual_source->set_source_uuid(src_uuid);
+    virtual_source->set_source_key(adler32_checksum(src_uuid.uuid_to_string()));
+    virtual_source->set_source_name(capfilename);
+
+    datasourcetracker->merge_source(virtual_source);
+    vs_cast->open_virtual_interface();
+
+    auto pack_comp_linkframe = packetchain->register_packet_component("LINKFRAME");
+    auto pack_comp_datasrc = packetchain->register_packet_component("KISDATASRC");
+
+    packetchain->register_handler(&bench_chain_handler, nullptr, CHAINPOS_LOGGING, 0x7FFFFFFF,
+            "kismet_bench");
+    packetchain->set_handler_profiling(true);
+
+    timetracker->spawn_timetracker_thread();
+    packetchain->start_processing();
+
+    if (survey_check) {
+        auto r = bench_survey_check(virtual_source);
+        packetchain->remove_handler(&bench_chain_handler, CHAINPOS_LOGGING);
+        bench_shutdown();
+        return r;
+    }
+
+    const uint64_t n_total = records.size() * repeat;
+    uint64_t n_fed = 0;
+
+    const uint64_t start_list_locks = devicetracker->fetch_num_devicelist_locks();
+
+    auto start_tm = std::chrono::steady_clock::now();
+
+    for (unsigned int pass = 0; pass < repeat; pass++) {
+        for (const auto& rec : records) {
+            // Only feed what the packet threads can queue without dropping
+            while (packetchain->queue_headroom() == 0)
+                std::this_thread::yield();
+
+            auto packet = packetchain->generate_packet();
+
+            packet->ts = rec.ts;
+            packet->original_len = rec.original_len;
+
+            // The records outlive the run, so the packet can view them directly
+            packet->set_data(nonstd::string_view(rec.data));
+
+            auto datachunk = packetchain->new_packet_component<kis_datachunk>();
+            datachunk->dlt = dlt;
+            datachunk->set_data(packet->data);
+            packet->insert(pack_comp_linkframe, datachunk);
+
+            auto srcinfo = packetchain->new_packet_component<packetchain_comp_datasource>();
+            srcinfo->ref_source = virtual_source.get();
+            packet->insert(pack_comp_datasrc, srcinfo);
+
+            packetchain->process_packet(packet);
+            n_fed++;
+        }
+    }
+
+    auto feed_tm = std::chrono::steady_clock::now();
+
+    while (bench_completed.load(std::memory_order_relaxed) < n_fed)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+    auto end_tm = std::chrono::steady_clock::now();
+
+    double feed_s = std::chrono::duration<double>(feed_tm - start_tm).count();
+    double run_s = std::chrono::duration<double>(end_tm - start_tm).count();
+
+    fmt::print("\n");
+    fmt::print("Packets:        {} ({} pass{})\n", n_total, repeat, repeat == 1 ? "" : "es");
+    fmt::print("Feed time:      {:.3f} s\n", feed_s);
+    fmt::print("Total time:     {:.3f} s\n", run_s);
+    fmt::print("Throughput:     {:.0f} packets/s, {:.2f} MB/s\n",
+            n_total / run_s, (total_bytes * repeat) / run_s / (1024 * 1024));
+    const uint64_t n_copied = bench_copied.load(std::memory_order_relaxed);
+    fmt::print("Bytes copied:   {} in {} of {} packets\n", n_copied,
+            bench_copied_packets.load(std::memory_order_relaxed), n_total);
+    fmt::print("Report decode:  tree {:.0f} ns, pooled tree {:.0f} ns, direct {:.0f} ns per packet\n",
+            decode_tree_ns, decode_pool_ns, decode_direct_ns);
+    const uint64_t n_list_locks = devicetracker->fetch_num_devicelist_locks() - start_list_locks;
+    fmt::print("Devices:        {}\n", devicetracker->fetch_num_devices());
+    fmt::print("List locks:     {} ({:.3f} per packet, {} shards)\n", n_list_locks,
+            n_total ? (double) n_list_locks / n_total : 0.0,
+            devicetracker->fetch_num_device_shards());
+    fmt::print("Peak RSS:       {} KB\n", peak_rss_kb());
+
+    fmt::print("\n{:<12} {:<40} {:>12} {:>10} {:>10} {:>10} {:>10}\n",
+            "Stage", "Handler", "Calls", "Total ms", "Mean us", "p99 us", "Max us");
+
+    packetchain->visit_handler_chains([](const std::string& stage,
+                const std::vector<std::shared_ptr<packet_chain::pc_link>>& chain) {
+        uint64_t stage_ns = 0;
+
+        for (const auto& pcl : chain) {
+            const auto& prof = pcl->profile;
+            auto calls = prof.calls.load(std::memory_order_relaxed);
+            auto total_ns = prof.total_ns.load(std::memory_order_relaxed);
+
+            stage_ns += total_ns;
+
+            fmt::print("{:<12} {:<40} {:>12} {:>10.1f} {:>10.2f} {:>10.2f} {:>10.2f}\n",
+                    stage, pcl->name, calls, total_ns / 1000000.0f,
+                    calls == 0 ? 0 : total_ns / (double) calls / 1000,
+                    prof.percentile_ns(0.99) / 1000.0f,
+                    prof.max_ns.load(std::memory_order_relaxed) / 1000.0f);
+        }
+
+        fmt::print("{:<12} {:<40} {:>12} {:>10.1f}\n\n", stage, "(stage total)", "",
+                stage_ns / 1000000.0f);
+    });
+
+    packetchain->remove_handler(&bench_chain_handler, CHAINPOS_LOGGING);
+
+    bench_shutdown();
+
+    return 0;
+}
@@ -125,6 +125,41 @@ class tracker_component : public tracker_element_map {
         cvar->set((ptype) in); \
     }
 
+// Proxy a scalar which is stored as a plain value in the class instead of as a
+// tracked element; <ttype> is the tracked element type used to represent it, which
+// is only built, as a copy of the current value, when something asks for it by
+// field id <id> (such as serialization or a field path lookup)
+#define __ProxyInline(name, ttype, itype, rtype, cvar, id) \
+    inline shared_tracker_element get_tracker_##name() const { \
+        auto e = std::make_shared<ttype>(id); \
+        e->set(cvar); \
+        return e; \
+    } \
+    inline rtype get_##name() const { \
+        return (rtype) cvar; \
+    } \
+    inline void set_##name(const itype& in) { \
+        cvar = static_cast<decltype(cvar)>(in); \
+    }
+
+// Inline value proxy, with a lambda called after setting
+#define __ProxyInlineL(name, ttype, itype, rtype, cvar, id, lambda) \
+    inline shared_tracker_element get_tracker_##name() const { \
+        auto e = std::make_shared<ttype>(id); \
+        e->set(cvar); \
+        return e; \
+    } \
+    inline rtype get_##name() const { \
+        return (rtype) cvar; \
+    } \
+    inline bool set_##name(const itype& in) { \
+        cvar = static_cast<decltype(cvar)>(in); \
+        return lambda(in); \
+    } \
+    inline void set_only_##name(const itype& in) { \
+        cvar = static_cast<decltype(cvar)>(in); \
+    }
+
 // Newer dynamic proxy model which doesn't use an instance pointer, only the
 // mapped object
 #define __ProxyFullyDynamic(name, ptype, itype, rtype, ctype, id) \
@@ -427,6 +462,21 @@ class tracker_component : public tracker_element_map {
         (*cvar) -= (ptype) i; \
     }
 
+// Proxy increment and decrement functions for inline values
+#define __ProxyInlineIncDec(name, rtype, cvar) \
+    inline void inc_##name() { \
+        cvar += 1; \
+    } \
+    inline void inc_##name(rtype i) { \
+        cvar += static_cast<decltype(cvar)>(i); \
+    } \
+    inline void dec_##name() { \
+        cvar -= 1; \
+    } \
+    inline void dec_##name(rtype i) { \
+        cvar -= static_cast<decltype(cvar)>(i); \
+    }
+
 // Proxy update if less
 #define __ProxySetIfLess(name, ptype, rtype, cvar) \
     inline void set_if_lt_##name(rtype i) { \
@@ -435,6 +485,14 @@ class tracker_component : public tracker_element_map {
         } \
     }
 
+// Proxy update if less for inline values
+#define __ProxyInlineSetIfLess(name, rtype, cvar) \
+    inline void set_if_lt_##name(rtype i) { \
+        if (cvar < static_cast<decltype(cvar)>(i)) { \
+            cvar = static_cast<decltype(cvar)>(i); \
+        } \
+    }
+
 // Proxy increment and decrement functions, with mutex
 #define __ProxyIncDecM(name, ptype, rtype, cvar, mutex) \
     inline void inc_##name() { \
@@ -786,6 +844,18 @@ class tracker_component : public tracker_element_map {
         return (dtype) (get_tracker_value<dtype>(cvar) & bs); \
     }
 
+// Proxy bitset functions for inline values
+#define __ProxyInlineBitset(name, dtype, cvar) \
+    inline void bitset_##name(dtype bs) { \
+        cvar |= bs; \
+    } \
+    inline void bitclear_##name(dtype bs) { \
+        cvar &= ~(bs); \
+    } \
+    inline dtype bitcheck_##name(dtype bs) { \
+        return (dtype) (cvar & bs); \
+    }
+
 // Proxy bitset functions (name, trackable type, data type, class var), with mutex
 #define __ProxyBitsetM(name, dtype, cvar, mutex) \
     inline void bitset_##name(dtype bs) { \
@@ -932,6 +932,48 @@ shared_tracker_element get_tracker_element_path(const std::vector<int>& in_path,
     return next_elem;
 }
 
+bool get_tracker_element_path_inline(const std::vector<int>& in_path,
+        const shared_tracker_element& elem, tracker_element_inline_value& value) {
+
+    if (in_path.size() < 1 || elem == nullptr)
+        return false;
+
+    // Walk the parents of the last field; only the last field can be an inline value
+    shared_tracker_element next_elem;
+    tracker_element *parent = elem.get();
+
+    for (size_t p = 0; p < in_path.size(); p++) {
+        if (in_path[p] < 0)
+            return false;
+
+        if (parent->get_type() == tracker_type::tracker_alias) {
+            next_elem = static_cast<tracker_element_alias *>(parent)->get();
+
+            if (next_elem == nullptr)
+                return false;
+
+            parent = next_elem.get();
+        }
+
+        if (parent->get_type() != tracker_type::tracker_map)
+            return false;
+
+        auto parent_map = static_cast<tracker_element_map *>(parent);
+
+        if (p == in_path.size() - 1)
+            return parent_map->get_inline_sub(in_path[p], value);
+
+        next_elem = parent_map->get_sub(in_path[p]);
+
+        if (next_elem == nullptr)
+            return false;
+
+        parent = next_elem.get();
+    }
+
+    return false;
+}
+
 std::vector<shared_tracker_element> get_tracker_element_multi_path(const std::string& in_path, 
         shared_tracker_element elem) {
     return get_tracker_element_multi_path(str_tokenize(in_path, "/"), elem);
@@ -1386,13 +1428,11 @@ std::shared_ptr<tracker_element> summarize_tracker_element(std::shared_ptr<track
     }
 
     // Poke the pre-serialization function to update anything that needs updating before
-    // we create the new meta-object
-    in->pre_serialize();
+    // we create the new meta-object; the scope calls post-serialization however we leave
+    serializer_scope scope(in, nullptr);
 
-    if (in_summarization.size() == 0) {
-        in->post_serialize();
+    if (in_summarization.size() == 0)
         return in;
-    }
 
     unsigned int fn = 0;
 
@@ -1439,8 +1479,6 @@ std::shared_ptr<tracker_element> summarize_tracker_element(std::shared_ptr<track
         ret_elem->push_back(f);
     }
 
-    in->post_serialize();
-
     return ret_elem;
 }
 
@@ -1454,6 +1454,34 @@ protected:
     uint8_t present_set;
 };
 
+// Value of a scalar field which a component keeps as a plain member instead of as a
+// tracked element; filled in by tracker_element_map::get_inline_sub so that sorting and
+// filtering can look at the field without building an element for every lookup.  Compares
+// the same way fast_sort_tracker_element_less compares the equivalent elements.
+class tracker_element_inline_value {
+public:
+    tracker_type type = tracker_type::tracker_unassigned;
+
+    uint64_t uint_value = 0;
+    double double_value = 0;
+    mac_addr mac_value;
+    device_key key_value;
+
+    inline bool less_than(const tracker_element_inline_value& rhs) const {
+        switch (type) {
+            case tracker_type::tracker_uint32:
+            case tracker_type::tracker_uint64:
+                return uint_value < rhs.uint_value;
+            case tracker_type::tracker_double:
+                return double_value < rhs.double_value;
+            case tracker_type::tracker_mac_addr:
+                return mac_value < rhs.mac_value;
+            default:
+                return false;
+        }
+    }
+};
+
 // Dictionary / map-by-id
 class tracker_element_map : public tracker_element_core_map<ankerl::unordered_dense::map<uint16_t, std::shared_ptr<tracker_element>>, uint16_t, std::shared_ptr<tracker_element>, tracker_type::tracker_map> {
 public:
@@ -1470,7 +1498,7 @@ public:
         auto v = map.find(id);
 
         if (v == map.end())
-            return NULL;
+            return materialize_sub(id);
 
         return v->second;
     }
@@ -1480,7 +1508,7 @@ public:
         auto v = map.find(id);
 
         if (v == map.end())
-            return NULL;
+            return std::static_pointer_cast<T>(materialize_sub(id));
 
         return std::static_pointer_cast<T>(v->second);
     }
@@ -1541,6 +1569,19 @@ public:
     iterator erase(const_iterator i) {
         return map.erase(i);
     }
+
+    // Fetch the value of a field the component keeps inline, without building a tracked
+    // element for it; returns false if the field isn't one of the inline fields
+    virtual bool get_inline_sub(int id, tracker_element_inline_value& value) const {
+        return false;
+    }
+
+protected:
+    // Called when a sub-element is not in the map; components which keep some fields
+    // as plain values instead of tracked elements return a copy of the field here
+    virtual shared_tracker_element materialize_sub(int id) {
+        return nullptr;
+    }
 };
 
 // int::element
@@ -1977,6 +2018,11 @@ shared_tracker_element get_tracker_element_path(const std::vector<std::string>&
 shared_tracker_element get_tracker_element_path(const std::vector<int>& in_path, 
         shared_tracker_element elem);
 
+// Resolved field ID path ending in a field the component keeps inline; fills in the value
+// without allocating, or returns false if the path doesn't end in an inline field
+bool get_tracker_element_path_inline(const std::vector<int>& in_path,
+        const shared_tracker_element& elem, tracker_element_inline_value& value);
+
 // Get a list of elements from a complex path which may include vectors
 // or key maps.  Returns a vector of all elements within that map.
 // For example, for a field spec: